@@ -18,7 +18,6 @@
 // ============== Constants ==============
 
 #define MESH_GROUP_SIZE 32
-#define TASK_GROUP_SIZE 1
 
 // #define SMALL_GRID
 
@@ -38,7 +37,7 @@
 
 // ================== Payloads =====================
 
-struct TaskPayload {
+struct TaskElement {
     vec3 position;
     vec3 normal;
     float area;
@@ -47,12 +46,20 @@ struct TaskPayload {
     uvec2 MN;
     uvec2 deltaUV;
     uint elementType;
+    uint firstMeshTask; // the mesh tasks of the element start here in the grid emitted by the task workgroup
 #ifdef DISPLAY_DEBUG_DATA
     vec4 debug;
 #endif
 };
 
-#ifndef FRAGMENT_SHADER
+// the rendered elements of a task workgroup, packed in lane order
+struct TaskPayload {
+    TaskElement elements[TASK_GROUP_SIZE];
+    uint elementCount;
+    uint instanceId; // a task workgroup never spans two instances
+};
+
+#if !defined(FRAGMENT_SHADER) && !defined(COMPUTE_SHADER)
 taskPayloadSharedEXT TaskPayload taskPayload;
 #endif
 
@@ -74,6 +81,110 @@ vec2 getBaseUv(uint taskId) {
 
 #ifndef FRAGMENT_SHADER
 
+// Element type the pipeline was built for, the switches below fold to a single surface in the specialized variants
+layout(constant_id = SC_elementType) const uint specializedElementType = GENERIC_ELEMENT_TYPE;
+
+uint resolveElementType(uint elementType) { return specializedElementType == GENERIC_ELEMENT_TYPE ? elementType : specializedElementType; }
+
+// ============== Element culling (task shader and compaction pre-pass) ==============
+
+struct ElementAnchor {
+    vec3 position;
+    vec3 normal;
+    float area;
+    bool isVertex;
+    uint faceId;
+    uint vertId;
+};
+
+// skinned anchor of an element in object space: face f is element f, vertex v is element nbFaces + v. The bone
+// matrices of the pose start at paletteOffset.
+ElementAnchor getElementAnchor(uint elementId, uint paletteOffset) {
+    ElementAnchor anchor;
+    anchor.faceId = elementId;
+    anchor.vertId = 0;
+
+    // all faces have already been processed by pervious tasks,
+    // now we process the vertices (This is part of mapping function F)
+    anchor.isVertex = (elementId >= resurfacingUbo.nbFaces);
+    if (anchor.isVertex) {
+        anchor.vertId = elementId - resurfacingUbo.nbFaces;
+        anchor.faceId = getFaceId(anchor.vertId);
+    }
+
+    anchor.normal = anchor.isVertex ? getVertexNormal(anchor.vertId) : getFaceNormal(anchor.faceId);
+    anchor.position = anchor.isVertex ? getVertexPosition(anchor.vertId) : getFaceCenter(anchor.faceId);
+    anchor.area = getFaceArea(anchor.faceId);
+
+    if (resurfacingUbo.doSkinning) {
+        uint skinVertId = anchor.isVertex ? anchor.vertId : getVertIdFace(anchor.faceId);
+        vec4 jointsIndice = jointsIndices[skinVertId];
+        vec4 jointsWeight = jointsWeights[skinVertId];
+        mat4 skinMat =
+            jointsWeight.x * boneMatrices[paletteOffset + int(jointsIndice.x)] +
+            jointsWeight.y * boneMatrices[paletteOffset + int(jointsIndice.y)] +
+            jointsWeight.z * boneMatrices[paletteOffset + int(jointsIndice.z)] +
+            jointsWeight.w * boneMatrices[paletteOffset + int(jointsIndice.w)];
+
+        anchor.position = (skinMat * vec4(anchor.position, 1.)).xyz;
+        anchor.normal = (skinMat * vec4(anchor.normal, 1.)).xyz;
+    }
+    return anchor;
+}
+
+// visibility computed on the CPU against the depth of the base mesh, see OcclusionCulling.hpp
+bool isElementOccluded(uint elementId) {
+    return resurfacingUbo.occlusionCulling && (visibilityMask[constants.visibilityMaskBase + elementId / 32] & (1u << (elementId % 32))) == 0;
+}
+
+// occlusion, backface and frustum culling of an anchor placed by model, isElementCulled in Clusters.hpp is the CPU
+// version of the last two
+bool isElementCulled(ElementAnchor anchor, mat4 model) {
+    if (isElementOccluded(anchor.isVertex ? resurfacingUbo.nbFaces + anchor.vertId : anchor.faceId)) { return true; }
+    if (!resurfacingUbo.backfaceCulling) { return false; }
+    vec3 position = (model * vec4(anchor.position, 1.0)).xyz;
+    vec3 viewDir = -normalize(viewUbo.cameraPosition.xyz - position);
+    if (dot(viewDir, mat3(model) * anchor.normal) > resurfacingUbo.cullingThreshold) { return true; }
+    return !isVisible(anchor.position, viewUbo.projection * viewUbo.view * model, 1.1);
+}
+
+// returns the element type according to the texture
+uint getTextureElementType(uint elementId) {
+    vec2 baseUV = getBaseUv(elementId);
+    baseUV.y = 1.0 - baseUV.y;
+    vec3 textureColor = textureLod(sampler2D(textures[elementTextureID], samplers[nearestSamplerID]), baseUV, 0.0).xyz;
+
+    // hard coded element mapping
+
+    uint ball = 1;
+    uint chain = 0;
+    uint spike = 6;
+    uint empty = -1;
+
+    // pure blue
+    if (textureColor.r <= 0.1 && textureColor.g <= 0.1 && textureColor.b >= 0.9) {
+        return spike;
+    }
+
+    // pure violet
+    if (textureColor.r >= 0.9 && textureColor.g <= 0.1 && textureColor.b >= 0.9) {
+        return ball;
+    }
+
+    // pure green
+    if (textureColor.r <= 0.1 && textureColor.g >= 0.9 && textureColor.b <= 0.1) {
+        return empty;
+    }
+
+    return resurfacingUbo.elementType;
+}
+
+// ELEMENT_TYPE_COUNT or more when the element is not rendered
+uint getElementType(uint elementId) {
+    if (specializedElementType == GENERIC_ELEMENT_TYPE && resurfacingUbo.hasElementTypeTexture) { return getTextureElementType(elementId); }
+    return resolveElementType(resurfacingUbo.elementType);
+}
+
 void parametricPosition(vec2 uv, out vec3 position, out vec3 normal, uint elementType) {
     vec3 pos = vec3(-10.0);
     vec3 nrm = vec3(0.0);
@@ -82,7 +193,7 @@ void parametricPosition(vec2 uv, out vec3 position, out vec3 normal, uint elemen
     float a = resurfacingUbo.majorRadius;
     float b = resurfacingUbo.minorRadius;
 
-    switch (elementType) {
+    switch (resolveElementType(elementType)) {
     case 0:
         parametricTorus(uv, pos, nrm, a, b);
         break;
@@ -127,7 +238,7 @@ void parametricBoundingBox(in out LodInfos lodInfos, uint elementType) {
     float b = resurfacingUbo.minorRadius * sqrt(lodInfos.area) * resurfacingUbo.scaling;
 
     // Use the switch-case structure to calculate the size of the selected parametric primitive
-    switch (elementType) {
+    switch (resolveElementType(elementType)) {
     case 0:
         parametricTorusScreenSpaceSize(lodInfos, a, b);
         break;
@@ -33,10 +33,12 @@ CONSTEXPR int U_viewBinding = 0;
 CONSTEXPR int U_globalShadingBinding = 1;
 
 // set 1 - Half-Edge Data
+#define HE_PACKED_BUFFER 1 // 1: all the half-edge arrays in one buffer behind an offset header, 0: one buffer per array
 CONSTEXPR int B_heVec4TypeBinding = 0;
 CONSTEXPR int B_heVec2TypeBinding = 1;
 CONSTEXPR int B_heIntTypeBinding = 2;
 CONSTEXPR int B_heFloatTypeBinding = 3;
+CONSTEXPR int B_hePackedBinding = 4;
 
 // set 2 - Other Data
 CONSTEXPR int U_configBinding = 0;
@@ -47,6 +49,9 @@ CONSTEXPR int B_skinJointsWeightsBinding = 4;
 CONSTEXPR int B_skinBoneMatricesBinding = 5;
 CONSTEXPR int S_samplersBinding = 6;
 CONSTEXPR int T_texturesBinding = 7;
+CONSTEXPR int B_visibleElementsBinding = 8; // compaction pre-pass output, read by the parametric task shader
+CONSTEXPR int B_visibilityMaskBinding = 9;  // CPU occlusion culling, one bit per element
+CONSTEXPR int B_instancesBinding = 10;      // InstanceData of instanced draws
 
 
 // ============== Textures info ================
@@ -58,6 +63,18 @@ CONSTEXPR int AOTextureID = 0;
 CONSTEXPR int elementTextureID = 1;
 CONSTEXPR int textureCount = 2;
 
+// ============== Parametric task shader ================
+#define TASK_GROUP_SIZE 32 // elements per task workgroup, 1: one workgroup per element
+
+// ============== Compaction pre-pass ================
+CONSTEXPR int compactionGroupSize = 64;
+CONSTEXPR int visibleElementsHeaderSize = 5; // uints before the element IDs of a frame slice: draw count, VkDrawMeshTasksIndirectCommandEXT, element count
+
+// ============== Specialization constants ================
+CONSTEXPR int SC_elementType = 0;
+#define ELEMENT_TYPE_COUNT 11u
+#define GENERIC_ELEMENT_TYPE ELEMENT_TYPE_COUNT // variant reading the element type from the UBO or the element type texture
+
 
 // ============== Half-Edge Data ================
 
@@ -90,47 +107,78 @@ CONSTEXPR int intDataCount = 10;
 CONSTEXPR int heFaceAreas = 0;
 CONSTEXPR int floatDataCount = 1;
 
+// packed buffer: the arrays of each type follow each other in the order above, the header starts with the word offset
+// of every array, each array is aligned on 16 bytes (see HalfEdgePacking.hpp)
+CONSTEXPR int hePackedVec4Base = 0;
+CONSTEXPR int hePackedVec2Base = hePackedVec4Base + vec4DataCount;
+CONSTEXPR int hePackedIntBase = hePackedVec2Base + vec2DataCount;
+CONSTEXPR int hePackedFloatBase = hePackedIntBase + intDataCount;
+CONSTEXPR int hePackedDataCount = hePackedFloatBase + floatDataCount;
+
 #ifndef __cplusplus
 #define lid gl_LocalInvocationID.x       // local thread ID
 #define gid gl_GlobalInvocationID.x      // global thread ID
 #define groupId gl_WorkGroupID.x         // workgroup ID
+#define flatGroupId (constants.firstWorkGroup + gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x) // workgroup ID in a draw split by planTaskGrid (TaskGrid.hpp)
+#define flatInstanceId (constants.instanceCount == 0 ? 0 : flatGroupId / constants.instanceWorkGroups) // instance of the workgroup, 0 when the draw is not instanced
+#define instanceGroupId (constants.instanceCount == 0 ? flatGroupId : flatGroupId % constants.instanceWorkGroups) // workgroup ID inside the instance
 #define workgroupSize gl_WorkGroupSize.x // workgroup size
 
 #define MAX_VERTS_HE 12
+#if HE_PACKED_BUFFER
+// All the arrays in one buffer, the same memory seen with the element type of each array
+layout(std430, set = HESet, binding = B_hePackedBinding) readonly buffer hePackedHeader { uint heArrayOffsets[hePackedDataCount]; };
+layout(std430, set = HESet, binding = B_hePackedBinding) readonly buffer hePackedVec4Buffer { vec4 hePackedVec4[]; };
+layout(std430, set = HESet, binding = B_hePackedBinding) readonly buffer hePackedVec2Buffer { vec2 hePackedVec2[]; };
+layout(std430, set = HESet, binding = B_hePackedBinding) readonly buffer hePackedIntBuffer { int hePackedInt[]; };
+layout(std430, set = HESet, binding = B_hePackedBinding) readonly buffer hePackedFloatBuffer { float hePackedFloat[]; };
+
+// offsets are in 4 byte words
+#define heVec4(ARRAY, ID) hePackedVec4[heArrayOffsets[hePackedVec4Base + ARRAY] / 4 + (ID)]
+#define heVec2(ARRAY, ID) hePackedVec2[heArrayOffsets[hePackedVec2Base + ARRAY] / 2 + (ID)]
+#define heInt(ARRAY, ID) hePackedInt[heArrayOffsets[hePackedIntBase + ARRAY] + (ID)]
+#define heFloat(ARRAY, ID) hePackedFloat[heArrayOffsets[hePackedFloatBase + ARRAY] + (ID)]
+#else
 // Vertex attributes in separate buffers (Structure of Arrays)
 layout(std430, set = HESet, binding = B_heVec4TypeBinding) readonly buffer heVertexPositionBuffer { vec4 data[]; }heVec4Buffer[vec4DataCount];
 layout(std430, set = HESet, binding = B_heVec2TypeBinding) readonly buffer heVertexColorBuffer { vec2 data[]; }heVec2Buffer[vec2DataCount];
 layout(std430, set = HESet, binding = B_heIntTypeBinding) readonly buffer heVertexNormalBuffer { int data[]; }heIntBuffer[intDataCount];
 layout(std430, set = HESet, binding = B_heFloatTypeBinding) readonly buffer heVertexTexCoordBuffer { float data[]; }heFloatBuffer[floatDataCount];
 
+#define heVec4(ARRAY, ID) heVec4Buffer[ARRAY].data[ID]
+#define heVec2(ARRAY, ID) heVec2Buffer[ARRAY].data[ID]
+#define heInt(ARRAY, ID) heIntBuffer[ARRAY].data[ID]
+#define heFloat(ARRAY, ID) heFloatBuffer[ARRAY].data[ID]
+#endif
+
 // ============== Getters =================
 
-vec3 getVertexPosition(uint vertId) { return heVec4Buffer[heVertexPositions].data[vertId].xyz; }
-vec3 getVertexColor(uint vertId) { return heVec4Buffer[heVertexColors].data[vertId].xyz; }
-vec3 getVertexNormal(uint vertId) { return heVec4Buffer[heVertexNormals].data[vertId].xyz; }
-vec2 getVertexTexCoord(uint vertId) { return heVec2Buffer[heVertexTexCoords].data[vertId]; }
-uint getVertexEdge(uint vertId) { return heIntBuffer[heVertexEdges].data[vertId]; }
-
-uint getFaceEdge(uint faceId) { return heIntBuffer[heFaceEdges].data[faceId]; }
-uint getFaceVertCount(uint faceId) { return heIntBuffer[heFaceVertCounts].data[faceId]; }
-uint getFaceOffset(uint faceId) { return heIntBuffer[heFaceOffsets].data[faceId]; }
-vec3 getFaceNormal(uint faceId) { return heVec4Buffer[heFaceNormals].data[faceId].xyz; }
-vec3 getFaceCenter(uint faceId) { return heVec4Buffer[heFaceCenters].data[faceId].xyz; }
-float getFaceArea(uint faceId) { return heFloatBuffer[heFaceAreas].data[faceId]; }
-
-uint getHalfEdgeVertex(uint edgeId) { return heIntBuffer[heHalfEdgeVertex].data[edgeId]; }
-uint getHalfEdgeFace(uint edgeId) { return heIntBuffer[heHalfEdgeFace].data[edgeId]; }
-uint getHalfEdgeNext(uint edgeId) { return heIntBuffer[heHalfEdgeNext].data[edgeId]; }
-uint getHalfEdgePrev(uint edgeId) { return heIntBuffer[heHalfEdgePrev].data[edgeId]; }
-uint getHalfEdgeTwin(uint edgeId) { return heIntBuffer[heHalfEdgeTwin].data[edgeId]; }
-
-uint getVertexFaceIndex(uint vertId) { return heIntBuffer[heVertexFaceIndex].data[vertId]; }
+vec3 getVertexPosition(uint vertId) { return heVec4(heVertexPositions, vertId).xyz; }
+vec3 getVertexColor(uint vertId) { return heVec4(heVertexColors, vertId).xyz; }
+vec3 getVertexNormal(uint vertId) { return heVec4(heVertexNormals, vertId).xyz; }
+vec2 getVertexTexCoord(uint vertId) { return heVec2(heVertexTexCoords, vertId); }
+uint getVertexEdge(uint vertId) { return heInt(heVertexEdges, vertId); }
+
+uint getFaceEdge(uint faceId) { return heInt(heFaceEdges, faceId); }
+uint getFaceVertCount(uint faceId) { return heInt(heFaceVertCounts, faceId); }
+uint getFaceOffset(uint faceId) { return heInt(heFaceOffsets, faceId); }
+vec3 getFaceNormal(uint faceId) { return heVec4(heFaceNormals, faceId).xyz; }
+vec3 getFaceCenter(uint faceId) { return heVec4(heFaceCenters, faceId).xyz; }
+float getFaceArea(uint faceId) { return heFloat(heFaceAreas, faceId); }
+
+uint getHalfEdgeVertex(uint edgeId) { return heInt(heHalfEdgeVertex, edgeId); }
+uint getHalfEdgeFace(uint edgeId) { return heInt(heHalfEdgeFace, edgeId); }
+uint getHalfEdgeNext(uint edgeId) { return heInt(heHalfEdgeNext, edgeId); }
+uint getHalfEdgePrev(uint edgeId) { return heInt(heHalfEdgePrev, edgeId); }
+uint getHalfEdgeTwin(uint edgeId) { return heInt(heHalfEdgeTwin, edgeId); }
+
+uint getVertexFaceIndex(uint vertId) { return heInt(heVertexFaceIndex, vertId); }
 uint getVertIdFace(uint faceId) { return getHalfEdgeVertex(getFaceEdge(faceId)); }
 
 uint getFaceId(uint vertId) { return getHalfEdgeFace(getVertexEdge(vertId)); }
 
-uint getFaceValencef(uint faceId) { return heIntBuffer[heFaceVertCounts].data[faceId]; }
-uint getFaceValencev(uint vertId) { return heIntBuffer[heFaceVertCounts].data[getFaceId(vertId)]; }
+uint getFaceValencef(uint faceId) { return heInt(heFaceVertCounts, faceId); }
+uint getFaceValencev(uint vertId) { return heInt(heFaceVertCounts, getFaceId(vertId)); }
 
 uint getVertValence(uint vertId) {
     uint edgeId = getVertexEdge(vertId);
@@ -173,6 +221,19 @@ layout(std430, set = PerObjectSet, binding = B_skinBoneMatricesBinding) readonly
 layout(set = PerObjectSet, binding = S_samplersBinding) uniform sampler samplers[samplerCount];
 layout(set = PerObjectSet, binding = T_texturesBinding) uniform texture2D textures[textureCount];
 
+// written by compaction.comp, one slice per frame in flight starting at word constants.visibleElementsBase. The header
+// of a slice doubles as the count and command of drawMeshTasksIndirectCountEXT, the element IDs follow.
+layout(std430, set = PerObjectSet, binding = B_visibleElementsBinding) buffer visibleElementsBuffer { uint visibleElementsData[]; };
+#define visibleDrawCount visibleElementsData[constants.visibleElementsBase]         // 0 when no element survived
+#define visibleTaskCountX visibleElementsData[constants.visibleElementsBase + 1]
+#define visibleTaskCountY visibleElementsData[constants.visibleElementsBase + 2]
+#define visibleTaskCountZ visibleElementsData[constants.visibleElementsBase + 3]
+#define visibleElementCount visibleElementsData[constants.visibleElementsBase + 4] // the X by Y task grid covers it with workgroups of TASK_GROUP_SIZE elements
+#define visibleElement(ID) visibleElementsData[constants.visibleElementsBase + visibleElementsHeaderSize + (ID)]
+
+// written by the CPU each frame, bit elementId % 32 of word elementId / 32 is set when the element may be visible
+layout(std430, set = PerObjectSet, binding = B_visibilityMaskBinding) readonly buffer visibilityMaskBuffer { uint visibilityMask[]; };
+
 #endif
 
 // ============== UBOs ================
@@ -207,8 +268,34 @@ using glm::uint;
 
 PushConstantStruct PushConstants {
     mat4 model;
+    uint firstWorkGroup;      // flat ID of the first workgroup of the draw, see flatGroupId
+    uint instanceCount;       // 0: a single object placed by model, else the workgroups of the instances follow each other
+    uint instanceWorkGroups;  // workgroups of each instance
+    uint boneMatrixBase;      // first matrix of the frame slice of boneMatrices
+    uint visibilityMaskBase;  // first word of the frame slice of visibilityMask
+    uint visibleElementsBase; // first word of the frame slice of visibleElementsData
 }UBOName(constants);
 
+// One copy of a shared mesh in an instanced draw, see SceneInstance
+struct InstanceData {
+    mat4 model;
+    uint paletteOffset; // first bone matrix of the pose of the instance in boneMatrices
+    float scaling;      // multiplies the element scaling of the mesh
+    uint pad0;
+    uint pad1;
+};
+
+#ifdef __cplusplus
+static_assert(sizeof(InstanceData) == 80, "std430 array stride of instances, --bench scene counts on it");
+#else
+layout(std430, set = PerObjectSet, binding = B_instancesBinding) readonly buffer instancesBuffer { InstanceData instances[]; };
+
+mat4 getModelMatrix(uint instanceId) { return constants.instanceCount == 0 ? constants.model : instances[instanceId].model; }
+// index of the first bone matrix of the pose of the instance, in the frame slice of boneMatrices
+uint getPaletteOffset(uint instanceId) { return constants.boneMatrixBase + (constants.instanceCount == 0 ? 0 : instances[instanceId].paletteOffset); }
+float getInstanceScaling(uint instanceId) { return constants.instanceCount == 0 ? 1.0 : instances[instanceId].scaling; }
+#endif
+
 UBOStruct(scalar, SceneSet, U_viewBinding) ViewUBO {
     mat4 view;
     mat4 projection;
@@ -328,8 +415,12 @@ UBOStruct(scalar, PerObjectSet, U_configBinding) ResurfacingUBO {
     vec3 minLutExtent UBODefaultVal(vec3(0));
     vec3 maxLutExtent UBODefaultVal(vec3(0));
     BOOL doSkinning UBODefaultVal(false);
+    BOOL gpuCompaction UBODefaultVal(false); // the task shader reads the element IDs kept by the compaction pre-pass
+    BOOL occlusionCulling UBODefaultVal(false); // elements hidden behind the CPU depth buffer are not rendered
+    uint taskGridWidth UBODefaultVal(65535);    // X count of the compaction indirect command, Y grows past it
 #ifdef __cplusplus
-    void displayUI(std::string meshName = "") {
+    // the mesh tells which culling paths it can use, see MeshData::supportsCompaction
+    void displayUI(std::string meshName = "", bool canCompact = true, bool canCullOcclusion = true) {
         if (ImGui::CollapsingHeader(("Resurfacing UBO " + meshName).c_str())) {
             ImGui::PushItemWidth(200.0f);
 
@@ -352,6 +443,14 @@ UBOStruct(scalar, PerObjectSet, U_configBinding) ResurfacingUBO {
                 ImGui::SameLine();
                 ImGui::SliderFloat("Threshold", &cullingThreshold, 0, 1, "%.2f");
             }
+            ImGui::BeginDisabled(!canCompact);
+            ImGui::Checkbox("GPU compaction", &gpuCompaction);
+            ImGui::EndDisabled();
+            if (!canCompact && ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) { ImGui::SetTooltip("Not for instanced meshes or task grids over the device limits"); }
+            ImGui::BeginDisabled(!canCullOcclusion);
+            ImGui::Checkbox("Occlusion culling", &occlusionCulling);
+            ImGui::EndDisabled();
+            if (!canCullOcclusion && ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)) { ImGui::SetTooltip("Not for instanced meshes"); }
 
             ImGui::Checkbox("Do LOD", &doLod);
             if (doLod) {
@@ -486,8 +585,8 @@ static vk::DescriptorSetLayout getDescriptorSetLayoutInfo(const int p_set, const
     switch (p_set) {
     case SceneSet: {
         bindings = {
-            {U_viewBinding, vk::DescriptorType::eUniformBuffer, 1, trueAllGraphics},
-            {U_globalShadingBinding, vk::DescriptorType::eUniformBuffer, 1, trueAllGraphics},
+            {U_viewBinding, vk::DescriptorType::eUniformBuffer, 1, trueAllStages},
+            {U_globalShadingBinding, vk::DescriptorType::eUniformBuffer, 1, trueAllStages},
         };
         bindingFlags = {
             {vk::DescriptorBindingFlagBits::eUpdateAfterBind},
@@ -497,11 +596,19 @@ static vk::DescriptorSetLayout getDescriptorSetLayoutInfo(const int p_set, const
     }
 
     case HESet: {
+#if HE_PACKED_BUFFER
+        bindings = {
+            {B_hePackedBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllStages},
+        };
+        bindingFlags = {
+            {vk::DescriptorBindingFlagBits::eUpdateAfterBind},
+        };
+#else
         bindings = {
-            {B_heVec4TypeBinding, vk::DescriptorType::eStorageBuffer, vec4DataCount, trueAllGraphics},
-            {B_heVec2TypeBinding, vk::DescriptorType::eStorageBuffer, vec2DataCount, trueAllGraphics},
-            {B_heIntTypeBinding, vk::DescriptorType::eStorageBuffer, intDataCount, trueAllGraphics},
-            {B_heFloatTypeBinding, vk::DescriptorType::eStorageBuffer, floatDataCount, trueAllGraphics},
+            {B_heVec4TypeBinding, vk::DescriptorType::eStorageBuffer, vec4DataCount, trueAllStages},
+            {B_heVec2TypeBinding, vk::DescriptorType::eStorageBuffer, vec2DataCount, trueAllStages},
+            {B_heIntTypeBinding, vk::DescriptorType::eStorageBuffer, intDataCount, trueAllStages},
+            {B_heFloatTypeBinding, vk::DescriptorType::eStorageBuffer, floatDataCount, trueAllStages},
         };
         bindingFlags = {
             {vk::DescriptorBindingFlagBits::eUpdateAfterBind},
@@ -509,18 +616,22 @@ static vk::DescriptorSetLayout getDescriptorSetLayoutInfo(const int p_set, const
             {vk::DescriptorBindingFlagBits::eUpdateAfterBind},
             {vk::DescriptorBindingFlagBits::eUpdateAfterBind},
         };
+#endif
         break;
     }
     case PerObjectSet: {
         bindings = {
-            {U_configBinding, vk::DescriptorType::eUniformBuffer, 1, trueAllGraphics},
-            {U_shadingBinding, vk::DescriptorType::eUniformBuffer, 1, trueAllGraphics},
-            {B_lutVertexBufferBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllGraphics},
-            {B_skinJointsIndicesBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllGraphics},
-            {B_skinJointsWeightsBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllGraphics},
-            {B_skinBoneMatricesBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllGraphics},
-            {S_samplersBinding, vk::DescriptorType::eSampler, samplerCount, trueAllGraphics},
-            {T_texturesBinding, vk::DescriptorType::eSampledImage, textureCount, trueAllGraphics},
+            {U_configBinding, vk::DescriptorType::eUniformBuffer, 1, trueAllStages},
+            {U_shadingBinding, vk::DescriptorType::eUniformBuffer, 1, trueAllStages},
+            {B_lutVertexBufferBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllStages},
+            {B_skinJointsIndicesBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllStages},
+            {B_skinJointsWeightsBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllStages},
+            {B_skinBoneMatricesBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllStages}, // one slice per frame in flight, see boneMatrixBase
+            {S_samplersBinding, vk::DescriptorType::eSampler, samplerCount, trueAllStages},
+            {T_texturesBinding, vk::DescriptorType::eSampledImage, textureCount, trueAllStages},
+            {B_visibleElementsBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllStages},
+            {B_visibilityMaskBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllStages}, // one slice per frame in flight, see visibilityMaskBase
+            {B_instancesBinding, vk::DescriptorType::eStorageBuffer, 1, trueAllStages},
         };
         bindingFlags = {
             {vk::DescriptorBindingFlagBits::eUpdateAfterBind},
@@ -531,6 +642,9 @@ static vk::DescriptorSetLayout getDescriptorSetLayoutInfo(const int p_set, const
             {vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound},
             {vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound},
             {vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound},
+            {vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound},
+            {vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound},
+            {vk::DescriptorBindingFlagBits::eUpdateAfterBind | vk::DescriptorBindingFlagBits::ePartiallyBound},
         };
         break;
     }
@@ -0,0 +1,130 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include "Skeleton.hpp"
+#include "defines.hpp"
+
+enum class AnimationPath : uint8 {
+    TRANSLATION = 0,
+    ROTATION = 1,
+    SCALE = 2,
+};
+
+enum class Interpolation : uint8 {
+    LINEAR = 0,
+    STEP = 1,
+    CUBICSPLINE = 2,
+};
+
+// Sampler baked at load time: key times and values in flat arrays, values laid out like the glTF output accessor
+// (xyz or quaternion xyzw, CUBICSPLINE keys hold in-tangent, value, out-tangent).
+struct AnimationChannel {
+    int boneIndex;
+    uint32 slot; // evaluation slot of the bone in the skeleton
+    AnimationPath path;
+    Interpolation interpolation;
+    uint32 components; // 3 for translation and scale, 4 for rotation
+    std::vector<float> times;
+    std::vector<float> values;
+
+    uint32 keyCount() const { return uint32(times.size()); }
+    // p_element picks the in-tangent (0), value (1) or out-tangent (2) of CUBICSPLINE keys
+    const float *value(uint32 p_key, uint32 p_element = 1) const {
+        const bool cubic = interpolation == Interpolation::CUBICSPLINE;
+        return &values[(size_t(p_key) * (cubic ? 3 : 1) + (cubic ? p_element : 0)) * components];
+    }
+
+    // Last key with times[key] <= p_time (0 before the first key). Steps forward from p_cursor, the key found by the
+    // previous search, while time increases and falls back to a binary search when it jumps backward or far ahead.
+    uint32 findKey(float p_time, uint32 &p_cursor) const {
+        const uint32 last = keyCount() - 1;
+        constexpr uint32 maxSteps = 4;
+        uint32 key = p_cursor;
+        if (key > last || times[key] > p_time) {
+            key = uint32(std::upper_bound(times.begin() + 1, times.end(), p_time) - times.begin()) - 1;
+        } else {
+            uint32 steps = 0;
+            while (key < last && times[key + 1] <= p_time && steps < maxSteps) {
+                ++key;
+                ++steps;
+            }
+            if (key < last && times[key + 1] <= p_time) { key = uint32(std::upper_bound(times.begin() + key + 1, times.end(), p_time) - times.begin()) - 1; }
+        }
+        p_cursor = key;
+        return key;
+    }
+};
+
+struct Animation {
+    std::string name;
+    float duration;
+    std::vector<AnimationChannel> channels;
+};
+
+// Playback state of an animation, kept by whoever samples it so the animation itself stays shared and read only: the
+// key found by the last sample of each channel, where the next search starts.
+struct AnimationCursors {
+    std::vector<uint32> keys;
+};
+
+inline vec3 hermite(vec3 p_v0, vec3 p_out0, vec3 p_in1, vec3 p_v1, float p_t, float p_duration) {
+    const float t2 = p_t * p_t, t3 = t2 * p_t;
+    return (2.0f * t3 - 3.0f * t2 + 1.0f) * p_v0 + (t3 - 2.0f * t2 + p_t) * p_duration * p_out0 + (-2.0f * t3 + 3.0f * t2) * p_v1 + (t3 - t2) * p_duration * p_in1;
+}
+
+inline void sampleChannel(const AnimationChannel &channel, uint32 &cursor, float time, float duration, Skeleton &skeleton) {
+    // Handle time outside the animation duration
+    if (time < channel.times.front()) { time = channel.times.front(); } else if (time > channel.times.back()) { time = std::fmod(time, duration); }
+
+    const uint32 k0 = channel.findKey(time, cursor);
+    const uint32 k1 = std::min(k0 + 1, channel.keyCount() - 1);
+    const float t0 = channel.times[k0], t1 = channel.times[k1];
+    const float t = t0 != t1 ? (time - t0) / (t1 - t0) : 0.0f;
+    const uint32 slot = channel.slot;
+
+    switch (channel.interpolation) {
+    case Interpolation::LINEAR:
+        switch (channel.path) {
+        case AnimationPath::TRANSLATION: skeleton.translations[slot] = glm::mix(glm::make_vec3(channel.value(k0)), glm::make_vec3(channel.value(k1)), t); break;
+        case AnimationPath::ROTATION: skeleton.rotations[slot] = glm::slerp(glm::make_quat(channel.value(k0)), glm::make_quat(channel.value(k1)), t); break;
+        case AnimationPath::SCALE: skeleton.scales[slot] = glm::mix(glm::make_vec3(channel.value(k0)), glm::make_vec3(channel.value(k1)), t); break;
+        }
+        break;
+    case Interpolation::STEP:
+        switch (channel.path) {
+        case AnimationPath::TRANSLATION: skeleton.translations[slot] = glm::make_vec3(channel.value(k0)); break;
+        case AnimationPath::ROTATION: skeleton.rotations[slot] = glm::make_quat(channel.value(k0)); break;
+        case AnimationPath::SCALE: skeleton.scales[slot] = glm::make_vec3(channel.value(k0)); break;
+        }
+        break;
+    case Interpolation::CUBICSPLINE: {
+        // glTF cubic Hermite spline: value and out-tangent of k0, in-tangent and value of k1
+        const float keyDuration = t1 - t0;
+        if (channel.path == AnimationPath::ROTATION) {
+            const glm::quat v0 = glm::make_quat(channel.value(k0, 1)), b0 = glm::make_quat(channel.value(k0, 2));
+            const glm::quat a1 = glm::make_quat(channel.value(k1, 0)), v1 = glm::make_quat(channel.value(k1, 1));
+            const float t2 = t * t, t3 = t2 * t;
+            const glm::quat q = v0 * (2.0f * t3 - 3.0f * t2 + 1.0f) + b0 * ((t3 - 2.0f * t2 + t) * keyDuration) + v1 * (-2.0f * t3 + 3.0f * t2) + a1 * ((t3 - t2) * keyDuration);
+            skeleton.rotations[slot] = glm::normalize(q);
+        } else {
+            const vec3 v = hermite(glm::make_vec3(channel.value(k0, 1)), glm::make_vec3(channel.value(k0, 2)), glm::make_vec3(channel.value(k1, 0)), glm::make_vec3(channel.value(k1, 1)), t, keyDuration);
+            (channel.path == AnimationPath::TRANSLATION ? skeleton.translations[slot] : skeleton.scales[slot]) = v;
+        }
+        break;
+    }
+    }
+}
+
+// Samples every channel of the animation into the skeleton pose, the cursors make it O(1) per channel while time
+// increases. Each sequence of times sampled, one per pose played, needs its own cursors.
+inline void updateSkeleton(const Animation &animation, AnimationCursors &cursors, float time, Skeleton &skeleton) {
+    if (cursors.keys.size() != animation.channels.size()) { cursors.keys.assign(animation.channels.size(), 0); }
+    for (size_t i = 0; i < animation.channels.size(); ++i) { sampleChannel(animation.channels[i], cursors.keys[i], time, animation.duration, skeleton); }
+}
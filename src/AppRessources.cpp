@@ -1,39 +1,87 @@
 #include "AppRessources.hpp"
+#include "HalfEdgeReorder.hpp"
+#include "loaders/HeMeshCache.hpp"
 #include <stb_image.h>
 
 void MeshData::init(Renderer &renderer, const std::string &modelPath, const std::string &meshName, const std::string &gltfPath) {
+    load(modelPath, meshName, gltfPath);
+    upload(renderer);
+}
+
+void MeshData::load(const std::string &modelPath, const std::string &meshName, const std::string &gltfPath) {
     isSkeletal = !gltfPath.empty();
     name = meshName;
 
-    vk::CommandBuffer cmdBuffer = beginSingleTimeCommands(renderer.m_logicalDevice, renderer.m_transientCommandPool);
-
-    // Load NGon mesh data
-    NgonLoader loader;
-    NGonDataWBones data = loader.loadNgonData(modelPath);
+    // the skeleton and the animations are always read from the glTF, the skin comes from its buffers
+    tinygltf::Model model;
+    if (isSkeletal) { model = GLTFLoader::loadGltfModel(gltfPath); }
 
+    // Reuse the half-edge mesh and skin from the binary cache when the sources did not change
+    const std::string cachePath = HeMeshCache::cachePath(modelPath);
+    std::vector<std::string> sourceFiles = {modelPath, gltfPath};
     if (isSkeletal) {
-        data.jointIndices.resize(data.vertices.size());
-        data.jointWeights.resize(data.vertices.size());
-        GLTFLoader gltfLoader;
-        tinygltf::Model model = gltfLoader.loadGltfModel(gltfPath);
+        const std::vector<std::string> bufferFiles = GLTFLoader::externalBufferFiles(model, gltfPath);
+        sourceFiles.insert(sourceFiles.end(), bufferFiles.begin(), bufferFiles.end());
+    }
+    const uint64 sourceHash = HeMeshCache::hashFiles(sourceFiles);
+    HeMeshCache cache;
+    const bool cached = cache.open(cachePath, sourceHash);
+    if (cached) { cache.read(heMesh, jointIndicesData, jointWeightsData); }
+
+    NGonDataWBones data;
+    if (!cached) {
+        // Load NGon mesh data
+        NgonLoader loader;
+        data = loader.loadNgonData(modelPath);
+    }
 
+    if (isSkeletal) {
         extractSkeleton(model, skeleton);
         extractAnimations(model, skeleton, animations);
-        updateNgonMeshWithBoneData(model, data);
+        if (!cached) {
+            data.jointIndices.resize(data.vertices.size());
+            data.jointWeights.resize(data.vertices.size());
+            updateNgonMeshWithBoneData(model, data);
+            jointIndicesData = data.jointIndices;
+            jointWeightsData = data.jointWeights;
+        }
+    }
+
+    if (!cached) {
+        heMesh = convertToHalfEdgeMeshParallel(data, ThreadPool::global());
+
+        // Faces along a Morton curve and vertices by first use, neighbouring task workgroups then touch neighbouring data
+        const MeshReordering order = computeLocalityOrder(heMesh);
+        heMesh = applyReordering(heMesh, order);
+        jointIndicesData = permute(jointIndicesData, order.vertexOrder);
+        jointWeightsData = permute(jointWeightsData, order.vertexOrder);
 
-        std::vector<mat4> boneMatrices;
+        HeMeshCache::save(cachePath, sourceHash, heMesh, jointIndicesData, jointWeightsData);
+    }
+
+    if (isSkeletal) {
         computeBoneMatrices(skeleton, boneMatrices);
         boneMatCount = static_cast<uint32>(boneMatrices.size());
-        jointsIndices = renderer.createAndUploadBuffer(cmdBuffer, data.jointIndices, vk::BufferUsageFlagBits::eStorageBuffer);
-        jointsWeights = renderer.createAndUploadBuffer(cmdBuffer, data.jointWeights, vk::BufferUsageFlagBits::eStorageBuffer);
-        boneMats = renderer.createAndUploadBuffer(cmdBuffer, boneMatrices, vk::BufferUsageFlagBits::eStorageBuffer);
-        jointIndicesData = data.jointIndices;
-        jointWeightsData = data.jointWeights;
     }
 
-    heMesh = convertToHalfEdgeMesh(data);
+    clusters = buildClusters(heMesh);
+    occluderTriangles = triangulateFaces(heMesh);
+}
+
+void MeshData::upload(Renderer &renderer) {
+    taskGridLimits = renderer.getTaskGridLimits();
+    meshGridLimits = renderer.getMeshGridLimits();
+    computeGridLimits = renderer.getComputeGridLimits();
+
+    vk::CommandBuffer cmdBuffer = renderer.beginUploadCommands();
+    if (isSkeletal) {
+        jointsIndices = renderer.createAndUploadBuffer(cmdBuffer, jointIndicesData, vk::BufferUsageFlagBits::eStorageBuffer);
+        jointsWeights = renderer.createAndUploadBuffer(cmdBuffer, jointWeightsData, vk::BufferUsageFlagBits::eStorageBuffer);
+        boneMats = renderer.createRingBuffer(sizeof(mat4) * boneMatCount, vk::BufferUsageFlagBits::eStorageBuffer);
+        for (uint32 i = 0; i < boneMats.sliceCount; ++i) { memcpy(boneMats.slice(i), boneMatrices.data(), sizeof(mat4) * boneMatCount); }
+    }
     heMeshDescSoa.uploadBuffersToGPU(heMesh, renderer, cmdBuffer);
-    endSingleTimeCommands(cmdBuffer, renderer.m_logicalDevice, renderer.m_transientCommandPool, renderer.m_graphicsQueue);
+    renderer.endUploadCommands(cmdBuffer);
 
     // Setup and update descriptor sets
     heDescriptorSetLayout = shaderInterface::getDescriptorSetLayoutInfo(shaderInterface::HESet, renderer.m_logicalDevice);
@@ -53,6 +101,9 @@ void MeshData::allocateDescriptorSets(Renderer &renderer) {
 }
 
 void MeshData::primeDescriptorSets(Renderer &renderer) {
+#if HE_PACKED_BUFFER
+    const vk::DescriptorBufferInfo hePackedBufferInfo(heMeshDescSoa.hePackedBuffer.buffer, 0, VK_WHOLE_SIZE);
+#else
     // Prepare buffer infos for the heDescriptorSet
     const std::array<vk::DescriptorBufferInfo, shaderInterface::vec4DataCount> heDescriptorBufferInfosVec4 = {
         vk::DescriptorBufferInfo(heMeshDescSoa.heVertexPositionBuffer.buffer, 0, VK_WHOLE_SIZE),
@@ -82,6 +133,7 @@ void MeshData::primeDescriptorSets(Renderer &renderer) {
     const std::array<vk::DescriptorBufferInfo, shaderInterface::floatDataCount> heDescriptorBufferInfosFloat = {
         vk::DescriptorBufferInfo(heMeshDescSoa.heFaceAreaBuffer.buffer, 0, VK_WHOLE_SIZE)
     };
+#endif
 
     std::vector<vk::DescriptorBufferInfo> skinBufferInfos = {
         vk::DescriptorBufferInfo(jointsIndices.buffer, 0, VK_WHOLE_SIZE),
@@ -90,6 +142,9 @@ void MeshData::primeDescriptorSets(Renderer &renderer) {
     };
 
     std::vector<vk::WriteDescriptorSet> descriptorWrites = {
+#if HE_PACKED_BUFFER
+        {heDescriptorSet, shaderInterface::B_hePackedBinding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &hePackedBufferInfo, nullptr},
+#else
         {heDescriptorSet, shaderInterface::B_heVec4TypeBinding, 0, shaderInterface::vec4DataCount,
          vk::DescriptorType::eStorageBuffer, nullptr, heDescriptorBufferInfosVec4.data(), nullptr},
         {heDescriptorSet, shaderInterface::B_heVec2TypeBinding, 0, shaderInterface::vec2DataCount,
@@ -98,6 +153,7 @@ void MeshData::primeDescriptorSets(Renderer &renderer) {
          vk::DescriptorType::eStorageBuffer, nullptr, heDescriptorBufferInfosInt.data(), nullptr},
         {heDescriptorSet, shaderInterface::B_heFloatTypeBinding, 0, shaderInterface::floatDataCount,
          vk::DescriptorType::eStorageBuffer, nullptr, heDescriptorBufferInfosFloat.data(), nullptr},
+#endif
     };
 
     if (isSkeletal) {
@@ -109,13 +165,176 @@ void MeshData::primeDescriptorSets(Renderer &renderer) {
     renderer.m_logicalDevice.updateDescriptorSets(descriptorWrites, nullptr);
 }
 
-LutData MeshData::loadLut(const std::string &path, Renderer &renderer, vk::CommandBuffer cmd) {
+void MeshData::createCullingBuffers(Renderer &renderer) {
+    // one slice per frame in flight, a frame compacts while the previous ones still draw from their list
+    visibleElementsSliceWords = shaderInterface::visibleElementsHeaderSize + heMesh.nbFaces + heMesh.nbVertices;
+    const vk::DeviceSize size = sizeof(uint32) * vk::DeviceSize(visibleElementsSliceWords) * renderer.getFrameSlotCount();
+    visibleElements = renderer.createDeviceBuffer(size, vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst);
+
+    // every element visible until the first culling
+    const uint32 maskSize = sizeof(uint32) * ((heMesh.nbFaces + heMesh.nbVertices + 31) / 32);
+    visibilityMask = renderer.createRingBuffer(maskSize, vk::BufferUsageFlagBits::eStorageBuffer);
+    for (uint32 i = 0; i < visibilityMask.sliceCount; ++i) { memset(visibilityMask.slice(i), 0xFF, maskSize); }
+
+    const vk::DescriptorBufferInfo bufferInfo(visibleElements.buffer, 0, VK_WHOLE_SIZE);
+    const vk::DescriptorBufferInfo maskInfo(visibilityMask.buffer, 0, VK_WHOLE_SIZE);
+    const std::vector<vk::WriteDescriptorSet> writes = {
+        {perObjectDescriptorSet, shaderInterface::B_visibleElementsBinding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfo, nullptr},
+        {perObjectDescriptorSet, shaderInterface::B_visibilityMaskBinding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &maskInfo, nullptr},
+    };
+    renderer.m_logicalDevice.updateDescriptorSets(writes, nullptr);
+}
+
+void MeshData::dispatchCompaction(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, uint32 frameSlot) {
+    using Stage = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+    // the frame that last used this slice was waited for before the slot was reused, no barrier against its draws
+    visibleElementsBase = frameSlot * visibleElementsSliceWords;
+    const std::array<uint32, shaderInterface::visibleElementsHeaderSize> header = {0, 0, 1, 1, 0}; // no draw, 0 x 1 x 1 task workgroups, no element
+    cmd.updateBuffer(visibleElements.buffer, sizeof(uint32) * vk::DeviceSize(visibleElementsBase), sizeof(header), header.data());
+    cmdBufferBarrier(cmd, visibleElements, Stage::eTransfer, Access::eTransferWrite, Stage::eComputeShader, Access::eShaderStorageRead | Access::eShaderStorageWrite);
+
+    std::array<vk::DescriptorSet, 2> sets = {heDescriptorSet, perObjectDescriptorSet};
+    cmd.pushConstants(layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(mat4), &modelMatrix);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, layout, shaderInterface::HESet, sets, nullptr);
+    pushFrameSlices(cmd, layout, vk::ShaderStageFlagBits::eCompute);
+    const uint32 groupCount = (heMesh.nbFaces + heMesh.nbVertices + shaderInterface::compactionGroupSize - 1) / shaderInterface::compactionGroupSize;
+    for (const TaskGridDraw &grid : planTaskGrid(groupCount, computeGridLimits)) {
+        cmd.pushConstants(layout, vk::ShaderStageFlagBits::eCompute, offsetof(shaderInterface::PushConstants, firstWorkGroup), sizeof(uint32), &grid.firstWorkGroup);
+        cmd.dispatch(grid.x, grid.y, 1);
+    }
+
+    cmdBufferBarrier(cmd, visibleElements, Stage::eComputeShader, Access::eShaderStorageWrite, Stage::eDrawIndirect | Stage::eTaskShaderEXT, Access::eIndirectCommandRead | Access::eShaderStorageRead);
+}
+
+void MeshData::drawVisibleElements(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout) {
+    const uint32 firstWorkGroup = 0;
+    cmd.pushConstants(layout, trueAllGraphics, offsetof(shaderInterface::PushConstants, firstWorkGroup), sizeof(uint32), &firstWorkGroup);
+    const vk::DeviceSize countOffset = sizeof(uint32) * vk::DeviceSize(visibleElementsBase);
+    const vk::DeviceSize commandOffset = countOffset + sizeof(uint32); // after the draw count
+    cmd.drawMeshTasksIndirectCountEXT(visibleElements.buffer, commandOffset, visibleElements.buffer, countOffset, 1, sizeof(vk::DrawMeshTasksIndirectCommandEXT));
+}
+
+void MeshData::updateSkinnedBounds(float elementRadiusScale) {
+    if (isSkeletal) { computeSkinMatrices(jointIndicesData, jointWeightsData, boneMatrices, skinMatrices, ThreadPool::global()); }
+    skinVertexPositions(heMesh, skinMatrices, skinnedPositions, ThreadPool::global());
+    computeElementSpheres(heMesh, skinMatrices, elementRadiusScale, elementSpheres, ThreadPool::global());
+}
+
+void MeshData::rasterizeOccluder(OcclusionBuffer &buffer, const mat4 &viewProjection) const {
+    buffer.rasterize(skinnedPositions, occluderTriangles, viewProjection * modelMatrix, ThreadPool::global());
+}
+
+void MeshData::cullOccludedElements(OcclusionBuffer &buffer, const mat4 &viewProjection) {
+    buffer.testSpheres(elementSpheres, viewProjection * modelMatrix, elementVisibility, ThreadPool::global());
+    occludedElements = buffer.getStats().occludedBounds;
+}
+
+void MeshData::uploadVisibilityMask(Renderer &renderer) {
+    if (!visibilityMask.buffer) { return; }
+    const uint32 slice = renderer.getFrameSlot();
+    if (!elementVisibility.empty()) { memcpy(visibilityMask.slice(slice), elementVisibility.data(), sizeof(uint32) * elementVisibility.size()); }
+    visibilityMaskBase = visibilityMask.sliceOffset(slice) / uint32(sizeof(uint32));
+}
+
+void MeshData::drawTaskGrid(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, uint32 workGroupCount, const TaskGridLimits &limits) {
+    for (const TaskGridDraw &draw : planTaskGrid(workGroupCount, limits)) {
+        cmd.pushConstants(layout, trueAllGraphics, offsetof(shaderInterface::PushConstants, firstWorkGroup), sizeof(uint32), &draw.firstWorkGroup);
+        cmd.drawMeshTasksEXT(draw.x, draw.y, 1);
+    }
+}
+
+void MeshData::setInstances(Renderer &renderer, const std::vector<SceneInstance> &sceneInstances) {
+    instances = sceneInstances;
+    if (instances.empty()) { return; }
+    ASSERT(uint64(std::max(parametricTaskGroups(), heMesh.nbFaces)) * instances.size() <= ~0u, "Too many instances for the flat workgroup IDs");
+
+    const InstancePalettes palettes = groupAnimationOffsets(instances);
+    paletteOffsets = palettes.offsets;
+    paletteCursors.assign(paletteOffsets.size(), {});
+    std::vector<shaderInterface::InstanceData> instanceData(instances.size());
+    for (size_t i = 0; i < instances.size(); ++i) {
+        instanceData[i].model = modelMatrix * instances[i].transform;
+        instanceData[i].paletteOffset = palettes.instancePalette[i] * boneMatCount;
+        instanceData[i].scaling = instances[i].elementScaling;
+    }
+    vk::CommandBuffer cmdBuffer = renderer.beginUploadCommands();
+    instanceBuffer = renderer.createAndUploadBuffer(cmdBuffer, instanceData, vk::BufferUsageFlagBits::eStorageBuffer);
+    renderer.endUploadCommands(cmdBuffer);
+
+    if (isSkeletal) {
+        // every pose of a frame in the same ring slice, one boneMatrixBase for all the instances
+        boneMatrices.resize(size_t(boneMatCount) * paletteOffsets.size());
+        for (size_t palette = 1; palette < paletteOffsets.size(); ++palette) { std::copy_n(boneMatrices.begin(), boneMatCount, boneMatrices.begin() + palette * boneMatCount); }
+        renderer.destroyBuffer(boneMats);
+        boneMats = renderer.createRingBuffer(sizeof(mat4) * uint32(boneMatrices.size()), vk::BufferUsageFlagBits::eStorageBuffer);
+        for (uint32 i = 0; i < boneMats.sliceCount; ++i) { memcpy(boneMats.slice(i), boneMatrices.data(), sizeof(mat4) * boneMatrices.size()); }
+    }
+    writeInstancingDescriptors(renderer, perObjectDescriptorSet);
+}
+
+void MeshData::applyCullingSupport(shaderInterface::ResurfacingUBO &ubo) const {
+    if (!supportsCompaction()) { ubo.gpuCompaction = false; }
+    if (!supportsOcclusionCulling()) { ubo.occlusionCulling = false; }
+}
+
+void MeshData::writeInstancingDescriptors(Renderer &renderer, vk::DescriptorSet set) const {
+    const vk::DescriptorBufferInfo instanceInfo(instanceBuffer.buffer, 0, VK_WHOLE_SIZE);
+    const vk::DescriptorBufferInfo boneInfo(boneMats.buffer, 0, VK_WHOLE_SIZE);
+    std::vector<vk::WriteDescriptorSet> writes = {{set, shaderInterface::B_instancesBinding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &instanceInfo, nullptr}};
+    if (isSkeletal) { writes.emplace_back(set, shaderInterface::B_skinBoneMatricesBinding, 0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &boneInfo, nullptr); }
+    renderer.m_logicalDevice.updateDescriptorSets(writes, nullptr);
+}
+
+void MeshData::pushFrameSlices(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, vk::ShaderStageFlags stages) const {
+    const std::array<uint32, 3> bases = {boneMatrixBase, visibilityMaskBase, visibleElementsBase};
+    cmd.pushConstants(layout, stages, offsetof(shaderInterface::PushConstants, boneMatrixBase), sizeof(bases), bases.data());
+}
+
+void MeshData::pushInstancing(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, uint32 workGroupsPerInstance) const {
+    const std::array<uint32, 2> instancing = {uint32(instances.size()), workGroupsPerInstance}; // instanceCount, instanceWorkGroups
+    cmd.pushConstants(layout, trueAllGraphics, offsetof(shaderInterface::PushConstants, instanceCount), sizeof(instancing), instancing.data());
+}
+
+ClusterCullingStats MeshData::cullClustersCPU(const mat4 &viewProjection, vec3 cameraPosition, float cullingThreshold) const {
+    const vec3 localCamera = vec3(glm::inverse(modelMatrix) * vec4(cameraPosition, 1.0f));
+    return cullClusters(heMesh, clusters, viewProjection * modelMatrix, localCamera, cullingThreshold);
+}
+
+void MeshData::animateSkeleton(float currentTime) {
+    if (animations.empty()) { return; }
+    auto start = std::chrono::high_resolution_clock::now();
+    if (paletteOffsets.size() == 1) {
+        updateSkeleton(animations[0], paletteCursors[0], currentTime + paletteOffsets[0], skeleton);
+        computeBoneMatrices(skeleton, boneMatrices);
+    } else {
+        // one pose per distinct animation offset of the instances, one after the other
+        std::vector<mat4> pose;
+        for (size_t palette = 0; palette < paletteOffsets.size(); ++palette) {
+            updateSkeleton(animations[0], paletteCursors[palette], currentTime + paletteOffsets[palette], skeleton);
+            computeBoneMatrices(skeleton, pose);
+            std::copy(pose.begin(), pose.end(), boneMatrices.begin() + palette * boneMatCount);
+        }
+    }
+    poseCpuMs = static_cast<float>(millisecondsD(std::chrono::high_resolution_clock::now() - start).count());
+}
+
+void MeshData::uploadBoneMatrices(Renderer &renderer) {
+    if (!isSkeletal) { return; }
+    auto start = std::chrono::high_resolution_clock::now();
+    const uint32 slice = renderer.getFrameSlot();
+    memcpy(boneMats.slice(slice), boneMatrices.data(), sizeof(mat4) * boneMatrices.size());
+    boneMatrixBase = boneMats.sliceOffset(slice) / uint32(sizeof(mat4)); // the slices are whole palettes padded to a power of two alignment
+    const float frameMs = poseCpuMs + static_cast<float>(millisecondsD(std::chrono::high_resolution_clock::now() - start).count());
+    skinningCpuMs = skinningCpuMs * 0.95f + frameMs * 0.05f;
+    poseCpuMs = 0.0f;
+}
+
+void MeshData::uploadLut(Renderer &renderer, vk::CommandBuffer cmd) {
     if (lutVertexBuffer.buffer) {
-        renderer.m_logicalDevice.destroyBuffer(lutVertexBuffer.buffer);
-        renderer.m_logicalDevice.freeMemory(lutVertexBuffer.memory);
+        renderer.destroyBuffer(lutVertexBuffer);
     }
 
-    LutData lutData = LutLoader::loadLutData(path);
     lutVertexBuffer = renderer.createAndUploadBuffer(cmd, lutData.positions, vk::BufferUsageFlagBits::eStorageBuffer);
     hasLut = true;
 
@@ -123,26 +342,53 @@ LutData MeshData::loadLut(const std::string &path, Renderer &renderer, vk::Comma
     vk::WriteDescriptorSet descriptorWrite(perObjectDescriptorSet, shaderInterface::B_lutVertexBufferBinding,
                                            0, 1, vk::DescriptorType::eStorageBuffer, nullptr, &bufferInfo, nullptr);
     renderer.m_logicalDevice.updateDescriptorSets(descriptorWrite, nullptr);
-    return lutData;
 }
 
-SampledTexture MeshData::loadAndUploadTexture(const std::string &path, Renderer &renderer, vk::CommandBuffer cmd, bool &flag) {
+ImageData MeshData::decodeImage(const std::string &path) {
     int texWidth, texHeight, texChannels;
     stbi_uc *pixels = stbi_load(path.c_str(), &texWidth, &texHeight, &texChannels, STBI_rgb_alpha);
     if (!pixels) {
         std::cerr << "Failed to load texture: " << path << std::endl;
-        flag = false;
-        return SampledTexture{};
+        return ImageData{};
     }
-    std::vector<stbi_uc> pixelsVec(pixels, pixels + (texWidth * texHeight * sizeof(uint32)));
-    SampledTexture texture = renderer.createAndUploadTexture(cmd, pixelsVec, uvec2(texWidth, texHeight), vk::Format::eR8G8B8A8Srgb);
-    flag = true;
+    ImageData image;
+    image.pixels.assign(pixels, pixels + (texWidth * texHeight * sizeof(uint32)));
+    image.size = uvec2(texWidth, texHeight);
     stbi_image_free(pixels);
+    return image;
+}
+
+SampledTexture MeshData::uploadTexture(ImageData &image, Renderer &renderer, vk::CommandBuffer cmd, bool &flag) {
+    flag = !image.pixels.empty();
+    if (!flag) { return SampledTexture{}; }
+    SampledTexture texture = renderer.createAndUploadTexture(cmd, image.pixels, image.size, vk::Format::eR8G8B8A8Srgb);
+    image = ImageData{}; // the GPU copy is all that is needed from now on
     return texture;
 }
 
+float elementBoundingScale(const shaderInterface::ResurfacingUBO &ubo) {
+    auto typeRadius = [&ubo](int type) {
+        if (type >= 9) { return glm::length(glm::max(glm::abs(ubo.minLutExtent), glm::abs(ubo.maxLutExtent))); }
+        return parametricSurfaceRadius(uint32(type), ubo.majorRadius, ubo.minorRadius);
+    };
+    // the element type texture can pick any type
+    float radius = typeRadius(ubo.elementType);
+    if (ubo.hasElementTypeTexture) {
+        for (int type = 0; type < int(ELEMENT_TYPE_COUNT); type++) { radius = std::max(radius, typeRadius(type)); }
+    }
+    return radius * ubo.scaling;
+}
+
 void Dragon::init(Renderer &renderer, const std::string &modelPath, const std::string &meshName, const std::string &gltfPath, const std::string &lutPath, const std::string &aoPath, const std::string &elementTypePath) {
-    MeshData::init(renderer, modelPath, meshName, gltfPath);
+    load(modelPath, meshName, gltfPath, lutPath, aoPath, elementTypePath);
+    upload(renderer);
+}
+
+void Dragon::load(const std::string &modelPath, const std::string &meshName, const std::string &gltfPath, const std::string &lutPath, const std::string &aoPath, const std::string &elementTypePath) {
+    MeshData::load(modelPath, meshName, gltfPath);
+    lutData = LutLoader::loadLutData(lutPath);
+    aoImage = decodeImage(aoPath);
+    elementTypeImage = decodeImage(elementTypePath);
 
     renderMode = MeshData::RenderMode::PARAMETRIC;
     renderBaseMesh = true;
@@ -157,8 +403,14 @@ void Dragon::init(Renderer &renderer, const std::string &modelPath, const std::s
     resurfacingUBOData.elementType = 9;
     resurfacingUBOData.backfaceCulling = true;
     resurfacingUBOData.cullingThreshold = 0.1f;
+    resurfacingUBOData.gpuCompaction = true;
     shadingUBOData.doShading = true;
     shadingUBOData.diffuse = vec3(0.8, 0.0, 0.0);
+}
+
+void Dragon::upload(Renderer &renderer) {
+    MeshData::upload(renderer);
+    applyCullingSupport(resurfacingUBOData);
 
     // Allocate extra descriptor set for the base mesh
     std::array<vk::DescriptorSetLayout, 1> layouts = {perObjectDescriptorSetLayout};
@@ -167,19 +419,19 @@ void Dragon::init(Renderer &renderer, const std::string &modelPath, const std::s
     VK_CHECK(renderer.m_logicalDevice.allocateDescriptorSets(&allocInfo, descriptorSets.data()));
     perObjectDescriptorSetBaseMesh = descriptorSets[0];
 
-    vk::CommandBuffer cmdBuffer = beginSingleTimeCommands(renderer.m_logicalDevice, renderer.m_transientCommandPool);
-    LutData ltData = loadLut(lutPath, renderer, cmdBuffer);
-    loadAOTexture(aoPath, renderer, cmdBuffer);
+    vk::CommandBuffer cmdBuffer = renderer.beginUploadCommands();
+    uploadLut(renderer, cmdBuffer);
+    aoTexture = uploadTexture(aoImage, renderer, cmdBuffer, hasAOTexture);
     aoTexture.sampler = renderer.m_linearSampler;
-    loadElementTypeTexture(elementTypePath, renderer, cmdBuffer);
+    elementTypeTexture = uploadTexture(elementTypeImage, renderer, cmdBuffer, hasElementTypeTexture);
     elementTypeTexture.sampler = renderer.m_nearestSampler;
-    endSingleTimeCommands(cmdBuffer, renderer.m_logicalDevice, renderer.m_transientCommandPool, renderer.m_graphicsQueue);
+    renderer.endUploadCommands(cmdBuffer);
 
     shadingUBO = renderer.createUniformBuffer(sizeof(shaderInterface::ShadingUBO));
     shadingUBOBaseMesh = renderer.createUniformBuffer(sizeof(shaderInterface::ShadingUBO));
     heUBO = renderer.createUniformBuffer(sizeof(shaderInterface::HeUBO));
     resurfacingUBO = renderer.createUniformBuffer(sizeof(shaderInterface::ResurfacingUBO));
-    boneMatStagingBuffer = renderer.createStagingBuffer(sizeof(mat4) * boneMatCount);
+    createCullingBuffers(renderer);
 
     // Update descriptor sets for uniform buffers (base mesh)
     std::vector<vk::DescriptorBufferInfo> skinBufferInfos = {
@@ -215,10 +467,11 @@ void Dragon::init(Renderer &renderer, const std::string &modelPath, const std::s
     heUBOData.nbFaces = heMesh.nbFaces;
     resurfacingUBOData.nbFaces = heMesh.nbFaces;
     resurfacingUBOData.nbVertices = heMesh.nbVertices;
-    resurfacingUBOData.Nx = ltData.Nx;
-    resurfacingUBOData.Ny = ltData.Ny;
-    resurfacingUBOData.minLutExtent = ltData.min;
-    resurfacingUBOData.maxLutExtent = ltData.max;
+    resurfacingUBOData.taskGridWidth = taskGridWidth(parametricTaskGroups(), taskGridLimits);
+    resurfacingUBOData.Nx = lutData.Nx;
+    resurfacingUBOData.Ny = lutData.Ny;
+    resurfacingUBOData.minLutExtent = lutData.min;
+    resurfacingUBOData.maxLutExtent = lutData.max;
     resurfacingUBOData.hasElementTypeTexture = false;
     resurfacingUBOData.doSkinning = isSkeletal;
     heUBOData.doSkinning = isSkeletal;
@@ -231,15 +484,29 @@ void Dragon::init(Renderer &renderer, const std::string &modelPath, const std::s
 void Dragon::bindAndDispatch(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout) {
     std::array<vk::DescriptorSet, 2> sets = {heDescriptorSet, perObjectDescriptorSet};
     cmd.pushConstants(layout, trueAllGraphics, 0, sizeof(mat4), &modelMatrix);
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, shaderInterface::HESet, sets, {});
-    cmd.drawMeshTasksEXT(heMesh.nbFaces + heMesh.nbVertices, 1, 1);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, shaderInterface::HESet, sets, nullptr);
+    pushFrameSlices(cmd, layout, trueAllGraphics);
+    pushInstancing(cmd, layout, parametricTaskGroups());
+    if (resurfacingUBOData.gpuCompaction) {
+        drawVisibleElements(cmd, layout);
+    } else {
+        drawTaskGrid(cmd, layout, parametricTaskGroups() * instanceCount(), taskGridLimits);
+    }
 }
 
 void Dragon::bindAndDispatchBaseMesh(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout) {
     std::array<vk::DescriptorSet, 2> sets = {heDescriptorSet, perObjectDescriptorSetBaseMesh};
     cmd.pushConstants(layout, trueAllGraphics, 0, sizeof(mat4), &modelMatrix);
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, shaderInterface::HESet, sets, {});
-    cmd.drawMeshTasksEXT(heMesh.nbFaces, 1, 1);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, shaderInterface::HESet, sets, nullptr);
+    pushFrameSlices(cmd, layout, trueAllGraphics);
+    pushInstancing(cmd, layout, heMesh.nbFaces);
+    drawTaskGrid(cmd, layout, heMesh.nbFaces * instanceCount(), meshGridLimits);
+}
+
+void Dragon::setInstances(Renderer &renderer, const std::vector<SceneInstance> &sceneInstances) {
+    MeshData::setInstances(renderer, sceneInstances);
+    if (!instances.empty()) { writeInstancingDescriptors(renderer, perObjectDescriptorSetBaseMesh); }
+    applyCullingSupport(resurfacingUBOData);
 }
 
 void Dragon::updateUBOs() {
@@ -253,23 +520,20 @@ void Dragon::updateUBOs() {
 
 void Dragon::displayUI() {
     heUBOData.displayUI(name);
-    resurfacingUBOData.displayUI(name);
+    resurfacingUBOData.displayUI(name, supportsCompaction(), supportsOcclusionCulling());
     shadingUBOData.displayUI(name);
 }
 
-void Dragon::animate(float currentTime, Renderer &renderer) {
-    if (!animations.empty()) {
-        updateSkeleton(animations[0], currentTime, skeleton);
-        std::vector<mat4> boneMatrices;
-        computeBoneMatrices(skeleton, boneMatrices);
-        vk::CommandBuffer cmd = beginSingleTimeCommands(renderer.m_logicalDevice, renderer.m_transientCommandPool);
-        renderer.uploadToBuffer(boneMatStagingBuffer, boneMats, cmd, boneMatrices);
-        endSingleTimeCommands(cmd, renderer.m_logicalDevice, renderer.m_transientCommandPool, renderer.m_graphicsQueue);
-    }
-}
+void Dragon::animate(float currentTime, Renderer &renderer) { animateSkeleton(currentTime); }
 
 void Coat::init(Renderer &renderer, const std::string &modelPath, const std::string &meshName, const std::string &gltfPath, const std::string &aoPath) {
-    MeshData::init(renderer, modelPath, meshName, gltfPath);
+    load(modelPath, meshName, gltfPath, aoPath);
+    upload(renderer);
+}
+
+void Coat::load(const std::string &modelPath, const std::string &meshName, const std::string &gltfPath, const std::string &aoPath) {
+    MeshData::load(modelPath, meshName, gltfPath);
+    aoImage = decodeImage(aoPath);
 
     renderMode = MeshData::RenderMode::PARAMETRIC;
     renderBaseMesh = false;
@@ -284,21 +548,27 @@ void Coat::init(Renderer &renderer, const std::string &modelPath, const std::str
     resurfacingUBOData.elementType = 0;
     resurfacingUBOData.backfaceCulling = true;
     resurfacingUBOData.cullingThreshold = 0.1f;
+    resurfacingUBOData.gpuCompaction = true;
 
     shadingUBOData.doShading = true;
     shadingUBOData.diffuse = vec3(0.5);
     shadingUBOData.shininess = 32;
     shadingUBOData.specularStrength = 8;
     shadingUBOData.doAo = true;
+}
 
-    vk::CommandBuffer cmdBuffer = beginSingleTimeCommands(renderer.m_logicalDevice, renderer.m_transientCommandPool);
-    loadAOTexture(aoPath, renderer, cmdBuffer);
+void Coat::upload(Renderer &renderer) {
+    MeshData::upload(renderer);
+    applyCullingSupport(resurfacingUBOData);
+
+    vk::CommandBuffer cmdBuffer = renderer.beginUploadCommands();
+    aoTexture = uploadTexture(aoImage, renderer, cmdBuffer, hasAOTexture);
     aoTexture.sampler = renderer.m_linearSampler;
-    endSingleTimeCommands(cmdBuffer, renderer.m_logicalDevice, renderer.m_transientCommandPool, renderer.m_graphicsQueue);
+    renderer.endUploadCommands(cmdBuffer);
 
     shadingUBO = renderer.createUniformBuffer(sizeof(shaderInterface::ShadingUBO));
     resurfacingUBO = renderer.createUniformBuffer(sizeof(shaderInterface::ResurfacingUBO));
-    boneMatStagingBuffer = renderer.createStagingBuffer(sizeof(mat4) * boneMatCount);
+    createCullingBuffers(renderer);
 
     // Update descriptor sets for uniform buffers (base mesh)
     std::vector<vk::DescriptorBufferInfo> skinBufferInfos = {
@@ -320,6 +590,7 @@ void Coat::init(Renderer &renderer, const std::string &modelPath, const std::str
 
     resurfacingUBOData.nbFaces = heMesh.nbFaces;
     resurfacingUBOData.nbVertices = heMesh.nbVertices;
+    resurfacingUBOData.taskGridWidth = taskGridWidth(parametricTaskGroups(), taskGridLimits);
     resurfacingUBOData.hasElementTypeTexture = false;
     resurfacingUBOData.doSkinning = isSkeletal;
     shadingUBOData.doAo = hasAOTexture;
@@ -330,8 +601,19 @@ void Coat::init(Renderer &renderer, const std::string &modelPath, const std::str
 void Coat::bindAndDispatch(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout) {
     std::array<vk::DescriptorSet, 2> sets = {heDescriptorSet, perObjectDescriptorSet};
     cmd.pushConstants(layout, trueAllGraphics, 0, sizeof(mat4), &modelMatrix);
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, shaderInterface::HESet, sets, {});
-    cmd.drawMeshTasksEXT(heMesh.nbFaces + heMesh.nbVertices, 1, 1);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, shaderInterface::HESet, sets, nullptr);
+    pushFrameSlices(cmd, layout, trueAllGraphics);
+    pushInstancing(cmd, layout, parametricTaskGroups());
+    if (resurfacingUBOData.gpuCompaction) {
+        drawVisibleElements(cmd, layout);
+    } else {
+        drawTaskGrid(cmd, layout, parametricTaskGroups() * instanceCount(), taskGridLimits);
+    }
+}
+
+void Coat::setInstances(Renderer &renderer, const std::vector<SceneInstance> &sceneInstances) {
+    MeshData::setInstances(renderer, sceneInstances);
+    applyCullingSupport(resurfacingUBOData);
 }
 
 void Coat::updateUBOs() {
@@ -340,23 +622,19 @@ void Coat::updateUBOs() {
 }
 
 void Coat::displayUI() {
-    resurfacingUBOData.displayUI(name);
+    resurfacingUBOData.displayUI(name, supportsCompaction(), supportsOcclusionCulling());
     shadingUBOData.displayUI(name);
 }
 
-void Coat::animate(float currentTime, Renderer &renderer) {
-    if (!animations.empty()) {
-        updateSkeleton(animations[0], currentTime, skeleton);
-        std::vector<mat4> boneMatrices;
-        computeBoneMatrices(skeleton, boneMatrices);
-        vk::CommandBuffer cmd = beginSingleTimeCommands(renderer.m_logicalDevice, renderer.m_transientCommandPool);
-        renderer.uploadToBuffer(boneMatStagingBuffer, boneMats, cmd, boneMatrices);
-        endSingleTimeCommands(cmd, renderer.m_logicalDevice, renderer.m_transientCommandPool, renderer.m_graphicsQueue);
-    }
-}
+void Coat::animate(float currentTime, Renderer &renderer) { animateSkeleton(currentTime); }
 
 void Ground::init(Renderer &renderer, const std::string &modelPath, const std::string &meshName) {
-    MeshData::init(renderer, modelPath, meshName);
+    load(modelPath, meshName);
+    upload(renderer);
+}
+
+void Ground::load(const std::string &modelPath, const std::string &meshName) {
+    MeshData::load(modelPath, meshName);
 
     renderMode = MeshData::RenderMode::PEBBLE;
     renderBaseMesh = false;
@@ -368,6 +646,10 @@ void Ground::init(Renderer &renderer, const std::string &modelPath, const std::s
     pebbleUBOData.doNoise = true;
     pebbleUBOData.noiseAmplitude = 0.01f;
     pebbleUBOData.noiseFrequency = 35.0f;
+}
+
+void Ground::upload(Renderer &renderer) {
+    MeshData::upload(renderer);
 
     shadingUBO = renderer.createUniformBuffer(sizeof(shaderInterface::ShadingUBO));
     pebbleUBO = renderer.createUniformBuffer(sizeof(shaderInterface::ResurfacingUBO));
@@ -386,8 +668,10 @@ void Ground::init(Renderer &renderer, const std::string &modelPath, const std::s
 void Ground::bindAndDispatch(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout) {
     std::array<vk::DescriptorSet, 2> sets = {heDescriptorSet, perObjectDescriptorSet};
     cmd.pushConstants(layout, trueAllGraphics, 0, sizeof(mat4), &modelMatrix);
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, shaderInterface::HESet, sets, {});
-    cmd.drawMeshTasksEXT(heMesh.nbFaces + heMesh.nbVertices, 1, 1);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, layout, shaderInterface::HESet, sets, nullptr);
+    pushFrameSlices(cmd, layout, trueAllGraphics);
+    pushInstancing(cmd, layout, heMesh.nbFaces);
+    drawTaskGrid(cmd, layout, heMesh.nbFaces, taskGridLimits); // one pebble task workgroup per face
 }
 
 void Ground::updateUBOs() {
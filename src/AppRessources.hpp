@@ -1,11 +1,25 @@
 ﻿#pragma once
 #include "loaders/GLTFLoader.hpp"
+#include "Clusters.hpp"
 #include "HalfEdge.hpp"
+#include "HalfEdgePacking.hpp"
+#include "OcclusionCulling.hpp"
+#include "loaders/SceneLoader.hpp"
 #include "renderer.hpp"
 #include "shaderInterface.h"
 #include "vkHelper.hpp"
 
+// the packed layout on the CPU must match the getters of the shaders
+static_assert(shaderInterface::hePackedDataCount == hePackedArrayCount);
+static_assert(shaderInterface::hePackedVec4Base + shaderInterface::heFaceCenters == uint32(HePackedArray::FACE_CENTERS));
+static_assert(shaderInterface::hePackedVec2Base + shaderInterface::heVertexTexCoords == uint32(HePackedArray::VERTEX_TEXCOORDS));
+static_assert(shaderInterface::hePackedIntBase + shaderInterface::heHalfEdgeTwin == uint32(HePackedArray::HALF_EDGE_TWINS));
+static_assert(shaderInterface::hePackedIntBase + shaderInterface::heVertexFaceIndex == uint32(HePackedArray::VERTEX_FACE_INDICES));
+static_assert(shaderInterface::hePackedFloatBase + shaderInterface::heFaceAreas == uint32(HePackedArray::FACE_AREAS));
+
 struct HeBufferDescSOA {
+    Buffer hePackedBuffer; // HE_PACKED_BUFFER: every array below in one buffer
+
     Buffer heVertexPositionBuffer;
     Buffer heVertexColorBuffer;
     Buffer heVertexNormalBuffer;
@@ -25,6 +39,9 @@ struct HeBufferDescSOA {
     Buffer vertexFaceIndexBuffer;
 
     void uploadBuffersToGPU(const HalfEdgeMesh &meshData, Renderer &renderer, vk::CommandBuffer cmd) {
+#if HE_PACKED_BUFFER
+        hePackedBuffer = renderer.createAndUploadBuffer(cmd, packHalfEdgeMesh(meshData), vk::BufferUsageFlagBits::eStorageBuffer);
+#else
         // helper lambda to upload buffer
         auto uploadBuffer = [&renderer, &cmd](Buffer &destBuffer, const auto &data) { destBuffer = renderer.createAndUploadBuffer(cmd, data, vk::BufferUsageFlagBits::eStorageBuffer); };
 
@@ -52,9 +69,16 @@ struct HeBufferDescSOA {
 
         // Upload vertex-face index buffer
         uploadBuffer(vertexFaceIndexBuffer, meshData.vertexFaceIndices);
+#endif
     }
 };
 
+// RGBA8 pixels decoded on the CPU, empty when the file could not be read
+struct ImageData {
+    std::vector<uint8> pixels;
+    uvec2 size = uvec2(0);
+};
+
 struct MeshData {
     enum RenderMode {
         HALF_EDGE = 0,
@@ -65,7 +89,11 @@ struct MeshData {
     // === Mesh Data ===
     HeBufferDescSOA heMeshDescSoa;
     HalfEdgeMesh heMesh;
+    MeshClusters clusters; // groups of adjacent elements, used for cluster culling
     mat4 modelMatrix = mat4(1.0f);
+    TaskGridLimits taskGridLimits; // of the device, for drawTaskGrid
+    TaskGridLimits meshGridLimits;
+    TaskGridLimits computeGridLimits;
 
     // === Skeletal Data ===
     Skeleton skeleton;
@@ -74,11 +102,39 @@ struct MeshData {
     std::vector<vec4> jointIndicesData;
     std::vector<vec4> jointWeightsData;
     uint32 boneMatCount = 0;
+    std::vector<mat4> boneMatrices; // current palette, copied into the frame slice of boneMats
     Buffer jointsIndices;
     Buffer jointsWeights;
-    Buffer boneMats;
+    RingBuffer boneMats;
+    uint32 boneMatrixBase = 0; // first matrix of the slice written for the frame being recorded, pushed with the draws
+    float skinningCpuMs = 0.0f; // pose evaluation and palette copy, smoothed over frames
+    float poseCpuMs = 0.0f;     // pose evaluation of the current frame, 0 when the animation is paused
+
+    // === CPU occlusion culling ===
+    std::vector<uint32> occluderTriangles; // fan triangulation of the faces
+    std::vector<mat4> skinMatrices;        // per vertex, empty when the mesh is not skinned
+    std::vector<vec3> skinnedPositions;
+    std::vector<vec4> elementSpheres;      // bounds of the elements, faces then vertices
+    std::vector<uint32> elementVisibility; // copied into the frame slice of visibilityMask
+    RingBuffer visibilityMask;
+    uint32 visibilityMaskBase = 0; // first word of the slice written for the frame being recorded, pushed with the draws
+    uint32 occludedElements = 0;
+
+    // === Instancing ===
+    std::vector<SceneInstance> instances;       // copies drawn by the same dispatches, empty: one object placed by modelMatrix
+    std::vector<float> paletteOffsets = {0.0f}; // animation offset of each pose of boneMatrices
+    std::vector<AnimationCursors> paletteCursors = std::vector<AnimationCursors>(1); // each pose samples its own times
+    Buffer instanceBuffer;                      // shaderInterface::InstanceData of every instance
+
+    // === Loaded files, kept until upload ===
+    LutData lutData;
+    ImageData aoImage;
+    ImageData elementTypeImage;
 
     Buffer lutVertexBuffer;
+    Buffer visibleElements; // compaction pre-pass output, see B_visibleElementsBinding
+    uint32 visibleElementsSliceWords = 0; // size of the slice of each frame in flight, header included
+    uint32 visibleElementsBase = 0;       // first word of the slice compacted for the frame being recorded
     SampledTexture aoTexture;
     SampledTexture elementTypeTexture;
 
@@ -93,18 +149,61 @@ struct MeshData {
     bool hasAOTexture = false;
     bool hasElementTypeTexture = false;
     bool hasLut = false;
+    bool loaded = false; // set by the render thread once upload returned, nothing may be drawn or updated before
+    bool failed = false; // set by the render thread when load threw, the mesh is never drawn
+    bool isFinished() const { return loaded || failed; }
 
+    // init = load then upload. load reads the files and builds the CPU data without any Vulkan call, it can run on a
+    // worker thread. upload creates the GPU resources and the descriptors, on the render thread.
     void init(Renderer &renderer, const std::string &modelPath, const std::string &meshName, const std::string &gltfPath = "");
-    LutData loadLut(const std::string &path, Renderer &renderer, vk::CommandBuffer cmd);
-    void loadAOTexture(const std::string &path, Renderer &renderer, vk::CommandBuffer cmd) { aoTexture = loadAndUploadTexture(path, renderer, cmd, hasAOTexture); }
-    void loadElementTypeTexture(const std::string &path, Renderer &renderer, vk::CommandBuffer cmd) { elementTypeTexture = loadAndUploadTexture(path, renderer, cmd, hasElementTypeTexture); }
+    void load(const std::string &modelPath, const std::string &meshName, const std::string &gltfPath = "");
+    void upload(Renderer &renderer);
+    void uploadLut(Renderer &renderer, vk::CommandBuffer cmd); // lutData, loaded with LutLoader::loadLutData
+    void animateSkeleton(float currentTime);
+    // Copies the palette into the ring slice of the current frame, call after Renderer::beginFrame
+    void uploadBoneMatrices(Renderer &renderer);
+    // GPU-driven culling of the parametric elements: record the pre-pass outside of a rendering, then draw the survivors
+    void dispatchCompaction(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, uint32 frameSlot);
+    void drawVisibleElements(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout);
+    // Splits the workgroups in grids and draws that fit the device limits, the shaders read them back with flatGroupId
+    void drawTaskGrid(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, uint32 workGroupCount, const TaskGridLimits &limits);
+    uint32 parametricTaskGroups() const { return (heMesh.nbFaces + heMesh.nbVertices + TASK_GROUP_SIZE - 1) / TASK_GROUP_SIZE; }
+    // Draws the mesh once per instance, the instances with the same animation offset share a pose. Call before the first
+    // frame that draws the mesh, the bone matrices ring grows to hold every pose.
+    void setInstances(Renderer &renderer, const std::vector<SceneInstance> &sceneInstances);
+    uint32 instanceCount() const { return std::max(uint32(instances.size()), 1u); }
+    // The compaction list and the visibility mask are per element of a single object, and the compaction draws a single
+    // task grid. applyCullingSupport turns off in ubo what the mesh cannot use, on upload and setInstances, the UI greys
+    // it out.
+    bool supportsCompaction() const { return instances.empty() && fitsSingleTaskGrid(parametricTaskGroups(), taskGridLimits); }
+    bool supportsOcclusionCulling() const { return instances.empty(); }
+    void applyCullingSupport(shaderInterface::ResurfacingUBO &ubo) const;
+    // instancing of the next draws, each instance covers workGroupsPerInstance workgroups
+    void pushInstancing(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, uint32 workGroupsPerInstance) const;
+    // CPU occlusion culling: skin the base mesh and the element bounds with the current palette, draw the mesh as an
+    // occluder, test the elements against it, then copy the result into the ring slice of the frame
+    void updateSkinnedBounds(float elementRadiusScale);
+    void rasterizeOccluder(OcclusionBuffer &buffer, const mat4 &viewProjection) const;
+    void cullOccludedElements(OcclusionBuffer &buffer, const mat4 &viewProjection);
+    void uploadVisibilityMask(Renderer &renderer);
+    // frame slices of the ring buffers for the next draws or dispatches, the storage buffers are bound whole
+    void pushFrameSlices(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout, vk::ShaderStageFlags stages) const;
+    // CPU reference of the cluster culling for a world space camera, ignores skinning
+    ClusterCullingStats cullClustersCPU(const mat4 &viewProjection, vec3 cameraPosition, float cullingThreshold) const;
 
 protected:
     void allocateDescriptorSets(Renderer &renderer);
     void primeDescriptorSets(Renderer &renderer);
-    SampledTexture loadAndUploadTexture(const std::string &path, Renderer &renderer, vk::CommandBuffer cmd, bool &flag);
+    void createCullingBuffers(Renderer &renderer);
+    void writeInstancingDescriptors(Renderer &renderer, vk::DescriptorSet set) const;
+    static ImageData decodeImage(const std::string &path);
+    // flag tells whether the image was loaded, the pixels are released once uploaded
+    SampledTexture uploadTexture(ImageData &image, Renderer &renderer, vk::CommandBuffer cmd, bool &flag);
 };
 
+// Radius of the bounding sphere of an element over sqrt(face area), from the extent of the parametric surfaces
+float elementBoundingScale(const shaderInterface::ResurfacingUBO &ubo);
+
 struct Dragon : MeshData {
     shaderInterface::ShadingUBO shadingUBOData;
     shaderInterface::ShadingUBO shadingUBODataBaseMesh;
@@ -115,16 +214,19 @@ struct Dragon : MeshData {
     UniformBuffer shadingUBOBaseMesh;
     UniformBuffer heUBO;
     UniformBuffer resurfacingUBO;
-    Buffer boneMatStagingBuffer;
 
     vk::DescriptorSet perObjectDescriptorSetBaseMesh;
 
     void init(Renderer &renderer, const std::string &modelPath, const std::string &meshName,
               const std::string &gltfPath, const std::string &lutPath, const std::string &aoPath,
               const std::string &elementTypePath);
+    void load(const std::string &modelPath, const std::string &meshName, const std::string &gltfPath,
+              const std::string &lutPath, const std::string &aoPath, const std::string &elementTypePath);
+    void upload(Renderer &renderer);
 
     void bindAndDispatch(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout);
     void bindAndDispatchBaseMesh(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout);
+    void setInstances(Renderer &renderer, const std::vector<SceneInstance> &sceneInstances); // also for the base mesh
     void updateUBOs();
     void displayUI();
     void animate(float currentTime, Renderer &renderer);
@@ -140,12 +242,14 @@ struct Coat : MeshData {
 
     UniformBuffer shadingUBO;
     UniformBuffer resurfacingUBO;
-    Buffer boneMatStagingBuffer;
 
     void init(Renderer& renderer, const std::string& modelPath, const std::string& meshName,
               const std::string& gltfPath, const std::string& aoPath);
+    void load(const std::string &modelPath, const std::string &meshName, const std::string &gltfPath, const std::string &aoPath);
+    void upload(Renderer &renderer);
 
     void bindAndDispatch(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout);
+    void setInstances(Renderer &renderer, const std::vector<SceneInstance> &sceneInstances);
     void updateUBOs();
     void displayUI();
     void animate(float currentTime, Renderer &renderer);
@@ -163,6 +267,8 @@ struct Ground : MeshData {
     UniformBuffer pebbleUBO;
 
     void init(Renderer& renderer, const std::string& modelPath, const std::string& meshName);
+    void load(const std::string &modelPath, const std::string &meshName);
+    void upload(Renderer &renderer);
 
     void bindAndDispatch(vk::CommandBuffer &cmd, const vk::PipelineLayout &layout);
     void updateUBOs();
@@ -0,0 +1,215 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <queue>
+#include <vector>
+
+#include "HalfEdge.hpp"
+#include "defines.hpp"
+
+// Group of resurfacing elements (faces and vertices) built from adjacent faces.
+// Elements are identified like in the task shaders: face f is element f, vertex v is element nbFaces + v.
+struct MeshCluster {
+    vec4 sphere;          // xyz center, w radius, bounds the element anchors (face centers and vertex positions)
+    vec4 cone;            // xyz axis, w cosine of the half angle containing every element normal, -1 when the cone is open
+    uint32 elementOffset; // first element in MeshClusters::elements
+    uint32 elementCount;
+    uint32 faceCount; // the first faceCount elements are faces, the rest are vertices
+    uint32 padding = 0;
+};
+
+struct MeshClusters {
+    std::vector<MeshCluster> clusters;
+    std::vector<uint32> elements;
+};
+
+struct ClusterCullingStats {
+    uint32 clusterCount = 0;
+    uint32 rejectedClusters = 0;
+    uint32 elementCount = 0;
+    uint32 rejectedByClusters = 0; // elements inside rejected clusters
+    uint32 rejectedByElements = 0; // elements the per-element test rejects, upper bound for the cluster test
+    uint32 wronglyRejected = 0;    // elements in rejected clusters the per-element test keeps, must stay 0
+
+    float rejectedFraction() const { return elementCount ? float(rejectedByClusters) / float(elementCount) : 0.0f; }
+    float elementRejectedFraction() const { return elementCount ? float(rejectedByElements) / float(elementCount) : 0.0f; }
+};
+
+// Grows clusters of at most p_maxFaces faces by breadth-first search across twins, seeds follow the face order.
+// Each vertex goes to the cluster of the first face using it.
+inline MeshClusters buildClusters(const HalfEdgeMesh &p_mesh, uint32 p_maxFaces = 32) {
+    MeshClusters result;
+    const size_t nbFaces = p_mesh.faces.edges.size();
+    const size_t nbVertices = p_mesh.vertices.positions.size();
+    std::vector<int> faceCluster(nbFaces, -1);
+    std::vector<bool> vertexAssigned(nbVertices, false);
+    std::vector<int> faces;
+    std::queue<int> frontier;
+
+    for (size_t seed = 0; seed < nbFaces; ++seed) {
+        if (faceCluster[seed] != -1) { continue; }
+        const int clusterIndex = int(result.clusters.size());
+
+        // faces
+        faces.clear();
+        frontier = {};
+        frontier.push(int(seed));
+        faceCluster[seed] = clusterIndex;
+        while (!frontier.empty() && faces.size() < p_maxFaces) {
+            const int face = frontier.front();
+            frontier.pop();
+            faces.push_back(face);
+            const int offset = p_mesh.faces.offsets[face];
+            for (int i = 0; i < p_mesh.faces.vertCounts[face]; ++i) {
+                const int twin = p_mesh.halfEdges.twins[offset + i];
+                if (twin < 0) { continue; }
+                const int neighbour = p_mesh.halfEdges.faces[twin];
+                if (faceCluster[neighbour] != -1) { continue; }
+                faceCluster[neighbour] = clusterIndex;
+                frontier.push(neighbour);
+            }
+        }
+        while (!frontier.empty()) { // reached the size limit, give the remaining candidates back
+            faceCluster[frontier.front()] = -1;
+            frontier.pop();
+        }
+
+        MeshCluster cluster{};
+        cluster.elementOffset = uint32(result.elements.size());
+        cluster.faceCount = uint32(faces.size());
+        for (int face : faces) { result.elements.push_back(uint32(face)); }
+
+        // vertices
+        for (int face : faces) {
+            const int offset = p_mesh.faces.offsets[face];
+            for (int i = 0; i < p_mesh.faces.vertCounts[face]; ++i) {
+                const int vertex = p_mesh.vertexFaceIndices[offset + i];
+                if (vertexAssigned[vertex]) { continue; }
+                vertexAssigned[vertex] = true;
+                result.elements.push_back(uint32(nbFaces + vertex));
+            }
+        }
+        cluster.elementCount = uint32(result.elements.size()) - cluster.elementOffset;
+
+        // bounding sphere centered on the anchors bounding box
+        auto anchor = [&](uint32 p_element) { return p_element < nbFaces ? vec3(p_mesh.faces.centers[p_element]) : vec3(p_mesh.vertices.positions[p_element - nbFaces]); };
+        auto normal = [&](uint32 p_element) {
+            const vec3 n = p_element < nbFaces ? vec3(p_mesh.faces.normals[p_element]) : vec3(p_mesh.vertices.normals[p_element - nbFaces]);
+            const float length = glm::length(n);
+            return length > 0.0f ? n / length : n;
+        };
+        vec3 boxMin(std::numeric_limits<float>::max()), boxMax(std::numeric_limits<float>::lowest());
+        vec3 normalSum(0.0f);
+        for (uint32 i = cluster.elementOffset; i < cluster.elementOffset + cluster.elementCount; ++i) {
+            boxMin = glm::min(boxMin, anchor(result.elements[i]));
+            boxMax = glm::max(boxMax, anchor(result.elements[i]));
+            normalSum += normal(result.elements[i]);
+        }
+        const vec3 center = (boxMin + boxMax) * 0.5f;
+        float radius = 0.0f;
+        for (uint32 i = cluster.elementOffset; i < cluster.elementOffset + cluster.elementCount; ++i) { radius = std::max(radius, glm::length(anchor(result.elements[i]) - center)); }
+        cluster.sphere = vec4(center, radius);
+
+        // normal cone around the average normal, elements without a normal open it
+        const float sumLength = glm::length(normalSum);
+        vec3 axis = sumLength > 1e-6f ? normalSum / sumLength : vec3(0.0f, 0.0f, 1.0f);
+        float minCos = sumLength > 1e-6f ? 1.0f : -1.0f;
+        for (uint32 i = cluster.elementOffset; i < cluster.elementOffset + cluster.elementCount && minCos > -1.0f; ++i) {
+            const vec3 n = normal(result.elements[i]);
+            minCos = glm::length(n) > 0.0f ? std::min(minCos, glm::dot(n, axis)) : -1.0f;
+        }
+        cluster.cone = vec4(axis, minCos);
+
+        result.clusters.push_back(cluster);
+    }
+    return result;
+}
+
+// CPU version of the task shader tests: rejected when facing away (dot(viewDir, normal) > p_threshold) or outside the
+// p_frustumMargin-scaled clip box like isVisible() in common.glsl
+inline bool isElementCulled(vec3 p_position, vec3 p_normal, const mat4 &p_mvp, vec3 p_cameraPosition, float p_threshold, float p_frustumMargin = 1.1f) {
+    const vec3 viewDir = glm::normalize(p_position - p_cameraPosition);
+    if (glm::dot(viewDir, p_normal) > p_threshold) { return true; }
+    vec4 clip = p_mvp * vec4(p_position, 1.0f);
+    clip /= clip.w;
+    return clip.x < -p_frustumMargin || clip.x > p_frustumMargin || clip.y < -p_frustumMargin || clip.y > p_frustumMargin;
+}
+
+// CPU reference of compaction.comp, without skinning nor element type texture: the elements the task shader keeps, in
+// element order (the GPU list holds the same IDs in the order of its atomics). Returns the surviving element count.
+inline uint32 compactElements(const HalfEdgeMesh &p_mesh, const mat4 &p_mvp, vec3 p_cameraPosition, bool p_culling, float p_threshold, std::vector<uint32> &p_visibleElements) {
+    const uint32 nbFaces = uint32(p_mesh.faces.edges.size());
+    const uint32 nbVertices = uint32(p_mesh.vertices.positions.size());
+    p_visibleElements.clear();
+    for (uint32 element = 0; element < nbFaces + nbVertices; ++element) {
+        const bool isVertex = element >= nbFaces;
+        const vec3 position = isVertex ? vec3(p_mesh.vertices.positions[element - nbFaces]) : vec3(p_mesh.faces.centers[element]);
+        const vec3 normal = isVertex ? vec3(p_mesh.vertices.normals[element - nbFaces]) : vec3(p_mesh.faces.normals[element]);
+        if (!p_culling || !isElementCulled(position, normal, p_mvp, p_cameraPosition, p_threshold)) { p_visibleElements.push_back(element); }
+    }
+    return uint32(p_visibleElements.size());
+}
+
+// Conservative: a cluster is only culled when every element inside would be culled by isElementCulled
+inline bool isClusterCulled(const MeshCluster &p_cluster, const mat4 &p_mvp, vec3 p_cameraPosition, float p_threshold, float p_frustumMargin = 1.1f) {
+    const vec3 center = vec3(p_cluster.sphere);
+    const float radius = p_cluster.sphere.w;
+
+    // frustum: side planes of the margin-scaled clip box, the sphere must be fully outside one of them.
+    // isVisible() divides by w, so this only matches it when the whole sphere is in front of the camera (w > 0)
+    auto row = [&p_mvp](int p_row) { return vec4(p_mvp[0][p_row], p_mvp[1][p_row], p_mvp[2][p_row], p_mvp[3][p_row]); };
+    auto signedDistance = [&center](const vec4 &p_plane) {
+        const float length = glm::length(vec3(p_plane));
+        return length > 0.0f ? (glm::dot(vec3(p_plane), center) + p_plane.w) / length : 0.0f;
+    };
+    const vec4 rowX = row(0), rowY = row(1), rowW = row(3);
+    if (signedDistance(rowW) > radius) {
+        const vec4 planes[4] = {rowW * p_frustumMargin + rowX, rowW * p_frustumMargin - rowX, rowW * p_frustumMargin + rowY, rowW * p_frustumMargin - rowY};
+        for (const vec4 &plane : planes) {
+            if (signedDistance(plane) < -radius) { return true; }
+        }
+    }
+
+    // backface: the widest angle between a view direction towards the sphere and a normal of the cone
+    // must stay below acos(threshold) for every element to be rejected
+    if (p_cluster.cone.w <= -1.0f) { return false; }
+    const vec3 toCenter = center - p_cameraPosition;
+    const float distance = glm::length(toCenter);
+    if (distance <= radius) { return false; }
+    const float viewAngle = std::acos(glm::clamp(glm::dot(toCenter / distance, vec3(p_cluster.cone)), -1.0f, 1.0f));
+    const float sphereAngle = std::asin(radius / distance);
+    const float coneAngle = std::acos(glm::clamp(p_cluster.cone.w, -1.0f, 1.0f));
+    return viewAngle + sphereAngle + coneAngle < std::acos(glm::clamp(p_threshold, -1.0f, 1.0f));
+}
+
+// p_mvp and p_cameraPosition are in the mesh space (bind pose, no skinning)
+inline ClusterCullingStats cullClusters(const HalfEdgeMesh &p_mesh, const MeshClusters &p_clusters, const mat4 &p_mvp, vec3 p_cameraPosition, float p_threshold, std::vector<uint32> *p_visibleClusters = nullptr) {
+    ClusterCullingStats stats;
+    const size_t nbFaces = p_mesh.faces.edges.size();
+    stats.clusterCount = uint32(p_clusters.clusters.size());
+    stats.elementCount = uint32(p_clusters.elements.size());
+    if (p_visibleClusters) { p_visibleClusters->clear(); }
+
+    for (uint32 c = 0; c < p_clusters.clusters.size(); ++c) {
+        const MeshCluster &cluster = p_clusters.clusters[c];
+        const bool clusterCulled = isClusterCulled(cluster, p_mvp, p_cameraPosition, p_threshold);
+        for (uint32 i = cluster.elementOffset; i < cluster.elementOffset + cluster.elementCount; ++i) {
+            const uint32 element = p_clusters.elements[i];
+            const bool isVertex = element >= nbFaces;
+            const vec3 position = isVertex ? vec3(p_mesh.vertices.positions[element - nbFaces]) : vec3(p_mesh.faces.centers[element]);
+            const vec3 normal = isVertex ? vec3(p_mesh.vertices.normals[element - nbFaces]) : vec3(p_mesh.faces.normals[element]);
+            const bool elementCulled = isElementCulled(position, normal, p_mvp, p_cameraPosition, p_threshold);
+            stats.rejectedByElements += elementCulled ? 1 : 0;
+            stats.wronglyRejected += clusterCulled && !elementCulled ? 1 : 0;
+        }
+        if (clusterCulled) {
+            stats.rejectedClusters++;
+            stats.rejectedByClusters += cluster.elementCount;
+        } else if (p_visibleClusters) {
+            p_visibleClusters->push_back(c);
+        }
+    }
+    return stats;
+}
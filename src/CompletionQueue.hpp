@@ -0,0 +1,44 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// Lock-free queue with many producers and one consumer: jobs push what they completed, the render thread takes
+// everything pushed since its last call. A push is a compare-and-swap on the head of a linked list and popAll detaches
+// the whole list with one exchange, so a node is never shared between the two sides and there is no ABA issue.
+template <typename T>
+class CompletionQueue {
+public:
+    CompletionQueue() = default;
+    CompletionQueue(const CompletionQueue &) = delete;
+    CompletionQueue &operator=(const CompletionQueue &) = delete;
+    ~CompletionQueue() { popAll(); }
+
+    void push(T p_value) {
+        Node *node = new Node{std::move(p_value), m_head.load(std::memory_order_relaxed)};
+        while (!m_head.compare_exchange_weak(node->next, node, std::memory_order_release, std::memory_order_relaxed)) {}
+    }
+
+    // Values pushed since the last call, in push order for each producer
+    std::vector<T> popAll() {
+        std::vector<T> values;
+        for (Node *node = m_head.exchange(nullptr, std::memory_order_acquire); node != nullptr;) {
+            values.push_back(std::move(node->value));
+            Node *next = node->next;
+            delete node;
+            node = next;
+        }
+        std::reverse(values.begin(), values.end());
+        return values;
+    }
+
+    bool empty() const { return m_head.load(std::memory_order_acquire) == nullptr; }
+
+private:
+    struct Node {
+        T value;
+        Node *next;
+    };
+    std::atomic<Node *> m_head{nullptr};
+};
@@ -0,0 +1,79 @@
+#include "FrameRecorder.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+
+double percentile(std::vector<double> p_values, double p_percent) {
+    if (p_values.empty()) { return 0.0; }
+    const size_t rank = size_t(std::ceil(std::clamp(p_percent, 0.0, 100.0) / 100.0 * double(p_values.size())));
+    const size_t index = std::max<size_t>(rank, 1) - 1;
+    std::nth_element(p_values.begin(), p_values.begin() + index, p_values.end());
+    return p_values[index];
+}
+
+FrameStatsSummary summarizeFrameStats(const std::vector<double> &p_values) {
+    FrameStatsSummary summary;
+    if (p_values.empty()) { return summary; }
+    summary.mean = std::accumulate(p_values.begin(), p_values.end(), 0.0) / double(p_values.size());
+    summary.p50 = percentile(p_values, 50.0);
+    summary.p90 = percentile(p_values, 90.0);
+    summary.p95 = percentile(p_values, 95.0);
+    summary.p99 = percentile(p_values, 99.0);
+    summary.max = *std::max_element(p_values.begin(), p_values.end());
+    return summary;
+}
+
+std::vector<std::pair<std::string, FrameStatsSummary>> FrameRecorder::summarize() const {
+    std::vector<double> cpuMs, gpuMs, triangles;
+    for (const FrameRecord &frame : m_frames) {
+        cpuMs.push_back(frame.cpuMs);
+        if (frame.gpuMs >= 0.0) { gpuMs.push_back(frame.gpuMs); }
+        if (frame.triangles >= 0) { triangles.push_back(double(frame.triangles)); }
+    }
+    std::vector<std::pair<std::string, FrameStatsSummary>> summaries = {{"cpu_ms", summarizeFrameStats(cpuMs)}};
+    if (!gpuMs.empty()) { summaries.emplace_back("gpu_ms", summarizeFrameStats(gpuMs)); }
+    if (!triangles.empty()) { summaries.emplace_back("triangles", summarizeFrameStats(triangles)); }
+    return summaries;
+}
+
+bool FrameRecorder::writeCsv(const std::string &p_path) const {
+    std::ofstream csv(p_path, std::ios::trunc);
+    if (!csv) {
+        std::cerr << "Could not open frame times: " << p_path << std::endl;
+        return false;
+    }
+    // the values that are not available are left empty
+    csv << "frame,time_s,cpu_ms,gpu_ms,elements_dispatched,triangles\n";
+    for (uint32 i = 0; i < size(); i++) {
+        const FrameRecord &frame = m_frames[i];
+        csv << i << "," << frame.time << "," << frame.cpuMs << ",";
+        if (frame.gpuMs >= 0.0) { csv << frame.gpuMs; }
+        csv << "," << frame.elementsDispatched << ",";
+        if (frame.triangles >= 0) { csv << frame.triangles; }
+        csv << "\n";
+    }
+    return bool(csv);
+}
+
+bool FrameRecorder::writeSummaryCsv(const std::string &p_path) const {
+    std::ofstream csv(p_path, std::ios::trunc);
+    if (!csv) {
+        std::cerr << "Could not open frame time summary: " << p_path << std::endl;
+        return false;
+    }
+    csv << "metric,mean,p50,p90,p95,p99,max\n";
+    for (const auto &[metric, summary] : summarize()) {
+        csv << metric << "," << summary.mean << "," << summary.p50 << "," << summary.p90 << "," << summary.p95 << "," << summary.p99 << "," << summary.max << "\n";
+    }
+    return bool(csv);
+}
+
+void FrameRecorder::printSummary() const {
+    std::cout << size() << " frames" << std::endl;
+    for (const auto &[metric, summary] : summarize()) {
+        std::cout << "  " << metric << ": mean " << summary.mean << ", p50 " << summary.p50 << ", p90 " << summary.p90 << ", p95 " << summary.p95 << ", p99 " << summary.p99 << ", max " << summary.max << std::endl;
+    }
+}
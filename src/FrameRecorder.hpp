@@ -0,0 +1,47 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+
+// One measured frame of a scripted run. The GPU values arrive a few frames later, when the profiler reads them back.
+struct FrameRecord {
+    float time = 0.0f;             // animation clock, seconds
+    double cpuMs = 0.0;            // animation, culling, recording and submission of the frame
+    double gpuMs = -1.0;           // sum of the GPU profiler scopes, -1 when not read back
+    uint64 elementsDispatched = 0; // parametric elements and pebbles the draws cover after the CPU occlusion culling, the
+                                   // GPU compaction, frustum, backface and level of detail culling may still drop them
+    int64 triangles = -1;          // mesh shader primitives, -1 without mesh shader queries
+};
+
+struct FrameStatsSummary {
+    double mean = 0.0;
+    double p50 = 0.0;
+    double p90 = 0.0;
+    double p95 = 0.0;
+    double p99 = 0.0;
+    double max = 0.0;
+};
+
+// Nearest rank percentile, p_percent in [0, 100], 0 for no value
+double percentile(std::vector<double> p_values, double p_percent);
+FrameStatsSummary summarizeFrameStats(const std::vector<double> &p_values);
+
+// Frames of a scripted benchmark run, written as one CSV row per frame plus a summary CSV to compare runs
+class FrameRecorder {
+public:
+    void reset(uint32 p_frameCount) { m_frames.assign(p_frameCount, FrameRecord{}); }
+    uint32 size() const { return uint32(m_frames.size()); }
+    FrameRecord &operator[](uint32 p_frame) { return m_frames[p_frame]; }
+    const FrameRecord &operator[](uint32 p_frame) const { return m_frames[p_frame]; }
+
+    // cpu_ms, then gpu_ms and triangles over the frames that have them
+    std::vector<std::pair<std::string, FrameStatsSummary>> summarize() const;
+    bool writeCsv(const std::string &p_path) const;
+    bool writeSummaryCsv(const std::string &p_path) const; // metric,mean,p50,p90,p95,p99,max
+    void printSummary() const;
+
+private:
+    std::vector<FrameRecord> m_frames;
+};
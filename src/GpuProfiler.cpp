@@ -0,0 +1,156 @@
+#include "GpuProfiler.hpp"
+#include "renderer.hpp"
+
+#include <imgui.h>
+
+// pipeline statistics are written in the bit order of the flags: fragment, task then mesh invocations
+static constexpr vk::QueryPipelineStatisticFlags statisticFlags = vk::QueryPipelineStatisticFlagBits::eFragmentShaderInvocations | vk::QueryPipelineStatisticFlagBits::eTaskShaderInvocationsEXT | vk::QueryPipelineStatisticFlagBits::eMeshShaderInvocationsEXT;
+
+void GpuProfiler::init(Renderer &p_renderer, uint32 p_frameSlots, uint32 p_maxScopes) {
+    m_renderer = &p_renderer;
+    m_maxScopes = p_maxScopes;
+    m_slots.assign(p_frameSlots, {});
+    m_timestampPeriodMs = p_renderer.getTimestampPeriod() * 1e-6;
+
+    const vk::Device device = p_renderer.m_logicalDevice;
+    const uint32 queryCount = p_frameSlots * p_maxScopes;
+    const vk::QueryPoolCreateInfo timestampInfo({}, vk::QueryType::eTimestamp, 2 * queryCount);
+    VK_CHECK(device.createQueryPool(&timestampInfo, nullptr, &m_timestampPool));
+    if (p_renderer.supportsMeshQueries()) {
+        const vk::QueryPoolCreateInfo statisticsInfo({}, vk::QueryType::ePipelineStatistics, queryCount, statisticFlags);
+        VK_CHECK(device.createQueryPool(&statisticsInfo, nullptr, &m_statisticsPool));
+        const vk::QueryPoolCreateInfo primitivesInfo({}, vk::QueryType::eMeshPrimitivesGeneratedEXT, queryCount);
+        VK_CHECK(device.createQueryPool(&primitivesInfo, nullptr, &m_primitivesPool));
+    } else {
+        std::cout << "GPU profiler: no mesh shader queries on this device, timings only" << std::endl;
+    }
+}
+
+void GpuProfiler::cleanup() {
+    const vk::Device device = m_renderer->m_logicalDevice;
+    device.destroyQueryPool(m_timestampPool);
+    device.destroyQueryPool(m_statisticsPool);
+    device.destroyQueryPool(m_primitivesPool);
+    m_csv.close();
+}
+
+void GpuProfiler::beginFrame(vk::CommandBuffer p_cmd, uint32 p_frameSlot) {
+    readBack(p_frameSlot);
+    m_currentSlot = p_frameSlot;
+    m_slots[p_frameSlot].scopes.clear();
+    m_slots[p_frameSlot].frameIndex = m_frameIndex++;
+
+    p_cmd.resetQueryPool(m_timestampPool, 2 * queryIndex(0), 2 * m_maxScopes);
+    if (hasStatistics()) {
+        p_cmd.resetQueryPool(m_statisticsPool, queryIndex(0), m_maxScopes);
+        p_cmd.resetQueryPool(m_primitivesPool, queryIndex(0), m_maxScopes);
+    }
+}
+
+void GpuProfiler::beginScope(vk::CommandBuffer p_cmd, const std::string &p_name) {
+    FrameSlot &slot = m_slots[m_currentSlot];
+    ASSERT(slot.scopes.size() < m_maxScopes, "Too many profiler scopes in a frame");
+    const uint32 query = queryIndex(uint32(slot.scopes.size()));
+    slot.scopes.push_back(p_name);
+    p_cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, m_timestampPool, 2 * query);
+    if (hasStatistics()) {
+        p_cmd.beginQuery(m_statisticsPool, query, {});
+        p_cmd.beginQuery(m_primitivesPool, query, {});
+    }
+}
+
+void GpuProfiler::endScope(vk::CommandBuffer p_cmd) {
+    const uint32 query = queryIndex(uint32(m_slots[m_currentSlot].scopes.size()) - 1);
+    if (hasStatistics()) {
+        p_cmd.endQuery(m_primitivesPool, query);
+        p_cmd.endQuery(m_statisticsPool, query);
+    }
+    p_cmd.writeTimestamp2(vk::PipelineStageFlagBits2::eAllCommands, m_timestampPool, 2 * query + 1);
+}
+
+void GpuProfiler::readBack(uint32 p_frameSlot) {
+    const FrameSlot &slot = m_slots[p_frameSlot];
+    const uint32 count = uint32(slot.scopes.size());
+    if (count == 0) { return; }
+
+    // the slot's frame has completed, the results are there without waiting; a missing one drops the frame
+    const vk::Device device = m_renderer->m_logicalDevice;
+    const uint32 first = p_frameSlot * m_maxScopes;
+    std::vector<uint64> timestamps(2 * count);
+    if (device.getQueryPoolResults(m_timestampPool, 2 * first, 2 * count, timestamps.size() * sizeof(uint64), timestamps.data(), sizeof(uint64), vk::QueryResultFlagBits::e64) != vk::Result::eSuccess) { return; }
+    std::vector<uint64> statistics(3 * count), primitives(count);
+    if (hasStatistics()) {
+        if (device.getQueryPoolResults(m_statisticsPool, first, count, statistics.size() * sizeof(uint64), statistics.data(), 3 * sizeof(uint64), vk::QueryResultFlagBits::e64) != vk::Result::eSuccess) { return; }
+        if (device.getQueryPoolResults(m_primitivesPool, first, count, primitives.size() * sizeof(uint64), primitives.data(), sizeof(uint64), vk::QueryResultFlagBits::e64) != vk::Result::eSuccess) { return; }
+    }
+
+    std::vector<ScopeResult> results(count);
+    for (uint32 i = 0; i < count; i++) {
+        ScopeResult &result = results[i];
+        result.name = slot.scopes[i];
+        result.gpuMs = double(timestamps[2 * i + 1] - timestamps[2 * i]) * m_timestampPeriodMs;
+        result.averageGpuMs = result.gpuMs;
+        for (const ScopeResult &previous : m_results) { if (previous.name == result.name) { result.averageGpuMs = previous.averageGpuMs * 0.95 + result.gpuMs * 0.05; } }
+        result.fragmentInvocations = statistics[3 * i];
+        result.taskInvocations = statistics[3 * i + 1];
+        result.meshInvocations = statistics[3 * i + 2];
+        result.meshPrimitives = primitives[i];
+        if (m_csv.is_open()) {
+            m_csv << slot.frameIndex << "," << result.name << "," << result.gpuMs << "," << result.taskInvocations << "," << result.meshInvocations << "," << result.meshPrimitives << ","
+                  << result.fragmentInvocations << "\n";
+        }
+    }
+    m_results = std::move(results);
+    m_resultsFrameIndex = slot.frameIndex;
+}
+
+bool GpuProfiler::startCsv(const std::string &p_path) {
+    m_csv.close();
+    m_csv.open(p_path, std::ios::trunc);
+    if (!m_csv) {
+        std::cerr << "Could not open GPU profile: " << p_path << std::endl;
+        return false;
+    }
+    m_csv << "frame,scope,gpu_ms,task_invocations,mesh_invocations,mesh_primitives,fragment_invocations\n";
+    return true;
+}
+
+void GpuProfiler::displayUI() {
+    if (!ImGui::CollapsingHeader("GPU Time")) { return; }
+    double totalMs = 0.0;
+    if (ImGui::BeginTable("GPU scopes", hasStatistics() ? 5 : 2)) {
+        ImGui::TableSetupColumn("Scope");
+        ImGui::TableSetupColumn("ms");
+        if (hasStatistics()) {
+            ImGui::TableSetupColumn("Task inv.");
+            ImGui::TableSetupColumn("Mesh inv.");
+            ImGui::TableSetupColumn("Primitives");
+        }
+        ImGui::TableHeadersRow();
+        for (const ScopeResult &result : m_results) {
+            totalMs += result.averageGpuMs;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(result.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.3f", result.averageGpuMs);
+            if (hasStatistics()) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)result.taskInvocations);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)result.meshInvocations);
+                ImGui::TableNextColumn();
+                ImGui::Text("%llu", (unsigned long long)result.meshPrimitives);
+            }
+        }
+        ImGui::EndTable();
+    }
+    ImGui::Text("Total: %.3f ms", totalMs);
+
+    ImGui::InputText("CSV", m_csvPath, sizeof(m_csvPath));
+    if (isRecordingCsv()) {
+        if (ImGui::Button("Stop recording")) { stopCsv(); }
+    } else if (ImGui::Button("Record")) {
+        startCsv(m_csvPath);
+    }
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+#include "vkHelper.hpp"
+
+class Renderer;
+
+// Per draw GPU timings and mesh pipeline statistics. Every frame slot has its own queries, they are read back without
+// waiting when the slot comes around again, the frame timeline having already guaranteed that the GPU is done with it.
+// The statistics are only collected when the device supports pipeline statistics and mesh shader queries.
+class GpuProfiler {
+public:
+    struct ScopeResult {
+        std::string name;
+        double gpuMs = 0.0;
+        double averageGpuMs = 0.0; // smoothed over frames
+        uint64 taskInvocations = 0;
+        uint64 meshInvocations = 0;
+        uint64 meshPrimitives = 0;
+        uint64 fragmentInvocations = 0;
+    };
+
+    void init(Renderer &p_renderer, uint32 p_frameSlots, uint32 p_maxScopes = 16);
+    void cleanup();
+
+    // Reads back the results of the last use of p_frameSlot and resets its queries, call right after Renderer::beginFrame
+    void beginFrame(vk::CommandBuffer p_cmd, uint32 p_frameSlot);
+    // Scopes do not nest, the statistics queries of a scope must start and end in the same rendering
+    void beginScope(vk::CommandBuffer p_cmd, const std::string &p_name);
+    void endScope(vk::CommandBuffer p_cmd);
+
+    const std::vector<ScopeResult> &getResults() const { return m_results; } // latest frame read back
+    // frame indices counted by beginFrame: the frame being recorded, and the one getResults comes from
+    uint64 getFrameIndex() const { return m_frameIndex - 1; }
+    uint64 getResultsFrameIndex() const { return m_resultsFrameIndex; }
+    bool hasStatistics() const { return m_statisticsPool != nullptr; }
+
+    // Appends one row per scope and per frame read back until stopCsv
+    bool startCsv(const std::string &p_path);
+    void stopCsv() { m_csv.close(); }
+    bool isRecordingCsv() const { return m_csv.is_open(); }
+
+    void displayUI();
+
+private:
+    struct FrameSlot {
+        std::vector<std::string> scopes;
+        uint64 frameIndex = 0;
+    };
+
+    void readBack(uint32 p_frameSlot);
+    uint32 queryIndex(uint32 p_scope) const { return m_currentSlot * m_maxScopes + p_scope; }
+
+    Renderer *m_renderer = nullptr;
+    vk::QueryPool m_timestampPool{};  // 2 queries per scope and per slot
+    vk::QueryPool m_statisticsPool{}; // task, mesh and fragment invocations
+    vk::QueryPool m_primitivesPool{}; // mesh primitives generated
+    std::vector<FrameSlot> m_slots;
+    uint32 m_maxScopes = 0;
+    uint32 m_currentSlot = 0;
+    uint64 m_frameIndex = 0;
+    uint64 m_resultsFrameIndex = ~0ull; // none read back yet
+    double m_timestampPeriodMs = 0.0;
+    std::vector<ScopeResult> m_results;
+    std::ofstream m_csv;
+    char m_csvPath[256] = "gpu_profile.csv";
+};
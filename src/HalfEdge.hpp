@@ -1,9 +1,11 @@
 #pragma once
 
+#include <atomic>
 #include <iostream>
-#include <map>
+#include <limits>
 #include <vector>
 
+#include "ThreadPool.hpp"
 #include "defines.hpp"
 #include "loaders/objLoader.hpp"
 
@@ -44,90 +46,296 @@ struct HalfEdgeMesh {
     std::vector<int> vertexFaceIndices; // Buffer of vertex indices for each face
 };
 
+// Open-addressing table from a directed edge (start, end) to the last half-edge inserted with it
+struct EdgeTable {
+    static constexpr uint64 emptyKey = ~uint64(0);
+
+    struct Slot {
+        uint64 key = emptyKey;
+        int value = -1;
+    };
+
+    std::vector<Slot> slots; // key and value side by side, one cache miss per probe
+    uint64 mask = 0;
+    uint32 shift = 60;
+
+    explicit EdgeTable(size_t p_edgeCount) {
+        size_t capacity = 16;
+        while (capacity < p_edgeCount * 2) { capacity *= 2, shift--; } // load factor <= 0.5
+        slots.resize(capacity);
+        mask = capacity - 1;
+    }
+
+    static uint64 packKey(int p_start, int p_end) { return (uint64(uint32(p_start)) << 32) | uint32(p_end); }
+    size_t slot(uint64 p_key) const { return size_t((p_key * 0x9E3779B97F4A7C15ull) >> shift); } // Fibonacci hashing
+
+    void insert(uint64 p_key, int p_value) {
+        size_t i = slot(p_key);
+        while (slots[i].key != emptyKey && slots[i].key != p_key) { i = (i + 1) & mask; }
+        slots[i] = {p_key, p_value};
+    }
+
+    int find(uint64 p_key) const {
+        for (size_t i = slot(p_key); slots[i].key != emptyKey; i = (i + 1) & mask) {
+            if (slots[i].key == p_key) { return slots[i].value; }
+        }
+        return -1;
+    }
+};
+
 // Main function to convert NgonMesh to HalfEdgeMesh using SoA and vertexFaceIndices
 inline HalfEdgeMesh convertToHalfEdgeMesh(const NgonData &ngonMesh) {
     HalfEdgeMesh heMesh;
-
-    std::map<std::pair<int, int>, int> edgeToHalfEdgeMap; // Maps edges to half-edge indices
-    std::vector<std::pair<int, int>> halfEdgeToEdge;      // For finding twins
+    const size_t nbVertices = ngonMesh.vertices.size();
+    const size_t nbFaces = ngonMesh.faces.size();
+    size_t nbHalfEdges = 0;
+    for (const auto &f : ngonMesh.faces) { nbHalfEdges += f.count; }
 
     // Initialize vertices
-    for (const auto &v : ngonMesh.vertices) {
-        heMesh.vertices.positions.push_back(v.position);
-        heMesh.vertices.colors.push_back(v.color);
-        heMesh.vertices.normals.push_back(v.normal);
-        heMesh.vertices.texCoords.push_back(v.texCoord);
-        heMesh.vertices.edges.push_back(-1); // Initialize with no edge
+    heMesh.vertices.positions.resize(nbVertices);
+    heMesh.vertices.colors.resize(nbVertices);
+    heMesh.vertices.normals.resize(nbVertices);
+    heMesh.vertices.texCoords.resize(nbVertices);
+    heMesh.vertices.edges.assign(nbVertices, -1); // Initialize with no edge
+    for (size_t v = 0; v < nbVertices; ++v) {
+        const Vertex &vertex = ngonMesh.vertices[v];
+        heMesh.vertices.positions[v] = vertex.position;
+        heMesh.vertices.colors[v] = vertex.color;
+        heMesh.vertices.normals[v] = vertex.normal;
+        heMesh.vertices.texCoords[v] = vertex.texCoord;
     }
 
-    int vertexFaceOffset = 0; // Tracks offset for vertexFaceIndices
+    heMesh.faces.edges.resize(nbFaces);
+    heMesh.faces.vertCounts.resize(nbFaces);
+    heMesh.faces.offsets.resize(nbFaces);
+    heMesh.faces.normals.resize(nbFaces);
+    heMesh.faces.centers.resize(nbFaces);
+    heMesh.faces.faceAreas.resize(nbFaces);
+
+    heMesh.halfEdges.vertices.resize(nbHalfEdges);
+    heMesh.halfEdges.faces.resize(nbHalfEdges);
+    heMesh.halfEdges.next.resize(nbHalfEdges);
+    heMesh.halfEdges.prev.resize(nbHalfEdges);
+    heMesh.halfEdges.twins.assign(nbHalfEdges, -1); // To be determined later
+    heMesh.vertexFaceIndices.resize(nbHalfEdges);
 
-    // Initialize faces and half-edges
-    for (const auto &f : ngonMesh.faces) {
-        int firstHalfEdgeIndex = heMesh.halfEdges.vertices.size();
-        int lastHalfEdgeIndex = -1;
+    EdgeTable edgeTable(nbHalfEdges); // Maps edges to half-edge indices
 
-        // Store the offset to the vertex indices of this face
-        heMesh.faces.offsets.push_back(vertexFaceOffset);
+    // Initialize faces and half-edges, half-edges of a face are contiguous and follow the face order
+    int halfEdgeIndex = 0;
+    for (size_t faceIndex = 0; faceIndex < nbFaces; ++faceIndex) {
+        const NGonFace &f = ngonMesh.faces[faceIndex];
+        const int firstHalfEdgeIndex = halfEdgeIndex;
+        const int lastHalfEdgeIndex = firstHalfEdgeIndex + int(f.count) - 1;
 
-        for (unsigned i = 0; i < f.count; ++i) {
+        for (unsigned i = 0; i < f.count; ++i, ++halfEdgeIndex) {
             int startVertexIndex = ngonMesh.indices[f.offset + i];
             int endVertexIndex = ngonMesh.indices[f.offset + (i + 1) % f.count];
 
-            HalfEdges he;
-            heMesh.halfEdges.vertices.push_back(endVertexIndex);
-            heMesh.halfEdges.faces.push_back(heMesh.faces.edges.size());           // Current face index
-            heMesh.halfEdges.next.push_back(heMesh.halfEdges.vertices.size() + 1); // Point to the next half-edge
-            heMesh.halfEdges.prev.push_back(lastHalfEdgeIndex);                    // Point to the previous half-edge
-            heMesh.halfEdges.twins.push_back(-1);                                  // To be determined later
+            heMesh.halfEdges.vertices[halfEdgeIndex] = endVertexIndex;
+            heMesh.halfEdges.faces[halfEdgeIndex] = int(faceIndex);
+            heMesh.halfEdges.next[halfEdgeIndex] = halfEdgeIndex == lastHalfEdgeIndex ? firstHalfEdgeIndex : halfEdgeIndex + 1;
+            heMesh.halfEdges.prev[halfEdgeIndex] = halfEdgeIndex == firstHalfEdgeIndex ? lastHalfEdgeIndex : halfEdgeIndex - 1;
 
             // Add to vertexFaceIndices for the current face
-            heMesh.vertexFaceIndices.push_back(startVertexIndex);
-            ++vertexFaceOffset; // Increment offset for next vertex
+            heMesh.vertexFaceIndices[halfEdgeIndex] = startVertexIndex;
 
             // Store the mapping from edge to half-edge index
-            edgeToHalfEdgeMap[{startVertexIndex, endVertexIndex}] = heMesh.halfEdges.vertices.size() - 1;
-            halfEdgeToEdge.push_back({startVertexIndex, endVertexIndex});
-
-            if (lastHalfEdgeIndex != -1) {
-                heMesh.halfEdges.next[lastHalfEdgeIndex] = heMesh.halfEdges.vertices.size() - 1;
-            }
-
-            lastHalfEdgeIndex = heMesh.halfEdges.vertices.size() - 1;
+            edgeTable.insert(EdgeTable::packKey(startVertexIndex, endVertexIndex), halfEdgeIndex);
         }
 
-        // Connect the last half-edge to the first
-        heMesh.halfEdges.next[lastHalfEdgeIndex] = firstHalfEdgeIndex;
-        heMesh.halfEdges.prev[firstHalfEdgeIndex] = lastHalfEdgeIndex;
-
         // Create the face
-        heMesh.faces.edges.push_back(firstHalfEdgeIndex);
-        heMesh.faces.normals.push_back(f.normal);
-        heMesh.faces.centers.push_back(f.center);
-        heMesh.faces.faceAreas.push_back(f.faceArea);
-        heMesh.faces.vertCounts.push_back(f.count); // Set the vertex count for the face
+        heMesh.faces.edges[faceIndex] = firstHalfEdgeIndex;
+        heMesh.faces.offsets[faceIndex] = firstHalfEdgeIndex; // offset to the vertex indices of this face
+        heMesh.faces.normals[faceIndex] = f.normal;
+        heMesh.faces.centers[faceIndex] = f.center;
+        heMesh.faces.faceAreas[faceIndex] = f.faceArea;
+        heMesh.faces.vertCounts[faceIndex] = int(f.count); // Set the vertex count for the face
     }
 
     // Link twin half-edges
-    for (int i = 0; i < halfEdgeToEdge.size(); ++i) {
-        int start = halfEdgeToEdge[i].first;
-        int end = halfEdgeToEdge[i].second;
-        auto it = edgeToHalfEdgeMap.find({end, start}); // Find the opposite half-edge
-        if (it != edgeToHalfEdgeMap.end()) {
-            heMesh.halfEdges.twins[i] = it->second;
-            heMesh.halfEdges.twins[it->second] = i;
+    for (int i = 0; i < int(nbHalfEdges); ++i) {
+        int start = heMesh.vertexFaceIndices[i];
+        int end = heMesh.halfEdges.vertices[i];
+        int twin = edgeTable.find(EdgeTable::packKey(end, start)); // Find the opposite half-edge
+        if (twin != -1) {
+            heMesh.halfEdges.twins[i] = twin;
+            heMesh.halfEdges.twins[twin] = i;
         }
     }
 
     // Set the vertex edge index
-    for (int i = 0; i < heMesh.halfEdges.vertices.size(); ++i) {
+    for (int i = 0; i < int(nbHalfEdges); ++i) {
         if (heMesh.vertices.edges[heMesh.halfEdges.vertices[i]] == -1) {
             heMesh.vertices.edges[heMesh.halfEdges.vertices[i]] = i;
         }
     }
 
-    heMesh.nbVertices = ngonMesh.vertices.size();
-    heMesh.nbFaces = ngonMesh.faces.size();
+    heMesh.nbVertices = uint32(nbVertices);
+    heMesh.nbFaces = uint32(nbFaces);
+
+    return heMesh;
+}
+
+// EdgeTable filled from several threads, the highest half-edge index wins like the serial insertion order
+struct ConcurrentEdgeTable {
+    static constexpr uint64 emptyKey = ~uint64(0);
+
+    struct Slot {
+        std::atomic<uint64> key{emptyKey};
+        std::atomic<int> value{-1};
+    };
+
+    std::vector<Slot> slots;
+    uint64 mask = 0;
+    uint32 shift = 60;
+
+    explicit ConcurrentEdgeTable(size_t p_edgeCount) {
+        size_t capacity = 16;
+        while (capacity < p_edgeCount * 2) { capacity *= 2, shift--; } // load factor <= 0.5
+        slots = std::vector<Slot>(capacity);
+        mask = capacity - 1;
+    }
+
+    size_t slot(uint64 p_key) const { return size_t((p_key * 0x9E3779B97F4A7C15ull) >> shift); }
+
+    void insert(uint64 p_key, int p_value) {
+        for (size_t i = slot(p_key);; i = (i + 1) & mask) {
+            uint64 key = slots[i].key.load(std::memory_order_relaxed);
+            if (key == emptyKey && slots[i].key.compare_exchange_strong(key, p_key, std::memory_order_relaxed)) { key = p_key; }
+            if (key != p_key) { continue; }
+            int value = slots[i].value.load(std::memory_order_relaxed);
+            while (value < p_value && !slots[i].value.compare_exchange_weak(value, p_value, std::memory_order_relaxed)) {}
+            return;
+        }
+    }
+
+    // only valid once every insertion is done
+    int find(uint64 p_key) const {
+        for (size_t i = slot(p_key);; i = (i + 1) & mask) {
+            const uint64 key = slots[i].key.load(std::memory_order_relaxed);
+            if (key == emptyKey) { return -1; }
+            if (key == p_key) { return slots[i].value.load(std::memory_order_relaxed); }
+        }
+    }
+};
+
+// Same result as convertToHalfEdgeMesh, built on p_pool.
+// The half-edge range of every face is given by a prefix sum over the face counts, every array is then filled in place.
+inline HalfEdgeMesh convertToHalfEdgeMeshParallel(const NgonData &ngonMesh, ThreadPool &p_pool) {
+    constexpr size_t grain = 4096;
+    HalfEdgeMesh heMesh;
+    const size_t nbVertices = ngonMesh.vertices.size();
+    const size_t nbFaces = ngonMesh.faces.size();
+
+    // first half-edge of each face
+    std::vector<int> faceOffsets(nbFaces);
+    size_t nbHalfEdges = 0;
+    for (size_t f = 0; f < nbFaces; ++f) {
+        faceOffsets[f] = int(nbHalfEdges);
+        nbHalfEdges += ngonMesh.faces[f].count;
+    }
+
+    heMesh.vertices.positions.resize(nbVertices);
+    heMesh.vertices.colors.resize(nbVertices);
+    heMesh.vertices.normals.resize(nbVertices);
+    heMesh.vertices.texCoords.resize(nbVertices);
+    heMesh.vertices.edges.resize(nbVertices);
+    heMesh.faces.edges.resize(nbFaces);
+    heMesh.faces.vertCounts.resize(nbFaces);
+    heMesh.faces.normals.resize(nbFaces);
+    heMesh.faces.centers.resize(nbFaces);
+    heMesh.faces.faceAreas.resize(nbFaces);
+    heMesh.halfEdges.vertices.resize(nbHalfEdges);
+    heMesh.halfEdges.faces.resize(nbHalfEdges);
+    heMesh.halfEdges.next.resize(nbHalfEdges);
+    heMesh.halfEdges.prev.resize(nbHalfEdges);
+    heMesh.halfEdges.twins.resize(nbHalfEdges);
+    heMesh.vertexFaceIndices.resize(nbHalfEdges);
+
+    p_pool.parallelFor(nbVertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            const Vertex &vertex = ngonMesh.vertices[v];
+            heMesh.vertices.positions[v] = vertex.position;
+            heMesh.vertices.colors[v] = vertex.color;
+            heMesh.vertices.normals[v] = vertex.normal;
+            heMesh.vertices.texCoords[v] = vertex.texCoord;
+        }
+    }, grain);
+
+    // Faces and half-edges
+    ConcurrentEdgeTable edgeTable(nbHalfEdges);
+    p_pool.parallelFor(nbFaces, [&](size_t begin, size_t end) {
+        for (size_t faceIndex = begin; faceIndex < end; ++faceIndex) {
+            const NGonFace &f = ngonMesh.faces[faceIndex];
+            const int firstHalfEdgeIndex = faceOffsets[faceIndex];
+            const int lastHalfEdgeIndex = firstHalfEdgeIndex + int(f.count) - 1;
+            for (unsigned i = 0; i < f.count; ++i) {
+                const int halfEdgeIndex = firstHalfEdgeIndex + int(i);
+                int startVertexIndex = ngonMesh.indices[f.offset + i];
+                int endVertexIndex = ngonMesh.indices[f.offset + (i + 1) % f.count];
+
+                heMesh.halfEdges.vertices[halfEdgeIndex] = endVertexIndex;
+                heMesh.halfEdges.faces[halfEdgeIndex] = int(faceIndex);
+                heMesh.halfEdges.next[halfEdgeIndex] = halfEdgeIndex == lastHalfEdgeIndex ? firstHalfEdgeIndex : halfEdgeIndex + 1;
+                heMesh.halfEdges.prev[halfEdgeIndex] = halfEdgeIndex == firstHalfEdgeIndex ? lastHalfEdgeIndex : halfEdgeIndex - 1;
+                heMesh.vertexFaceIndices[halfEdgeIndex] = startVertexIndex;
+                edgeTable.insert(EdgeTable::packKey(startVertexIndex, endVertexIndex), halfEdgeIndex);
+            }
+            heMesh.faces.edges[faceIndex] = firstHalfEdgeIndex;
+            heMesh.faces.normals[faceIndex] = f.normal;
+            heMesh.faces.centers[faceIndex] = f.center;
+            heMesh.faces.faceAreas[faceIndex] = f.faceArea;
+            heMesh.faces.vertCounts[faceIndex] = int(f.count);
+        }
+    }, grain);
+    heMesh.faces.offsets = std::move(faceOffsets);
+
+    // Twins. The serial pass visits half-edges in order and writes twins[i] = j then twins[j] = i,
+    // so twins[x] ends up with the latest of those writes: the largest i that found x, or x's own lookup if x came after it.
+    std::vector<std::atomic<int>> lastFoundBy(nbHalfEdges);
+    p_pool.parallelFor(nbHalfEdges, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            lastFoundBy[i].store(-1, std::memory_order_relaxed);
+            heMesh.halfEdges.twins[i] = edgeTable.find(EdgeTable::packKey(heMesh.halfEdges.vertices[i], heMesh.vertexFaceIndices[i]));
+        }
+    }, grain);
+    p_pool.parallelFor(nbHalfEdges, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            const int twin = heMesh.halfEdges.twins[i];
+            if (twin == -1) { continue; }
+            int last = lastFoundBy[twin].load(std::memory_order_relaxed);
+            while (last < int(i) && !lastFoundBy[twin].compare_exchange_weak(last, int(i), std::memory_order_relaxed)) {}
+        }
+    }, grain);
+    p_pool.parallelFor(nbHalfEdges, [&](size_t begin, size_t end) {
+        for (size_t x = begin; x < end; ++x) {
+            const int lastFound = lastFoundBy[x].load(std::memory_order_relaxed);
+            if (heMesh.halfEdges.twins[x] == -1 || lastFound > int(x)) { heMesh.halfEdges.twins[x] = lastFound; }
+        }
+    }, grain);
+
+    // Vertex edge index: first half-edge ending at the vertex
+    std::vector<std::atomic<int>> vertexEdges(nbVertices);
+    p_pool.parallelFor(nbVertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) { vertexEdges[v].store(std::numeric_limits<int>::max(), std::memory_order_relaxed); }
+    }, grain);
+    p_pool.parallelFor(nbHalfEdges, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            std::atomic<int> &edge = vertexEdges[heMesh.halfEdges.vertices[i]];
+            int current = edge.load(std::memory_order_relaxed);
+            while (current > int(i) && !edge.compare_exchange_weak(current, int(i), std::memory_order_relaxed)) {}
+        }
+    }, grain);
+    p_pool.parallelFor(nbVertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; ++v) {
+            const int edge = vertexEdges[v].load(std::memory_order_relaxed);
+            heMesh.vertices.edges[v] = edge == std::numeric_limits<int>::max() ? -1 : edge;
+        }
+    }, grain);
+
+    heMesh.nbVertices = uint32(nbVertices);
+    heMesh.nbFaces = uint32(nbFaces);
 
     return heMesh;
 }
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstring>
+#include <type_traits>
+#include <vector>
+
+#include "HalfEdge.hpp"
+#include "defines.hpp"
+
+// Every array of a HalfEdgeMesh in a single buffer of 32-bit words, so that a mesh is one allocation, one upload and
+// one descriptor. The header holds the word offset of each array, then its element count. Arrays start on 16 byte
+// boundaries, vec4 data can be read as vec4.
+// The order is the one of the hePacked* constants in shaderInterface.h: vec4 arrays, vec2, int, then float arrays.
+enum class HePackedArray : uint32 {
+    VERTEX_POSITIONS = 0,
+    VERTEX_COLORS,
+    VERTEX_NORMALS,
+    FACE_NORMALS,
+    FACE_CENTERS,
+    VERTEX_TEXCOORDS,
+    VERTEX_EDGES,
+    FACE_EDGES,
+    FACE_VERT_COUNTS,
+    FACE_OFFSETS,
+    HALF_EDGE_VERTICES,
+    HALF_EDGE_FACES,
+    HALF_EDGE_NEXT,
+    HALF_EDGE_PREV,
+    HALF_EDGE_TWINS,
+    VERTEX_FACE_INDICES,
+    FACE_AREAS,
+    COUNT,
+};
+
+constexpr uint32 hePackedArrayCount = uint32(HePackedArray::COUNT);
+constexpr uint32 hePackedHeaderWords = 2 * hePackedArrayCount; // offsets then element counts
+constexpr uint32 hePackedAlignmentWords = 4;
+
+// Calls p_function on each array of the mesh in packed order
+template <typename Mesh, typename Function>
+inline void forEachHeArray(Mesh &p_mesh, Function &&p_function) {
+    p_function(p_mesh.vertices.positions);
+    p_function(p_mesh.vertices.colors);
+    p_function(p_mesh.vertices.normals);
+    p_function(p_mesh.faces.normals);
+    p_function(p_mesh.faces.centers);
+    p_function(p_mesh.vertices.texCoords);
+    p_function(p_mesh.vertices.edges);
+    p_function(p_mesh.faces.edges);
+    p_function(p_mesh.faces.vertCounts);
+    p_function(p_mesh.faces.offsets);
+    p_function(p_mesh.halfEdges.vertices);
+    p_function(p_mesh.halfEdges.faces);
+    p_function(p_mesh.halfEdges.next);
+    p_function(p_mesh.halfEdges.prev);
+    p_function(p_mesh.halfEdges.twins);
+    p_function(p_mesh.vertexFaceIndices);
+    p_function(p_mesh.faces.faceAreas);
+}
+
+inline uint32 hePackedOffset(const std::vector<uint32> &p_packed, HePackedArray p_array) { return p_packed[uint32(p_array)]; }
+inline uint32 hePackedCount(const std::vector<uint32> &p_packed, HePackedArray p_array) { return p_packed[hePackedArrayCount + uint32(p_array)]; }
+
+inline std::vector<uint32> packHalfEdgeMesh(const HalfEdgeMesh &p_mesh) {
+    auto alignWords = [](size_t p_words) { return (p_words + hePackedAlignmentWords - 1) / hePackedAlignmentWords * hePackedAlignmentWords; };
+
+    std::vector<uint32> header(hePackedHeaderWords);
+    size_t words = alignWords(hePackedHeaderWords);
+    uint32 array = 0;
+    forEachHeArray(p_mesh, [&](const auto &p_data) {
+        using T = typename std::decay_t<decltype(p_data)>::value_type;
+        static_assert(sizeof(T) % sizeof(uint32) == 0, "Packed arrays are made of 32-bit words");
+        header[array] = uint32(words);
+        header[hePackedArrayCount + array] = uint32(p_data.size());
+        words = alignWords(words + p_data.size() * sizeof(T) / sizeof(uint32));
+        array++;
+    });
+
+    std::vector<uint32> packed(words, 0);
+    memcpy(packed.data(), header.data(), header.size() * sizeof(uint32));
+    array = 0;
+    forEachHeArray(p_mesh, [&](const auto &p_data) {
+        if (!p_data.empty()) { memcpy(&packed[header[array]], p_data.data(), p_data.size() * sizeof(p_data[0])); }
+        array++;
+    });
+    return packed;
+}
+
+inline HalfEdgeMesh unpackHalfEdgeMesh(const std::vector<uint32> &p_packed) {
+    HalfEdgeMesh mesh;
+    uint32 array = 0;
+    forEachHeArray(mesh, [&](auto &p_data) {
+        const uint32 count = hePackedCount(p_packed, HePackedArray(array));
+        p_data.resize(count);
+        if (count > 0) { memcpy(p_data.data(), &p_packed[hePackedOffset(p_packed, HePackedArray(array))], count * sizeof(p_data[0])); }
+        array++;
+    });
+    mesh.nbVertices = uint32(mesh.vertices.positions.size());
+    mesh.nbFaces = uint32(mesh.faces.edges.size());
+    return mesh;
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "HalfEdge.hpp"
+#include "defines.hpp"
+
+// Element order used by the task shaders: faces sorted along a Morton curve of their centers,
+// vertices numbered by first use in that face order. Orders map new index -> old index.
+struct MeshReordering {
+    std::vector<int> faceOrder;
+    std::vector<int> vertexOrder;
+    std::vector<int> vertexRemap; // old index -> new index
+};
+
+// Average index distance between neighbouring elements, lower is better for caches
+struct LocalityStats {
+    double faceNeighbourDistance = 0; // |f - g| over every pair of faces sharing an edge
+    double faceVertexSpan = 0;        // max - min vertex index inside a face
+};
+
+// Spreads the 10 low bits of p_value so that two zero bits separate each of them
+inline uint32 expandBits10(uint32 p_value) {
+    p_value &= 0x3ff;
+    p_value = (p_value | (p_value << 16)) & 0x030000ff;
+    p_value = (p_value | (p_value << 8)) & 0x0300f00f;
+    p_value = (p_value | (p_value << 4)) & 0x030c30c3;
+    p_value = (p_value | (p_value << 2)) & 0x09249249;
+    return p_value;
+}
+
+// 30 bit Morton code of a point normalized in [0, 1]^3
+inline uint32 mortonCode(vec3 p_position) {
+    const vec3 cell = glm::clamp(p_position * 1024.0f, vec3(0.0f), vec3(1023.0f));
+    return (expandBits10(uint32(cell.x)) << 2) | (expandBits10(uint32(cell.y)) << 1) | expandBits10(uint32(cell.z));
+}
+
+inline MeshReordering computeLocalityOrder(const HalfEdgeMesh &p_mesh) {
+    MeshReordering order;
+    const size_t nbFaces = p_mesh.faces.centers.size();
+    const size_t nbVertices = p_mesh.vertices.positions.size();
+
+    // bounding box of the face centers
+    vec3 boxMin(std::numeric_limits<float>::max()), boxMax(std::numeric_limits<float>::lowest());
+    for (const vec4 &center : p_mesh.faces.centers) {
+        boxMin = glm::min(boxMin, vec3(center));
+        boxMax = glm::max(boxMax, vec3(center));
+    }
+    const vec3 extent = glm::max(boxMax - boxMin, vec3(1e-12f));
+
+    // sort faces by (morton code, original index), ties keep the file order
+    std::vector<uint64> keys(nbFaces);
+    for (size_t f = 0; f < nbFaces; ++f) { keys[f] = (uint64(mortonCode((vec3(p_mesh.faces.centers[f]) - boxMin) / extent)) << 32) | uint32(f); }
+    std::sort(keys.begin(), keys.end());
+    order.faceOrder.resize(nbFaces);
+    for (size_t f = 0; f < nbFaces; ++f) { order.faceOrder[f] = int(uint32(keys[f])); }
+
+    // vertices by first use, unused vertices keep their relative order at the end
+    order.vertexRemap.assign(nbVertices, -1);
+    order.vertexOrder.clear();
+    order.vertexOrder.reserve(nbVertices);
+    for (int face : order.faceOrder) {
+        const int offset = p_mesh.faces.offsets[face];
+        for (int i = 0; i < p_mesh.faces.vertCounts[face]; ++i) {
+            const int vertex = p_mesh.vertexFaceIndices[offset + i];
+            if (order.vertexRemap[vertex] != -1) { continue; }
+            order.vertexRemap[vertex] = int(order.vertexOrder.size());
+            order.vertexOrder.push_back(vertex);
+        }
+    }
+    for (size_t v = 0; v < nbVertices; ++v) {
+        if (order.vertexRemap[v] != -1) { continue; }
+        order.vertexRemap[v] = int(order.vertexOrder.size());
+        order.vertexOrder.push_back(int(v));
+    }
+    return order;
+}
+
+// Gathers p_data in the new order
+template <typename T>
+std::vector<T> permute(const std::vector<T> &p_data, const std::vector<int> &p_newToOld) {
+    if (p_data.empty()) { return {}; }
+    std::vector<T> result(p_newToOld.size());
+    for (size_t i = 0; i < p_newToOld.size(); ++i) { result[i] = p_data[p_newToOld[i]]; }
+    return result;
+}
+
+// Rebuilds p_mesh in the given order. Half-edges stay contiguous per face and keep their order inside the face,
+// every index (vertices, faces, next, prev, twins, edges) is remapped.
+inline HalfEdgeMesh applyReordering(const HalfEdgeMesh &p_mesh, const MeshReordering &p_order) {
+    HalfEdgeMesh result;
+    const size_t nbFaces = p_order.faceOrder.size();
+    const size_t nbHalfEdges = p_mesh.halfEdges.vertices.size();
+    auto remapIndex = [](const std::vector<int> &p_remap, int p_index) { return p_index < 0 ? p_index : p_remap[p_index]; };
+
+    // new half-edge numbering follows the new face order
+    std::vector<int> faceRemap(nbFaces);
+    std::vector<int> halfEdgeRemap(nbHalfEdges);
+    std::vector<int> halfEdgeOrder(nbHalfEdges);
+    result.faces.offsets.resize(nbFaces);
+    int halfEdgeIndex = 0;
+    for (size_t f = 0; f < nbFaces; ++f) {
+        const int oldFace = p_order.faceOrder[f];
+        faceRemap[oldFace] = int(f);
+        result.faces.offsets[f] = halfEdgeIndex;
+        for (int i = 0; i < p_mesh.faces.vertCounts[oldFace]; ++i, ++halfEdgeIndex) {
+            halfEdgeRemap[p_mesh.faces.offsets[oldFace] + i] = halfEdgeIndex;
+            halfEdgeOrder[halfEdgeIndex] = p_mesh.faces.offsets[oldFace] + i;
+        }
+    }
+
+    result.vertices.positions = permute(p_mesh.vertices.positions, p_order.vertexOrder);
+    result.vertices.colors = permute(p_mesh.vertices.colors, p_order.vertexOrder);
+    result.vertices.normals = permute(p_mesh.vertices.normals, p_order.vertexOrder);
+    result.vertices.texCoords = permute(p_mesh.vertices.texCoords, p_order.vertexOrder);
+    result.vertices.edges = permute(p_mesh.vertices.edges, p_order.vertexOrder);
+    for (int &edge : result.vertices.edges) { edge = remapIndex(halfEdgeRemap, edge); }
+
+    result.faces.edges = permute(p_mesh.faces.edges, p_order.faceOrder);
+    for (int &edge : result.faces.edges) { edge = remapIndex(halfEdgeRemap, edge); }
+    result.faces.vertCounts = permute(p_mesh.faces.vertCounts, p_order.faceOrder);
+    result.faces.normals = permute(p_mesh.faces.normals, p_order.faceOrder);
+    result.faces.centers = permute(p_mesh.faces.centers, p_order.faceOrder);
+    result.faces.faceAreas = permute(p_mesh.faces.faceAreas, p_order.faceOrder);
+
+    result.halfEdges.vertices.resize(nbHalfEdges);
+    result.halfEdges.faces.resize(nbHalfEdges);
+    result.halfEdges.next.resize(nbHalfEdges);
+    result.halfEdges.prev.resize(nbHalfEdges);
+    result.halfEdges.twins.resize(nbHalfEdges);
+    result.vertexFaceIndices.resize(nbHalfEdges);
+    for (size_t he = 0; he < nbHalfEdges; ++he) {
+        const int oldHalfEdge = halfEdgeOrder[he];
+        result.halfEdges.vertices[he] = remapIndex(p_order.vertexRemap, p_mesh.halfEdges.vertices[oldHalfEdge]);
+        result.halfEdges.faces[he] = remapIndex(faceRemap, p_mesh.halfEdges.faces[oldHalfEdge]);
+        result.halfEdges.next[he] = remapIndex(halfEdgeRemap, p_mesh.halfEdges.next[oldHalfEdge]);
+        result.halfEdges.prev[he] = remapIndex(halfEdgeRemap, p_mesh.halfEdges.prev[oldHalfEdge]);
+        result.halfEdges.twins[he] = remapIndex(halfEdgeRemap, p_mesh.halfEdges.twins[oldHalfEdge]);
+        result.vertexFaceIndices[he] = remapIndex(p_order.vertexRemap, p_mesh.vertexFaceIndices[oldHalfEdge]);
+    }
+
+    result.nbVertices = p_mesh.nbVertices;
+    result.nbFaces = p_mesh.nbFaces;
+    return result;
+}
+
+inline LocalityStats computeLocalityStats(const HalfEdgeMesh &p_mesh) {
+    LocalityStats stats;
+    size_t pairCount = 0;
+    for (size_t he = 0; he < p_mesh.halfEdges.twins.size(); ++he) {
+        const int twin = p_mesh.halfEdges.twins[he];
+        if (twin < 0) { continue; }
+        stats.faceNeighbourDistance += std::abs(double(p_mesh.halfEdges.faces[he]) - double(p_mesh.halfEdges.faces[twin]));
+        pairCount++;
+    }
+    if (pairCount > 0) { stats.faceNeighbourDistance /= double(pairCount); }
+
+    const size_t nbFaces = p_mesh.faces.offsets.size();
+    for (size_t f = 0; f < nbFaces; ++f) {
+        const auto begin = p_mesh.vertexFaceIndices.begin() + p_mesh.faces.offsets[f];
+        const auto range = std::minmax_element(begin, begin + p_mesh.faces.vertCounts[f]);
+        stats.faceVertexSpan += double(*range.second - *range.first);
+    }
+    if (nbFaces > 0) { stats.faceVertexSpan /= double(nbFaces); }
+    return stats;
+}
@@ -0,0 +1,239 @@
+#include "MemoryAllocator.hpp"
+
+#include <algorithm>
+#include <tuple>
+
+static uint64 alignUp(uint64 p_value, uint64 p_alignment) { return (p_value + p_alignment - 1) & ~(p_alignment - 1); }
+
+static uint64 nextPowerOfTwo(uint64 p_value) {
+    uint64 res = 1;
+    while (res < p_value) { res <<= 1; }
+    return res;
+}
+
+uint32 findMemoryType(const std::vector<MemoryTypeInfo> &p_types, uint32 p_typeBits, uint32 p_requiredFlags) {
+    for (uint32 i = 0; i < p_types.size(); i++) { if ((p_typeBits & (1u << i)) && (p_types[i].propertyFlags & p_requiredFlags) == p_requiredFlags) { return i; } }
+    return ~0U;
+}
+
+void MemoryAllocator::init(const std::vector<MemoryTypeInfo> &p_types, AllocateBlockFn p_allocateBlock, FreeBlockFn p_freeBlock, const MemoryAllocatorConfig &p_config) {
+    ASSERT((p_config.buddyBlockSize & (p_config.buddyBlockSize - 1)) == 0 && (p_config.buddyMinAllocation & (p_config.buddyMinAllocation - 1)) == 0, "Buddy sizes must be powers of two");
+    m_types = p_types;
+    m_allocateBlock = std::move(p_allocateBlock);
+    m_freeBlock = std::move(p_freeBlock);
+    m_config = p_config;
+}
+
+void MemoryAllocator::cleanup() {
+    for (uint32 i = 0; i < m_blocks.size(); i++) { if (m_blocks[i].live) { releaseBlock(i); } }
+}
+
+MemoryAllocation MemoryAllocator::allocate(uint64 p_size, uint64 p_alignment, uint32 p_typeBits, uint32 p_requiredFlags, bool p_linear) {
+    ASSERT(p_alignment != 0 && (p_alignment & (p_alignment - 1)) == 0, "Alignment must be a power of two");
+    // the first matching type is the preferred one, the next ones are fallbacks when its heap is full
+    for (uint32 type = 0; type < m_types.size(); type++) {
+        if (!(p_typeBits & (1u << type)) || (m_types[type].propertyFlags & p_requiredFlags) != p_requiredFlags) { continue; }
+        const MemoryAllocation allocation = allocateInType(type, p_size, p_alignment, p_linear);
+        if (allocation.valid()) { return allocation; }
+    }
+    return {};
+}
+
+MemoryAllocation MemoryAllocator::allocateInType(uint32 p_memoryType, uint64 p_size, uint64 p_alignment, bool p_linear) {
+    MemoryAllocation allocation;
+    allocation.memoryType = p_memoryType;
+    allocation.size = p_size;
+
+    if (p_size > m_config.freeListBlockSize / 2) {
+        const uint32 id = createBlock(BlockKind::DEDICATED, p_memoryType, p_linear, p_size);
+        if (id == ~0U) { return {}; }
+        m_blocks[id].usedBytes = p_size;
+        m_blocks[id].allocationCount = 1;
+        allocation.block = id;
+        allocation.rangeSize = p_size;
+        return allocation;
+    }
+
+    const BlockKind kind = p_size <= m_config.buddyMaxAllocation && p_alignment <= m_config.buddyBlockSize ? BlockKind::BUDDY : BlockKind::FREE_LIST;
+    for (uint32 i = 0; i < m_blocks.size(); i++) {
+        Block &block = m_blocks[i];
+        if (!block.live || block.kind != kind || block.memoryType != p_memoryType || block.linear != p_linear) { continue; }
+        if (allocateFromBlock(block, p_size, p_alignment, allocation)) {
+            allocation.block = i;
+            return allocation;
+        }
+    }
+
+    // new block, free-list blocks shrink down to the request when the heap is almost full
+    uint32 id = ~0U;
+    if (kind == BlockKind::BUDDY) {
+        id = createBlock(kind, p_memoryType, p_linear, m_config.buddyBlockSize);
+    } else {
+        for (uint64 size = m_config.freeListBlockSize; id == ~0U && size >= p_size + p_alignment; size /= 2) { id = createBlock(kind, p_memoryType, p_linear, size); }
+    }
+    if (id == ~0U) { return {}; }
+    const bool fits = allocateFromBlock(m_blocks[id], p_size, p_alignment, allocation);
+    ASSERT(fits, "Fresh memory block too small");
+    allocation.block = id;
+    return allocation;
+}
+
+bool MemoryAllocator::allocateFromBlock(Block &p_block, uint64 p_size, uint64 p_alignment, MemoryAllocation &p_allocation) const {
+    if (p_block.kind == BlockKind::BUDDY) {
+        // buddy ranges are aligned on their own size
+        const uint32 order = buddyOrder(std::max({nextPowerOfTwo(p_size), m_config.buddyMinAllocation, p_alignment}));
+        uint32 freeOrder = order;
+        while (freeOrder < p_block.buddyFree.size() && p_block.buddyFree[freeOrder].empty()) { freeOrder++; }
+        if (freeOrder >= p_block.buddyFree.size()) { return false; }
+
+        const uint64 offset = *p_block.buddyFree[freeOrder].begin();
+        p_block.buddyFree[freeOrder].erase(p_block.buddyFree[freeOrder].begin());
+        while (freeOrder > order) {
+            freeOrder--;
+            p_block.buddyFree[freeOrder].insert(offset + (m_config.buddyMinAllocation << freeOrder));
+        }
+        p_allocation.offset = offset;
+        p_allocation.rangeOffset = offset;
+        p_allocation.rangeSize = m_config.buddyMinAllocation << order;
+    } else {
+        auto it = p_block.freeRanges.begin();
+        for (; it != p_block.freeRanges.end(); ++it) {
+            if (alignUp(it->first, p_alignment) + p_size <= it->first + it->second) { break; }
+        }
+        if (it == p_block.freeRanges.end()) { return false; }
+
+        const uint64 rangeOffset = it->first, rangeEnd = it->first + it->second;
+        const uint64 offset = alignUp(rangeOffset, p_alignment);
+        p_block.freeRanges.erase(it);
+        if (offset + p_size < rangeEnd) { p_block.freeRanges.emplace(offset + p_size, rangeEnd - offset - p_size); }
+        p_allocation.offset = offset;
+        p_allocation.rangeOffset = rangeOffset;
+        p_allocation.rangeSize = offset + p_size - rangeOffset;
+    }
+    p_block.usedBytes += p_allocation.rangeSize;
+    p_block.allocationCount++;
+    return true;
+}
+
+void MemoryAllocator::free(const MemoryAllocation &p_allocation) {
+    if (!p_allocation.valid()) { return; }
+    Block &block = m_blocks[p_allocation.block];
+    ASSERT(block.live && block.allocationCount > 0, "Freeing an allocation twice");
+    block.usedBytes -= p_allocation.rangeSize;
+    block.allocationCount--;
+
+    if (block.kind == BlockKind::BUDDY) {
+        uint32 order = buddyOrder(p_allocation.rangeSize);
+        uint64 offset = p_allocation.rangeOffset;
+        while (order + 1 < block.buddyFree.size()) {
+            const uint64 buddy = offset ^ (m_config.buddyMinAllocation << order);
+            if (block.buddyFree[order].erase(buddy) == 0) { break; }
+            offset = std::min(offset, buddy);
+            order++;
+        }
+        block.buddyFree[order].insert(offset);
+    } else if (block.kind == BlockKind::FREE_LIST) {
+        uint64 offset = p_allocation.rangeOffset, size = p_allocation.rangeSize;
+        auto next = block.freeRanges.lower_bound(offset);
+        if (next != block.freeRanges.end() && offset + size == next->first) {
+            size += next->second;
+            next = block.freeRanges.erase(next);
+        }
+        if (next != block.freeRanges.begin()) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == offset) {
+                offset = prev->first;
+                size += prev->second;
+                block.freeRanges.erase(prev);
+            }
+        }
+        block.freeRanges.emplace(offset, size);
+    }
+
+    if (block.allocationCount > 0) { return; }
+    // keep one empty block per pool so that a free followed by an allocate does not go back to the device
+    const bool otherEmptyBlock = std::any_of(m_blocks.begin(), m_blocks.end(), [&](const Block &b) { return &b != &block && b.live && b.allocationCount == 0 && b.kind == block.kind && b.memoryType == block.memoryType && b.linear == block.linear; });
+    if (block.kind == BlockKind::DEDICATED || otherEmptyBlock) { releaseBlock(p_allocation.block); }
+}
+
+uint32 MemoryAllocator::createBlock(BlockKind p_kind, uint32 p_memoryType, bool p_linear, uint64 p_size) {
+    uint32 id;
+    if (!m_freeBlockIds.empty()) {
+        id = m_freeBlockIds.back();
+        m_freeBlockIds.pop_back();
+    } else {
+        id = uint32(m_blocks.size());
+        m_blocks.emplace_back();
+    }
+    if (!m_allocateBlock(id, p_memoryType, p_size)) {
+        m_freeBlockIds.push_back(id);
+        return ~0U;
+    }
+
+    Block &block = m_blocks[id];
+    block = Block{};
+    block.live = true;
+    block.kind = p_kind;
+    block.memoryType = p_memoryType;
+    block.linear = p_linear;
+    block.size = p_size;
+    if (p_kind == BlockKind::FREE_LIST) { block.freeRanges.emplace(0, p_size); }
+    if (p_kind == BlockKind::BUDDY) {
+        block.buddyFree.resize(buddyOrder(p_size) + 1);
+        block.buddyFree.back().insert(0);
+    }
+    m_deviceAllocations++;
+    m_reservedBytes += p_size;
+    m_peakReservedBytes = std::max(m_peakReservedBytes, m_reservedBytes);
+    return id;
+}
+
+void MemoryAllocator::releaseBlock(uint32 p_block) {
+    m_freeBlock(p_block);
+    m_reservedBytes -= m_blocks[p_block].size;
+    m_blocks[p_block] = Block{};
+    m_freeBlockIds.push_back(p_block);
+    m_deviceFrees++;
+}
+
+uint32 MemoryAllocator::buddyOrder(uint64 p_size) const {
+    uint32 order = 0;
+    while ((m_config.buddyMinAllocation << order) < p_size) { order++; }
+    return order;
+}
+
+MemoryAllocator::Stats MemoryAllocator::getStats() const {
+    Stats stats;
+    stats.deviceAllocations = m_deviceAllocations;
+    stats.deviceFrees = m_deviceFrees;
+    stats.peakReservedBytes = m_peakReservedBytes;
+
+    std::map<std::tuple<BlockKind, uint32, bool>, std::pair<uint32, uint64>> pools; // block count and used bytes per pool
+    for (const Block &block : m_blocks) {
+        if (!block.live) { continue; }
+        stats.liveBlocks++;
+        stats.allocationCount += block.allocationCount;
+        stats.reservedBytes += block.size;
+        stats.usedBytes += block.usedBytes;
+        if (block.kind == BlockKind::DEDICATED) { continue; }
+
+        auto &pool = pools[{block.kind, block.memoryType, block.linear}];
+        pool.first++;
+        pool.second += block.usedBytes;
+        auto addFreeRange = [&](uint64 p_size) {
+            stats.freeRangeCount++;
+            stats.freeBytes += p_size;
+            stats.largestFreeRange = std::max(stats.largestFreeRange, p_size);
+        };
+        for (const auto &[offset, size] : block.freeRanges) { addFreeRange(size); }
+        for (uint32 order = 0; order < block.buddyFree.size(); order++) {
+            for (size_t i = 0; i < block.buddyFree[order].size(); i++) { addFreeRange(m_config.buddyMinAllocation << order); }
+        }
+    }
+    for (const auto &[key, pool] : pools) {
+        const uint64 blockSize = std::get<0>(key) == BlockKind::BUDDY ? m_config.buddyBlockSize : m_config.freeListBlockSize;
+        const uint32 neededBlocks = uint32((pool.second + blockSize - 1) / blockSize);
+        stats.reclaimableBlocks += pool.first > neededBlocks ? pool.first - neededBlocks : 0;
+    }
+    return stats;
+}
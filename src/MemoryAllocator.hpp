@@ -0,0 +1,112 @@
+#pragma once
+
+#include <functional>
+#include <map>
+#include <set>
+#include <vector>
+
+#include "defines.hpp"
+
+// Memory type as reported by the device. The property flags use the VkMemoryPropertyFlagBits values so that the
+// table can be filled from vk::PhysicalDeviceMemoryProperties or by hand.
+struct MemoryTypeInfo {
+    uint32 propertyFlags = 0;
+    uint32 heapIndex = 0;
+};
+
+// First type allowed by p_typeBits that has all p_requiredFlags, ~0U if there is none
+uint32 findMemoryType(const std::vector<MemoryTypeInfo> &p_types, uint32 p_typeBits, uint32 p_requiredFlags);
+
+struct MemoryAllocation {
+    uint32 memoryType = ~0U;
+    uint32 block = ~0U;     // id of the device memory block
+    uint64 offset = 0;      // aligned offset of the resource in the block
+    uint64 size = 0;
+    uint64 rangeOffset = 0; // range taken in the block, alignment padding and buddy rounding included
+    uint64 rangeSize = 0;
+
+    bool valid() const { return block != ~0U; }
+};
+
+struct MemoryAllocatorConfig {
+    uint64 freeListBlockSize = 64ull << 20;
+    uint64 buddyBlockSize = 8ull << 20;       // power of two
+    uint64 buddyMaxAllocation = 256ull << 10; // larger requests go to the free-list blocks
+    uint64 buddyMinAllocation = 256;          // power of two
+};
+
+// Sub-allocates resources from a few large device memory blocks per memory type. Small resources go to buddy blocks,
+// the others are placed first fit in free-list blocks, and resources bigger than half a free-list block get a
+// dedicated one. Linear (buffers) and optimal (images) resources never share a block, which keeps them apart without
+// having to deal with bufferImageGranularity.
+// The allocator itself never talks to the device: blocks are created and released through the two callbacks, keyed
+// by block id.
+class MemoryAllocator {
+public:
+    enum class BlockKind : uint8 {
+        FREE_LIST = 0,
+        BUDDY = 1,
+        DEDICATED = 2,
+    };
+
+    struct Stats {
+        uint64 deviceAllocations = 0; // block allocations since init, including the ones already released
+        uint64 deviceFrees = 0;
+        uint32 liveBlocks = 0;
+        uint32 allocationCount = 0;
+        uint64 reservedBytes = 0; // sum of the live block sizes
+        uint64 usedBytes = 0;     // sum of the allocation ranges
+        uint64 peakReservedBytes = 0;
+        // defragmentation statistics over the free-list and buddy blocks
+        uint32 freeRangeCount = 0;
+        uint64 freeBytes = 0;
+        uint64 largestFreeRange = 0;
+        uint32 reclaimableBlocks = 0; // blocks a full compaction would release
+
+        float fragmentation() const { return freeBytes == 0 ? 0.0f : 1.0f - float(largestFreeRange) / float(freeBytes); }
+    };
+
+    // Creates block p_block of p_size bytes in p_memoryType, returns false when the device is out of memory
+    using AllocateBlockFn = std::function<bool(uint32 p_block, uint32 p_memoryType, uint64 p_size)>;
+    using FreeBlockFn = std::function<void(uint32 p_block)>;
+
+    void init(const std::vector<MemoryTypeInfo> &p_types, AllocateBlockFn p_allocateBlock, FreeBlockFn p_freeBlock, const MemoryAllocatorConfig &p_config = {});
+    void cleanup(); // releases every block, the allocations are all invalid afterwards
+
+    // p_alignment must be a power of two. Returns an invalid allocation when no memory type can hold the resource.
+    MemoryAllocation allocate(uint64 p_size, uint64 p_alignment, uint32 p_typeBits, uint32 p_requiredFlags, bool p_linear);
+    void free(const MemoryAllocation &p_allocation);
+
+    Stats getStats() const;
+    const std::vector<MemoryTypeInfo> &getMemoryTypes() const { return m_types; }
+
+private:
+    struct Block {
+        bool live = false;
+        BlockKind kind = BlockKind::FREE_LIST;
+        uint32 memoryType = 0;
+        bool linear = true;
+        uint64 size = 0;
+        uint64 usedBytes = 0;
+        uint32 allocationCount = 0;
+        std::map<uint64, uint64> freeRanges;     // FREE_LIST: offset -> size, neighbours are always merged
+        std::vector<std::set<uint64>> buddyFree; // BUDDY: free offsets per order, order 0 is buddyMinAllocation
+    };
+
+    MemoryAllocation allocateInType(uint32 p_memoryType, uint64 p_size, uint64 p_alignment, bool p_linear);
+    uint32 createBlock(BlockKind p_kind, uint32 p_memoryType, bool p_linear, uint64 p_size);
+    void releaseBlock(uint32 p_block);
+    bool allocateFromBlock(Block &p_block, uint64 p_size, uint64 p_alignment, MemoryAllocation &p_allocation) const;
+    uint32 buddyOrder(uint64 p_size) const;
+
+    std::vector<MemoryTypeInfo> m_types;
+    AllocateBlockFn m_allocateBlock;
+    FreeBlockFn m_freeBlock;
+    MemoryAllocatorConfig m_config;
+    std::vector<Block> m_blocks;
+    std::vector<uint32> m_freeBlockIds;
+    uint64 m_deviceAllocations = 0;
+    uint64 m_deviceFrees = 0;
+    uint64 m_reservedBytes = 0;
+    uint64 m_peakReservedBytes = 0;
+};
@@ -0,0 +1,285 @@
+#include "OcclusionCulling.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+
+#if OCCLUSION_SSE
+#include <emmintrin.h>
+#endif
+
+void OcclusionBuffer::resize(uint32 p_width, uint32 p_height) {
+    m_width = std::max(p_width, 1u);
+    m_height = std::max(p_height, 1u);
+    m_tilesX = (m_width + tileWidth - 1) / tileWidth;
+    m_tilesY = (m_height + tileHeight - 1) / tileHeight;
+    m_stride = m_tilesX * tileWidth;
+    m_depth.assign(size_t(m_stride) * m_tilesY * tileHeight, clearDepth);
+    m_bins.assign(m_tilesX * m_tilesY, {});
+}
+
+void OcclusionBuffer::rasterize(const std::vector<vec3> &p_positions, const std::vector<uint32> &p_triangles, const mat4 &p_mvp, ThreadPool &p_pool) {
+    auto start = std::chrono::high_resolution_clock::now();
+    const vec2 viewport = vec2(m_width, m_height);
+
+    m_screenVertices.resize(p_positions.size());
+    p_pool.parallelFor(p_positions.size(), [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            const vec4 clip = p_mvp * vec4(p_positions[i], 1.0f);
+            if (clip.w <= nearW) {
+                m_screenVertices[i] = vec4(0.0f, 0.0f, 0.0f, -1.0f);
+                continue;
+            }
+            const vec3 ndc = vec3(clip) / clip.w;
+            m_screenVertices[i] = vec4((vec2(ndc) * 0.5f + 0.5f) * viewport, ndc.z, 1.0f);
+        }
+    }, 1024);
+
+    // edge functions and depth plane, invalid triangles get an empty box
+    const size_t triangleCount = p_triangles.size() / 3;
+    m_triangles.resize(triangleCount);
+    p_pool.parallelFor(triangleCount, [&](size_t begin, size_t end) {
+        for (size_t t = begin; t < end; t++) {
+            Triangle &triangle = m_triangles[t];
+            triangle.minX = triangle.minY = 0;
+            triangle.maxX = triangle.maxY = -1;
+            const vec4 &v0 = m_screenVertices[p_triangles[3 * t]];
+            const vec4 &v1 = m_screenVertices[p_triangles[3 * t + 1]];
+            const vec4 &v2 = m_screenVertices[p_triangles[3 * t + 2]];
+            // a vertex behind the camera would need clipping, not drawing the triangle keeps the buffer conservative
+            if (v0.w < 0.0f || v1.w < 0.0f || v2.w < 0.0f) { continue; }
+            const float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+            if (area == 0.0f || !std::isfinite(area)) { continue; }
+
+            // both windings are drawn, the occluder does not have to be closed
+            const float sign = area > 0.0f ? 1.0f : -1.0f;
+            const vec4 *vertices[3] = {&v0, &v1, &v2};
+            for (int e = 0; e < 3; e++) {
+                const vec4 &a = *vertices[e];
+                const vec4 &b = *vertices[(e + 1) % 3];
+                triangle.edgeX[e] = sign * (a.y - b.y);
+                triangle.edgeY[e] = sign * (b.x - a.x);
+                triangle.edgeC[e] = sign * (a.x * b.y - a.y * b.x);
+            }
+            const float dzdx = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+            const float dzdy = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+            triangle.depthPlane = vec3(dzdx, dzdy, v0.z - dzdx * v0.x - dzdy * v0.y);
+
+            triangle.minX = std::max(int(std::floor(std::min({v0.x, v1.x, v2.x}))), 0);
+            triangle.minY = std::max(int(std::floor(std::min({v0.y, v1.y, v2.y}))), 0);
+            triangle.maxX = std::min(int(std::floor(std::max({v0.x, v1.x, v2.x}))), int(m_width) - 1);
+            triangle.maxY = std::min(int(std::floor(std::max({v0.y, v1.y, v2.y}))), int(m_height) - 1);
+        }
+    }, 1024);
+
+    // binning stays serial, it is a fraction of the rasterization and keeps the bins in triangle order
+    m_stats = {};
+    for (std::vector<uint32> &bin : m_bins) { bin.clear(); }
+    for (uint32 t = 0; t < triangleCount; t++) {
+        const Triangle &triangle = m_triangles[t];
+        if (triangle.maxX < triangle.minX || triangle.maxY < triangle.minY) { continue; }
+        m_stats.triangles++;
+        for (int ty = triangle.minY / int(tileHeight); ty <= triangle.maxY / int(tileHeight); ty++) {
+            for (int tx = triangle.minX / int(tileWidth); tx <= triangle.maxX / int(tileWidth); tx++) {
+                m_bins[ty * m_tilesX + tx].push_back(t);
+                m_stats.binnedTiles++;
+            }
+        }
+    }
+
+    p_pool.parallelFor(m_bins.size(), [&](size_t begin, size_t end) {
+        for (size_t tile = begin; tile < end; tile++) { rasterizeTile(uint32(tile)); }
+    });
+    m_stats.rasterMs = static_cast<float>(millisecondsD(std::chrono::high_resolution_clock::now() - start).count());
+}
+
+void OcclusionBuffer::rasterizeTile(uint32 p_tile) {
+    const int tileX = int(p_tile % m_tilesX * tileWidth);
+    const int tileY = int(p_tile / m_tilesX * tileHeight);
+    for (uint32 y = 0; y < tileHeight; y++) { std::fill_n(&m_depth[(tileY + y) * m_stride + tileX], tileWidth, clearDepth); }
+
+    for (uint32 t : m_bins[p_tile]) {
+        const Triangle &triangle = m_triangles[t];
+        // spans start on a multiple of 4 inside the tile, pixels past the box fail the edge tests
+        const int minX = std::max(triangle.minX, tileX) & ~3;
+        const int maxX = std::min(triangle.maxX, tileX + int(tileWidth) - 1);
+        const int minY = std::max(triangle.minY, tileY);
+        const int maxY = std::min(triangle.maxY, tileY + int(tileHeight) - 1);
+        for (int y = minY; y <= maxY; y++) {
+            const float py = float(y) + 0.5f;
+            float *row = &m_depth[y * m_stride];
+#if OCCLUSION_SSE
+            const __m128 rowEdge0 = _mm_set1_ps(triangle.edgeY[0] * py + triangle.edgeC[0]);
+            const __m128 rowEdge1 = _mm_set1_ps(triangle.edgeY[1] * py + triangle.edgeC[1]);
+            const __m128 rowEdge2 = _mm_set1_ps(triangle.edgeY[2] * py + triangle.edgeC[2]);
+            const __m128 rowDepth = _mm_set1_ps(triangle.depthPlane.y * py + triangle.depthPlane.z);
+            const __m128 edgeX0 = _mm_set1_ps(triangle.edgeX[0]);
+            const __m128 edgeX1 = _mm_set1_ps(triangle.edgeX[1]);
+            const __m128 edgeX2 = _mm_set1_ps(triangle.edgeX[2]);
+            const __m128 dzdx = _mm_set1_ps(triangle.depthPlane.x);
+            const __m128 zero = _mm_setzero_ps();
+            for (int x = minX; x <= maxX; x += 4) {
+                const __m128 px = _mm_add_ps(_mm_set1_ps(float(x)), _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f));
+                __m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX0, px), rowEdge0), zero);
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX1, px), rowEdge1), zero));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(edgeX2, px), rowEdge2), zero));
+                if (_mm_movemask_ps(inside) == 0) { continue; }
+                const __m128 depth = _mm_add_ps(_mm_mul_ps(dzdx, px), rowDepth);
+                const __m128 previous = _mm_loadu_ps(row + x);
+                const __m128 nearest = _mm_min_ps(previous, depth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearest), _mm_andnot_ps(inside, previous)));
+            }
+#else
+            const float rowEdge0 = triangle.edgeY[0] * py + triangle.edgeC[0];
+            const float rowEdge1 = triangle.edgeY[1] * py + triangle.edgeC[1];
+            const float rowEdge2 = triangle.edgeY[2] * py + triangle.edgeC[2];
+            const float rowDepth = triangle.depthPlane.y * py + triangle.depthPlane.z;
+            for (int x = minX; x <= maxX; x++) {
+                const float px = float(x) + 0.5f;
+                if (triangle.edgeX[0] * px + rowEdge0 < 0.0f || triangle.edgeX[1] * px + rowEdge1 < 0.0f || triangle.edgeX[2] * px + rowEdge2 < 0.0f) { continue; }
+                row[x] = std::min(row[x], triangle.depthPlane.x * px + rowDepth);
+            }
+#endif
+        }
+    }
+}
+
+bool OcclusionBuffer::isOccluded(vec3 p_boxMin, vec3 p_boxMax, const mat4 &p_mvp) const {
+    vec2 screenMin(std::numeric_limits<float>::max());
+    vec2 screenMax(-std::numeric_limits<float>::max());
+    float nearestDepth = std::numeric_limits<float>::max();
+    const vec2 viewport = vec2(m_width, m_height);
+    // corners as the projected center plus or minus the projected half extents, one matrix product per box
+    const vec3 halfExtent = (p_boxMax - p_boxMin) * 0.5f;
+    const vec4 center = p_mvp * vec4((p_boxMin + p_boxMax) * 0.5f, 1.0f);
+    const vec4 axisX = p_mvp[0] * halfExtent.x, axisY = p_mvp[1] * halfExtent.y, axisZ = p_mvp[2] * halfExtent.z;
+    const vec4 cornersX[2] = {center - axisX, center + axisX}, cornersY[2] = {-axisY, axisY}, cornersZ[2] = {-axisZ, axisZ};
+    for (int corner = 0; corner < 8; corner++) {
+        const vec4 clip = cornersX[corner & 1] + cornersY[(corner >> 1) & 1] + cornersZ[corner >> 2];
+        if (clip.w <= nearW) { return false; }
+        const vec3 ndc = vec3(clip) / clip.w;
+        const vec2 screen = (vec2(ndc) * 0.5f + 0.5f) * viewport;
+        screenMin = glm::min(screenMin, screen);
+        screenMax = glm::max(screenMax, screen);
+        nearestDepth = std::min(nearestDepth, ndc.z);
+    }
+
+    // every pixel the box overlaps, the depth of a pixel being the one of its center
+    const int minX = std::max(int(std::floor(screenMin.x)), 0);
+    const int minY = std::max(int(std::floor(screenMin.y)), 0);
+    const int maxX = std::min(int(std::floor(screenMax.x)), int(m_width) - 1);
+    const int maxY = std::min(int(std::floor(screenMax.y)), int(m_height) - 1);
+    if (maxX < minX || maxY < minY) { return false; }
+    for (int y = minY; y <= maxY; y++) {
+        const float *row = &m_depth[y * m_stride];
+        int x = minX;
+#if OCCLUSION_SSE
+        const __m128 nearest = _mm_set1_ps(nearestDepth);
+        for (; x + 3 <= maxX; x += 4) {
+            if (_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(row + x), nearest)) != 0) { return false; }
+        }
+#endif
+        for (; x <= maxX; x++) {
+            if (row[x] >= nearestDepth) { return false; }
+        }
+    }
+    return true;
+}
+
+void OcclusionBuffer::testSpheres(const std::vector<vec4> &p_spheres, const mat4 &p_mvp, std::vector<uint32> &p_visibility, ThreadPool &p_pool) {
+    auto start = std::chrono::high_resolution_clock::now();
+    const size_t wordCount = (p_spheres.size() + 31) / 32;
+    p_visibility.assign(wordCount, 0);
+    std::atomic<uint32> occluded{0};
+    // whole words per job, no two jobs write the same word
+    p_pool.parallelFor(wordCount, [&](size_t begin, size_t end) {
+        uint32 localOccluded = 0;
+        for (size_t word = begin; word < end; word++) {
+            uint32 bits = 0;
+            const size_t last = std::min(word * 32 + 32, p_spheres.size());
+            for (size_t i = word * 32; i < last; i++) {
+                const vec3 center(p_spheres[i]);
+                const vec3 extent(p_spheres[i].w);
+                if (isOccluded(center - extent, center + extent, p_mvp)) {
+                    localOccluded++;
+                } else {
+                    bits |= 1u << (i & 31);
+                }
+            }
+            p_visibility[word] = bits;
+        }
+        occluded += localOccluded;
+    }, 16);
+    m_stats.testedBounds = uint32(p_spheres.size());
+    m_stats.occludedBounds = occluded;
+    m_stats.testMs = static_cast<float>(millisecondsD(std::chrono::high_resolution_clock::now() - start).count());
+}
+
+// ============== Occluder and element bounds ==============
+
+std::vector<uint32> triangulateFaces(const HalfEdgeMesh &p_mesh) {
+    std::vector<uint32> triangles;
+    triangles.reserve(p_mesh.vertexFaceIndices.size() * 3);
+    for (uint32 f = 0; f < p_mesh.nbFaces; f++) {
+        const int *indices = &p_mesh.vertexFaceIndices[p_mesh.faces.offsets[f]];
+        for (int i = 2; i < p_mesh.faces.vertCounts[f]; i++) { triangles.insert(triangles.end(), {uint32(indices[0]), uint32(indices[i - 1]), uint32(indices[i])}); }
+    }
+    return triangles;
+}
+
+void computeSkinMatrices(const std::vector<vec4> &p_jointIndices, const std::vector<vec4> &p_jointWeights, const std::vector<mat4> &p_boneMatrices, std::vector<mat4> &p_skinMatrices,
+                         ThreadPool &p_pool) {
+    p_skinMatrices.resize(p_jointIndices.size());
+    p_pool.parallelFor(p_jointIndices.size(), [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            const vec4 &indices = p_jointIndices[v];
+            const vec4 &weights = p_jointWeights[v];
+            p_skinMatrices[v] = weights.x * p_boneMatrices[int(indices.x)] + weights.y * p_boneMatrices[int(indices.y)] + weights.z * p_boneMatrices[int(indices.z)] +
+                                weights.w * p_boneMatrices[int(indices.w)];
+        }
+    }, 1024);
+}
+
+void skinVertexPositions(const HalfEdgeMesh &p_mesh, const std::vector<mat4> &p_skinMatrices, std::vector<vec3> &p_positions, ThreadPool &p_pool) {
+    p_positions.resize(p_mesh.nbVertices);
+    const bool skinned = !p_skinMatrices.empty();
+    p_pool.parallelFor(p_mesh.nbVertices, [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            const vec4 position = vec4(vec3(p_mesh.vertices.positions[v]), 1.0f);
+            p_positions[v] = vec3(skinned ? p_skinMatrices[v] * position : position);
+        }
+    }, 1024);
+}
+
+void computeElementSpheres(const HalfEdgeMesh &p_mesh, const std::vector<mat4> &p_skinMatrices, float p_radiusScale, std::vector<vec4> &p_spheres, ThreadPool &p_pool) {
+    p_spheres.resize(p_mesh.nbFaces + p_mesh.nbVertices);
+    const bool skinned = !p_skinMatrices.empty();
+    p_pool.parallelFor(p_spheres.size(), [&](size_t begin, size_t end) {
+        for (size_t element = begin; element < end; element++) {
+            const bool isVertex = element >= p_mesh.nbFaces;
+            const uint32 vertId = isVertex ? uint32(element - p_mesh.nbFaces) : 0;
+            const uint32 faceId = isVertex ? uint32(p_mesh.halfEdges.faces[p_mesh.vertices.edges[vertId]]) : uint32(element);
+            vec4 position = vec4(vec3(isVertex ? p_mesh.vertices.positions[vertId] : p_mesh.faces.centers[faceId]), 1.0f);
+            if (skinned) { position = p_skinMatrices[isVertex ? vertId : p_mesh.halfEdges.vertices[p_mesh.faces.edges[faceId]]] * position; }
+            p_spheres[element] = vec4(vec3(position), std::sqrt(p_mesh.faces.faceAreas[faceId]) * p_radiusScale);
+        }
+    }, 1024);
+}
+
+float parametricSurfaceRadius(uint32 p_type, float p_a, float p_b) {
+    const float pi = 3.14159265f;
+    switch (p_type) {
+    case 0: return p_a + p_b;                                                   // torus
+    case 1: return p_a;                                                         // sphere
+    case 2: return 1.0f + 0.5f * p_a;                                           // Mobius strip of width a around the unit circle
+    case 3: return glm::length(vec3(3.0f, 3.0f, 1.5f)) * p_a;                   // Klein bottle
+    case 4: return glm::length(vec3(2.0f * p_a, 2.0f * p_b, 4.0f));             // x / a and y / b up to 2, so z up to 4
+    case 5: return glm::length(vec3(4.0f * pi * p_a, 4.0f * pi * p_a, 4.0f));   // 2 turns out to 4 pi a, 4 high
+    case 6: return glm::length(vec3(p_b, p_b, 8.0f * p_a));                     // cone
+    case 7: return glm::length(vec3(p_b, p_b, 0.5f * p_a));                     // cylinder
+    case 8: return glm::length(vec3(p_a, p_a, p_b));                            // egg
+    default: return 0.0f;
+    }
+}
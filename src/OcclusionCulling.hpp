@@ -0,0 +1,92 @@
+#pragma once
+
+#include <vector>
+
+#include "HalfEdge.hpp"
+#include "ThreadPool.hpp"
+#include "defines.hpp"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define OCCLUSION_SSE 1
+#else
+#define OCCLUSION_SSE 0
+#endif
+
+// Low resolution depth buffer of an occluder mesh, rasterized on the CPU to reject the parametric elements hidden
+// behind it before the task shaders expand them (not the pebbles, see App::cullOccludedElements). The screen is split
+// in tiles, triangles are binned per tile and each tile is rasterized by a single job, 4 pixels at a time with SSE.
+// Depth is the min of clip z / w, the buffer is only written by rasterize so tests can run from any thread afterwards.
+// Coverage is sampled at pixel centers: thin occluders and silhouettes can hide an element that shows through a gap
+// narrower than a pixel of the buffer.
+class OcclusionBuffer {
+public:
+    static constexpr uint32 tileWidth = 32; // multiple of the 4 pixel SIMD span
+    static constexpr uint32 tileHeight = 16;
+
+    struct Stats {
+        uint32 triangles = 0;    // in front of the camera and not degenerate
+        uint32 binnedTiles = 0;  // triangle-tile pairs
+        uint32 testedBounds = 0;
+        uint32 occludedBounds = 0;
+        float rasterMs = 0.0f;
+        float testMs = 0.0f;
+    };
+
+    void resize(uint32 p_width, uint32 p_height);
+    // Clears the buffer and draws p_triangles (indices into p_positions) transformed by p_mvp
+    void rasterize(const std::vector<vec3> &p_positions, const std::vector<uint32> &p_triangles, const mat4 &p_mvp, ThreadPool &p_pool);
+    // True when the box is behind the buffer on every pixel it covers. Boxes crossing the near plane or off screen are
+    // never occluded, the frustum culling is done elsewhere.
+    bool isOccluded(vec3 p_boxMin, vec3 p_boxMax, const mat4 &p_mvp) const;
+    // One bit per sphere (xyz center, w radius), set when the sphere may be visible, 32 spheres per word
+    void testSpheres(const std::vector<vec4> &p_spheres, const mat4 &p_mvp, std::vector<uint32> &p_visibility, ThreadPool &p_pool);
+
+    uint32 getWidth() const { return m_width; }
+    uint32 getHeight() const { return m_height; }
+    float getDepth(uint32 p_x, uint32 p_y) const { return m_depth[p_y * m_stride + p_x]; }
+    const Stats &getStats() const { return m_stats; }
+
+    static constexpr float clearDepth = 3.402823e38f; // nothing drawn: every box is in front
+    static constexpr float nearW = 1e-5f;              // vertices with a smaller clip w are behind the camera
+
+private:
+    struct Triangle {
+        vec3 edgeX, edgeY, edgeC; // edge functions a * x + b * y + c, positive inside
+        vec3 depthPlane;          // z = x * dzdx + y * dzdy + z0
+        int minX, minY, maxX, maxY; // pixel bounds, clamped to the buffer
+    };
+
+    void rasterizeTile(uint32 p_tile);
+
+    uint32 m_width = 0;
+    uint32 m_height = 0;
+    uint32 m_stride = 0; // row length rounded up to whole tiles
+    uint32 m_tilesX = 0;
+    uint32 m_tilesY = 0;
+    std::vector<float> m_depth;
+    std::vector<vec4> m_screenVertices; // pixel x, y, clip z / w, w <= 0 behind the camera
+    std::vector<Triangle> m_triangles;
+    std::vector<std::vector<uint32>> m_bins; // triangles per tile
+    Stats m_stats;
+};
+
+// ============== Occluder and element bounds ==============
+
+// Fan triangulation of the faces of p_mesh, for OcclusionBuffer::rasterize
+std::vector<uint32> triangulateFaces(const HalfEdgeMesh &p_mesh);
+
+// Skinning matrix of every vertex, the same weighted sum as getElementAnchor in parametric.glsl
+void computeSkinMatrices(const std::vector<vec4> &p_jointIndices, const std::vector<vec4> &p_jointWeights, const std::vector<mat4> &p_boneMatrices, std::vector<mat4> &p_skinMatrices,
+                         ThreadPool &p_pool);
+
+// Vertex positions of p_mesh, skinned when p_skinMatrices is not empty
+void skinVertexPositions(const HalfEdgeMesh &p_mesh, const std::vector<mat4> &p_skinMatrices, std::vector<vec3> &p_positions, ThreadPool &p_pool);
+
+// Radius around the origin of the parametric surface p_type of parametricSurfaces.glsl (0 to 8), with the major and minor
+// radius p_a and p_b, before offsetVertex scales it by sqrt(area) * scaling. 0 for the B-spline and Bezier types, their
+// control points are bounded by the LUT extents instead.
+float parametricSurfaceRadius(uint32 p_type, float p_a, float p_b);
+
+// Bounding spheres of the resurfacing elements, faces then vertices, placed like the anchors of getElementAnchor.
+// The radius is sqrt(area of the element face) * p_radiusScale, the extent of the parametric surface times the scaling.
+void computeElementSpheres(const HalfEdgeMesh &p_mesh, const std::vector<mat4> &p_skinMatrices, float p_radiusScale, std::vector<vec4> &p_spheres, ThreadPool &p_pool);
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <glm/gtc/quaternion.hpp>
+
+#include "defines.hpp"
+
+// Bones stay in the order of the glTF skin joints, which is what the vertex joint indices and the bone matrices use.
+// The animated pose is stored as SoA arrays in evaluation order (parents before children), so that computing the bone
+// matrices is a single linear pass instead of walking up the hierarchy for every bone.
+struct Skeleton {
+    struct Bone {
+        int nodeIndex;                    // Index of the node in the glTF model
+        std::string name;                 // Name of the bone
+        int parentIndex;                  // Index of the parent bone (-1 if root)
+        std::vector<int> childrenIndices; // Indices of child bones
+        mat4 inverseBindMatrix;           // Inverse bind matrix
+        vec3 restTranslation;             // Node transform, used for the channels an animation does not drive
+        glm::quat restRotation;
+        vec3 restScale;
+    };
+
+    std::vector<Bone> bones;
+
+    // === Pose, indexed by evaluation slot ===
+    std::vector<uint32> evaluationOrder; // slot -> bone
+    std::vector<uint32> boneSlots;       // bone -> slot
+    std::vector<int> slotParents;        // slot of the parent, always lower than the slot itself, -1 for roots
+    std::vector<vec3> translations;
+    std::vector<glm::quat> rotations;
+    std::vector<vec3> scales;
+    std::vector<mat4> inverseBindMatrices;
+
+    // Sorts the bones parent before child (depth first from the roots) and resets the pose to the rest transforms.
+    // Must be called once the hierarchy is complete.
+    void buildPose() {
+        const size_t count = bones.size();
+        evaluationOrder.clear();
+        evaluationOrder.reserve(count);
+        std::vector<uint32> stack;
+        for (size_t i = count; i-- > 0;) {
+            if (bones[i].parentIndex == -1) { stack.push_back(uint32(i)); }
+        }
+        while (!stack.empty()) {
+            const uint32 bone = stack.back();
+            stack.pop_back();
+            evaluationOrder.push_back(bone);
+            const std::vector<int> &children = bones[bone].childrenIndices;
+            for (auto it = children.rbegin(); it != children.rend(); ++it) { stack.push_back(uint32(*it)); }
+        }
+        ASSERT(evaluationOrder.size() == count, "Bone hierarchy is not a forest");
+
+        boneSlots.resize(count);
+        for (uint32 slot = 0; slot < count; ++slot) { boneSlots[evaluationOrder[slot]] = slot; }
+
+        slotParents.resize(count);
+        inverseBindMatrices.resize(count);
+        for (uint32 slot = 0; slot < count; ++slot) {
+            const Bone &bone = bones[evaluationOrder[slot]];
+            slotParents[slot] = bone.parentIndex == -1 ? -1 : int(boneSlots[bone.parentIndex]);
+            inverseBindMatrices[slot] = bone.inverseBindMatrix;
+        }
+        resetPose();
+    }
+
+    void resetPose() {
+        const size_t count = evaluationOrder.size();
+        translations.resize(count);
+        rotations.resize(count);
+        scales.resize(count);
+        for (size_t slot = 0; slot < count; ++slot) {
+            const Bone &bone = bones[evaluationOrder[slot]];
+            translations[slot] = bone.restTranslation;
+            rotations[slot] = bone.restRotation;
+            scales[slot] = bone.restScale;
+        }
+    }
+};
+
+// translate(t) * mat4_cast(r) * scale(s) without the two matrix products
+inline mat4 composeTransform(vec3 p_translation, const glm::quat &p_rotation, vec3 p_scale) {
+    mat4 m = glm::mat4_cast(p_rotation);
+    m[0] *= p_scale.x;
+    m[1] *= p_scale.y;
+    m[2] *= p_scale.z;
+    m[3] = vec4(p_translation, 1.0f);
+    return m;
+}
+
+// Product of two affine matrices (last row 0 0 0 1): twelve column multiply-adds instead of sixteen
+inline mat4 multiplyAffine(const mat4 &a, const mat4 &b) {
+    mat4 r;
+    r[0] = a[0] * b[0].x + a[1] * b[0].y + a[2] * b[0].z;
+    r[1] = a[0] * b[1].x + a[1] * b[1].y + a[2] * b[1].z;
+    r[2] = a[0] * b[2].x + a[1] * b[2].y + a[2] * b[2].z;
+    r[3] = a[0] * b[3].x + a[1] * b[3].y + a[2] * b[3].z + a[3];
+    return r;
+}
+
+// Skinning matrices (global transform * inverse bind matrix) indexed by bone, one pass over the slots
+inline void computeBoneMatrices(const Skeleton &skeleton, std::vector<mat4> &boneMatrices) {
+    const size_t count = skeleton.evaluationOrder.size();
+    boneMatrices.resize(count);
+    std::vector<mat4> globalTransforms(count);
+
+    for (size_t slot = 0; slot < count; ++slot) {
+        const mat4 local = composeTransform(skeleton.translations[slot], skeleton.rotations[slot], skeleton.scales[slot]);
+        const int parent = skeleton.slotParents[slot];
+        globalTransforms[slot] = parent == -1 ? local : multiplyAffine(globalTransforms[parent], local);
+        boneMatrices[skeleton.evaluationOrder[slot]] = globalTransforms[slot] * skeleton.inverseBindMatrices[slot];
+    }
+}
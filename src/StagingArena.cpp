@@ -0,0 +1,75 @@
+#include "StagingArena.hpp"
+#include "renderer.hpp"
+
+#include <algorithm>
+
+void StagingArena::init(Renderer &p_renderer, vk::DeviceSize p_blockSize, vk::DeviceSize p_alignment) {
+    m_renderer = &p_renderer;
+    m_blockSize = p_blockSize;
+    m_alignment = std::max<vk::DeviceSize>(p_alignment, 1);
+}
+
+void StagingArena::cleanup() {
+    for (Block &block : m_blocks) { m_renderer->destroyBuffer(block.buffer); }
+    m_blocks.clear();
+    m_stats.reservedBytes = 0;
+    m_stats.usedBytes = 0;
+}
+
+StagingArena::Allocation StagingArena::allocate(vk::DeviceSize p_size) {
+    Block *target = nullptr;
+    vk::DeviceSize offset = 0;
+    for (Block &block : m_blocks) {
+        offset = (block.head + m_alignment - 1) / m_alignment * m_alignment;
+        if (offset + p_size <= block.buffer.size) {
+            target = &block;
+            break;
+        }
+    }
+    if (target == nullptr) {
+        Block block;
+        block.buffer = m_renderer->createStagingBuffer(static_cast<uint32>(std::max(m_blockSize, p_size)));
+        block.mappedMemory = m_renderer->getMappedMemory(block.buffer);
+        m_stats.blockAllocations++;
+        m_stats.reservedBytes += block.buffer.size;
+        m_blocks.push_back(std::move(block));
+        target = &m_blocks.back();
+        offset = 0;
+    }
+
+    m_stats.usedBytes += offset + p_size - target->head;
+    m_stats.peakUsedBytes = std::max(m_stats.peakUsedBytes, m_stats.usedBytes);
+    m_stats.suballocations++;
+    target->head = offset + p_size;
+    target->hasOpenAllocations = true;
+    return {target->buffer.buffer, offset, static_cast<byte *>(target->mappedMemory) + offset};
+}
+
+void StagingArena::retire(vk::Semaphore p_semaphore, uint64 p_value) {
+    for (Block &block : m_blocks) {
+        if (!block.hasOpenAllocations) { continue; }
+        block.hasOpenAllocations = false;
+        auto it = std::find_if(block.pendingSubmits.begin(), block.pendingSubmits.end(), [&](const auto &submit) { return submit.first == p_semaphore; });
+        if (it == block.pendingSubmits.end()) { block.pendingSubmits.emplace_back(p_semaphore, p_value); } else { it->second = std::max(it->second, p_value); }
+    }
+}
+
+void StagingArena::reclaim() {
+    // one counter query per semaphore, there are only the upload and the frame timelines
+    std::vector<std::pair<vk::Semaphore, uint64>> reached;
+    auto reachedValue = [&](vk::Semaphore p_semaphore) {
+        for (const auto &[semaphore, value] : reached) { if (semaphore == p_semaphore) { return value; } }
+        reached.emplace_back(p_semaphore, m_renderer->m_logicalDevice.getSemaphoreCounterValue(p_semaphore));
+        return reached.back().second;
+    };
+
+    for (Block &block : m_blocks) {
+        if (block.hasOpenAllocations || block.head == 0) { continue; }
+        const bool completed = std::all_of(block.pendingSubmits.begin(), block.pendingSubmits.end(), [&](const auto &submit) { return reachedValue(submit.first) >= submit.second; });
+        if (!completed) { continue; }
+        m_stats.usedBytes -= block.head;
+        m_stats.blockRecycles++;
+        block.head = 0;
+        block.pendingSubmits.clear();
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <utility>
+#include <vector>
+
+#include "defines.hpp"
+#include "vkHelper.hpp"
+
+class Renderer;
+
+// Linear allocator for upload staging memory. A few large host visible blocks stay mapped for the whole run and are
+// sub-allocated front to back. Allocations are retired with the timeline semaphore value of the submit that reads them,
+// a block is rewound once every value retired on it is reached.
+class StagingArena {
+public:
+    struct Allocation {
+        vk::Buffer buffer;
+        vk::DeviceSize offset = 0;
+        void *mappedMemory = nullptr;
+    };
+
+    struct Stats {
+        uint32 blockAllocations = 0; // staging buffers created
+        uint64 suballocations = 0;
+        uint64 blockRecycles = 0;
+        vk::DeviceSize reservedBytes = 0; // sum of the block sizes
+        vk::DeviceSize usedBytes = 0;     // allocated and not reclaimed yet
+        vk::DeviceSize peakUsedBytes = 0;
+    };
+
+    // Blocks are staging buffers of the renderer, created on demand
+    void init(Renderer &p_renderer, vk::DeviceSize p_blockSize, vk::DeviceSize p_alignment);
+    void cleanup();
+
+    // Space for p_size bytes, valid until the submit recording the copy is retired and completed.
+    // Requests larger than the block size get a dedicated block, which is recycled like the others.
+    Allocation allocate(vk::DeviceSize p_size);
+    // Every allocation made since the last retire is read by the submit signaling p_value on p_semaphore
+    void retire(vk::Semaphore p_semaphore, uint64 p_value);
+    // Rewinds the blocks whose retired submits all completed, does not wait
+    void reclaim();
+
+    const Stats &getStats() const { return m_stats; }
+
+private:
+    struct Block {
+        Buffer buffer;
+        void *mappedMemory = nullptr;
+        vk::DeviceSize head = 0;
+        bool hasOpenAllocations = false;                            // allocated since the last retire
+        std::vector<std::pair<vk::Semaphore, uint64>> pendingSubmits; // highest retired value per semaphore
+    };
+
+    Renderer *m_renderer = nullptr;
+    vk::DeviceSize m_blockSize = 0;
+    vk::DeviceSize m_alignment = 1;
+    std::vector<Block> m_blocks;
+    Stats m_stats;
+};
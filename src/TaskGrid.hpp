@@ -0,0 +1,51 @@
+#pragma once
+
+#include <algorithm>
+#include <vector>
+
+#include "defines.hpp"
+
+// Workgroup count limits of drawMeshTasksEXT, VkPhysicalDeviceMeshShaderPropertiesEXT::max{Task,Mesh}WorkGroupCount
+// and max{Task,Mesh}WorkGroupTotalCount. The defaults are the minimums required by the spec.
+struct TaskGridLimits {
+    uint32 maxCount[3] = {65535, 65535, 65535};
+    uint32 maxTotalCount = 1u << 22;
+};
+
+// One drawMeshTasksEXT(x, y, 1). The shaders rebuild the flat workgroup ID as
+// firstWorkGroup + gl_WorkGroupID.y * gl_NumWorkGroups.x + gl_WorkGroupID.x (flatGroupId in shaderInterface.h).
+struct TaskGridDraw {
+    uint32 firstWorkGroup = 0; // PushConstants::firstWorkGroup
+    uint32 x = 0;
+    uint32 y = 0;
+};
+
+// Width of the rows of a grid of p_workGroupCount workgroups, the X count of every draw but the last
+inline uint32 taskGridWidth(uint32 p_workGroupCount, const TaskGridLimits &p_limits) {
+    return std::max(1u, std::min({p_workGroupCount, p_limits.maxCount[0], p_limits.maxTotalCount}));
+}
+
+// Covers exactly p_workGroupCount workgroups with 2D grids: rows as wide as the X limit allows, as many full rows per
+// draw as the Y and total limits allow, then one draw for the partial last row. A single draw when the count fits in X.
+inline std::vector<TaskGridDraw> planTaskGrid(uint32 p_workGroupCount, const TaskGridLimits &p_limits) {
+    std::vector<TaskGridDraw> draws;
+    const uint32 width = taskGridWidth(p_workGroupCount, p_limits);
+    const uint32 rowsPerDraw = std::max(1u, std::min(p_limits.maxCount[1], p_limits.maxTotalCount / width));
+    uint32 first = 0;
+    for (uint32 rows = p_workGroupCount / width; rows > 0;) {
+        const uint32 drawRows = std::min(rows, rowsPerDraw);
+        draws.push_back({first, width, drawRows});
+        first += drawRows * width;
+        rows -= drawRows;
+    }
+    if (first < p_workGroupCount) { draws.push_back({first, p_workGroupCount - first, 1}); }
+    return draws;
+}
+
+// True when the grid of the GPU compaction, ceil(p_workGroupCount / width) rows of taskGridWidth, fits in a single
+// indirect draw. The shaders skip the workgroups past the count on the last row.
+inline bool fitsSingleTaskGrid(uint32 p_workGroupCount, const TaskGridLimits &p_limits) {
+    const uint32 width = taskGridWidth(p_workGroupCount, p_limits);
+    const uint64 rows = (uint64(p_workGroupCount) + width - 1) / width;
+    return rows <= p_limits.maxCount[1] && rows * width <= p_limits.maxTotalCount;
+}
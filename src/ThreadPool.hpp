@@ -0,0 +1,118 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+#include "defines.hpp"
+
+// Fixed set of worker threads consuming a FIFO of jobs.
+class ThreadPool {
+public:
+    explicit ThreadPool(uint32 p_threadCount = std::max(1u, std::thread::hardware_concurrency())) {
+        for (uint32 i = 0; i < p_threadCount; i++) { m_workers.emplace_back([this] { workerLoop(); }); }
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_condition.notify_all();
+        for (std::thread &worker : m_workers) { worker.join(); }
+    }
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    // Pool shared by the whole application
+    static ThreadPool &global() {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    uint32 size() const { return static_cast<uint32>(m_workers.size()); }
+
+    template <typename F>
+    auto submit(F &&p_job) -> std::future<decltype(p_job())> {
+        auto task = std::make_shared<std::packaged_task<decltype(p_job())()>>(std::forward<F>(p_job));
+        std::future<decltype(p_job())> result = task->get_future();
+        enqueue([task] { (*task)(); });
+        return result;
+    }
+
+    // Splits [0, p_count) into contiguous ranges of at least p_grain elements and runs p_function(begin, end) on them.
+    // The calling thread takes part in the work, so this is safe to call from inside a job.
+    void parallelFor(size_t p_count, const std::function<void(size_t, size_t)> &p_function, size_t p_grain = 1) {
+        if (p_count == 0) { return; }
+        const size_t threadCount = size() + 1;
+        const size_t chunkSize = std::max<size_t>(std::max<size_t>(p_grain, 1), (p_count + threadCount * 4 - 1) / (threadCount * 4));
+        const size_t chunkCount = (p_count + chunkSize - 1) / chunkSize;
+        if (chunkCount == 1 || m_workers.empty()) {
+            p_function(0, p_count);
+            return;
+        }
+
+        struct State {
+            std::atomic<size_t> next{0};
+            std::atomic<size_t> done{0};
+            std::mutex mutex;
+            std::condition_variable condition;
+        };
+        auto state = std::make_shared<State>();
+        // helpers that start after every chunk has been claimed return without touching p_function
+        auto work = [state, chunkSize, chunkCount, p_count, &p_function] {
+            for (size_t chunk = state->next++; chunk < chunkCount; chunk = state->next++) {
+                const size_t begin = chunk * chunkSize;
+                p_function(begin, std::min(begin + chunkSize, p_count));
+                if (++state->done == chunkCount) {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->condition.notify_all();
+                }
+            }
+        };
+
+        const size_t helperCount = std::min<size_t>(size(), chunkCount - 1);
+        for (size_t i = 0; i < helperCount; i++) { enqueue(work); }
+        work();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->condition.wait(lock, [&] { return state->done == chunkCount; });
+    }
+
+private:
+    void enqueue(std::function<void()> p_job) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push(std::move(p_job));
+        }
+        m_condition.notify_one();
+    }
+
+    void workerLoop() {
+        while (true) {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_condition.wait(lock, [this] { return m_stop || !m_jobs.empty(); });
+                if (m_stop && m_jobs.empty()) { return; }
+                job = std::move(m_jobs.front());
+                m_jobs.pop();
+            }
+            job();
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::queue<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_condition;
+    bool m_stop = false;
+};
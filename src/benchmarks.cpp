@@ -0,0 +1,37 @@
+#include "benchmarks.hpp"
+
+#include <functional>
+#include <iostream>
+#include <map>
+
+#include "benchmarks/BenchmarkHelpers.hpp"
+
+int runBenchmarks(const std::vector<std::string> &p_args) {
+    static const std::map<std::string, std::function<int(const std::vector<std::string> &)>> benchmarks = {
+        {"obj", benchObjParser},
+        {"packing", benchHalfEdgePacking},
+        {"scene", benchScene},
+        {"reorder", benchReordering},
+        {"scripted", benchScripted},
+        {"animation", benchAnimation},
+        {"clusters", benchClusterCulling},
+        {"compaction", benchCompaction},
+        {"halfedge", benchHalfEdgeBuild},
+        {"hemesh", benchMeshCache},
+        {"loading", benchLoading},
+        {"memory", benchMemoryAllocator},
+        {"occlusion", benchOcclusion},
+        {"skeleton", benchSkeleton},
+        {"skin", benchSkinTransfer},
+        {"taskgrid", benchTaskGrid},
+    };
+
+    auto it = p_args.empty() ? benchmarks.end() : benchmarks.find(p_args[0]);
+    if (it == benchmarks.end()) {
+        std::cout << "Available benchmarks:";
+        for (const auto &[name, function] : benchmarks) { std::cout << " " << name; }
+        std::cout << std::endl;
+        return EXIT_FAILURE;
+    }
+    return it->second(std::vector<std::string>(p_args.begin() + 1, p_args.end()));
+}
@@ -0,0 +1,7 @@
+#pragma once
+#include <string>
+#include <vector>
+
+// CPU side benchmarks, they don't need a window nor a Vulkan device.
+// Usage: Resurfacing --bench <name> [args...], run without a name to list them.
+int runBenchmarks(const std::vector<std::string> &p_args);
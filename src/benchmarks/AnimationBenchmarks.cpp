@@ -0,0 +1,155 @@
+#include "BenchmarkHelpers.hpp"
+
+#include <random>
+
+#include "Animation.hpp"
+#include "Skeleton.hpp"
+
+// Random rig: each bone hangs from the previous bone with p_chainProbability, from a random earlier bone otherwise, bones are then shuffled
+// so that the storage order is not an evaluation order
+static Skeleton makeRig(uint32 p_boneCount, float p_chainProbability, std::mt19937 &p_rng) {
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    std::uniform_real_distribution<float> probability(0.0f, 1.0f);
+    std::vector<int> parents(p_boneCount, -1);
+    for (uint32 i = 1; i < p_boneCount; ++i) { parents[i] = probability(p_rng) < p_chainProbability ? int(i - 1) : int(std::uniform_int_distribution<uint32>(0, i - 1)(p_rng)); }
+
+    std::vector<uint32> shuffled(p_boneCount);
+    for (uint32 i = 0; i < p_boneCount; ++i) { shuffled[i] = i; }
+    std::shuffle(shuffled.begin(), shuffled.end(), p_rng);
+
+    Skeleton skeleton;
+    skeleton.bones.resize(p_boneCount);
+    for (uint32 i = 0; i < p_boneCount; ++i) {
+        Skeleton::Bone &bone = skeleton.bones[shuffled[i]];
+        bone.nodeIndex = int(i);
+        bone.parentIndex = parents[i] == -1 ? -1 : int(shuffled[parents[i]]);
+        bone.restTranslation = vec3(unit(p_rng), unit(p_rng), unit(p_rng)) * 0.1f;
+        bone.restRotation = glm::normalize(glm::quat(1.0f + 0.2f * unit(p_rng), 0.1f * unit(p_rng), 0.1f * unit(p_rng), 0.1f * unit(p_rng)));
+        bone.restScale = vec3(1.0f + 0.01f * unit(p_rng));
+        bone.inverseBindMatrix = composeTransform(vec3(unit(p_rng), unit(p_rng), unit(p_rng)), glm::quat(1.0f, 0.0f, 0.0f, 0.0f), vec3(1.0f));
+    }
+    for (uint32 i = 0; i < p_boneCount; ++i) {
+        if (skeleton.bones[i].parentIndex != -1) { skeleton.bones[skeleton.bones[i].parentIndex].childrenIndices.push_back(int(i)); }
+    }
+    skeleton.buildPose();
+    return skeleton;
+}
+
+// Previous evaluation: every bone recomputes the transforms of its whole ancestor chain
+static void computeBoneMatricesRecursive(const Skeleton &p_skeleton, std::vector<mat4> &p_boneMatrices) {
+    const size_t count = p_skeleton.bones.size();
+    std::vector<mat4> globalTransforms(count);
+    std::function<void(int)> computeGlobal = [&](int p_bone) {
+        const Skeleton::Bone &bone = p_skeleton.bones[p_bone];
+        const uint32 slot = p_skeleton.boneSlots[p_bone];
+        const mat4 local = glm::translate(mat4(1.0f), p_skeleton.translations[slot]) * glm::mat4_cast(p_skeleton.rotations[slot]) * glm::scale(mat4(1.0f), p_skeleton.scales[slot]);
+        if (bone.parentIndex != -1) {
+            computeGlobal(bone.parentIndex);
+            globalTransforms[p_bone] = globalTransforms[bone.parentIndex] * local;
+        } else { globalTransforms[p_bone] = local; }
+    };
+    p_boneMatrices.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        computeGlobal(int(i));
+        p_boneMatrices[i] = globalTransforms[i] * p_skeleton.bones[i].inverseBindMatrix;
+    }
+}
+
+// Usage: --bench skeleton [iterations]
+int benchSkeleton(const std::vector<std::string> &p_args) {
+    const uint32 iterations = std::stoi(argOr(p_args, 0, "5"));
+    std::mt19937 rng(7);
+    bool identical = true;
+    for (uint32 boneCount : {50u, 500u, 5000u}) {
+        for (float chainProbability : {0.5f, 0.95f}) {
+            const Skeleton skeleton = makeRig(boneCount, chainProbability, rng);
+            std::vector<mat4> linear, recursive;
+            const double linearMs = timeBest(iterations, [&] { computeBoneMatrices(skeleton, linear); });
+            const double recursiveMs = timeBest(iterations, [&] { computeBoneMatricesRecursive(skeleton, recursive); });
+
+            float maxError = 0.0f;
+            for (size_t i = 0; i < linear.size(); ++i) {
+                for (int c = 0; c < 4; ++c) { maxError = std::max(maxError, glm::length(linear[i][c] - recursive[i][c]) / std::max(1.0f, glm::length(recursive[i][c]))); }
+            }
+            const bool close = maxError < 1e-3f;
+            identical &= close;
+            std::cout << boneCount << " bones, chain probability " << chainProbability << ": linear " << linearMs * 1000.0 << " us, recursive " << recursiveMs * 1000.0
+                      << " us, max relative error " << maxError << (close ? "" : "  (DIFFERENT)") << std::endl;
+        }
+    }
+    return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Usage: --bench animation [keys per channel] [iterations]
+// Samples a random clip with the channel cursors and with a linear key search from 0, the poses must be identical
+int benchAnimation(const std::vector<std::string> &p_args) {
+    const uint32 keyCount = std::stoi(argOr(p_args, 0, "200"));
+    const uint32 iterations = std::stoi(argOr(p_args, 1, "5"));
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+    Skeleton skeleton = makeRig(100, 0.5f, rng);
+
+    Animation animation;
+    animation.duration = 0.0f;
+    for (uint32 bone = 0; bone < skeleton.bones.size(); ++bone) {
+        for (AnimationPath path : {AnimationPath::TRANSLATION, AnimationPath::ROTATION, AnimationPath::SCALE}) {
+            AnimationChannel channel;
+            channel.boneIndex = int(bone);
+            channel.slot = skeleton.boneSlots[bone];
+            channel.path = path;
+            channel.interpolation = Interpolation(bone % 3);
+            channel.components = path == AnimationPath::ROTATION ? 4 : 3;
+            float time = 0.0f;
+            for (uint32 k = 0; k < keyCount; ++k) {
+                channel.times.push_back(time);
+                time += 0.01f + 0.04f * (unit(rng) + 1.0f);
+                for (uint32 e = 0; e < (channel.interpolation == Interpolation::CUBICSPLINE ? 3u : 1u); ++e) {
+                    glm::quat q = glm::normalize(glm::quat(1.0f + 0.5f * unit(rng), unit(rng), unit(rng), unit(rng)));
+                    const float value[4] = {q.x, q.y, q.z, q.w};
+                    channel.values.insert(channel.values.end(), value, value + channel.components);
+                }
+            }
+            animation.duration = std::max(animation.duration, channel.times.back());
+            animation.channels.push_back(std::move(channel));
+        }
+    }
+
+    // 60 fps over two loops, then random jumps to exercise the binary search fallback
+    std::vector<float> frameTimes;
+    for (float time = 0.0f; time < 2.0f * animation.duration; time += 1.0f / 60.0f) { frameTimes.push_back(time); }
+    std::uniform_real_distribution<float> anyTime(0.0f, 2.0f * animation.duration);
+    for (uint32 i = 0; i < 200; ++i) { frameTimes.push_back(anyTime(rng)); }
+
+    // reference: the linear key search updateSkeleton used, the cursor is overwritten with its result before sampling
+    auto sampleLinear = [&animation](const AnimationChannel &p_channel, float p_time, Skeleton &p_skeleton) {
+        float localTime = p_time;
+        if (localTime < p_channel.times.front()) { localTime = p_channel.times.front(); } else if (localTime > p_channel.times.back()) { localTime = std::fmod(localTime, animation.duration); }
+        uint32 key = 0;
+        for (; key < p_channel.keyCount() - 1; ++key) {
+            if (localTime < p_channel.times[key + 1]) { break; }
+        }
+        sampleChannel(p_channel, key, p_time, animation.duration, p_skeleton);
+    };
+
+    bool identical = true;
+    Skeleton reference = skeleton;
+    AnimationCursors cursors;
+    for (float time : frameTimes) {
+        updateSkeleton(animation, cursors, time, skeleton);
+        for (const AnimationChannel &channel : animation.channels) { sampleLinear(channel, time, reference); }
+        identical &= isBitIdentical(skeleton.translations, reference.translations) && isBitIdentical(skeleton.scales, reference.scales) && isBitIdentical(skeleton.rotations, reference.rotations);
+    }
+
+    const size_t sampleCount = frameTimes.size() * animation.channels.size();
+    const double cursorMs = timeBest(iterations, [&] {
+        for (float time : frameTimes) { updateSkeleton(animation, cursors, time, skeleton); }
+    });
+    const double linearMs = timeBest(iterations, [&] {
+        for (float time : frameTimes) {
+            for (const AnimationChannel &channel : animation.channels) { sampleLinear(channel, time, reference); }
+        }
+    });
+    std::cout << animation.channels.size() << " channels of " << keyCount << " keys, " << frameTimes.size() << " frames: cursors " << cursorMs * 1e6 / double(sampleCount) << " ns per channel, linear search "
+              << linearMs * 1e6 / double(sampleCount) << " ns per channel" << (identical ? "" : "  (DIFFERENT)") << std::endl;
+    return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include "HalfEdge.hpp"
+#include "loaders/ObjLoader.hpp"
+
+// Shared by the benchmarks of every module, see runBenchmarks in benchmarks.cpp for the list.
+
+// ============== Helpers ==============
+
+template <typename T>
+inline bool isBitIdentical(const std::vector<T> &a, const std::vector<T> &b) { return a.size() == b.size() && (a.empty() || memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0); }
+
+inline bool isBitIdentical(const NgonData &a, const NgonData &b) { return isBitIdentical(a.vertices, b.vertices) && isBitIdentical(a.indices, b.indices) && isBitIdentical(a.faces, b.faces); }
+
+inline bool isBitIdentical(const HalfEdgeMesh &a, const HalfEdgeMesh &b) {
+    return a.nbVertices == b.nbVertices && a.nbFaces == b.nbFaces &&
+           isBitIdentical(a.vertices.positions, b.vertices.positions) && isBitIdentical(a.vertices.colors, b.vertices.colors) &&
+           isBitIdentical(a.vertices.normals, b.vertices.normals) && isBitIdentical(a.vertices.texCoords, b.vertices.texCoords) &&
+           isBitIdentical(a.vertices.edges, b.vertices.edges) && isBitIdentical(a.faces.edges, b.faces.edges) &&
+           isBitIdentical(a.faces.vertCounts, b.faces.vertCounts) && isBitIdentical(a.faces.offsets, b.faces.offsets) &&
+           isBitIdentical(a.faces.normals, b.faces.normals) && isBitIdentical(a.faces.centers, b.faces.centers) &&
+           isBitIdentical(a.faces.faceAreas, b.faces.faceAreas) && isBitIdentical(a.halfEdges.vertices, b.halfEdges.vertices) &&
+           isBitIdentical(a.halfEdges.faces, b.halfEdges.faces) && isBitIdentical(a.halfEdges.next, b.halfEdges.next) &&
+           isBitIdentical(a.halfEdges.prev, b.halfEdges.prev) && isBitIdentical(a.halfEdges.twins, b.halfEdges.twins) &&
+           isBitIdentical(a.vertexFaceIndices, b.vertexFaceIndices);
+}
+
+// Returns the best time out of p_iterations runs, in milliseconds
+inline double timeBest(uint32 p_iterations, const std::function<void()> &p_function) {
+    double best = std::numeric_limits<double>::max();
+    for (uint32 i = 0; i < p_iterations; i++) {
+        auto start = std::chrono::high_resolution_clock::now();
+        p_function();
+        best = std::min(best, millisecondsD(std::chrono::high_resolution_clock::now() - start).count());
+    }
+    return best;
+}
+
+inline std::string argOr(const std::vector<std::string> &p_args, size_t p_index, const std::string &p_default) { return p_index < p_args.size() ? p_args[p_index] : p_default; }
+
+// Camera p_pose out of p_poseCount around the mesh bounds, even poses see the whole mesh, odd ones are close and clip it
+inline mat4 orbitViewProjection(const HalfEdgeMesh &p_mesh, uint32 p_pose, uint32 p_poseCount, vec3 &p_eye) {
+    vec3 boxMin(std::numeric_limits<float>::max()), boxMax(std::numeric_limits<float>::lowest());
+    for (const vec4 &position : p_mesh.vertices.positions) {
+        boxMin = glm::min(boxMin, vec3(position));
+        boxMax = glm::max(boxMax, vec3(position));
+    }
+    const vec3 center = (boxMin + boxMax) * 0.5f;
+    const float radius = glm::length(boxMax - boxMin) * 0.5f;
+
+    const float angle = float(p_pose) / float(p_poseCount) * 6.28318530718f;
+    const float distance = radius * (p_pose % 2 == 0 ? 2.5f : 1.2f);
+    p_eye = center + vec3(std::cos(angle), 0.3f, std::sin(angle)) * distance;
+    mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f, 100.0f * radius);
+    projection[1][1] *= -1; // same convention as App::updateSceneUBOs
+    return projection * glm::lookAt(p_eye, center, vec3(0, 1, 0));
+}
+
+// Quad grid with about p_faceCount faces, in the layout produced by NgonLoader
+inline NgonData makeGridMesh(uint32 p_faceCount) {
+    const uint32 side = std::max(1u, uint32(std::sqrt(double(p_faceCount))));
+    NgonData data;
+    data.vertices.resize(size_t(side + 1) * (side + 1));
+    for (uint32 y = 0; y <= side; y++) {
+        for (uint32 x = 0; x <= side; x++) { data.vertices[size_t(y) * (side + 1) + x].position = vec4(float(x), 0.0f, float(y), 1.0f); }
+    }
+    data.faces.resize(size_t(side) * side);
+    data.indices.resize(data.faces.size() * 4);
+    for (uint32 y = 0; y < side; y++) {
+        for (uint32 x = 0; x < side; x++) {
+            const uint32 f = y * side + x;
+            const uint32 v = y * (side + 1) + x;
+            data.faces[f] = {VEC4F_ONE, VEC4F_ZERO, f * 4, 4, 1.0f};
+            data.indices[f * 4 + 0] = v;
+            data.indices[f * 4 + 1] = v + side + 1;
+            data.indices[f * 4 + 2] = v + side + 2;
+            data.indices[f * 4 + 3] = v + 1;
+        }
+    }
+    return data;
+}
+
+// ============== Benchmarks ==============
+// Each returns EXIT_SUCCESS when its checks pass, p_args are the arguments after the benchmark name.
+
+// MeshBenchmarks.cpp
+int benchObjParser(const std::vector<std::string> &p_args);
+int benchMeshCache(const std::vector<std::string> &p_args);
+int benchHalfEdgeBuild(const std::vector<std::string> &p_args);
+int benchReordering(const std::vector<std::string> &p_args);
+int benchHalfEdgePacking(const std::vector<std::string> &p_args);
+int benchSkinTransfer(const std::vector<std::string> &p_args);
+
+// CullingBenchmarks.cpp
+int benchClusterCulling(const std::vector<std::string> &p_args);
+int benchCompaction(const std::vector<std::string> &p_args);
+int benchTaskGrid(const std::vector<std::string> &p_args);
+int benchOcclusion(const std::vector<std::string> &p_args);
+
+// AnimationBenchmarks.cpp
+int benchSkeleton(const std::vector<std::string> &p_args);
+int benchAnimation(const std::vector<std::string> &p_args);
+
+// MemoryBenchmarks.cpp
+int benchMemoryAllocator(const std::vector<std::string> &p_args);
+
+// SceneBenchmarks.cpp
+int benchScene(const std::vector<std::string> &p_args);
+int benchLoading(const std::vector<std::string> &p_args);
+int benchScripted(const std::vector<std::string> &p_args);
@@ -0,0 +1,428 @@
+#include "BenchmarkHelpers.hpp"
+
+#include <fstream>
+#include <random>
+
+#include "Clusters.hpp"
+#include "HalfEdgeReorder.hpp"
+#include "OcclusionCulling.hpp"
+#include "TaskGrid.hpp"
+#include "ThreadPool.hpp"
+
+// Usage: --bench clusters [file.obj] [faces per cluster] [culling threshold]
+// Orbits a camera around the mesh and compares cluster rejection with the per-element test of the task shaders
+int benchClusterCulling(const std::vector<std::string> &p_args) {
+    const std::string path = argOr(p_args, 0, "assets/demo/dragon/dragon_coat.obj");
+    const uint32 maxFaces = std::stoi(argOr(p_args, 1, "32"));
+    const float threshold = std::stof(argOr(p_args, 2, "0.1"));
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "File not found: " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    const HalfEdgeMesh baseMesh = convertToHalfEdgeMesh(NgonLoader::loadNgonData(path));
+    const HalfEdgeMesh mesh = applyReordering(baseMesh, computeLocalityOrder(baseMesh));
+    MeshClusters clusters;
+    double ms = timeBest(3, [&] { clusters = buildClusters(mesh, maxFaces); });
+    std::cout << path << ": " << clusters.clusters.size() << " clusters of up to " << maxFaces << " faces for " << clusters.elements.size() << " elements, built in " << ms << " ms" << std::endl;
+
+    bool conservative = true;
+    const uint32 poseCount = 8;
+    for (uint32 pose = 0; pose < poseCount; ++pose) {
+        vec3 eye;
+        const mat4 mvp = orbitViewProjection(mesh, pose, poseCount, eye);
+
+        ClusterCullingStats stats = cullClusters(mesh, clusters, mvp, eye, threshold);
+        conservative &= stats.wronglyRejected == 0;
+        std::cout << "  pose " << pose << ": clusters reject " << stats.rejectedFraction() * 100.0f << "% of elements (" << stats.rejectedClusters << "/" << stats.clusterCount
+                  << " clusters), per-element test " << stats.elementRejectedFraction() * 100.0f << "%" << (stats.wronglyRejected ? "  (NOT CONSERVATIVE)" : "") << std::endl;
+    }
+    return conservative ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Appends p_kept the way compaction.comp does, one atomic per subgroup of p_subgroupSize elements with the subgroups in
+// random order. Returns the slice: draw count, task grid X Y Z, element count, then the element IDs.
+static std::vector<uint32> replayCompaction(const std::vector<uint32> &p_kept, uint32 p_elementCount, uint32 p_subgroupSize, uint32 p_taskGroupSize, uint32 p_gridWidth, std::mt19937 &p_rng) {
+    const uint32 headerSize = 5; // visibleElementsHeaderSize of shaderInterface.h
+    const uint32 subgroupCount = (p_elementCount + p_subgroupSize - 1) / p_subgroupSize;
+    std::vector<std::vector<uint32>> ballots(subgroupCount);
+    for (uint32 element : p_kept) { ballots[element / p_subgroupSize].push_back(element); }
+    std::vector<uint32> order(subgroupCount);
+    for (uint32 i = 0; i < subgroupCount; ++i) { order[i] = i; }
+    std::shuffle(order.begin(), order.end(), p_rng);
+
+    std::vector<uint32> slice = {0, 0, 1, 1, 0}; // cleared by dispatchCompaction
+    slice.resize(headerSize + p_elementCount, ~0u);
+    for (uint32 subgroup : order) {
+        const std::vector<uint32> &kept = ballots[subgroup];
+        if (kept.empty()) { continue; }
+        const uint32 base = slice[4];
+        slice[4] += uint32(kept.size()); // atomicAdd
+        const uint32 groups = (base + uint32(kept.size()) + p_taskGroupSize - 1) / p_taskGroupSize;
+        slice[1] = std::max(slice[1], std::min(groups, p_gridWidth)); // atomicMax
+        slice[2] = std::max(slice[2], (groups + p_gridWidth - 1) / p_gridWidth);
+        for (uint32 i = 0; i < kept.size(); ++i) { slice[headerSize + base + i] = kept[i]; }
+        if (base == 0) { slice[0] = 1; }
+    }
+    slice.resize(headerSize + slice[4]);
+    std::sort(slice.begin() + headerSize, slice.end()); // the order of the list changes from run to run, not its content
+    return slice;
+}
+
+// Usage: --bench compaction [file.obj] [culling threshold] [subgroup size] [task group size]
+// Checks the indirect commands of known survivor lists and the elements kept on a 2 x 2 quad grid seen from known
+// cameras, then replays the append of compaction.comp on orbit poses of the mesh against the CPU reference compaction
+int benchCompaction(const std::vector<std::string> &p_args) {
+    const std::string path = argOr(p_args, 0, "assets/demo/dragon/dragon_coat.obj");
+    const float threshold = std::stof(argOr(p_args, 1, "0.1"));
+    const uint32 subgroupSize = std::stoi(argOr(p_args, 2, "32"));
+    const uint32 taskGroupSize = std::stoi(argOr(p_args, 3, "32")); // TASK_GROUP_SIZE of shaderInterface.h
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "File not found: " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::mt19937 rng(7);
+
+    // indirect commands worked out by hand, 32 elements per task workgroup: no survivor draws nothing, 100 survivors
+    // need 4 workgroups in rows of 3, 64 survivors fill rows of 2 exactly
+    std::vector<uint32> hundred(100), sixtyFour(64);
+    for (uint32 i = 0; i < 100; ++i) { hundred[i] = i; }
+    for (uint32 i = 0; i < 64; ++i) { sixtyFour[i] = 2 * i; }
+    auto header = [](const std::vector<uint32> &p_slice) { return std::vector<uint32>(p_slice.begin(), p_slice.begin() + 5); };
+    bool valid = header(replayCompaction({}, 100, 32, 32, 3, rng)) == std::vector<uint32>{0, 0, 1, 1, 0};
+    valid &= header(replayCompaction({5}, 100, 32, 32, 3, rng)) == std::vector<uint32>{1, 1, 1, 1, 1};
+    valid &= header(replayCompaction(hundred, 100, 32, 32, 3, rng)) == std::vector<uint32>{1, 3, 2, 1, 100};
+    valid &= header(replayCompaction(sixtyFour, 128, 32, 32, 2, rng)) == std::vector<uint32>{1, 2, 1, 1, 64};
+    std::cout << "known commands: " << (valid ? "match" : "MISMATCH") << std::endl;
+
+    // 2 x 2 quads on y = 0 from (0, 0) to (2, 2) facing +y: 4 faces centered on (0.5 | 1.5, 0, 0.5 | 1.5) then 9 vertices.
+    // From above every element faces the camera, from below none does, and 1 unit above the first face center with a
+    // 45 degree square view, only that center is within the frustum margin (0.41 x 1.1 units off axis at that depth).
+    NgonData quadData = makeGridMesh(4);
+    for (uint32 f = 0; f < 4; ++f) {
+        quadData.faces[f].center = vec4(float(f % 2) + 0.5f, 0.0f, float(f / 2) + 0.5f, 1.0f);
+        quadData.faces[f].normal = vec4(0, 1, 0, 0);
+    }
+    for (Vertex &vertex : quadData.vertices) { vertex.normal = vec4(0, 1, 0, 0); }
+    const HalfEdgeMesh quads = convertToHalfEdgeMesh(quadData);
+    const mat4 squareProjection = glm::perspective(glm::radians(45.0f), 1.0f, 0.01f, 100.0f);
+    struct KnownView {
+        const char *name;
+        vec3 eye, target;
+        std::vector<uint32> kept;
+    };
+    const std::vector<KnownView> views = {
+        {"above", vec3(1, 5, 1), vec3(1, 0, 1), {0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12}},
+        {"below", vec3(1, -5, 1), vec3(1, 0, 1), {}},
+        {"close", vec3(0.5f, 1, 0.5f), vec3(0.5f, 0, 0.5f), {0}},
+    };
+    for (const KnownView &view : views) {
+        std::vector<uint32> kept;
+        compactElements(quads, squareProjection * glm::lookAt(view.eye, view.target, vec3(0, 0, -1)), view.eye, true, 0.1f, kept);
+        const bool viewValid = kept == view.kept;
+        valid &= viewValid;
+        std::cout << "  quads from " << view.name << ": " << kept.size() << " elements kept" << (viewValid ? "" : "  (MISMATCH)") << std::endl;
+    }
+
+    const HalfEdgeMesh mesh = convertToHalfEdgeMesh(NgonLoader::loadNgonData(path));
+    const uint32 elementCount = uint32(mesh.faces.edges.size() + mesh.vertices.positions.size());
+    std::cout << path << ": " << elementCount << " elements" << std::endl;
+    const uint32 gridWidth = taskGridWidth((elementCount + taskGroupSize - 1) / taskGroupSize, TaskGridLimits());
+    const uint32 poseCount = 8;
+    for (uint32 pose = 0; pose < poseCount; ++pose) {
+        vec3 eye;
+        const mat4 mvp = orbitViewProjection(mesh, pose, poseCount, eye);
+        std::vector<uint32> reference;
+        const double ms = timeBest(3, [&] { compactElements(mesh, mvp, eye, true, threshold, reference); });
+
+        const std::vector<uint32> buffer = replayCompaction(reference, elementCount, subgroupSize, taskGroupSize, gridWidth, rng);
+        const std::vector<uint32> written(buffer.begin() + 5, buffer.end());
+        const uint32 taskGroups = (uint32(reference.size()) + taskGroupSize - 1) / taskGroupSize;
+        const bool gridValid = buffer[1] == std::min(taskGroups, gridWidth) && buffer[2] == (taskGroups + gridWidth - 1) / gridWidth;
+        const bool poseValid = buffer[4] == reference.size() && gridValid && buffer[0] == (reference.empty() ? 0u : 1u) && written == reference;
+        valid &= poseValid;
+        std::cout << "  pose " << pose << ": " << reference.size() << " elements kept out of " << elementCount << " (" << (1.0f - float(reference.size()) / float(elementCount)) * 100.0f << "% culled), "
+                  << taskGroups << " task workgroups instead of " << (elementCount + taskGroupSize - 1) / taskGroupSize << ", reference in " << ms << " ms" << (poseValid ? "" : "  (MISMATCH)") << std::endl;
+    }
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Usage: --bench taskgrid
+// Plans the split task dispatches of element counts up to the 32 bit range against synthetic device limits, from the
+// spec minimums to tiny ones, and checks that every flat workgroup ID is covered exactly once within the limits. Also
+// checks the single grid written by the compaction pre-pass when it fits.
+int benchTaskGrid(const std::vector<std::string> &p_args) {
+    struct NamedLimits {
+        const char *name;
+        TaskGridLimits limits;
+        bool nearMinimal; // rows as wide as X and the total allow fill the draws, at most one draw above the lower bound
+    };
+    const std::vector<NamedLimits> limitSets = {
+        {"spec minimum", {{65535, 65535, 65535}, 1u << 22}, true},
+        {"wide X", {{4194304, 65535, 65535}, 1u << 22}, true},
+        {"large total", {{65535, 65535, 65535}, ~0u}, true},
+        {"small", {{1000, 3, 1}, 2000}, true},
+        {"tiny", {{7, 5, 1}, 16}, false},
+        {"single group", {{1, 1, 1}, 1}, true},
+    };
+    std::vector<uint32> counts = {0, 1, 2, 31, 65534, 65535, 65536, 65537, (1u << 22) - 1, 1u << 22, (1u << 22) + 1, 3000000, 100000000, ~0u};
+    std::mt19937 rng(11);
+    for (int i = 0; i < 16; i++) { counts.push_back(std::uniform_int_distribution<uint32>(1, 1u << 24)(rng)); }
+
+    bool valid = true;
+    for (const NamedLimits &set : limitSets) {
+        const TaskGridLimits &limits = set.limits;
+        const uint64 maxPerDraw = std::min<uint64>(limits.maxTotalCount, uint64(limits.maxCount[0]) * limits.maxCount[1]);
+        uint32 planned = 0, worstExtraDraws = 0;
+        double planMs = 0.0;
+        for (uint32 count : counts) {
+            if (count / maxPerDraw > 1000000) { continue; } // the tiny limits need too many draws
+            std::vector<TaskGridDraw> draws;
+            planMs += timeBest(1, [&] { draws = planTaskGrid(count, limits); });
+            planned++;
+
+            // the draws are contiguous ranges of flat IDs and each one decodes to its own range, so together they cover
+            // [0, count) exactly once
+            uint64 next = 0;
+            bool countValid = true;
+            for (const TaskGridDraw &draw : draws) {
+                countValid &= draw.firstWorkGroup == next && draw.x >= 1 && draw.y >= 1;
+                countValid &= draw.x <= limits.maxCount[0] && draw.y <= limits.maxCount[1] && uint64(draw.x) * draw.y <= limits.maxTotalCount;
+                next += uint64(draw.x) * draw.y;
+            }
+            countValid &= next == count;
+            if (count <= 100000) {
+                std::vector<uint8_t> hits(count, 0);
+                for (const TaskGridDraw &draw : draws) {
+                    for (uint32 y = 0; y < draw.y; y++) {
+                        for (uint32 x = 0; x < draw.x; x++) {
+                            const uint64 flat = draw.firstWorkGroup + uint64(y) * draw.x + x; // flatGroupId
+                            if (flat < count) { hits[flat]++; } else { countValid = false; }
+                        }
+                    }
+                }
+                countValid &= std::all_of(hits.begin(), hits.end(), [](uint8_t hit) { return hit == 1; });
+            }
+
+            const uint32 lowerBound = uint32((count + maxPerDraw - 1) / maxPerDraw);
+            worstExtraDraws = std::max(worstExtraDraws, uint32(draws.size()) - lowerBound);
+            if (set.nearMinimal) { countValid &= draws.size() <= lowerBound + 1; }
+
+            // compaction pre-pass: one grid of rows of taskGridWidth, the last one partial
+            if (fitsSingleTaskGrid(count, limits) && count > 0) {
+                const uint32 width = taskGridWidth(count, limits);
+                const uint64 x = std::min(count, width), y = (uint64(count) + width - 1) / width;
+                countValid &= x <= limits.maxCount[0] && y <= limits.maxCount[1] && x * y <= limits.maxTotalCount && x * y >= count && x * y - count < width;
+            }
+            countValid &= fitsSingleTaskGrid(count, limits) || draws.size() > 1;
+
+            if (!countValid) { std::cout << "  " << set.name << ": " << count << " workgroups in " << draws.size() << " draws  (INVALID)" << std::endl; }
+            valid &= countValid;
+        }
+        std::cout << set.name << " (" << limits.maxCount[0] << " x " << limits.maxCount[1] << ", total " << limits.maxTotalCount << "): " << planned << " counts planned in " << planMs
+                  << " ms, at most " << worstExtraDraws << " draws above the lower bound" << std::endl;
+    }
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Brute force rasterization of p_triangles, one pixel at a time in double precision, reference for OcclusionBuffer
+static std::vector<float> rasterizeReference(const std::vector<vec3> &p_positions, const std::vector<uint32> &p_triangles, const mat4 &p_mvp, uint32 p_width, uint32 p_height) {
+    std::vector<float> depth(size_t(p_width) * p_height, OcclusionBuffer::clearDepth);
+    for (size_t t = 0; t + 2 < p_triangles.size(); t += 3) {
+        glm::dvec3 screen[3];
+        bool behind = false;
+        for (int i = 0; i < 3; i++) {
+            const vec4 clip = p_mvp * vec4(p_positions[p_triangles[t + i]], 1.0f);
+            behind |= clip.w <= OcclusionBuffer::nearW;
+            screen[i] = glm::dvec3((clip.x / clip.w * 0.5 + 0.5) * p_width, (clip.y / clip.w * 0.5 + 0.5) * p_height, clip.z / clip.w);
+        }
+        const double area = (screen[1].x - screen[0].x) * (screen[2].y - screen[0].y) - (screen[2].x - screen[0].x) * (screen[1].y - screen[0].y);
+        if (behind || area == 0.0) { continue; }
+        const int minX = std::max(int(std::floor(std::min({screen[0].x, screen[1].x, screen[2].x}))), 0);
+        const int minY = std::max(int(std::floor(std::min({screen[0].y, screen[1].y, screen[2].y}))), 0);
+        const int maxX = std::min(int(std::floor(std::max({screen[0].x, screen[1].x, screen[2].x}))), int(p_width) - 1);
+        const int maxY = std::min(int(std::floor(std::max({screen[0].y, screen[1].y, screen[2].y}))), int(p_height) - 1);
+        for (int y = minY; y <= maxY; y++) {
+            for (int x = minX; x <= maxX; x++) {
+                const glm::dvec2 p(x + 0.5, y + 0.5);
+                double barycentric[3];
+                for (int i = 0; i < 3; i++) {
+                    const glm::dvec3 &a = screen[(i + 1) % 3], &b = screen[(i + 2) % 3];
+                    barycentric[i] = ((b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x)) / area;
+                }
+                if (barycentric[0] < 0.0 || barycentric[1] < 0.0 || barycentric[2] < 0.0) { continue; }
+                const float z = float(barycentric[0] * screen[0].z + barycentric[1] * screen[1].z + barycentric[2] * screen[2].z);
+                float &pixel = depth[size_t(y) * p_width + x];
+                pixel = std::min(pixel, z);
+            }
+        }
+    }
+    return depth;
+}
+
+// Position of the parametric surface p_type at p_uv, parametricPosition of parametric.glsl for the types 0 to 8
+static vec3 parametricSurfacePoint(uint32 p_type, vec2 p_uv, float p_a, float p_b) {
+    const float pi = 3.14159265f;
+    switch (p_type) {
+    case 0: return vec3((p_a + p_b * std::cos(p_uv.y * 2.0f * pi)) * std::cos(p_uv.x * 2.0f * pi), (p_a + p_b * std::cos(p_uv.y * 2.0f * pi)) * std::sin(p_uv.x * 2.0f * pi), p_b * std::sin(p_uv.y * 2.0f * pi));
+    case 1: return p_a * vec3(std::sin(p_uv.x * pi) * std::cos(p_uv.y * 2.0f * pi), std::sin(p_uv.x * pi) * std::sin(p_uv.y * 2.0f * pi), std::cos(p_uv.x * pi));
+    case 2: {
+        const float t = p_uv.x * 2.0f * pi, s = (p_uv.y - 0.5f) * p_a;
+        return vec3((1.0f + s * std::cos(t / 2.0f)) * std::cos(t), (1.0f + s * std::cos(t / 2.0f)) * std::sin(t), s * std::sin(t / 2.0f));
+    }
+    case 3: {
+        const float t = p_uv.x * 2.0f * pi, s = p_uv.y * 2.0f * pi;
+        const float tube = p_a * (1.0f - std::cos(t) / 2.0f);
+        return vec3(p_a * std::cos(t) * (1.0f + std::sin(t)) + tube * std::cos(s), p_a * std::sin(t) * (1.0f + std::sin(t)) + tube * std::sin(s), tube * std::sin(s));
+    }
+    case 4: {
+        const float x = (p_uv.x - 0.5f) * 4.0f * p_a, y = (p_uv.y - 0.5f) * 4.0f * p_b;
+        return vec3(x, y, (x * x) / (p_a * p_a) - (y * y) / (p_b * p_b));
+    }
+    case 5: {
+        const float t = p_uv.x * 4.0f * pi;
+        return vec3(p_a * t * std::cos(t), p_a * t * std::sin(t), p_uv.y * 4.0f);
+    }
+    case 6: return vec3((1.0f - p_uv.y) * p_b * std::cos(p_uv.x * 2.0f * pi), (1.0f - p_uv.y) * p_b * std::sin(p_uv.x * 2.0f * pi), p_uv.y * p_a * 8.0f);
+    case 7: return vec3(p_b * std::cos(p_uv.x * 2.0f * pi), p_b * std::sin(p_uv.x * 2.0f * pi), (p_uv.y - 0.5f) * p_a);
+    case 8: return vec3(p_a * std::sin(p_uv.x * pi) * std::cos(p_uv.y * 2.0f * pi), p_a * std::sin(p_uv.x * pi) * std::sin(p_uv.y * 2.0f * pi), p_b * std::cos(p_uv.x * pi));
+    default: return vec3(0.0f);
+    }
+}
+
+// Usage: --bench occlusion [file.obj] [radius scale] [buffer width] [poses file]
+// Rasterizes the mesh into the CPU occlusion buffer and tests the bounding spheres of its elements against it, on orbit
+// poses or on the poses of a file (one "eye.x eye.y eye.z target.x target.y target.z" line per pose). The buffer is
+// checked against a brute force rasterization, and every occluded sphere against the reference depths. Checked first:
+// every parametric surface lies within parametricSurfaceRadius, and a known scene, a wall in front of the camera and
+// spheres behind, in front of and beside it.
+int benchOcclusion(const std::vector<std::string> &p_args) {
+    // the spheres of the elements are only as good as these radii, sampled on a uv grid for thin and wide parameters
+    bool radiiValid = true;
+    for (uint32 type = 0; type < 9; type++) {
+        for (const vec2 ab : {vec2(0.3f, 0.1f), vec2(1.0f, 0.5f), vec2(2.0f, 3.0f)}) {
+            const float radius = parametricSurfaceRadius(type, ab.x, ab.y);
+            float farthest = 0.0f;
+            for (uint32 v = 0; v <= 64; v++) {
+                for (uint32 u = 0; u <= 64; u++) { farthest = std::max(farthest, glm::length(parametricSurfacePoint(type, vec2(u, v) / 64.0f, ab.x, ab.y))); }
+            }
+            if (farthest > radius * 1.0001f) {
+                std::cout << "surface " << type << " (a " << ab.x << ", b " << ab.y << "): sample at " << farthest << " outside of radius " << radius << std::endl;
+                radiiValid = false;
+            }
+        }
+    }
+    std::cout << "surface radii: " << (radiiValid ? "bound every sample" : "TOO SMALL") << std::endl;
+
+    bool wallValid = false;
+    {
+        // 4 x 4 wall 5 units down -Z, it covers the directions up to 0.4 units off axis per unit of depth
+        const std::vector<vec3> wall = {vec3(-2, -2, -5), vec3(2, -2, -5), vec3(2, 2, -5), vec3(-2, 2, -5)};
+        const std::vector<uint32> wallTriangles = {0, 1, 2, 0, 2, 3};
+        const std::vector<vec4> spheres = {
+            vec4(0, 0, -10, 0.5f), // behind the wall center: occluded
+            vec4(0, 0, -3, 0.5f),  // in front of the wall
+            vec4(8, 0, -10, 0.5f), // behind, 0.8 off axis per unit of depth: beside the wall
+            vec4(4, 0, -10, 0.5f), // behind, across the edge of the wall: partly visible
+        };
+        mat4 projection = glm::perspective(glm::radians(90.0f), 16.0f / 9.0f, 0.01f, 100.0f);
+        projection[1][1] *= -1;
+        const mat4 mvp = projection * glm::lookAt(vec3(0), vec3(0, 0, -1), vec3(0, 1, 0));
+        OcclusionBuffer wallBuffer;
+        wallBuffer.resize(64, 36);
+        wallBuffer.rasterize(wall, wallTriangles, mvp, ThreadPool::global());
+        std::vector<uint32> visibility;
+        wallBuffer.testSpheres(spheres, mvp, visibility, ThreadPool::global());
+        wallValid = visibility.size() == 1 && visibility[0] == 0b1110;
+        std::cout << "wall: visibility " << (visibility.empty() ? 0u : visibility[0]) << (wallValid ? "" : "  (expected 14)") << std::endl;
+    }
+
+    const std::string path = argOr(p_args, 0, "assets/demo/dragon/dragon_coat.obj");
+    const float radiusScale = std::stof(argOr(p_args, 1, "0.6"));
+    const uint32 width = std::stoi(argOr(p_args, 2, "256"));
+    const std::string posesPath = argOr(p_args, 3, "");
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "File not found: " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    const uint32 height = width * 9 / 16;
+    const HalfEdgeMesh mesh = convertToHalfEdgeMesh(NgonLoader::loadNgonData(path));
+    const std::vector<uint32> triangles = triangulateFaces(mesh);
+    std::vector<vec3> positions;
+    std::vector<vec4> spheres;
+    skinVertexPositions(mesh, {}, positions, ThreadPool::global());
+    computeElementSpheres(mesh, {}, radiusScale, spheres, ThreadPool::global());
+    std::cout << path << ": " << triangles.size() / 3 << " triangles, " << spheres.size() << " elements, " << width << "x" << height << " buffer, " << ThreadPool::global().size()
+              << " workers" << std::endl;
+
+    std::vector<mat4> poses;
+    if (posesPath.empty()) {
+        const uint32 poseCount = 8;
+        vec3 eye;
+        for (uint32 pose = 0; pose < poseCount; ++pose) { poses.push_back(orbitViewProjection(mesh, pose, poseCount, eye)); }
+    } else {
+        std::ifstream file(posesPath);
+        vec3 eye, target;
+        mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.01f, 1000.0f);
+        projection[1][1] *= -1;
+        while (file >> eye.x >> eye.y >> eye.z >> target.x >> target.y >> target.z) { poses.push_back(projection * glm::lookAt(eye, target, vec3(0, 1, 0))); }
+        if (poses.empty()) {
+            std::cerr << "No pose in " << posesPath << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+
+    OcclusionBuffer buffer;
+    buffer.resize(width, height);
+    ThreadPool serialPool(0);
+    bool valid = radiiValid && wallValid;
+    for (size_t pose = 0; pose < poses.size(); ++pose) {
+        const mat4 &mvp = poses[pose];
+        std::vector<uint32> visibility;
+        const double serialMs = timeBest(3, [&] { buffer.rasterize(positions, triangles, mvp, serialPool); });
+        const double rasterMs = timeBest(3, [&] { buffer.rasterize(positions, triangles, mvp, ThreadPool::global()); });
+        const double testMs = timeBest(3, [&] { buffer.testSpheres(spheres, mvp, visibility, ThreadPool::global()); });
+
+        // coverage may differ on pixel centers lying on an edge, depths by the float rounding of the plane equation, large
+        // on slivers; what matters is that no sphere gets occluded by it
+        const std::vector<float> reference = rasterizeReference(positions, triangles, mvp, width, height);
+        uint32 coverageMismatches = 0;
+        float maxDepthError = 0.0f;
+        for (uint32 y = 0; y < height; y++) {
+            for (uint32 x = 0; x < width; x++) {
+                const float depth = buffer.getDepth(x, y), expected = reference[size_t(y) * width + x];
+                if ((depth == OcclusionBuffer::clearDepth) != (expected == OcclusionBuffer::clearDepth)) {
+                    coverageMismatches++;
+                } else if (depth != OcclusionBuffer::clearDepth) {
+                    maxDepthError = std::max(maxDepthError, std::abs(depth - expected));
+                }
+            }
+        }
+        // an occluded sphere must be behind the reference depth on every pixel of its screen box
+        uint32 wronglyOccluded = 0;
+        for (size_t i = 0; i < spheres.size(); i++) {
+            if (visibility[i / 32] & (1u << (i % 32))) { continue; }
+            vec2 screenMin(std::numeric_limits<float>::max()), screenMax(std::numeric_limits<float>::lowest());
+            float nearest = std::numeric_limits<float>::max();
+            for (int corner = 0; corner < 8; corner++) {
+                const vec3 offset((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f);
+                const vec4 clip = mvp * vec4(vec3(spheres[i]) + offset * spheres[i].w, 1.0f);
+                const vec2 screen = (vec2(clip) / clip.w * 0.5f + 0.5f) * vec2(width, height);
+                screenMin = glm::min(screenMin, screen);
+                screenMax = glm::max(screenMax, screen);
+                nearest = std::min(nearest, clip.z / clip.w);
+            }
+            bool visible = false;
+            for (int y = std::max(int(std::floor(screenMin.y)), 0); y <= std::min(int(std::floor(screenMax.y)), int(height) - 1); y++) {
+                for (int x = std::max(int(std::floor(screenMin.x)), 0); x <= std::min(int(std::floor(screenMax.x)), int(width) - 1); x++) { visible |= reference[size_t(y) * width + x] >= nearest + 1e-5f; }
+            }
+            wronglyOccluded += visible ? 1 : 0;
+        }
+        const OcclusionBuffer::Stats &stats = buffer.getStats();
+        const bool poseValid = coverageMismatches <= width * height / 1000 && wronglyOccluded <= spheres.size() / 1000;
+        valid &= poseValid;
+        std::cout << "  pose " << pose << ": " << stats.occludedBounds * 100.0f / float(spheres.size()) << "% occluded, " << stats.triangles << " triangles in " << stats.binnedTiles
+                  << " tile bins, raster " << rasterMs << " ms (serial " << serialMs << " ms), test " << testMs << " ms, " << coverageMismatches << " coverage mismatches, depth error "
+                  << maxDepthError << ", " << wronglyOccluded << " wrongly occluded" << (poseValid ? "" : "  (MISMATCH)") << std::endl;
+    }
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,106 @@
+#include "BenchmarkHelpers.hpp"
+
+#include <random>
+
+#include "MemoryAllocator.hpp"
+
+// Usage: --bench memory [meshes] [churn operations]
+// Drives the device memory allocator with a mock memory-properties table: the resources of p_meshes meshes, then
+// random frees and allocations. Checks placement, alignment and overlaps, and reports the block counts.
+int benchMemoryAllocator(const std::vector<std::string> &p_args) {
+    const uint32 meshCount = uint32(std::stoul(argOr(p_args, 0, "16")));
+    const uint32 churn = uint32(std::stoul(argOr(p_args, 1, "20000")));
+
+    // VkMemoryPropertyFlagBits values
+    constexpr uint32 deviceLocal = 0x1, hostVisible = 0x2, hostCoherent = 0x4;
+    // discrete GPU like table, the device local heap is limited to check the fallback on the next type
+    const std::vector<MemoryTypeInfo> types = {{deviceLocal, 0}, {hostVisible | hostCoherent, 1}, {deviceLocal | hostVisible | hostCoherent, 2}};
+    const std::vector<uint64> heapBudgets = {768ull << 20, 4096ull << 20, 256ull << 20};
+
+    struct MockBlock {
+        uint32 type;
+        uint64 size;
+    };
+    std::map<uint32, MockBlock> blocks;
+    std::vector<uint64> heapUsage(heapBudgets.size(), 0);
+    MemoryAllocator allocator;
+    allocator.init(
+        types,
+        [&](uint32 p_block, uint32 p_memoryType, uint64 p_size) {
+            const uint32 heap = types[p_memoryType].heapIndex;
+            if (heapUsage[heap] + p_size > heapBudgets[heap] || blocks.count(p_block)) { return false; }
+            heapUsage[heap] += p_size;
+            blocks[p_block] = {p_memoryType, p_size};
+            return true;
+        },
+        [&](uint32 p_block) {
+            heapUsage[types[blocks.at(p_block).type].heapIndex] -= blocks.at(p_block).size;
+            blocks.erase(p_block);
+        });
+
+    struct Request {
+        uint64 size, alignment;
+        uint32 typeBits, flags;
+        bool linear;
+    };
+    std::mt19937 rng(7);
+    auto randomSize = [&](uint64 p_min, uint64 p_max) { return std::uniform_int_distribution<uint64>(p_min, p_max)(rng); };
+    std::vector<Request> requests;
+    for (uint32 mesh = 0; mesh < meshCount; ++mesh) {
+        // half-edge SoA buffers, skin, LUT and UBOs, as created by MeshData and the renderer
+        for (uint32 i = 0; i < 17; ++i) { requests.push_back({randomSize(16 << 10, 2 << 20), 16, 0x7, deviceLocal, true}); }
+        for (uint32 i = 0; i < 3; ++i) { requests.push_back({randomSize(1 << 10, 256 << 10), 16, 0x7, deviceLocal, true}); }
+        for (uint32 i = 0; i < 2; ++i) { requests.push_back({256, 256, 0x6, hostVisible | hostCoherent, true}); }
+        requests.push_back({randomSize(4 << 20, 24 << 20), 4096, 0x5, deviceLocal, false}); // texture
+    }
+
+    uint64 failures = 0;
+    std::vector<std::pair<Request, MemoryAllocation>> live;
+    auto allocate = [&](const Request &p_request) {
+        const MemoryAllocation allocation = allocator.allocate(p_request.size, p_request.alignment, p_request.typeBits, p_request.flags, p_request.linear);
+        if (allocation.valid()) { live.emplace_back(p_request, allocation); } else { failures++; }
+    };
+    for (const Request &request : requests) { allocate(request); }
+    const MemoryAllocator::Stats loaded = allocator.getStats();
+
+    for (uint32 i = 0; i < churn && !live.empty(); ++i) {
+        const size_t index = std::uniform_int_distribution<size_t>(0, live.size() - 1)(rng);
+        allocator.free(live[index].second);
+        live[index] = live.back();
+        live.pop_back();
+        allocate(requests[std::uniform_int_distribution<size_t>(0, requests.size() - 1)(rng)]);
+    }
+
+    // placement checks, then overlaps between the ranges of each block
+    bool valid = findMemoryType(types, 0x7, deviceLocal) == 0 && findMemoryType(types, 0x6, hostVisible) == 1 && findMemoryType(types, 0x1, hostVisible) == ~0U;
+    std::map<uint32, std::vector<std::pair<uint64, uint64>>> ranges;
+    for (const auto &[request, allocation] : live) {
+        const auto block = blocks.find(allocation.block);
+        valid &= block != blocks.end() && block->second.type == allocation.memoryType;
+        valid &= (request.typeBits & (1u << allocation.memoryType)) && (types[allocation.memoryType].propertyFlags & request.flags) == request.flags;
+        valid &= allocation.offset % request.alignment == 0 && allocation.offset >= allocation.rangeOffset;
+        valid &= allocation.offset + request.size <= allocation.rangeOffset + allocation.rangeSize && block != blocks.end() && allocation.rangeOffset + allocation.rangeSize <= block->second.size;
+        ranges[allocation.block].emplace_back(allocation.rangeOffset, allocation.rangeOffset + allocation.rangeSize);
+    }
+    for (auto &[block, blockRanges] : ranges) {
+        std::sort(blockRanges.begin(), blockRanges.end());
+        for (size_t i = 1; i < blockRanges.size(); ++i) { valid &= blockRanges[i - 1].second <= blockRanges[i].first; }
+    }
+
+    const MemoryAllocator::Stats churned = allocator.getStats();
+    auto report = [](const char *p_label, const MemoryAllocator::Stats &p_stats) {
+        std::cout << p_label << ": " << p_stats.allocationCount << " resources in " << p_stats.liveBlocks << " blocks, " << p_stats.usedBytes / (1024 * 1024) << "/" << p_stats.reservedBytes / (1024 * 1024)
+                  << " MB used, " << p_stats.freeRangeCount << " free ranges, fragmentation " << p_stats.fragmentation() << ", " << p_stats.reclaimableBlocks << " reclaimable blocks" << std::endl;
+    };
+    report("Loaded", loaded);
+    report("After churn", churned);
+    std::cout << churned.deviceAllocations << " device allocations and " << churned.deviceFrees << " frees for " << requests.size() + churn << " resources, " << failures << " out of memory"
+              << (valid ? "" : "  (INVALID PLACEMENT)") << std::endl;
+
+    for (const auto &[request, allocation] : live) { allocator.free(allocation); }
+    const MemoryAllocator::Stats empty = allocator.getStats();
+    valid &= empty.allocationCount == 0 && empty.usedBytes == 0;
+    allocator.cleanup();
+    valid &= blocks.empty();
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
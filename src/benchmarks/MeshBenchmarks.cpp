@@ -0,0 +1,246 @@
+#include "BenchmarkHelpers.hpp"
+
+#include <random>
+
+#include "HalfEdgePacking.hpp"
+#include "HalfEdgeReorder.hpp"
+#include "ThreadPool.hpp"
+#include "loaders/HeMeshCache.hpp"
+#include "loaders/PositionGrid.hpp"
+
+// Usage: --bench obj [file.obj] [iterations]
+int benchObjParser(const std::vector<std::string> &p_args) {
+    const std::string path = argOr(p_args, 0, "assets/demo/dragon/dragon_coat.obj");
+    const uint32 iterations = std::stoi(argOr(p_args, 1, "5"));
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "File not found: " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    const double fileSizeMB = double(std::filesystem::file_size(path)) / (1024.0 * 1024.0);
+
+    NgonData reference = NgonLoader::loadNgonData(path, NgonLoader::ParserMode::STREAM);
+    std::cout << path << ": " << fileSizeMB << " MB, " << reference.vertices.size() << " vertices, " << reference.faces.size() << " faces" << std::endl;
+
+    const std::pair<NgonLoader::ParserMode, const char *> modes[] = {{NgonLoader::ParserMode::STREAM, "stream"}, {NgonLoader::ParserMode::MAPPED, "mapped"}, {NgonLoader::ParserMode::PARALLEL, "parallel"}};
+    bool allIdentical = true;
+    for (const auto &[mode, modeName] : modes) {
+        NgonData data;
+        double ms = timeBest(iterations, [&] { data = NgonLoader::loadNgonData(path, mode); });
+        bool identical = isBitIdentical(reference, data);
+        allIdentical &= identical;
+        std::cout << "  " << modeName << ": " << ms << " ms, " << fileSizeMB / (ms / 1000.0) << " MB/s" << (identical ? "" : "  (MISMATCH)") << std::endl;
+    }
+
+    // thread scaling of the parallel parser, the calling thread counts as one
+    const uint32 maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    for (uint32 threads = 1; threads <= maxThreads; threads = threads == maxThreads ? threads + 1 : std::min(threads * 2, maxThreads)) {
+        ThreadPool pool(threads - 1);
+        NgonData data;
+        double ms = timeBest(iterations, [&] { data = NgonLoader::loadNgonDataParallel(path, pool); });
+        bool identical = isBitIdentical(reference, data);
+        allIdentical &= identical;
+        std::cout << "  parallel x" << threads << ": " << ms << " ms, " << fileSizeMB / (ms / 1000.0) << " MB/s" << (identical ? "" : "  (MISMATCH)") << std::endl;
+    }
+    return allIdentical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Usage: --bench hemesh [file.obj] [iterations]
+int benchMeshCache(const std::vector<std::string> &p_args) {
+    const std::string path = argOr(p_args, 0, "assets/demo/dragon/dragon_coat.obj");
+    const uint32 iterations = std::stoi(argOr(p_args, 1, "5"));
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "File not found: " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    const std::string cachePath = std::filesystem::temp_directory_path().append("bench.hemesh").string();
+    const std::vector<vec4> noSkin;
+
+    HalfEdgeMesh reference;
+    uint64 sourceHash = 0;
+    double coldMs = timeBest(iterations, [&] {
+        sourceHash = HeMeshCache::hashFiles({path});
+        reference = convertToHalfEdgeMesh(NgonLoader::loadNgonData(path));
+        HeMeshCache::save(cachePath, sourceHash, reference, noSkin, noSkin);
+    });
+
+    HalfEdgeMesh cached;
+    std::vector<vec4> jointIndices, jointWeights;
+    bool valid = true;
+    double warmMs = timeBest(iterations, [&] {
+        HeMeshCache cache;
+        valid &= cache.open(cachePath, HeMeshCache::hashFiles({path}));
+        if (valid) { cache.read(cached, jointIndices, jointWeights); }
+    });
+    const double cacheSizeMB = double(std::filesystem::file_size(cachePath)) / (1024.0 * 1024.0);
+    std::filesystem::remove(cachePath);
+
+    const bool identical = valid && isBitIdentical(cached, reference);
+
+    std::cout << path << ": " << reference.nbVertices << " vertices, " << reference.nbFaces << " faces, cache " << cacheSizeMB << " MB" << std::endl;
+    std::cout << "  cold (parse + half-edge + save): " << coldMs << " ms" << std::endl;
+    std::cout << "  warm (hash + map + read): " << warmMs << " ms" << (identical ? "" : "  (MISMATCH)") << std::endl;
+    return identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Usage: --bench halfedge [max faces] [iterations] [file.obj]
+// Serial and parallel builders on quad grids from 10k faces up to max faces, plus an optional OBJ to check non-grid topology
+int benchHalfEdgeBuild(const std::vector<std::string> &p_args) {
+    const uint32 maxFaces = std::stoul(argOr(p_args, 0, "10000000"));
+    const uint32 iterations = std::stoi(argOr(p_args, 1, "3"));
+    const std::string objPath = argOr(p_args, 2, "");
+
+    bool allIdentical = true;
+    auto run = [&](const std::string &p_name, const NgonData &p_data) {
+        HalfEdgeMesh serial, parallel;
+        double serialMs = timeBest(iterations, [&] { serial = convertToHalfEdgeMesh(p_data); });
+        double parallelMs = timeBest(iterations, [&] { parallel = convertToHalfEdgeMeshParallel(p_data, ThreadPool::global()); });
+        bool identical = isBitIdentical(serial, parallel);
+        allIdentical &= identical;
+        const double faceCount = double(p_data.faces.size());
+        std::cout << "  " << p_name << ", " << p_data.faces.size() << " faces: serial " << serialMs << " ms (" << serialMs * 1e6 / faceCount << " ns/face), parallel "
+                  << parallelMs << " ms (" << parallelMs * 1e6 / faceCount << " ns/face)" << (identical ? "" : "  (MISMATCH)") << std::endl;
+    };
+
+    std::cout << "threads: " << ThreadPool::global().size() + 1 << std::endl;
+    for (uint32 faceCount = 10000; faceCount <= maxFaces; faceCount *= 10) { run("grid", makeGridMesh(faceCount)); }
+    if (!objPath.empty()) { run(objPath, NgonLoader::loadNgonData(objPath)); }
+    return allIdentical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Checks that the connectivity of p_mesh is self-consistent
+static bool isValidHalfEdgeMesh(const HalfEdgeMesh &p_mesh) {
+    const HalfEdges &he = p_mesh.halfEdges;
+    for (size_t i = 0; i < he.vertices.size(); ++i) {
+        if (he.next[he.prev[i]] != int(i) || he.faces[he.next[i]] != he.faces[i]) { return false; }
+        if (he.twins[i] >= 0 && p_mesh.vertexFaceIndices[he.twins[i]] != he.vertices[i]) { return false; }
+        if (p_mesh.vertexFaceIndices[he.next[i]] != he.vertices[i]) { return false; }
+    }
+    for (size_t f = 0; f < p_mesh.faces.edges.size(); ++f) {
+        if (he.faces[p_mesh.faces.edges[f]] != int(f)) { return false; }
+    }
+    for (size_t v = 0; v < p_mesh.vertices.edges.size(); ++v) {
+        if (p_mesh.vertices.edges[v] >= 0 && he.vertices[p_mesh.vertices.edges[v]] != int(v)) { return false; }
+    }
+    return true;
+}
+
+// Usage: --bench reorder [file.obj]
+int benchReordering(const std::vector<std::string> &p_args) {
+    const std::string path = argOr(p_args, 0, "assets/demo/dragon/dragon_coat.obj");
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "File not found: " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    const HalfEdgeMesh mesh = convertToHalfEdgeMesh(NgonLoader::loadNgonData(path));
+    HalfEdgeMesh reordered;
+    double ms = timeBest(3, [&] { reordered = applyReordering(mesh, computeLocalityOrder(mesh)); });
+
+    const LocalityStats before = computeLocalityStats(mesh);
+    const LocalityStats after = computeLocalityStats(reordered);
+    const bool valid = isValidHalfEdgeMesh(reordered);
+    std::cout << path << ": " << mesh.nbVertices << " vertices, " << mesh.nbFaces << " faces, reordered in " << ms << " ms" << (valid ? "" : "  (INVALID MESH)") << std::endl;
+    std::cout << "  face neighbour distance: " << before.faceNeighbourDistance << " -> " << after.faceNeighbourDistance << std::endl;
+    std::cout << "  face vertex span: " << before.faceVertexSpan << " -> " << after.faceVertexSpan << std::endl;
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Usage: --bench packing [file.obj] [grid faces]
+// Packs half-edge meshes into the single GPU buffer layout, checks the header and the alignment of every array, and
+// that unpacking gives back the same mesh
+int benchHalfEdgePacking(const std::vector<std::string> &p_args) {
+    const std::string path = argOr(p_args, 0, "assets/demo/dragon/dragon_coat.obj");
+    const uint32 gridFaces = uint32(std::stoul(argOr(p_args, 1, "100000")));
+
+    std::vector<std::pair<std::string, HalfEdgeMesh>> meshes;
+    meshes.emplace_back("grid", convertToHalfEdgeMesh(makeGridMesh(gridFaces)));
+    meshes.emplace_back("empty", HalfEdgeMesh{});
+    if (std::filesystem::exists(path)) { meshes.emplace_back(path, convertToHalfEdgeMesh(NgonLoader::loadNgonData(path))); }
+
+    bool allValid = true;
+    for (const auto &[name, mesh] : meshes) {
+        std::vector<uint32> packed;
+        const double packMs = timeBest(3, [&] { packed = packHalfEdgeMesh(mesh); });
+
+        // arrays aligned, in order, inside the buffer, and holding the element counts of the mesh
+        bool valid = packed.size() % hePackedAlignmentWords == 0;
+        uint32 end = hePackedHeaderWords, array = 0;
+        size_t payloadBytes = 0;
+        forEachHeArray(mesh, [&](const auto &p_data) {
+            const uint32 offset = hePackedOffset(packed, HePackedArray(array));
+            const size_t words = p_data.size() * sizeof(p_data[0]) / sizeof(uint32);
+            valid &= offset % hePackedAlignmentWords == 0 && offset >= end && offset + words <= packed.size();
+            valid &= hePackedCount(packed, HePackedArray(array)) == p_data.size();
+            end = uint32(offset + words);
+            payloadBytes += words * sizeof(uint32);
+            array++;
+        });
+
+        HalfEdgeMesh unpacked;
+        const double unpackMs = timeBest(3, [&] { unpacked = unpackHalfEdgeMesh(packed); });
+        valid &= isBitIdentical(mesh, unpacked) && unpacked.nbVertices == mesh.vertices.positions.size() && unpacked.nbFaces == mesh.faces.edges.size();
+        allValid &= valid;
+        std::cout << name << ": " << packed.size() * sizeof(uint32) / 1024 << " KB packed, " << (packed.size() * sizeof(uint32) - payloadBytes) << " bytes of header and padding, pack " << packMs << " ms, unpack "
+                  << unpackMs << " ms" << (valid ? "" : "  (INVALID LAYOUT)") << std::endl;
+    }
+    return allValid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Usage: --bench skin [file.obj] [naive samples]
+// Matches glTF-like vertices (split, shuffled and jittered copies of the mesh vertices plus strays) against the mesh
+// vertices with the grid used by updateNgonMeshWithBoneData, and checks it against the first-match linear search
+int benchSkinTransfer(const std::vector<std::string> &p_args) {
+    const std::string path = argOr(p_args, 0, "assets/demo/dragon/dragon_coat.obj");
+    const size_t naiveSamples = std::stoul(argOr(p_args, 1, "2000"));
+    if (!std::filesystem::exists(path)) {
+        std::cerr << "File not found: " << path << std::endl;
+        return EXIT_FAILURE;
+    }
+    const NgonData ngon = NgonLoader::loadNgonData(path);
+    std::vector<vec3> positions(ngon.vertices.size());
+    for (size_t j = 0; j < ngon.vertices.size(); ++j) { positions[j] = ngon.vertices[j].position; }
+
+    const float skinMatchEpsilon = 1e-5f; // same as in GLTFLoader.hpp, which needs tinygltf
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> jitter(-0.5f * skinMatchEpsilon, 0.5f * skinMatchEpsilon);
+    std::vector<vec3> queries;
+    for (const vec3 &position : positions) {
+        queries.push_back(position); // glTF splits vertices along seams, each position shows up a few times
+        queries.push_back(position + vec3(jitter(rng), jitter(rng), jitter(rng)));
+    }
+    for (size_t i = 0; i < positions.size() / 100 + 1; ++i) { queries.push_back(positions[i] + vec3(10.0f * skinMatchEpsilon)); }
+    std::shuffle(queries.begin(), queries.end(), rng);
+
+    std::vector<int> matches(queries.size());
+    double ms = timeBest(3, [&] {
+        const PositionGrid grid(positions, skinMatchEpsilon);
+        ThreadPool::global().parallelFor(queries.size(), [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) { matches[i] = grid.findFirst(queries[i]); }
+        }, 1024);
+    });
+    const size_t unmatched = std::count(matches.begin(), matches.end(), -1);
+    std::cout << path << ": " << queries.size() << " vertices matched against " << positions.size() << " in " << ms << " ms (grid build included), " << unmatched << " unmatched" << std::endl;
+
+    // reference: the linear search updateNgonMeshWithBoneData used, on a sample of the queries
+    const size_t sampleCount = std::min(naiveSamples, queries.size());
+    size_t mismatches = 0;
+    auto naive = std::chrono::high_resolution_clock::now();
+    for (size_t i = 0; i < sampleCount; ++i) {
+        int expected = -1;
+        for (size_t j = 0; j < positions.size(); ++j) {
+            if (glm::distance(queries[i], positions[j]) < skinMatchEpsilon) {
+                expected = int(j);
+                break;
+            }
+        }
+        mismatches += expected != matches[i] ? 1 : 0;
+    }
+    double naiveMs = millisecondsD(std::chrono::high_resolution_clock::now() - naive).count();
+    std::cout << "  linear search: " << naiveMs / double(std::max<size_t>(sampleCount, 1)) * double(queries.size()) << " ms estimated from " << sampleCount << " samples, "
+              << mismatches << " mismatches" << (mismatches ? "  (DIFFERENT)" : "") << std::endl;
+
+    // points far outside the int range of the cells share the border cells, their distance still separates them
+    const PositionGrid farGrid({vec3(3e38f, 0.0f, 0.0f), vec3(-3e38f, 0.0f, 0.0f), vec3(1.0f, 2.0f, 3.0f)}, skinMatchEpsilon);
+    const bool farMatches = farGrid.findFirst(vec3(3e38f, 0.0f, 0.0f)) == 0 && farGrid.findFirst(vec3(-3e38f, 0.0f, 0.0f)) == 1 && farGrid.findFirst(vec3(1.0f, 2.0f, 3.0f)) == 2 && farGrid.findFirst(vec3(2e38f, 0.0f, 0.0f)) == -1;
+    std::cout << "  far points: " << (farMatches ? "matched" : "DIFFERENT") << std::endl;
+    return mismatches == 0 && farMatches ? EXIT_SUCCESS : EXIT_FAILURE;
+}
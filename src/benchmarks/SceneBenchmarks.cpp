@@ -0,0 +1,253 @@
+#include "BenchmarkHelpers.hpp"
+
+#include <fstream>
+#include <random>
+
+#include "Clusters.hpp"
+#include "CompletionQueue.hpp"
+#include "FrameRecorder.hpp"
+#include "HalfEdgePacking.hpp"
+#include "HalfEdgeReorder.hpp"
+#include "OcclusionCulling.hpp"
+#include "TaskGrid.hpp"
+#include "ThreadPool.hpp"
+#include "loaders/CameraPath.hpp"
+#include "loaders/HeMeshCache.hpp"
+#include "loaders/SceneLoader.hpp"
+
+// Usage: --bench scene [file.scene] [file.obj]
+// Loads the instances of a scene and checks the grids of the dragon and the coat line up, the poses shared by the
+// instances, and that the flat workgroup IDs of an instanced draw split by planTaskGrid reach every workgroup of every
+// instance once. Reports the memory of the shared mesh against one copy per instance.
+int benchScene(const std::vector<std::string> &p_args) {
+    const std::string scenePath = argOr(p_args, 0, "assets/scenes/crowd.scene");
+    const std::string meshPath = argOr(p_args, 1, "assets/demo/dragon/dragon_coat.obj");
+    if (!std::filesystem::exists(scenePath) || !std::filesystem::exists(meshPath)) {
+        std::cerr << "File not found: " << scenePath << " or " << meshPath << std::endl;
+        return EXIT_FAILURE;
+    }
+    Scene scene;
+    const double loadMs = timeBest(1, [&] { scene = Scene(); scene.load(scenePath); });
+    std::cout << scenePath << ": " << scene.instanceCount() << " instances of " << scene.instances.size() << " meshes in " << loadMs << " ms" << std::endl;
+
+    bool valid = scene.instanceCount() > 0;
+    const std::vector<SceneInstance> &dragons = scene.instances["Dragon"];
+    const std::vector<SceneInstance> &coats = scene.instances["Coat"];
+    if (!coats.empty()) {
+        bool aligned = dragons.size() == coats.size();
+        for (size_t i = 0; aligned && i < dragons.size(); i++) { aligned = dragons[i].transform == coats[i].transform && dragons[i].animationOffset == coats[i].animationOffset; }
+        std::cout << "  coats " << (aligned ? "aligned with" : "NOT ALIGNED with") << " the dragons" << std::endl;
+        valid &= aligned;
+    }
+
+    // explicit instances, default arguments, a line that cannot be parsed and a 3 x 2 grid spaced by 2 around the
+    // origin, with 4 poses over 2 seconds
+    const std::string inlinePath = std::filesystem::temp_directory_path().append("bench.scene").string();
+    std::ofstream(inlinePath) << "instance Dragon 1 2 3\ninstance Dragon 0 0 0 90 2 1.5 0.25 # comment\ninstance Dragon oops\n\ngrid Coat 3 2 2 4 2 5\n";
+    Scene inlineScene;
+    bool parsedValid = inlineScene.load(inlinePath) && inlineScene.instanceCount() == 8 && inlineScene.instances["Coat"].size() == 6;
+    if (parsedValid) {
+        const std::vector<SceneInstance> &parsed = inlineScene.instances["Dragon"];
+        parsedValid &= parsed[0].transform[3] == vec4(1, 2, 3, 1) && parsed[0].elementScaling == 1.0f && parsed[0].animationOffset == 0.0f;
+        parsedValid &= std::abs(parsed[1].transform[0].z + 2.0f) < 1e-5f && parsed[1].elementScaling == 1.5f && parsed[1].animationOffset == 0.25f; // yaw 90 sends x to -z
+        const std::vector<vec4> gridPositions = {vec4(-2, 0, -1, 1), vec4(0, 0, -1, 1), vec4(2, 0, -1, 1), vec4(-2, 0, 1, 1), vec4(0, 0, 1, 1), vec4(2, 0, 1, 1)}; // row by row
+        const std::vector<SceneInstance> &grid = inlineScene.instances["Coat"];
+        for (size_t i = 0; i < grid.size(); i++) {
+            const float offset = grid[i].animationOffset;
+            parsedValid &= grid[i].transform[3] == gridPositions[i] && std::abs(glm::length(vec3(grid[i].transform[0])) - 1.0f) < 1e-5f;
+            parsedValid &= grid[i].elementScaling >= 0.8f && grid[i].elementScaling <= 1.2f && (offset == 0.0f || offset == 0.5f || offset == 1.0f || offset == 1.5f);
+        }
+    }
+    std::filesystem::remove(inlinePath);
+    std::cout << "  parsed scene: " << (parsedValid ? "as written" : "WRONG") << std::endl;
+    valid &= parsedValid;
+
+    // poses numbered by first use, a scene without instance still has the pose of offset 0
+    std::vector<SceneInstance> offsetInstances(5);
+    const float offsets[5] = {0.5f, 0.0f, 0.5f, 0.25f, 0.0f};
+    for (size_t i = 0; i < offsetInstances.size(); i++) { offsetInstances[i].animationOffset = offsets[i]; }
+    const InstancePalettes known = groupAnimationOffsets(offsetInstances);
+    const bool palettesValid = known.offsets == std::vector<float>{0.5f, 0.0f, 0.25f} && known.instancePalette == std::vector<uint32>{0, 1, 0, 2, 1} && groupAnimationOffsets({}).offsets == std::vector<float>{0.0f};
+    std::cout << "  known poses: " << (palettesValid ? "grouped" : "WRONG") << std::endl;
+    valid &= palettesValid;
+
+    const InstancePalettes palettes = groupAnimationOffsets(dragons);
+    for (size_t i = 0; i < dragons.size(); i++) { valid &= palettes.offsets[palettes.instancePalette[i]] == dragons[i].animationOffset; }
+    std::cout << "  " << dragons.size() << " dragons share " << palettes.offsets.size() << " poses" << std::endl;
+
+    // one task workgroup per 32 elements (TASK_GROUP_SIZE), the instances follow each other in the flat IDs
+    const HalfEdgeMesh mesh = convertToHalfEdgeMesh(NgonLoader::loadNgonData(meshPath));
+    const uint32 instanceCount = std::max(uint32(dragons.size()), 1u);
+    const uint32 groupsPerInstance = uint32(mesh.faces.edges.size() + mesh.vertices.positions.size() + 31) / 32;
+    const std::vector<TaskGridDraw> draws = planTaskGrid(groupsPerInstance * instanceCount, TaskGridLimits());
+    std::vector<uint32> hits(size_t(groupsPerInstance) * instanceCount, 0);
+    for (const TaskGridDraw &draw : draws) {
+        for (uint32 y = 0; y < draw.y; y++) {
+            for (uint32 x = 0; x < draw.x; x++) {
+                const uint32 flat = draw.firstWorkGroup + y * draw.x + x;
+                const uint32 instance = flat / groupsPerInstance, group = flat % groupsPerInstance; // flatInstanceId, instanceGroupId
+                hits[size_t(instance) * groupsPerInstance + group]++;
+            }
+        }
+    }
+    const bool covered = std::all_of(hits.begin(), hits.end(), [](uint32 hit) { return hit == 1; });
+    valid &= covered;
+    std::cout << "  " << instanceCount << " x " << groupsPerInstance << " task workgroups in " << draws.size() << " draws" << (covered ? "" : "  (NOT COVERED)") << std::endl;
+
+    const double meshMB = double(packHalfEdgeMesh(mesh).size() * sizeof(uint32)) / (1024.0 * 1024.0);
+    const uint32 instanceDataSize = 80; // sizeof(shaderInterface::InstanceData), static_assert next to it
+    const double instancesMB = double(instanceCount * instanceDataSize) / (1024.0 * 1024.0);
+    std::cout << "  half-edge buffers: " << meshMB + instancesMB << " MB shared with an instance buffer, " << meshMB * instanceCount << " MB with a copy per instance" << std::endl;
+    return valid ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Usage: --bench loading [pushes per producer] [grid faces]
+// CompletionQueue with a producer per worker against the render thread popping as it goes: every value must come out
+// once, in push order for each producer. Then the CPU half of the mesh loading (parse, half-edge, reordering, clusters,
+// occluder) of the demo meshes and a synthetic grid, one after another then as jobs of the pool, with the time the
+// first and the last mesh became available.
+int benchLoading(const std::vector<std::string> &p_args) {
+    const uint32 pushes = std::stoul(argOr(p_args, 0, "100000"));
+    const uint32 gridFaces = std::stoul(argOr(p_args, 1, "1000000"));
+    ThreadPool &pool = ThreadPool::global();
+
+    const uint32 producers = std::max(pool.size(), 1u);
+    CompletionQueue<uint64> queue;
+    std::vector<std::future<void>> jobs;
+    for (uint32 producer = 0; producer < producers; producer++) {
+        jobs.push_back(pool.submit([&queue, producer, pushes] {
+            for (uint32 i = 0; i < pushes; i++) { queue.push(uint64(producer) << 32 | i); }
+        }));
+    }
+    std::vector<uint32> nextValue(producers, 0);
+    uint64 received = 0, pops = 0;
+    bool ordered = true;
+    const double queueMs = timeBest(1, [&] {
+        while (received < uint64(producers) * pushes) {
+            for (uint64 value : queue.popAll()) {
+                const uint32 producer = uint32(value >> 32);
+                ordered &= producer < producers && uint32(value) == nextValue[producer]++;
+                received++;
+            }
+            pops++;
+        }
+    });
+    for (std::future<void> &job : jobs) { job.wait(); }
+    ordered &= queue.popAll().empty();
+    std::cout << "queue: " << received << " values from " << producers << " producers in " << pops << " pops, " << queueMs << " ms" << (ordered ? "" : "  (LOST OR REORDERED)") << std::endl;
+
+    struct LoadedMesh {
+        HalfEdgeMesh heMesh;
+        MeshClusters clusters;
+        std::vector<uint32> occluderTriangles;
+    };
+    std::vector<std::function<NgonData()>> sources;
+    for (const char *path : {"assets/demo/dragon/dragon_coat.obj", "assets/demo/ground.obj"}) {
+        if (std::filesystem::exists(path)) { sources.push_back([path = std::string(path)] { return NgonLoader::loadNgonData(path); }); }
+    }
+    sources.push_back([gridFaces] { return makeGridMesh(gridFaces); });
+    auto load = [&pool](const std::function<NgonData()> &p_source) {
+        LoadedMesh mesh;
+        const HalfEdgeMesh heMesh = convertToHalfEdgeMeshParallel(p_source(), pool);
+        mesh.heMesh = applyReordering(heMesh, computeLocalityOrder(heMesh));
+        mesh.clusters = buildClusters(mesh.heMesh);
+        mesh.occluderTriangles = triangulateFaces(mesh.heMesh);
+        return mesh;
+    };
+
+    using Clock = std::chrono::high_resolution_clock;
+    const Clock::time_point serialStart = Clock::now();
+    double serialFirstMs = 0.0;
+    std::vector<LoadedMesh> serial;
+    for (const std::function<NgonData()> &source : sources) {
+        serial.push_back(load(source));
+        if (serial.size() == 1) { serialFirstMs = millisecondsD(Clock::now() - serialStart).count(); }
+    }
+    const double serialMs = millisecondsD(Clock::now() - serialStart).count();
+
+    // same completion path as App::loadMeshesAsync, the results are picked up by polling the queue
+    const Clock::time_point asyncStart = Clock::now();
+    double asyncFirstMs = 0.0;
+    std::vector<LoadedMesh> async(sources.size());
+    CompletionQueue<size_t> completed;
+    jobs.clear();
+    for (size_t i = 0; i < sources.size(); i++) {
+        jobs.push_back(pool.submit([&, i] {
+            async[i] = load(sources[i]);
+            completed.push(i);
+        }));
+    }
+    for (size_t done = 0; done < sources.size();) {
+        const size_t count = completed.popAll().size();
+        if (done == 0 && count > 0) { asyncFirstMs = millisecondsD(Clock::now() - asyncStart).count(); }
+        done += count;
+        if (count == 0) { std::this_thread::yield(); }
+    }
+    const double asyncMs = millisecondsD(Clock::now() - asyncStart).count();
+    for (std::future<void> &job : jobs) { job.wait(); }
+
+    bool identical = true;
+    for (size_t i = 0; i < sources.size(); i++) {
+        identical &= isBitIdentical(serial[i].heMesh, async[i].heMesh) && isBitIdentical(serial[i].occluderTriangles, async[i].occluderTriangles);
+    }
+    std::cout << sources.size() << " meshes, threads: " << pool.size() + 1 << std::endl;
+    std::cout << "  serial: first " << serialFirstMs << " ms, all " << serialMs << " ms" << std::endl;
+    std::cout << "  jobs:   first " << asyncFirstMs << " ms, all " << asyncMs << " ms" << (identical ? "" : "  (MISMATCH)") << std::endl;
+    return ordered && identical ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Usage: --bench scripted [file.campath] [frames]
+// The CPU side of the scripted benchmark mode: the camera path goes through its keys without jumps and is the same for
+// the same clock, the percentiles match a sorted reference, and the frame CSV holds one row per frame.
+int benchScripted(const std::vector<std::string> &p_args) {
+    const std::string pathFile = argOr(p_args, 0, "assets/scenes/dragon_orbit.campath");
+    const uint32 frames = std::stoul(argOr(p_args, 1, "600"));
+    CameraPath path;
+    if (!path.load(pathFile)) { return EXIT_FAILURE; }
+
+    bool throughKeys = true;
+    for (const CameraKey &key : path.keys) {
+        const CameraKey sample = path.sample(key.time);
+        throughKeys &= glm::length(sample.position - key.position) < 1e-4f && glm::length(sample.lookAt - key.lookAt) < 1e-4f;
+    }
+    // largest move between two frames at 60 Hz against the largest straight distance between two keys per frame
+    float maxStep = 0.0f, maxKeyStep = 0.0f;
+    for (uint32 frame = 1; frame < frames; frame++) { maxStep = std::max(maxStep, glm::length(path.sample(frame / 60.0f).position - path.sample((frame - 1) / 60.0f).position)); }
+    for (size_t i = 1; i < path.keys.size(); i++) { maxKeyStep = std::max(maxKeyStep, glm::length(path.keys[i].position - path.keys[i - 1].position) / ((path.keys[i].time - path.keys[i - 1].time) * 60.0f)); }
+    const bool smooth = maxStep < 2.0f * maxKeyStep + 1e-5f;
+    const bool repeatable = path.sample(3.3f).position == path.sample(3.3f).position;
+    std::cout << pathFile << ": " << path.keys.size() << " keys, " << path.duration() << " s, largest step " << maxStep << " (keys " << maxKeyStep << ")"
+              << (throughKeys ? "" : "  (MISSES A KEY)") << (smooth && repeatable ? "" : "  (JUMPS)") << std::endl;
+
+    std::mt19937 rng(7);
+    std::lognormal_distribution<double> frameMs(1.5, 0.3);
+    std::vector<double> values(frames);
+    for (double &value : values) { value = frameMs(rng); }
+    std::vector<double> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    bool percentiles = percentile({}, 50.0) == 0.0 && percentile({4.0, 1.0, 3.0, 2.0}, 50.0) == 2.0 && percentile({4.0, 1.0, 3.0, 2.0}, 100.0) == 4.0;
+    for (double percent : {1.0, 50.0, 90.0, 99.0}) { percentiles &= percentile(values, percent) == sorted[size_t(std::ceil(percent / 100.0 * frames)) - 1]; }
+    const FrameStatsSummary summary = summarizeFrameStats(values);
+    percentiles &= summary.p50 <= summary.p90 && summary.p90 <= summary.p95 && summary.p95 <= summary.p99 && summary.p99 <= summary.max && summary.max == sorted.back();
+    std::cout << "  " << frames << " frames: p50 " << summary.p50 << ", p99 " << summary.p99 << ", max " << summary.max << (percentiles ? "" : "  (WRONG PERCENTILES)") << std::endl;
+
+    FrameRecorder recorder;
+    recorder.reset(frames);
+    for (uint32 frame = 0; frame < frames; frame++) {
+        recorder[frame].time = frame / 60.0f;
+        recorder[frame].cpuMs = values[frame];
+        if (frame % 2 == 0) { recorder[frame].gpuMs = values[frame] * 0.5; } // the other frames were not read back
+    }
+    const std::string csvPath = std::filesystem::temp_directory_path().append("bench_frames.csv").string();
+    const std::string summaryPath = std::filesystem::temp_directory_path().append("bench_frames_summary.csv").string();
+    bool written = recorder.writeCsv(csvPath) && recorder.writeSummaryCsv(summaryPath);
+    std::ifstream csv(csvPath), summaryCsv(summaryPath);
+    uint32 rows = 0, summaryRows = 0;
+    for (std::string line; std::getline(csv, line);) { rows++; }
+    for (std::string line; std::getline(summaryCsv, line);) { summaryRows++; }
+    written &= rows == frames + 1 && summaryRows == 3; // header, cpu_ms and gpu_ms, no triangles
+    std::filesystem::remove(csvPath);
+    std::filesystem::remove(summaryPath);
+    std::cout << "  CSV: " << rows << " lines, summary " << summaryRows << " lines" << (written ? "" : "  (WRONG)") << std::endl;
+    return throughKeys && smooth && repeatable && percentiles && written ? EXIT_SUCCESS : EXIT_FAILURE;
+}
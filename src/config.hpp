@@ -4,6 +4,7 @@
 
 #define ROOT_IDENTIFIER ".root"
 constexpr bool enableValidationLayers = true;
+constexpr const char *pipelineCachePath = "shaders/_autogen/pipelines.cache"; // next to the SPIR-V it was built from
 
 inline void setWorkingDirectoryToProjectRoot() {
     std::filesystem::path exePath = std::filesystem::current_path();
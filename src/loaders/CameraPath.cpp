@@ -0,0 +1,46 @@
+#include "CameraPath.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+bool CameraPath::load(const std::string &p_path) {
+    std::ifstream file(p_path);
+    if (!file) {
+        std::cerr << "Could not open camera path: " << p_path << std::endl;
+        return false;
+    }
+    keys.clear();
+    std::string line;
+    for (uint32 lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) { continue; }
+        std::istringstream stream(line);
+        CameraKey key;
+        const bool valid = bool(stream >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.lookAt.x >> key.lookAt.y >> key.lookAt.z);
+        if (valid && (keys.empty() || key.time > keys.back().time)) {
+            keys.push_back(key);
+        } else {
+            std::cerr << p_path << ":" << lineNumber << ": cannot parse \"" << line << "\", expected increasing times" << std::endl;
+        }
+    }
+    return !keys.empty();
+}
+
+static vec3 catmullRom(const vec3 &p_0, const vec3 &p_1, const vec3 &p_2, const vec3 &p_3, float p_t) {
+    const float t2 = p_t * p_t, t3 = t2 * p_t;
+    return 0.5f * (2.0f * p_1 + (p_2 - p_0) * p_t + (2.0f * p_0 - 5.0f * p_1 + 4.0f * p_2 - p_3) * t2 + (3.0f * p_1 - p_0 - 3.0f * p_2 + p_3) * t3);
+}
+
+CameraKey CameraPath::sample(float p_time) const {
+    if (keys.empty()) { return CameraKey{p_time}; }
+    if (p_time <= keys.front().time) { return {p_time, keys.front().position, keys.front().lookAt}; }
+    if (p_time >= keys.back().time) { return {p_time, keys.back().position, keys.back().lookAt}; }
+
+    // segment [i, i + 1] holds p_time, the end keys are repeated as their own neighbour
+    const size_t i = size_t(std::upper_bound(keys.begin(), keys.end(), p_time, [](float time, const CameraKey &key) { return time < key.time; }) - keys.begin()) - 1;
+    const CameraKey &k0 = keys[i > 0 ? i - 1 : 0], &k1 = keys[i], &k2 = keys[i + 1], &k3 = keys[std::min(i + 2, keys.size() - 1)];
+    const float t = (p_time - k1.time) / (k2.time - k1.time);
+    return {p_time, catmullRom(k0.position, k1.position, k2.position, k3.position, t), catmullRom(k0.lookAt, k1.lookAt, k2.lookAt, k3.lookAt, t)};
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+
+struct CameraKey {
+    float time = 0.0f; // seconds
+    vec3 position = vec3(0.0f);
+    vec3 lookAt = vec3(0.0f);
+};
+
+// Camera keyframes read from a text file, one per line: <time> <position x y z> <look at x y z>, in increasing time.
+// # starts a comment.
+struct CameraPath {
+    std::vector<CameraKey> keys;
+
+    // false when the file cannot be read or holds no key, the lines that cannot be parsed are reported and skipped
+    bool load(const std::string &p_path);
+    float duration() const { return keys.empty() ? 0.0f : keys.back().time - keys.front().time; }
+    // Catmull-Rom spline through the keys, held at the first and last key outside of the path
+    CameraKey sample(float p_time) const;
+};
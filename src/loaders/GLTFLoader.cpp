@@ -4,8 +4,13 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include "GLTFLoader.hpp"
+#include "PositionGrid.hpp"
+#include "ThreadPool.hpp"
 #include "defines.hpp"
 
+#include <algorithm>
+#include <unordered_map>
+
 void extractSkeleton(const tinygltf::Model &model, Skeleton &skeleton) {
     if (model.skins.empty()) {
         std::cerr << "No skins found in the glTF model." << std::endl;
@@ -28,6 +33,9 @@ void extractSkeleton(const tinygltf::Model &model, Skeleton &skeleton) {
     }
 
     // Build the bone hierarchy
+    std::unordered_map<int, int> nodeToBone;
+    for (size_t i = 0; i < skin.joints.size(); ++i) { nodeToBone[skin.joints[i]] = static_cast<int>(i); }
+
     skeleton.bones.resize(skin.joints.size());
     for (size_t i = 0; i < skin.joints.size(); ++i) {
         int nodeIndex = skin.joints[i];
@@ -37,50 +45,33 @@ void extractSkeleton(const tinygltf::Model &model, Skeleton &skeleton) {
         bone.nodeIndex = nodeIndex;
         bone.name = node.name;
         bone.parentIndex = -1; // Default to -1 (no parent)
+        bone.childrenIndices.clear();
 
         // Set inverse bind matrix
         bone.inverseBindMatrix = inverseBindMatrices.empty() ? glm::mat4(1.0f) : inverseBindMatrices[i];
 
-        // Initialize animation data
-        bone.animTranslation = getNodeTranslation(node);
-        bone.animRotation = getNodeRotation(node);
-        bone.animScale = getNodeScale(node);
-        bone.localTransform = getNodeTransform(node);
-
-        // Find parent bone
-        for (size_t j = 0; j < skin.joints.size(); ++j) {
-            const tinygltf::Node &parentNode = model.nodes[skin.joints[j]];
-            if (std::find(parentNode.children.begin(), parentNode.children.end(), nodeIndex) != parentNode.children.end()) {
-                bone.parentIndex = j;
-                skeleton.bones[j].childrenIndices.push_back(i);
-                break;
-            }
-        }
+        // Rest pose
+        getNodeRestPose(node, bone.restTranslation, bone.restRotation, bone.restScale);
     }
-}
-
-void computeGlobalTransform(const Skeleton &skeleton, int boneIndex, std::vector<glm::mat4> &globalTransforms) {
-    const Skeleton::Bone &bone = skeleton.bones[boneIndex];
-
-    glm::mat4 localTransform = bone.localTransform;
-
-    if (bone.parentIndex != -1) {
-        computeGlobalTransform(skeleton, bone.parentIndex, globalTransforms);
-        globalTransforms[boneIndex] = globalTransforms[bone.parentIndex] * localTransform;
-    } else { globalTransforms[boneIndex] = localTransform; }
-}
-
-void computeBoneMatrices(const Skeleton &skeleton, std::vector<glm::mat4> &boneMatrices) {
-    boneMatrices.resize(skeleton.bones.size());
-    std::vector<glm::mat4> globalTransforms(skeleton.bones.size());
 
+    // Find parent bones, the first joint listing the node as a child
+    for (size_t j = 0; j < skin.joints.size(); ++j) {
+        for (int child : model.nodes[skin.joints[j]].children) {
+            auto it = nodeToBone.find(child);
+            if (it != nodeToBone.end() && skeleton.bones[it->second].parentIndex == -1) { skeleton.bones[it->second].parentIndex = static_cast<int>(j); }
+        }
+    }
     for (size_t i = 0; i < skeleton.bones.size(); ++i) {
-        computeGlobalTransform(skeleton, i, globalTransforms);
-        boneMatrices[i] = globalTransforms[i] * skeleton.bones[i].inverseBindMatrix;
+        if (skeleton.bones[i].parentIndex != -1) { skeleton.bones[skeleton.bones[i].parentIndex].childrenIndices.push_back(static_cast<int>(i)); }
     }
+
+    skeleton.buildPose();
 }
 
 void extractAnimations(const tinygltf::Model &model, const Skeleton &skeleton, std::vector<Animation> &animations) {
+    std::unordered_map<int, int> nodeToBone;
+    for (size_t i = 0; i < skeleton.bones.size(); ++i) { nodeToBone[skeleton.bones[i].nodeIndex] = static_cast<int>(i); }
+
     for (const auto &gltfAnimation : model.animations) {
         Animation animation;
         animation.name = gltfAnimation.name;
@@ -89,129 +80,55 @@ void extractAnimations(const tinygltf::Model &model, const Skeleton &skeleton, s
         for (const auto &channel : gltfAnimation.channels) {
             const tinygltf::AnimationSampler &sampler = gltfAnimation.samplers[channel.sampler];
 
-            // Get interpolation method
-            std::string interpolation = sampler.interpolation.empty() ? "LINEAR" : sampler.interpolation;
+            // Find the corresponding bone
+            auto bone = nodeToBone.find(channel.target_node);
+            if (bone == nodeToBone.end()) continue;
+
+            AnimationChannel animChannel;
+            animChannel.boneIndex = bone->second;
+            animChannel.slot = skeleton.boneSlots[bone->second];
+            if (channel.target_path == "translation") {
+                animChannel.path = AnimationPath::TRANSLATION;
+                animChannel.components = 3;
+            } else if (channel.target_path == "rotation") {
+                animChannel.path = AnimationPath::ROTATION;
+                animChannel.components = 4;
+            } else if (channel.target_path == "scale") {
+                animChannel.path = AnimationPath::SCALE;
+                animChannel.components = 3;
+            } else {
+                continue; // Unsupported path
+            }
+            if (sampler.interpolation == "STEP") { animChannel.interpolation = Interpolation::STEP; } else if (sampler.interpolation == "CUBICSPLINE") { animChannel.interpolation = Interpolation::CUBICSPLINE; } else { animChannel.interpolation = Interpolation::LINEAR; }
 
             // Load keyframe times
-            std::vector<float> times;
             {
                 const tinygltf::Accessor &accessor = model.accessors[sampler.input];
                 const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
                 const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
                 const unsigned char *dataPtr = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
                 size_t count = accessor.count;
-                times.resize(count);
-                memcpy(times.data(), dataPtr, sizeof(float) * count);
+                animChannel.times.resize(count);
+                memcpy(animChannel.times.data(), dataPtr, sizeof(float) * count);
             }
+            if (animChannel.times.empty()) continue;
+            animation.duration = std::max(animation.duration, animChannel.times.back());
 
-            // Load keyframe values
-            std::vector<float> values;
+            // Load keyframe values, kept in the accessor layout
             {
                 const tinygltf::Accessor &accessor = model.accessors[sampler.output];
                 const tinygltf::BufferView &bufferView = model.bufferViews[accessor.bufferView];
                 const tinygltf::Buffer &buffer = model.buffers[bufferView.buffer];
                 const unsigned char *dataPtr = &buffer.data[accessor.byteOffset + bufferView.byteOffset];
                 size_t count = accessor.count * tinygltf::GetNumComponentsInType(accessor.type);
-                values.resize(count);
-                memcpy(values.data(), dataPtr, sizeof(float) * count);
-            }
-
-            // Find the corresponding bone
-            int boneIndex = -1;
-            for (size_t i = 0; i < skeleton.bones.size(); ++i) {
-                if (skeleton.bones[i].nodeIndex == channel.target_node) {
-                    boneIndex = static_cast<int>(i);
-                    break;
-                }
-            }
-            if (boneIndex == -1) continue;
-
-            AnimationChannel animChannel;
-            animChannel.boneIndex = boneIndex;
-            animChannel.path = channel.target_path;
-            animChannel.interpolation = interpolation;
-
-            // Create keyframes
-            size_t numKeyframes = times.size();
-            size_t valueComponents = 0;
-            if (channel.target_path == "translation" || channel.target_path == "scale") { valueComponents = 3; } else if (channel.target_path == "rotation") { valueComponents = 4; } else {
-                continue; // Unsupported path
-            }
-
-            size_t stride = valueComponents;
-            if (interpolation == "CUBICSPLINE") {
-                stride = valueComponents * 3; // in-tangent, value, out-tangent
+                animChannel.values.resize(count);
+                memcpy(animChannel.values.data(), dataPtr, sizeof(float) * count);
             }
 
-            for (size_t i = 0; i < numKeyframes; ++i) {
-                KeyFrame keyframe;
-                keyframe.time = times[i];
-                if (keyframe.time > animation.duration) { animation.duration = keyframe.time; }
-
-                size_t offset = i * stride;
-
-                if (interpolation == "CUBICSPLINE") {
-                    // Extract in-tangent, value, and out-tangent
-                    size_t inOffset = offset;
-                    size_t valueOffset = offset + valueComponents;
-                    size_t outOffset = offset + valueComponents * 2;
-
-                    if (channel.target_path == "translation") {
-                        keyframe.inTangentTranslation = glm::make_vec3(&values[inOffset]);
-                        keyframe.translation = glm::make_vec3(&values[valueOffset]);
-                        keyframe.outTangentTranslation = glm::make_vec3(&values[outOffset]);
-                    } else if (channel.target_path == "rotation") {
-                        keyframe.inTangentRotation = glm::make_quat(&values[inOffset]);
-                        keyframe.rotation = glm::make_quat(&values[valueOffset]);
-                        keyframe.outTangentRotation = glm::make_quat(&values[outOffset]);
-                    } else if (channel.target_path == "scale") {
-                        keyframe.inTangentScale = glm::make_vec3(&values[inOffset]);
-                        keyframe.scale = glm::make_vec3(&values[valueOffset]);
-                        keyframe.outTangentScale = glm::make_vec3(&values[outOffset]);
-                    }
-                } else {
-                    // LINEAR or STEP interpolation
-                    if (channel.target_path == "translation") { keyframe.translation = glm::make_vec3(&values[offset]); } else if (channel.target_path == "rotation") { keyframe.rotation = glm::make_quat(&values[offset]); } else if (channel.target_path == "scale") { keyframe.scale = glm::make_vec3(&values[offset]); }
-                }
-
-                animChannel.keyframes.push_back(keyframe);
-            }
-
-            animation.channels.push_back(animChannel);
+            animation.channels.push_back(std::move(animChannel));
         }
 
-        animations.push_back(animation);
-    }
-}
-
-void updateSkeleton(const Animation &animation, float time, Skeleton &skeleton) {
-    for (const auto &channel : animation.channels) {
-        int boneIndex = channel.boneIndex;
-        Skeleton::Bone &bone = skeleton.bones[boneIndex];
-
-        const auto &keyframes = channel.keyframes;
-        size_t numKeyframes = keyframes.size();
-
-        // Handle time outside the animation duration
-        if (time < keyframes.front().time) { time = keyframes.front().time; } else if (time > keyframes.back().time) { time = fmod(time, animation.duration); }
-
-        // Find the current keyframe index
-        size_t kfIndex = 0;
-        for (; kfIndex < numKeyframes - 1; ++kfIndex) { if (time < keyframes[kfIndex + 1].time) { break; } }
-
-        const KeyFrame &kf0 = keyframes[kfIndex];
-        const KeyFrame &kf1 = keyframes[std::min(kfIndex + 1, numKeyframes - 1)];
-
-        float t = 0.0f;
-        if (kf0.time != kf1.time) { t = (time - kf0.time) / (kf1.time - kf0.time); }
-
-        // Interpolation based on the method
-        if (channel.interpolation == "LINEAR") { if (channel.path == "translation") { bone.animTranslation = glm::mix(kf0.translation, kf1.translation, t); } else if (channel.path == "rotation") { bone.animRotation = glm::slerp(kf0.rotation, kf1.rotation, t); } else if (channel.path == "scale") { bone.animScale = glm::mix(kf0.scale, kf1.scale, t); } } else if (channel.interpolation == "STEP") { if (channel.path == "translation") { bone.animTranslation = kf0.translation; } else if (channel.path == "rotation") { bone.animRotation = kf0.rotation; } else if (channel.path == "scale") { bone.animScale = kf0.scale; } } else if (channel.interpolation == "CUBICSPLINE") { std::cout << "Cubic interpolation is not supported" << std::endl; }
-
-        // Update the bone's local transform
-        bone.localTransform = glm::translate(glm::mat4(1.0f), bone.animTranslation) *
-                              glm::mat4_cast(bone.animRotation) *
-                              glm::scale(glm::mat4(1.0f), bone.animScale);
+        animations.push_back(std::move(animation));
     }
 }
 
@@ -230,7 +147,26 @@ vec3 getNodeScale(const tinygltf::Node &node) {
     return glm::vec3(1.0f);
 }
 
+// glTF allows a node to give its transform as a matrix instead of TRS, the matrix is then split back into TRS. It must
+// not be sheared, a negative determinant is carried by the X scale.
+void getNodeRestPose(const tinygltf::Node &node, vec3 &translation, glm::quat &rotation, vec3 &scale) {
+    if (node.matrix.size() != 16) {
+        translation = getNodeTranslation(node);
+        rotation = getNodeRotation(node);
+        scale = getNodeScale(node);
+        return;
+    }
+    const mat4 matrix(glm::make_mat4(node.matrix.data())); // column major, like glm
+    translation = vec3(matrix[3]);
+    glm::mat3 basis(matrix);
+    scale = vec3(glm::length(basis[0]), glm::length(basis[1]), glm::length(basis[2]));
+    if (glm::determinant(basis) < 0.0f) { scale.x = -scale.x; }
+    for (int axis = 0; axis < 3; ++axis) { basis[axis] /= scale[axis]; }
+    rotation = glm::normalize(glm::quat_cast(basis));
+}
+
 mat4 getNodeTransform(const tinygltf::Node &node) {
+    if (node.matrix.size() == 16) { return mat4(glm::make_mat4(node.matrix.data())); }
     glm::mat4 translation = glm::translate(glm::mat4(1.0f), getNodeTranslation(node));
     glm::mat4 rotation = glm::mat4_cast(getNodeRotation(node));
     glm::mat4 scale = glm::scale(glm::mat4(1.0f), getNodeScale(node));
@@ -250,10 +186,28 @@ tinygltf::Model GLTFLoader::loadGltfModel(const std::string &filepath) {
     return model;
 }
 
+std::vector<std::string> GLTFLoader::externalBufferFiles(const tinygltf::Model &model, const std::string &gltfPath) {
+    const size_t separator = gltfPath.find_last_of("/\\");
+    const std::string folder = separator == std::string::npos ? "" : gltfPath.substr(0, separator + 1);
+    std::vector<std::string> files;
+    for (const tinygltf::Buffer &buffer : model.buffers) {
+        if (buffer.uri.empty() || buffer.uri.rfind("data:", 0) == 0) { continue; }
+        files.push_back(folder + buffer.uri);
+    }
+    return files;
+}
+
 bool arePositionsEqual(const vec3 &posA, const vec3 &posB, float epsilon) { return glm::distance(posA, posB) < epsilon; }
 
-void updateNgonMeshWithBoneData(const tinygltf::Model &model, NGonDataWBones &ngonMesh) {
-    // VERY SLOW, VERY NAIVE
+SkinTransferStats updateNgonMeshWithBoneData(const tinygltf::Model &model, NGonDataWBones &ngonMesh) {
+    SkinTransferStats stats;
+
+    // NGon vertices bucketed on a grid, the matching rule stays arePositionsEqual with the lowest NGon index winning
+    std::vector<vec3> ngonPositions(ngonMesh.vertices.size());
+    for (size_t j = 0; j < ngonMesh.vertices.size(); ++j) { ngonPositions[j] = ngonMesh.vertices[j].position; }
+    const PositionGrid grid(ngonPositions, skinMatchEpsilon);
+    std::vector<bool> ngonMatched(ngonMesh.vertices.size(), false);
+
     for (const auto &mesh : model.meshes) {
         for (const auto &primitive : mesh.primitives) {
             const auto &attributes = primitive.attributes;
@@ -273,42 +227,49 @@ void updateNgonMeshWithBoneData(const tinygltf::Model &model, NGonDataWBones &ng
                 const float *positionData = reinterpret_cast<const float *>(&model.buffers[positionBufferView.buffer].data[positionAccessor.byteOffset + positionBufferView.byteOffset]);
 
                 size_t vertexCount = positionAccessor.count;
+                stats.gltfVertices += vertexCount;
 
-                // Iterate through each vertex in the glTF model
+                // Find the matching NGon vertex of every glTF vertex in parallel
+                std::vector<int> matches(vertexCount);
+                ThreadPool::global().parallelFor(vertexCount, [&](size_t begin, size_t end) {
+                    for (size_t i = begin; i < end; ++i) { matches[i] = grid.findFirst(vec3(positionData[i * 3 + 0], positionData[i * 3 + 1], positionData[i * 3 + 2])); }
+                }, 1024);
+
+                // Apply in glTF order so that the last glTF vertex matching an NGon vertex wins, like the linear search did
                 for (size_t i = 0; i < vertexCount; ++i) {
-                    // Extract position from glTF
-                    vec3 gltfPosition(positionData[i * 3 + 0], positionData[i * 3 + 1], positionData[i * 3 + 2]);
-
-                    // Now directly compare the position with the vertices in NgonMesh
-                    for (size_t j = 0; j < ngonMesh.vertices.size(); ++j) {
-                        const vec3 &ngonPosition = ngonMesh.vertices[j].position;
-
-                        // Directly compare vertex positions
-                        if (arePositionsEqual(gltfPosition, ngonPosition)) {
-                            // If positions match, update the NgonMesh vertex with joint indices and weights
-                            vec4 jointIndices;
-                            vec4 jointWeights;
-
-                            // Extract joint indices (4 per vertex, stored as unsigned bytes)
-                            jointIndices.x = static_cast<float>(jointData[i * 4 + 0]);
-                            jointIndices.y = static_cast<float>(jointData[i * 4 + 1]);
-                            jointIndices.z = static_cast<float>(jointData[i * 4 + 2]);
-                            jointIndices.w = static_cast<float>(jointData[i * 4 + 3]);
-
-                            // Extract joint weights (4 per vertex, stored as floats)
-                            jointWeights.x = weightData[i * 4 + 0];
-                            jointWeights.y = weightData[i * 4 + 1];
-                            jointWeights.z = weightData[i * 4 + 2];
-                            jointWeights.w = weightData[i * 4 + 3];
-
-                            // Update the corresponding NgonMesh vertex with the bone data
-                            ngonMesh.jointIndices[j] = jointIndices;
-                            ngonMesh.jointWeights[j] = jointWeights;
-                            break; // Move on to the next vertex in the glTF model
-                        }
+                    const int j = matches[i];
+                    if (j == -1) {
+                        stats.unmatchedGltfVertices++;
+                        continue;
                     }
+
+                    // Extract joint indices (4 per vertex, stored as unsigned bytes)
+                    vec4 jointIndices;
+                    jointIndices.x = static_cast<float>(jointData[i * 4 + 0]);
+                    jointIndices.y = static_cast<float>(jointData[i * 4 + 1]);
+                    jointIndices.z = static_cast<float>(jointData[i * 4 + 2]);
+                    jointIndices.w = static_cast<float>(jointData[i * 4 + 3]);
+
+                    // Extract joint weights (4 per vertex, stored as floats)
+                    vec4 jointWeights;
+                    jointWeights.x = weightData[i * 4 + 0];
+                    jointWeights.y = weightData[i * 4 + 1];
+                    jointWeights.z = weightData[i * 4 + 2];
+                    jointWeights.w = weightData[i * 4 + 3];
+
+                    // Update the corresponding NgonMesh vertex with the bone data
+                    ngonMesh.jointIndices[j] = jointIndices;
+                    ngonMesh.jointWeights[j] = jointWeights;
+                    ngonMatched[j] = true;
                 }
             } else { std::cerr << "JOINTS_0 or WEIGHTS_0 not found in the glTF model." << std::endl; }
         }
     }
-}
\ No newline at end of file
+
+    stats.unmatchedNgonVertices = std::count(ngonMatched.begin(), ngonMatched.end(), false);
+    if (stats.unmatchedGltfVertices > 0 || stats.unmatchedNgonVertices > 0) {
+        std::cerr << "Skin transfer: " << stats.unmatchedGltfVertices << "/" << stats.gltfVertices << " glTF vertices without an NGon vertex, "
+                  << stats.unmatchedNgonVertices << "/" << ngonMesh.vertices.size() << " NGon vertices left without bone data" << std::endl;
+    }
+    return stats;
+}
@@ -7,79 +7,39 @@
 #include <iostream>
 #include "defines.hpp"
 #include "ObjLoader.hpp"
-
-// Data structures
-
-
-struct Skeleton {
-    struct Bone {
-        int nodeIndex; // Index of the node in the glTF model
-        std::string name; // Name of the bone
-        int parentIndex; // Index of the parent bone (-1 if root)
-        std::vector<int> childrenIndices; // Indices of child bones
-        mat4 inverseBindMatrix; // Inverse bind matrix
-        mat4 localTransform; // Local transform (animation applied)
-        vec3 animTranslation; // Animated translation
-        glm::quat animRotation; // Animated rotation
-        vec3 animScale; // Animated scale
-    };
-
-    std::vector<Bone> bones;
-};
+#include "Animation.hpp"
+#include "Skeleton.hpp"
 
 // Helper functions
 mat4 getNodeTransform(const tinygltf::Node &node);
 vec3 getNodeTranslation(const tinygltf::Node &node);
 glm::quat getNodeRotation(const tinygltf::Node &node);
 vec3 getNodeScale(const tinygltf::Node &node);
+// TRS of the node, decomposed from its matrix when it has one
+void getNodeRestPose(const tinygltf::Node &node, vec3 &translation, glm::quat &rotation, vec3 &scale);
 
-// Function to extract skeleton
+// Function to extract skeleton, the bones are ready for computeBoneMatrices
 void extractSkeleton(const tinygltf::Model &model, Skeleton &skeleton);
 
-// Recursive function to compute global transform
-void computeGlobalTransform(const Skeleton &skeleton, int boneIndex, std::vector<mat4> &globalTransforms);
-
-void computeBoneMatrices(const Skeleton &skeleton, std::vector<mat4> &boneMatrices);
-
-struct KeyFrame {
-    float time;
-    // For LINEAR and STEP
-    vec3 translation;
-    glm::quat rotation;
-    vec3 scale;
-
-    // For CUBICSPLINE (additional data)
-    vec3 inTangentTranslation;
-    vec3 outTangentTranslation;
-    glm::quat inTangentRotation;
-    glm::quat outTangentRotation;
-    vec3 inTangentScale;
-    vec3 outTangentScale;
-};
-
+// Bakes the glTF samplers of the skeleton bones, channels on other nodes or paths are skipped
+void extractAnimations(const tinygltf::Model &model, const Skeleton &skeleton, std::vector<Animation> &animations);
 
-struct AnimationChannel {
-    int boneIndex;
-    std::string path; // "translation", "rotation", or "scale"
-    std::string interpolation; // "LINEAR", "STEP", or "CUBICSPLINE"
-    std::vector<KeyFrame> keyframes;
-};
+constexpr float skinMatchEpsilon = 1e-5f; // max distance between a glTF vertex and the NGon vertex receiving its bone data
 
-struct Animation {
-    std::string name;
-    float duration;
-    std::vector<AnimationChannel> channels;
+struct SkinTransferStats {
+    size_t gltfVertices = 0;
+    size_t unmatchedGltfVertices = 0; // no NGon vertex close enough, their bone data is dropped
+    size_t unmatchedNgonVertices = 0; // no glTF vertex close enough, they keep zero weights
 };
 
-void extractAnimations(const tinygltf::Model &model, const Skeleton &skeleton, std::vector<Animation> &animations);
-
-void updateSkeleton(const Animation &animation, float time, Skeleton &skeleton);
-
-void updateNgonMeshWithBoneData(const tinygltf::Model &model, NGonDataWBones &ngonMesh);
+SkinTransferStats updateNgonMeshWithBoneData(const tinygltf::Model &model, NGonDataWBones &ngonMesh);
 
 class GLTFLoader {
 public:
     static tinygltf::Model loadGltfModel(const std::string &filepath);
+    // Paths of the .bin files the buffers of the model point to, relative URIs resolved against the glTF folder.
+    // Embedded data: URIs are part of the glTF file itself and are skipped.
+    static std::vector<std::string> externalBufferFiles(const tinygltf::Model &model, const std::string &gltfPath);
 
 };
 
@@ -0,0 +1,159 @@
+#include "HeMeshCache.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static constexpr char hemeshMagic[8] = {'H', 'E', 'M', 'E', 'S', 'H', '\0', '\0'};
+
+// FNV-1a over 64 bit words, the tail is hashed byte per byte
+static uint64 hashBytes(const char *p_data, size_t p_size, uint64 p_hash) {
+    constexpr uint64 prime = 0x100000001b3ull;
+    size_t i = 0;
+    for (; i + sizeof(uint64) <= p_size; i += sizeof(uint64)) {
+        uint64 word;
+        memcpy(&word, p_data + i, sizeof(uint64));
+        p_hash = (p_hash ^ word) * prime;
+    }
+    for (; i < p_size; i++) { p_hash = (p_hash ^ uint8(p_data[i])) * prime; }
+    return p_hash;
+}
+
+uint64 HeMeshCache::hashFiles(const std::vector<std::string> &p_paths) {
+    uint64 hash = 0xcbf29ce484222325ull;
+    for (const std::string &path : p_paths) {
+        if (path.empty()) { continue; }
+        MappedFile file(path);
+        const uint64 size = file.size();
+        hash = hashBytes(reinterpret_cast<const char *>(&size), sizeof(size), hash);
+        if (file.data()) { hash = hashBytes(file.data(), file.size(), hash); }
+    }
+    return hash;
+}
+
+bool HeMeshCache::open(const std::string &p_path, uint64 p_sourceHash) {
+    m_header = nullptr;
+    if (!m_file.open(p_path)) { return false; }
+
+    auto reject = [this](const char *p_reason) {
+        m_file.close();
+        m_header = nullptr;
+        std::cout << "Ignoring mesh cache: " << p_reason << std::endl;
+        return false;
+    };
+    if (m_file.size() < sizeof(Header)) { return reject("truncated header"); }
+    m_header = reinterpret_cast<const Header *>(m_file.data());
+    if (memcmp(m_header->magic, hemeshMagic, sizeof(hemeshMagic)) != 0) { return reject("not a .hemesh file"); }
+    if (m_header->version != version || m_header->blobCount != BLOB_COUNT) { return reject("outdated version"); }
+    if (m_header->sourceHash != p_sourceHash) { return reject("source files changed"); }
+    for (const BlobEntry &blob : m_header->blobs) {
+        if (blob.offset % blobAlignment != 0 || blob.offset > m_file.size() || blob.size > m_file.size() - blob.offset) { return reject("corrupted blob table"); }
+    }
+    return true;
+}
+
+template <typename T>
+static void readBlob(const HeMeshCache &p_cache, HeMeshCache::Blob p_blob, std::vector<T> &p_dst) {
+    const T *data = p_cache.blobData<T>(p_blob);
+    p_dst.assign(data, data + p_cache.blobCount<T>(p_blob));
+}
+
+void HeMeshCache::read(HalfEdgeMesh &p_mesh, std::vector<vec4> &p_jointIndices, std::vector<vec4> &p_jointWeights) const {
+    p_mesh.nbVertices = m_header->nbVertices;
+    p_mesh.nbFaces = m_header->nbFaces;
+
+    readBlob(*this, VERTEX_POSITIONS, p_mesh.vertices.positions);
+    readBlob(*this, VERTEX_COLORS, p_mesh.vertices.colors);
+    readBlob(*this, VERTEX_NORMALS, p_mesh.vertices.normals);
+    readBlob(*this, VERTEX_TEXCOORDS, p_mesh.vertices.texCoords);
+    readBlob(*this, VERTEX_EDGES, p_mesh.vertices.edges);
+
+    readBlob(*this, FACE_EDGES, p_mesh.faces.edges);
+    readBlob(*this, FACE_VERT_COUNTS, p_mesh.faces.vertCounts);
+    readBlob(*this, FACE_OFFSETS, p_mesh.faces.offsets);
+    readBlob(*this, FACE_NORMALS, p_mesh.faces.normals);
+    readBlob(*this, FACE_CENTERS, p_mesh.faces.centers);
+    readBlob(*this, FACE_AREAS, p_mesh.faces.faceAreas);
+
+    readBlob(*this, HALF_EDGE_VERTICES, p_mesh.halfEdges.vertices);
+    readBlob(*this, HALF_EDGE_FACES, p_mesh.halfEdges.faces);
+    readBlob(*this, HALF_EDGE_NEXT, p_mesh.halfEdges.next);
+    readBlob(*this, HALF_EDGE_PREV, p_mesh.halfEdges.prev);
+    readBlob(*this, HALF_EDGE_TWINS, p_mesh.halfEdges.twins);
+
+    readBlob(*this, VERTEX_FACE_INDICES, p_mesh.vertexFaceIndices);
+
+    readBlob(*this, JOINT_INDICES, p_jointIndices);
+    readBlob(*this, JOINT_WEIGHTS, p_jointWeights);
+}
+
+bool HeMeshCache::save(const std::string &p_path, uint64 p_sourceHash, const HalfEdgeMesh &p_mesh, const std::vector<vec4> &p_jointIndices, const std::vector<vec4> &p_jointWeights) {
+    Header header{};
+    memcpy(header.magic, hemeshMagic, sizeof(hemeshMagic));
+    header.version = version;
+    header.blobCount = BLOB_COUNT;
+    header.sourceHash = p_sourceHash;
+    header.nbVertices = p_mesh.nbVertices;
+    header.nbFaces = p_mesh.nbFaces;
+
+    // source of every blob, in Blob order
+    std::pair<const void *, size_t> blobs[BLOB_COUNT];
+    auto setBlob = [&blobs](Blob p_blob, const auto &p_data) { blobs[p_blob] = {p_data.data(), p_data.size() * sizeof(p_data[0])}; };
+    setBlob(VERTEX_POSITIONS, p_mesh.vertices.positions);
+    setBlob(VERTEX_COLORS, p_mesh.vertices.colors);
+    setBlob(VERTEX_NORMALS, p_mesh.vertices.normals);
+    setBlob(VERTEX_TEXCOORDS, p_mesh.vertices.texCoords);
+    setBlob(VERTEX_EDGES, p_mesh.vertices.edges);
+    setBlob(FACE_EDGES, p_mesh.faces.edges);
+    setBlob(FACE_VERT_COUNTS, p_mesh.faces.vertCounts);
+    setBlob(FACE_OFFSETS, p_mesh.faces.offsets);
+    setBlob(FACE_NORMALS, p_mesh.faces.normals);
+    setBlob(FACE_CENTERS, p_mesh.faces.centers);
+    setBlob(FACE_AREAS, p_mesh.faces.faceAreas);
+    setBlob(HALF_EDGE_VERTICES, p_mesh.halfEdges.vertices);
+    setBlob(HALF_EDGE_FACES, p_mesh.halfEdges.faces);
+    setBlob(HALF_EDGE_NEXT, p_mesh.halfEdges.next);
+    setBlob(HALF_EDGE_PREV, p_mesh.halfEdges.prev);
+    setBlob(HALF_EDGE_TWINS, p_mesh.halfEdges.twins);
+    setBlob(VERTEX_FACE_INDICES, p_mesh.vertexFaceIndices);
+    setBlob(JOINT_INDICES, p_jointIndices);
+    setBlob(JOINT_WEIGHTS, p_jointWeights);
+
+    uint64 offset = sizeof(Header);
+    for (uint32 i = 0; i < BLOB_COUNT; i++) {
+        offset = (offset + blobAlignment - 1) / blobAlignment * blobAlignment;
+        header.blobs[i] = {offset, blobs[i].second};
+        offset += blobs[i].second;
+    }
+
+    // write next to the destination and rename, a crash never leaves a partial cache behind
+    const std::string tmpPath = p_path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!file) {
+            std::cerr << "Could not write mesh cache: " << p_path << std::endl;
+            return false;
+        }
+        const char padding[blobAlignment] = {};
+        file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+        uint64 written = sizeof(Header);
+        for (uint32 i = 0; i < BLOB_COUNT; i++) {
+            file.write(padding, std::streamsize(header.blobs[i].offset - written));
+            if (blobs[i].second > 0) { file.write(static_cast<const char *>(blobs[i].first), std::streamsize(blobs[i].second)); }
+            written = header.blobs[i].offset + blobs[i].second;
+        }
+        if (!file) {
+            std::cerr << "Could not write mesh cache: " << p_path << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tmpPath, p_path, error);
+    if (error) {
+        std::cerr << "Could not write mesh cache: " << p_path << " (" << error.message() << ")" << std::endl;
+        std::filesystem::remove(tmpPath, error);
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "HalfEdge.hpp"
+#include "MappedFile.hpp"
+#include "defines.hpp"
+
+// Binary container (.hemesh) holding the SoA arrays of a HalfEdgeMesh and its skin as aligned blobs.
+// The file is memory-mapped and blobs are read in place, it is rebuilt whenever the hash of the source files changes.
+class HeMeshCache {
+public:
+    enum Blob : uint32 {
+        VERTEX_POSITIONS = 0,
+        VERTEX_COLORS,
+        VERTEX_NORMALS,
+        VERTEX_TEXCOORDS,
+        VERTEX_EDGES,
+        FACE_EDGES,
+        FACE_VERT_COUNTS,
+        FACE_OFFSETS,
+        FACE_NORMALS,
+        FACE_CENTERS,
+        FACE_AREAS,
+        HALF_EDGE_VERTICES,
+        HALF_EDGE_FACES,
+        HALF_EDGE_NEXT,
+        HALF_EDGE_PREV,
+        HALF_EDGE_TWINS,
+        VERTEX_FACE_INDICES,
+        JOINT_INDICES,
+        JOINT_WEIGHTS,
+        BLOB_COUNT
+    };
+
+    static constexpr uint32 version = 2; // bump when the layout or the mesh building changes
+    static constexpr uint64 blobAlignment = 64;
+
+    struct BlobEntry {
+        uint64 offset; // from the start of the file
+        uint64 size;   // in bytes
+    };
+
+    struct Header {
+        char magic[8];
+        uint32 version;
+        uint32 blobCount;
+        uint64 sourceHash;
+        uint32 nbVertices;
+        uint32 nbFaces;
+        BlobEntry blobs[BLOB_COUNT];
+    };
+
+    static std::string cachePath(const std::string &p_modelPath) { return p_modelPath + ".hemesh"; }
+    // Hash of the content of every file, empty paths are skipped
+    static uint64 hashFiles(const std::vector<std::string> &p_paths);
+
+    // Maps the file and validates it against p_sourceHash, the mapping stays valid while the object lives
+    bool open(const std::string &p_path, uint64 p_sourceHash);
+    bool isOpen() const { return m_file.isOpen() && m_header != nullptr; }
+    const Header &header() const { return *m_header; }
+
+    template <typename T>
+    const T *blobData(Blob p_blob) const { return reinterpret_cast<const T *>(m_file.data() + m_header->blobs[p_blob].offset); }
+    template <typename T>
+    size_t blobCount(Blob p_blob) const { return m_header->blobs[p_blob].size / sizeof(T); }
+
+    // Copies the mapped blobs into p_mesh and the skin arrays (left empty when the mesh has no skin)
+    void read(HalfEdgeMesh &p_mesh, std::vector<vec4> &p_jointIndices, std::vector<vec4> &p_jointWeights) const;
+
+    static bool save(const std::string &p_path, uint64 p_sourceHash, const HalfEdgeMesh &p_mesh, const std::vector<vec4> &p_jointIndices, const std::vector<vec4> &p_jointWeights);
+
+private:
+    MappedFile m_file;
+    const Header *m_header = nullptr;
+};
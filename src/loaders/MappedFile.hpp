@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only view of a whole file mapped in memory, unmapped on destruction.
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string &filename) { open(filename); }
+    ~MappedFile() { close(); }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::string &filename) {
+        close();
+#ifdef _WIN32
+        m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_file == INVALID_HANDLE_VALUE) { return false; }
+        LARGE_INTEGER fileSize{};
+        GetFileSizeEx(m_file, &fileSize);
+        m_size = static_cast<size_t>(fileSize.QuadPart);
+        m_isOpen = true;
+        if (m_size == 0) { return true; } // empty files can't be mapped
+        m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_mapping != nullptr) { m_data = static_cast<const char *>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0)); }
+#else
+        m_file = ::open(filename.c_str(), O_RDONLY);
+        if (m_file < 0) { return false; }
+        struct stat fileStat{};
+        fstat(m_file, &fileStat);
+        m_size = static_cast<size_t>(fileStat.st_size);
+        m_isOpen = true;
+        if (m_size == 0) { return true; } // empty files can't be mapped
+        void *ptr = mmap(nullptr, m_size, PROT_READ, MAP_PRIVATE, m_file, 0);
+        if (ptr != MAP_FAILED) {
+            m_data = static_cast<const char *>(ptr);
+            madvise(ptr, m_size, MADV_SEQUENTIAL);
+        }
+#endif
+        if (m_data == nullptr) { close(); }
+        return m_isOpen;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (m_data) { UnmapViewOfFile(m_data); }
+        if (m_mapping) { CloseHandle(m_mapping); }
+        if (m_file != INVALID_HANDLE_VALUE) { CloseHandle(m_file); }
+        m_mapping = nullptr;
+        m_file = INVALID_HANDLE_VALUE;
+#else
+        if (m_data) { munmap(const_cast<char *>(m_data), m_size); }
+        if (m_file >= 0) { ::close(m_file); }
+        m_file = -1;
+#endif
+        m_data = nullptr;
+        m_size = 0;
+        m_isOpen = false;
+    }
+
+    bool isOpen() const { return m_isOpen; }
+    const char *data() const { return m_data; }
+    const char *end() const { return m_data + m_size; }
+    size_t size() const { return m_size; }
+
+private:
+#ifdef _WIN32
+    HANDLE m_file = INVALID_HANDLE_VALUE;
+    HANDLE m_mapping = nullptr;
+#else
+    int m_file = -1;
+#endif
+    const char *m_data = nullptr;
+    size_t m_size = 0;
+    bool m_isOpen = false;
+};
@@ -1,13 +1,20 @@
 #include "ObjLoader.hpp"
 
+#include <algorithm>
+#include <atomic>
+#include <charconv>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
 #include <sstream>
 #include <string>
 #include <unordered_set>
 #include <regex>
 
 #include "defines.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
 
 void extractIndices(const std::string &token, int &posIndex, int &texIndex, int &nIndex) {
     posIndex = texIndex = nIndex = 0; // Default values in case no indices are found
@@ -31,7 +38,141 @@ void extractIndices(const std::string &token, int &posIndex, int &texIndex, int
     if (secondSlash + 1 < token.size()) { nIndex = std::stoi(token.substr(secondSlash + 1)); }
 }
 
-NgonData NgonLoader::loadNgonData(const std::string &filename) {
+// Same as std::stoi on the given chars (leading sign, stops at the first non digit), but returns 0 instead of throwing
+static int parseInt(std::string_view str) {
+    const char *first = str.data();
+    const char *last = str.data() + str.size();
+    if (first != last && *first == '+') { first++; }
+    int value = 0;
+    std::from_chars(first, last, value);
+    return value;
+}
+
+void extractIndices(std::string_view token, int &posIndex, int &texIndex, int &nIndex) {
+    posIndex = texIndex = nIndex = 0; // Default values in case no indices are found
+
+    size_t firstSlash = token.find('/');
+    size_t secondSlash = token.find('/', firstSlash + 1);
+    if (firstSlash != std::string_view::npos) { if (firstSlash > 0) { posIndex = parseInt(token.substr(0, firstSlash)); } } else {
+        // If no slashes are found, treat the whole token as the position index
+        posIndex = parseInt(token);
+        return; // No texture or normal index to extract
+    }
+
+    // Extract the texture index (between the first and second slashes)
+    if (secondSlash != std::string_view::npos) { if (secondSlash > firstSlash + 1) { texIndex = parseInt(token.substr(firstSlash + 1, secondSlash - firstSlash - 1)); } } else if (firstSlash + 1 < token.size()) {
+        // If only one slash is found and there are characters after it, it may contain a texture index
+        texIndex = parseInt(token.substr(firstSlash + 1));
+        return; // No normal index to extract
+    }
+
+    // Extract the normal index (after the second slash)
+    if (secondSlash + 1 < token.size()) { nIndex = parseInt(token.substr(secondSlash + 1)); }
+}
+
+// Whitespace separated tokens of a single line, mimics the std::istringstream extraction rules:
+// once a read fails, every following read fails too.
+struct ObjLineTokenizer {
+    const char *cursor;
+    const char *end;
+
+    static bool isSpace(char c) { return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f'; }
+
+    void skipSpaces() { while (cursor < end && isSpace(*cursor)) { cursor++; } }
+
+    std::string_view nextToken() {
+        skipSpaces();
+        const char *first = cursor;
+        while (cursor < end && !isSpace(*cursor)) { cursor++; }
+        return {first, size_t(cursor - first)};
+    }
+
+    bool readFloat(float &value) {
+        skipSpaces();
+        const char *first = cursor;
+        if (first < end && *first == '+') { first++; }
+        std::from_chars_result result = std::from_chars(first, end, value);
+        if (result.ec != std::errc()) {
+            cursor = end; // fail every following read, like a stream in fail state
+            return false;
+        }
+        cursor = result.ptr;
+        return true;
+    }
+};
+
+// Resolves one face corner, shared by every parser mode so they all produce the same NgonData
+static void addFaceVertex(NgonData &ngonData, NGonFace &face, const std::vector<vec4> &positions, const std::vector<vec4> &normals, const std::vector<vec4> &texCoords, int posIndex, int texIndex, int nIndex) {
+    Vertex vertex{};
+    // OBJ file uses 1-based indexing
+    // set vertex data (position, normal, texCoord
+    if (positions.size() >= posIndex && posIndex > 0) {
+        vec3 pos = positions[posIndex - 1];
+        vertex.position = vec4(pos.x, pos.y, pos.z, 1.0f);
+    }
+    if (normals.size() >= nIndex && nIndex > 0)
+        vertex.normal = normals[nIndex - 1];
+    if (texCoords.size() >= texIndex && texIndex > 0)
+        vertex.texCoord = texCoords[texIndex - 1];
+    // set vertex at pos (posIndex - 1) in _vertices
+    // but first allocate space for it up to posIndex
+    if (posIndex > ngonData.vertices.size())
+        ngonData.vertices.resize(posIndex);
+    ngonData.vertices.at(posIndex - 1) = vertex;
+    ngonData.indices.push_back(posIndex - 1);
+    face.count++;
+}
+
+// Face normals, areas and centers for the faces in [begin, end), every face is independent of the others
+static void computeFaceAttributes(NgonData &ngonData, size_t begin, size_t end) {
+    for (size_t f = begin; f < end; f++) {
+        NGonFace &face = ngonData.faces[f];
+
+        // compute face normal
+        vec4 v0 = ngonData.vertices[ngonData.indices[face.offset]].position;
+        vec4 v1 = ngonData.vertices[ngonData.indices[face.offset + 1]].position;
+        vec4 v2 = ngonData.vertices[ngonData.indices[face.offset + 2]].position;
+        vec3 normal = glm::normalize(glm::cross(vec3(v1.x, v1.y, v1.z) - vec3(v0.x, v0.y, v0.z),
+                                                vec3(v2.x, v2.y, v2.z) - vec3(v0.x, v0.y, v0.z)));
+        face.normal = vec4(normal.x, normal.y, normal.z, 1.0f);
+
+        // compute face center
+        vec4 center = VEC4F_ZERO;
+        for (uint32 i = 0; i < face.count; i++) { center += ngonData.vertices[ngonData.indices[face.offset + i]].position; }
+        center /= float(face.count);
+        face.center = center;
+
+        // compute face area
+        face.faceArea = 0.0f;
+        for (uint32 i = 0; i < face.count; i++) {
+            v0 = ngonData.vertices[ngonData.indices[face.offset + i]].position;
+            v1 = ngonData.vertices[ngonData.indices[face.offset + (i + 1) % face.count]].position;
+            face.faceArea += glm::length(glm::cross(vec3(v1.x, v1.y, v1.z) - vec3(v0.x, v0.y, v0.z),
+                                                    vec3(center.x, center.y, center.z) - vec3(v0.x, v0.y, v0.z)));
+        }
+        face.faceArea *= 0.5f;
+    }
+}
+
+static void computeFaceAttributes(NgonData &ngonData) {
+    computeFaceAttributes(ngonData, 0, ngonData.faces.size());
+
+    // set ngonData
+    ngonData.vertices.shrink_to_fit();
+    ngonData.indices.shrink_to_fit();
+    ngonData.faces.shrink_to_fit();
+}
+
+NgonData NgonLoader::loadNgonData(const std::string &filename, ParserMode mode) {
+    switch (mode) {
+    case ParserMode::STREAM: return loadNgonDataStream(filename);
+    case ParserMode::MAPPED: return loadNgonDataMapped(filename);
+    case ParserMode::PARALLEL: return loadNgonDataParallel(filename, ThreadPool::global());
+    }
+    return {};
+}
+
+NgonData NgonLoader::loadNgonDataStream(const std::string &filename) {
     NgonData ngonData;
     std::ifstream file(filename);
     std::string line;
@@ -70,24 +211,7 @@ NgonData NgonLoader::loadNgonData(const std::string &filename) {
             while (ss >> token) {
                 int posIndex, texIndex, nIndex;
                 extractIndices(token, posIndex, texIndex, nIndex);
-                Vertex vertex{};
-                // OBJ file uses 1-based indexing
-                // set vertex data (position, normal, texCoord
-                if (temp_positions.size() >= posIndex && posIndex > 0) {
-                    vec3 pos = temp_positions[posIndex - 1];
-                    vertex.position = vec4(pos.x, pos.y, pos.z, 1.0f);
-                }
-                if (temp_normals.size() >= nIndex && nIndex > 0)
-                    vertex.normal = temp_normals[nIndex - 1];
-                if (temp_texCoords.size() >= texIndex && texIndex > 0)
-                    vertex.texCoord = temp_texCoords[texIndex - 1];
-                // set vertex at pos (posIndex - 1) in _vertices
-                // but first allocate space for it up to posIndex
-                if (posIndex > ngonData.vertices.size())
-                    ngonData.vertices.resize(posIndex);
-                ngonData.vertices.at(posIndex - 1) = vertex;
-                ngonData.indices.push_back(posIndex - 1);
-                face.count++;
+                addFaceVertex(ngonData, face, temp_positions, temp_normals, temp_texCoords, posIndex, texIndex, nIndex);
             }
             ngonData.faces.push_back(face);
         }
@@ -95,42 +219,251 @@ NgonData NgonLoader::loadNgonData(const std::string &filename) {
 
     file.close();
 
-    // compute face normals
-    for (auto &face : ngonData.faces) {
-        vec4 v0 = ngonData.vertices[ngonData.indices[face.offset]].position;
-        vec4 v1 = ngonData.vertices[ngonData.indices[face.offset + 1]].position;
-        vec4 v2 = ngonData.vertices[ngonData.indices[face.offset + 2]].position;
-        vec3 normal = glm::normalize(glm::cross(vec3(v1.x, v1.y, v1.z) - vec3(v0.x, v0.y, v0.z),
-                                                vec3(v2.x, v2.y, v2.z) - vec3(v0.x, v0.y, v0.z)));
-        face.normal = vec4(normal.x, normal.y, normal.z, 1.0f);
+    computeFaceAttributes(ngonData);
+    return ngonData;
+}
+
+NgonData NgonLoader::loadNgonDataMapped(const std::string &filename) {
+    NgonData ngonData;
+    MappedFile file(filename);
+    // temp data
+    std::vector<vec4> temp_positions;
+    std::vector<vec4> temp_normals;
+    std::vector<vec4> temp_texCoords;
+    // open file
+    if (!file.isOpen()) {
+        std::cerr << "Error opening the file: " << filename << std::endl;
+        return ngonData;
     }
+    // read file, one line at a time without copying it
+    const char *cursor = file.data();
+    const char *fileEnd = file.end();
+    while (cursor < fileEnd) {
+        const char *lineEnd = static_cast<const char *>(memchr(cursor, '\n', fileEnd - cursor));
+        if (lineEnd == nullptr) { lineEnd = fileEnd; }
+        ObjLineTokenizer ss{cursor, lineEnd};
+        cursor = lineEnd + 1;
 
-    // compute face areas
-    for (auto &face : ngonData.faces) {
-        vec4 center = VEC4F_ZERO;
-        for (uint32 i = 0; i < face.count; i++) { center += ngonData.vertices[ngonData.indices[face.offset + i]].position; }
-        center /= float(face.count);
-        face.faceArea = 0.0f;
-        for (uint32 i = 0; i < face.count; i++) {
-            vec4 v0 = ngonData.vertices[ngonData.indices[face.offset + i]].position;
-            vec4 v1 = ngonData.vertices[ngonData.indices[face.offset + (i + 1) % face.count]].position;
-            face.faceArea += glm::length(glm::cross(vec3(v1.x, v1.y, v1.z) - vec3(v0.x, v0.y, v0.z),
-                                                    vec3(center.x, center.y, center.z) - vec3(v0.x, v0.y, v0.z)));
+        std::string_view type = ss.nextToken();
+        if (type == "v") {
+            vec4 position = vec4(0, 0, 0, 1);
+            ss.readFloat(position.x), ss.readFloat(position.y), ss.readFloat(position.z);
+            temp_positions.push_back(position);
+        } else if (type == "vn") {
+            vec4 normal = vec4(0);
+            ss.readFloat(normal.x), ss.readFloat(normal.y), ss.readFloat(normal.z);
+            temp_normals.push_back(normal);
+        } else if (type == "vt") {
+            vec4 texCoord = vec4(0);
+            ss.readFloat(texCoord.x), ss.readFloat(texCoord.y);
+            temp_texCoords.push_back(texCoord);
+        } else if (type == "f") {
+            NGonFace face{};
+            face.count = 0;
+            face.offset = unsigned(ngonData.indices.size());
+            face.normal = VEC4F_ONE;
+            for (std::string_view token = ss.nextToken(); !token.empty(); token = ss.nextToken()) {
+                int posIndex, texIndex, nIndex;
+                extractIndices(token, posIndex, texIndex, nIndex);
+                addFaceVertex(ngonData, face, temp_positions, temp_normals, temp_texCoords, posIndex, texIndex, nIndex);
+            }
+            ngonData.faces.push_back(face);
         }
-        face.faceArea *= 0.5f;
     }
 
-    // compute face centers
-    for (auto &face : ngonData.faces) {
-        face.center = VEC4F_ZERO;
-        for (uint32 i = 0; i < face.count; i++) { face.center += ngonData.vertices[ngonData.indices[face.offset + i]].position; }
-        face.center /= float(face.count);
+    file.close();
+
+    computeFaceAttributes(ngonData);
+    return ngonData;
+}
+
+// ============== Parallel parser ==============
+
+// Face corner as written in the file (1-based indices)
+struct ObjCorner {
+    int posIndex;
+    int texIndex;
+    int nIndex;
+    bool hasPosition; // resolved at stitch time: the position was declared before the face
+};
+
+// Everything declared in a line-aligned slice of the file, indices are still file-global
+struct ObjChunk {
+    std::vector<vec4> positions;
+    std::vector<vec4> normals;
+    std::vector<vec4> texCoords;
+    std::vector<ObjCorner> corners;
+    std::vector<uint32> faceCounts;     // number of corners of each face
+    std::vector<uvec3> faceDeclarations; // positions, normals and texCoords declared in the chunk before each face
+    int minPosIndex = std::numeric_limits<int>::max();
+    int maxPosIndex = 0;
+
+    // prefix sums over the previous chunks
+    size_t positionBase = 0;
+    size_t normalBase = 0;
+    size_t texCoordBase = 0;
+    size_t cornerBase = 0;
+    size_t faceBase = 0;
+};
+
+static void parseObjChunk(const char *begin, const char *end, ObjChunk &chunk) {
+    const char *cursor = begin;
+    while (cursor < end) {
+        const char *lineEnd = static_cast<const char *>(memchr(cursor, '\n', end - cursor));
+        if (lineEnd == nullptr) { lineEnd = end; }
+        ObjLineTokenizer ss{cursor, lineEnd};
+        cursor = lineEnd + 1;
+
+        std::string_view type = ss.nextToken();
+        if (type == "v") {
+            vec4 position = vec4(0, 0, 0, 1);
+            ss.readFloat(position.x), ss.readFloat(position.y), ss.readFloat(position.z);
+            chunk.positions.push_back(position);
+        } else if (type == "vn") {
+            vec4 normal = vec4(0);
+            ss.readFloat(normal.x), ss.readFloat(normal.y), ss.readFloat(normal.z);
+            chunk.normals.push_back(normal);
+        } else if (type == "vt") {
+            vec4 texCoord = vec4(0);
+            ss.readFloat(texCoord.x), ss.readFloat(texCoord.y);
+            chunk.texCoords.push_back(texCoord);
+        } else if (type == "f") {
+            uint32 count = 0;
+            for (std::string_view token = ss.nextToken(); !token.empty(); token = ss.nextToken()) {
+                ObjCorner corner{};
+                extractIndices(token, corner.posIndex, corner.texIndex, corner.nIndex);
+                chunk.minPosIndex = std::min(chunk.minPosIndex, corner.posIndex);
+                chunk.maxPosIndex = std::max(chunk.maxPosIndex, corner.posIndex);
+                chunk.corners.push_back(corner);
+                count++;
+            }
+            chunk.faceCounts.push_back(count);
+            chunk.faceDeclarations.push_back(uvec3(chunk.positions.size(), chunk.normals.size(), chunk.texCoords.size()));
+        }
     }
+}
 
-    // set ngonData
-    ngonData.vertices.shrink_to_fit();
-    ngonData.indices.shrink_to_fit();
-    ngonData.faces.shrink_to_fit();
+NgonData NgonLoader::loadNgonDataParallel(const std::string &filename, ThreadPool &pool) {
+    NgonData ngonData;
+    MappedFile file(filename);
+    if (!file.isOpen()) {
+        std::cerr << "Error opening the file: " << filename << std::endl;
+        return ngonData;
+    }
+
+    // Split the file in chunks ending on a line break
+    constexpr size_t minChunkSize = 256 * 1024;
+    const size_t targetChunkCount = std::max<size_t>(1, std::min<size_t>((pool.size() + 1) * 4, file.size() / minChunkSize));
+    std::vector<const char *> boundaries = {file.data()};
+    for (size_t i = 1; i < targetChunkCount; i++) {
+        const char *split = std::max(boundaries.back(), file.data() + file.size() * i / targetChunkCount);
+        const char *lineEnd = static_cast<const char *>(memchr(split, '\n', file.end() - split));
+        if (lineEnd == nullptr) { break; }
+        boundaries.push_back(lineEnd + 1);
+    }
+    boundaries.push_back(file.end());
+    std::vector<ObjChunk> chunks(boundaries.size() - 1);
+
+    // Parse every chunk independently
+    pool.parallelFor(chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) { parseObjChunk(boundaries[c], boundaries[c + 1], chunks[c]); }
+    });
+
+    // Prefix sums of the per-chunk counts
+    size_t positionCount = 0, normalCount = 0, texCoordCount = 0, cornerCount = 0, faceCount = 0;
+    int minPosIndex = std::numeric_limits<int>::max(), maxPosIndex = 0;
+    for (ObjChunk &chunk : chunks) {
+        chunk.positionBase = positionCount;
+        chunk.normalBase = normalCount;
+        chunk.texCoordBase = texCoordCount;
+        chunk.cornerBase = cornerCount;
+        chunk.faceBase = faceCount;
+        positionCount += chunk.positions.size();
+        normalCount += chunk.normals.size();
+        texCoordCount += chunk.texCoords.size();
+        cornerCount += chunk.corners.size();
+        faceCount += chunk.faceCounts.size();
+        if (!chunk.corners.empty()) {
+            minPosIndex = std::min(minPosIndex, chunk.minPosIndex);
+            maxPosIndex = std::max(maxPosIndex, chunk.maxPosIndex);
+        }
+    }
+    ASSERT(cornerCount == 0 || minPosIndex > 0, "Relative or null OBJ face indices are not supported");
+
+    ngonData.faces.resize(faceCount);
+    ngonData.indices.resize(cornerCount);
+    ngonData.vertices.resize(cornerCount == 0 ? 0 : maxPosIndex);
+
+    // The serial parser overwrites a vertex each time a face uses it: the last corner referencing it wins
+    std::vector<std::atomic<uint32>> lastCorner(ngonData.vertices.size()); // global corner index + 1, 0 if unused
+
+    // Stitch faces and indices, resolve which declarations each corner could see
+    pool.parallelFor(chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            ObjChunk &chunk = chunks[c];
+            uint32 localOffset = 0;
+            for (size_t f = 0; f < chunk.faceCounts.size(); f++) {
+                NGonFace &face = ngonData.faces[chunk.faceBase + f];
+                face.offset = uint32(chunk.cornerBase + localOffset);
+                face.count = chunk.faceCounts[f];
+                face.normal = VEC4F_ONE;
+
+                const size_t declaredPositions = chunk.positionBase + chunk.faceDeclarations[f].x;
+                const size_t declaredNormals = chunk.normalBase + chunk.faceDeclarations[f].y;
+                const size_t declaredTexCoords = chunk.texCoordBase + chunk.faceDeclarations[f].z;
+                for (uint32 i = 0; i < face.count; i++) {
+                    ObjCorner &corner = chunk.corners[localOffset + i];
+                    corner.hasPosition = size_t(corner.posIndex) <= declaredPositions;
+                    if (corner.nIndex <= 0 || size_t(corner.nIndex) > declaredNormals) { corner.nIndex = 0; }
+                    if (corner.texIndex <= 0 || size_t(corner.texIndex) > declaredTexCoords) { corner.texIndex = 0; }
+
+                    const uint32 globalCorner = uint32(chunk.cornerBase + localOffset + i);
+                    ngonData.indices[globalCorner] = corner.posIndex - 1;
+                    std::atomic<uint32> &last = lastCorner[corner.posIndex - 1];
+                    uint32 previous = last.load(std::memory_order_relaxed);
+                    while (previous < globalCorner + 1 && !last.compare_exchange_weak(previous, globalCorner + 1, std::memory_order_relaxed)) {}
+                }
+                localOffset += face.count;
+            }
+        }
+    });
+
+    // Gather the declared attributes, every chunk copies its own range
+    std::vector<vec4> normals(normalCount);
+    std::vector<vec4> texCoords(texCoordCount);
+    std::vector<vec4> positions(positionCount);
+    pool.parallelFor(chunks.size(), [&](size_t begin, size_t end) {
+        for (size_t c = begin; c < end; c++) {
+            std::copy(chunks[c].positions.begin(), chunks[c].positions.end(), positions.begin() + chunks[c].positionBase);
+            std::copy(chunks[c].normals.begin(), chunks[c].normals.end(), normals.begin() + chunks[c].normalBase);
+            std::copy(chunks[c].texCoords.begin(), chunks[c].texCoords.end(), texCoords.begin() + chunks[c].texCoordBase);
+        }
+    });
+
+    // Build each vertex from the corner that wrote it last
+    pool.parallelFor(ngonData.vertices.size(), [&](size_t begin, size_t end) {
+        for (size_t v = begin; v < end; v++) {
+            const uint32 last = lastCorner[v].load(std::memory_order_relaxed);
+            if (last == 0) { continue; }
+            const uint32 globalCorner = last - 1;
+            const ObjChunk &chunk = *(std::upper_bound(chunks.begin(), chunks.end(), globalCorner, [](uint32 corner, const ObjChunk &ch) { return corner < ch.cornerBase; }) - 1);
+            const ObjCorner &corner = chunk.corners[globalCorner - chunk.cornerBase];
+
+            Vertex vertex{};
+            if (corner.hasPosition) {
+                vec3 pos = positions[corner.posIndex - 1];
+                vertex.position = vec4(pos.x, pos.y, pos.z, 1.0f);
+            }
+            if (corner.nIndex > 0) { vertex.normal = normals[corner.nIndex - 1]; }
+            if (corner.texIndex > 0) { vertex.texCoord = texCoords[corner.texIndex - 1]; }
+            ngonData.vertices[v] = vertex;
+        }
+    });
+
+    file.close();
+
+    // Face normals, areas and centers
+    pool.parallelFor(ngonData.faces.size(), [&](size_t begin, size_t end) { computeFaceAttributes(ngonData, begin, end); }, 1024);
     return ngonData;
 }
 
@@ -1,6 +1,11 @@
 #pragma once
+#include <string>
+#include <string_view>
+
 #include "defines.hpp"
 
+class ThreadPool;
+
 struct Vertex {
     vec4 position = VEC4F_ZERO;
     vec4 color = VEC4F_ONE;
@@ -35,10 +40,22 @@ struct NGonDataWBones : public NgonData {
 };
 
 void extractIndices(const std::string &token, int &posIndex, int &texIndex, int &nIndex);
+void extractIndices(std::string_view token, int &posIndex, int &texIndex, int &nIndex); // allocation free, used by the mapped parser
 
 class NgonLoader {
 public:
-    static NgonData loadNgonData(const std::string &filename);
+    enum class ParserMode {
+        STREAM = 0, // std::getline + std::istringstream, reference implementation
+        MAPPED = 1, // memory-mapped file tokenized in place, produces the same NgonData as STREAM
+        PARALLEL = 2, // MAPPED split in line-aligned chunks parsed on the global thread pool, same NgonData as STREAM
+    };
+
+    static NgonData loadNgonData(const std::string &filename, ParserMode mode = ParserMode::PARALLEL);
+    static NgonData loadNgonDataParallel(const std::string &filename, ThreadPool &pool);
+
+private:
+    static NgonData loadNgonDataStream(const std::string &filename);
+    static NgonData loadNgonDataMapped(const std::string &filename);
 };
 
 struct LutData {
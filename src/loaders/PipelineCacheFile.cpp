@@ -0,0 +1,83 @@
+#include "PipelineCacheFile.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+
+static constexpr char pipelineCacheMagic[8] = {'P', 'I', 'P', 'E', 'C', 'A', 'C', 'H'};
+
+// FNV-1a, byte per byte, the blobs are a few MB at most
+static uint64 hashBytes(const byte *p_data, size_t p_size) {
+    uint64 hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < p_size; i++) { hash = (hash ^ p_data[i]) * 0x100000001b3ull; }
+    return hash;
+}
+
+static bool sameKey(const PipelineCacheFile::DeviceKey &p_a, const PipelineCacheFile::DeviceKey &p_b) {
+    return p_a.vendorID == p_b.vendorID && p_a.deviceID == p_b.deviceID && p_a.driverVersion == p_b.driverVersion && memcmp(p_a.deviceUUID, p_b.deviceUUID, sizeof(p_a.deviceUUID)) == 0 &&
+           memcmp(p_a.pipelineCacheUUID, p_b.pipelineCacheUUID, sizeof(p_a.pipelineCacheUUID)) == 0;
+}
+
+std::vector<byte> PipelineCacheFile::load(const std::string &p_path, const DeviceKey &p_key) {
+    std::ifstream file(p_path, std::ios::binary | std::ios::ate);
+    if (!file) { return {}; }
+    const uint64 fileSize = uint64(file.tellg());
+    file.seekg(0);
+
+    auto reject = [](const char *p_reason) {
+        std::cout << "Ignoring pipeline cache: " << p_reason << std::endl;
+        return std::vector<byte>{};
+    };
+    Header header{};
+    if (fileSize < sizeof(Header) || !file.read(reinterpret_cast<char *>(&header), sizeof(Header))) { return reject("truncated header"); }
+    if (memcmp(header.magic, pipelineCacheMagic, sizeof(pipelineCacheMagic)) != 0) { return reject("not a pipeline cache file"); }
+    if (header.version != version || header.headerSize != sizeof(Header)) { return reject("outdated version"); }
+    if (!sameKey(header.key, p_key)) { return reject("written by another device or driver"); }
+    if (header.dataSize != fileSize - sizeof(Header)) { return reject("truncated data"); }
+
+    std::vector<byte> data(header.dataSize);
+    if (!file.read(reinterpret_cast<char *>(data.data()), std::streamsize(data.size()))) { return reject("truncated data"); }
+    if (hashBytes(data.data(), data.size()) != header.dataHash) { return reject("corrupted data"); }
+
+    // the driver checks its own header too, but not every driver survives a foreign blob
+    // VkPipelineCacheHeaderVersionOne: headerSize, headerVersion, vendorID, deviceID, pipelineCacheUUID[16]
+    uint32 vkHeader[4];
+    if (data.size() < sizeof(vkHeader) + sizeof(p_key.pipelineCacheUUID)) { return reject("truncated data"); }
+    memcpy(vkHeader, data.data(), sizeof(vkHeader));
+    if (vkHeader[0] < sizeof(vkHeader) + sizeof(p_key.pipelineCacheUUID) || vkHeader[1] != 1 || vkHeader[2] != p_key.vendorID || vkHeader[3] != p_key.deviceID ||
+        memcmp(data.data() + sizeof(vkHeader), p_key.pipelineCacheUUID, sizeof(p_key.pipelineCacheUUID)) != 0) {
+        return reject("driver header mismatch");
+    }
+    return data;
+}
+
+bool PipelineCacheFile::save(const std::string &p_path, const DeviceKey &p_key, const std::vector<byte> &p_data) {
+    Header header{};
+    memcpy(header.magic, pipelineCacheMagic, sizeof(pipelineCacheMagic));
+    header.version = version;
+    header.headerSize = sizeof(Header);
+    header.key = p_key;
+    header.dataSize = p_data.size();
+    header.dataHash = hashBytes(p_data.data(), p_data.size());
+
+    // same write and rename as the mesh cache, a crash never leaves a partial file behind
+    const std::string tmpPath = p_path + ".tmp";
+    {
+        std::ofstream file(tmpPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(Header));
+        file.write(reinterpret_cast<const char *>(p_data.data()), std::streamsize(p_data.size()));
+        if (!file) {
+            std::cerr << "Could not write pipeline cache: " << p_path << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(tmpPath, p_path, error);
+    if (error) {
+        std::cerr << "Could not write pipeline cache: " << p_path << " (" << error.message() << ")" << std::endl;
+        std::filesystem::remove(tmpPath, error);
+        return false;
+    }
+    return true;
+}
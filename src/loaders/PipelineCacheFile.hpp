@@ -0,0 +1,34 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+
+// On-disk container for the data of a VkPipelineCache. The blob is only valid for the device and driver that produced
+// it, so the file header records both and a stale or corrupt file is ignored instead of being handed to the driver.
+class PipelineCacheFile {
+public:
+    static constexpr uint32 version = 1;
+
+    struct DeviceKey {
+        uint32 vendorID = 0;
+        uint32 deviceID = 0;
+        uint32 driverVersion = 0;
+        uint8 deviceUUID[16] = {};
+        uint8 pipelineCacheUUID[16] = {};
+    };
+
+    struct Header {
+        char magic[8];
+        uint32 version;
+        uint32 headerSize;
+        DeviceKey key;
+        uint64 dataSize;
+        uint64 dataHash;
+    };
+
+    // Cache data for p_key, empty when the file is missing, was written for another device or driver, or is corrupt
+    static std::vector<byte> load(const std::string &p_path, const DeviceKey &p_key);
+    static bool save(const std::string &p_path, const DeviceKey &p_key, const std::vector<byte> &p_data);
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <vector>
+
+#include "defines.hpp"
+
+// Uniform grid over a point set, answers "first point closer than epsilon" in near constant time.
+// Cells are twice epsilon wide so that two points closer than epsilon always fall in neighbouring cells.
+class PositionGrid {
+public:
+    PositionGrid(const std::vector<vec3> &p_points, float p_epsilon) : m_points(p_points), m_epsilon(p_epsilon), m_invCellSize(1.0 / (2.0 * double(p_epsilon))) {
+        m_entries.resize(p_points.size());
+        for (size_t i = 0; i < p_points.size(); ++i) { m_entries[i] = {cellOf(p_points[i]), int(i)}; }
+        // sorted by cell then by index, the first match in a cell is the lowest index
+        std::sort(m_entries.begin(), m_entries.end(), [](const Entry &a, const Entry &b) { return a.cell != b.cell ? lessCell(a.cell, b.cell) : a.index < b.index; });
+    }
+
+    // Lowest index i with distance(points[i], p_position) < epsilon, -1 if there is none
+    int findFirst(vec3 p_position) const {
+        const ivec3 center = cellOf(p_position);
+        int best = -1;
+        for (int z = -1; z <= 1; ++z) {
+            for (int y = -1; y <= 1; ++y) {
+                for (int x = -1; x <= 1; ++x) {
+                    const ivec3 cell = center + ivec3(x, y, z);
+                    auto it = std::lower_bound(m_entries.begin(), m_entries.end(), cell, [](const Entry &e, const ivec3 &c) { return lessCell(e.cell, c); });
+                    for (; it != m_entries.end() && it->cell == cell; ++it) {
+                        if (best != -1 && it->index >= best) { break; }
+                        if (glm::distance(m_points[it->index], p_position) < m_epsilon) {
+                            best = it->index;
+                            break;
+                        }
+                    }
+                }
+            }
+        }
+        return best;
+    }
+
+private:
+    struct Entry {
+        ivec3 cell;
+        int index;
+    };
+
+    static bool lessCell(const ivec3 &a, const ivec3 &b) { return a.x != b.x ? a.x < b.x : a.y != b.y ? a.y < b.y : a.z < b.z; }
+    // Clamped so the cast and the neighbour offsets of findFirst cannot overflow with a tiny epsilon or far points (NaN
+    // goes to the lowest cell). Points clamped into the same border cell are still told apart by their distance.
+    static int cellCoord(double p_coordinate) {
+        constexpr double limit = double(std::numeric_limits<int>::max() - 1);
+        const double cell = std::floor(p_coordinate);
+        return int(cell > -limit ? (cell < limit ? cell : limit) : -limit);
+    }
+    ivec3 cellOf(vec3 p_position) const { return ivec3(cellCoord(p_position.x * m_invCellSize), cellCoord(p_position.y * m_invCellSize), cellCoord(p_position.z * m_invCellSize)); }
+
+    std::vector<vec3> m_points;
+    float m_epsilon;
+    double m_invCellSize;
+    std::vector<Entry> m_entries;
+};
@@ -0,0 +1,83 @@
+#include "SceneLoader.hpp"
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <sstream>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+static mat4 placement(vec3 p_position, float p_yawDegrees, float p_scale) {
+    const mat4 translation = glm::translate(mat4(1.0f), p_position);
+    return glm::scale(glm::rotate(translation, glm::radians(p_yawDegrees), vec3(0, 1, 0)), vec3(p_scale));
+}
+
+bool Scene::load(const std::string &p_path) {
+    std::ifstream file(p_path);
+    if (!file) {
+        std::cerr << "Could not open scene: " << p_path << std::endl;
+        return false;
+    }
+    std::string line;
+    for (uint32 lineNumber = 1; std::getline(file, line); lineNumber++) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream stream(line);
+        std::string command, mesh;
+        if (!(stream >> command)) { continue; }
+
+        bool valid = false;
+        if (command == "instance") {
+            vec3 position;
+            SceneInstance instance;
+            float yaw = 0.0f, scale = 1.0f;
+            valid = bool(stream >> mesh >> position.x >> position.y >> position.z);
+            stream >> yaw >> scale >> instance.elementScaling >> instance.animationOffset; // optional, left to their default
+            if (valid) {
+                instance.transform = placement(position, yaw, scale);
+                instances[mesh].push_back(instance);
+            }
+        } else if (command == "grid") {
+            uint32 columns = 0, rows = 0, poses = 1, seed = 1;
+            float spacing = 0.0f, period = 2.0f;
+            valid = bool(stream >> mesh >> columns >> rows >> spacing);
+            stream >> poses >> period >> seed;
+            poses = std::max(poses, 1u);
+            std::mt19937 rng(seed);
+            std::uniform_real_distribution<float> yaw(0.0f, 360.0f), elementScaling(0.8f, 1.2f);
+            std::uniform_int_distribution<uint32> pose(0, poses - 1);
+            std::vector<SceneInstance> grid;
+            for (uint32 row = 0; valid && row < rows; row++) {
+                for (uint32 column = 0; column < columns; column++) {
+                    const vec3 position = vec3(float(column) - 0.5f * float(columns - 1), 0.0f, float(row) - 0.5f * float(rows - 1)) * spacing;
+                    SceneInstance instance;
+                    instance.transform = placement(position, yaw(rng), 1.0f);
+                    instance.elementScaling = elementScaling(rng);
+                    instance.animationOffset = period * float(pose(rng)) / float(poses);
+                    grid.push_back(instance);
+                }
+            }
+            if (valid) { instances[mesh].insert(instances[mesh].end(), grid.begin(), grid.end()); }
+        }
+        if (!valid) { std::cerr << p_path << ":" << lineNumber << ": cannot parse \"" << line << "\"" << std::endl; }
+    }
+    return true;
+}
+
+uint32 Scene::instanceCount() const {
+    uint32 count = 0;
+    for (const auto &[mesh, meshInstances] : instances) { count += uint32(meshInstances.size()); }
+    return count;
+}
+
+InstancePalettes groupAnimationOffsets(const std::vector<SceneInstance> &p_instances) {
+    InstancePalettes palettes;
+    palettes.instancePalette.reserve(p_instances.size());
+    for (const SceneInstance &instance : p_instances) {
+        auto it = std::find(palettes.offsets.begin(), palettes.offsets.end(), instance.animationOffset);
+        if (it == palettes.offsets.end()) { it = palettes.offsets.insert(palettes.offsets.end(), instance.animationOffset); }
+        palettes.instancePalette.push_back(uint32(it - palettes.offsets.begin()));
+    }
+    if (palettes.offsets.empty()) { palettes.offsets.push_back(0.0f); }
+    return palettes;
+}
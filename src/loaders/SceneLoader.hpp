@@ -0,0 +1,39 @@
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+
+#include "defines.hpp"
+
+// One placement of a shared mesh. The geometry and its GPU buffers stay with the mesh, an instance only carries its
+// transform, a multiplier of the element scaling of the mesh and the time offset of its animation.
+struct SceneInstance {
+    mat4 transform = mat4(1.0f);
+    float elementScaling = 1.0f;
+    float animationOffset = 0.0f; // seconds added to the animation clock, instances with the same offset share a pose
+};
+
+// Instances of the meshes of the app by mesh name, read from a text file with one command per line:
+//   instance <mesh> <x> <y> <z> [yaw degrees] [scale] [element scaling] [animation offset]
+//   grid <mesh> <columns> <rows> <spacing> [poses] [period] [seed]
+// A grid places columns x rows instances on the XZ plane around the origin, each with a random yaw and element scaling
+// and one of [poses] animation offsets spread over [period] seconds. Grids with the same seed get the same placements,
+// so two meshes meant to be drawn together (the dragon and its coat) stay aligned. # starts a comment.
+// A scene does not load meshes: it only instances the demo meshes the app already loads, by their MeshData name, and
+// the app only instances the dragon ("Dragon") and its coat ("Coat"). The ground stays a single object.
+struct Scene {
+    std::map<std::string, std::vector<SceneInstance>> instances;
+
+    // false when the file cannot be read, the lines that cannot be parsed are reported and skipped
+    bool load(const std::string &p_path);
+    uint32 instanceCount() const;
+};
+
+// Poses shared by the instances of a mesh: the distinct animation offsets, then the palette of each instance
+struct InstancePalettes {
+    std::vector<float> offsets;
+    std::vector<uint32> instancePalette;
+};
+
+InstancePalettes groupAnimationOffsets(const std::vector<SceneInstance> &p_instances);
@@ -1,12 +1,21 @@
 #include "AppRessources.hpp"
+#include "CompletionQueue.hpp"
+#include "FrameRecorder.hpp"
+#include "GpuProfiler.hpp"
+#include "benchmarks.hpp"
 #include "config.hpp"
 #include "camera.hpp"
+#include "loaders/CameraPath.hpp"
 #include "renderer.hpp"
 #include "GLFW/glfw3.h"
 
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_vulkan.h>
 
+#include <cctype>
+#include <functional>
+#include <future>
+
 void drawFrame(Renderer&);
 void run();
 void cleanup();
@@ -14,8 +23,11 @@ void cleanup();
 class App {
     GLFWwindow* m_window = nullptr;
     Renderer m_renderer{};
+    GpuProfiler m_profiler{};
     Pipeline m_hePipeline{};
-    Pipeline m_parametricPipline{};
+    std::vector<Pipeline> m_parametricPipelines{}; // one variant per element type, then the generic one
+    bool m_specializedPipelines = true;
+    Pipeline m_compactionPipeline{}; // compute pre-pass culling the parametric elements
     Pipeline m_pebblePipeline{};
 
     vk::DescriptorSetLayout m_uboDescriptorSetLayout;
@@ -29,6 +41,18 @@ class App {
     Dragon dragon{};
     Coat dragonCoat{};
     Ground ground{};
+    Scene m_scene;
+
+    // the meshes are loaded by jobs of the global pool, the render thread uploads them between two frames
+    std::vector<std::future<void>> m_loadJobs;
+    CompletionQueue<std::function<void()>> m_pendingUploads;
+    std::chrono::high_resolution_clock::time_point m_startTime;
+    double m_firstFrameMs = -1.0; // time to first frame and to full scene from the start of init, -1 until reached
+    double m_fullSceneMs = -1.0;  // the full scene is reached once every mesh is loaded or failed
+
+    OcclusionBuffer m_occlusionBuffer; // depth of the skinned dragon body, rasterized on the CPU
+    float m_occlusionCpuMs = 0.0f;     // smoothed over frames
+    static constexpr uint32 occlusionBufferWidth = 256;
 
     Camera m_camera;
     bool m_animation = true;
@@ -37,25 +61,68 @@ class App {
     vk::Extent2D m_swapChainExtent;
 
 private:
+    void loadMeshesAsync();
+    void uploadLoadedMeshes(); // runs the completions of the load jobs, call on the render thread outside of a frame
+    bool isSceneFinished() const { return dragon.isFinished() && dragonCoat.isFinished() && ground.isFinished(); }
+    uint32 failedMeshCount() const { return uint32(dragon.failed) + uint32(dragonCoat.failed) + uint32(ground.failed); }
+    bool hasLoadJobsRunning() const;
+    uint64 countDispatchedElements() const; // upper bound of the rendered elements, the GPU culling is not read back
+    void drawScriptedFrame(const CameraPath &p_path, float p_time);
     void updateSceneUBOs();
+    // Rasterizes the dragon body into m_occlusionBuffer and tests the elements of the dragon and the coat against it.
+    // The ground is not tested: the pebbles of pebble.mesh have no CPU bound (random extrusion, roundness, noise and a
+    // rotation animated on the GPU), and the dragon standing on it only hides a small patch of it.
+    void cullOccludedElements();
+    const Pipeline &getParametricPipeline(const shaderInterface::ResurfacingUBO &p_ubo) const;
     void drawFrame();
 
 public:
-    void init();
+    void init(bool p_coldStart = false, bool p_headless = false, const std::string &p_gpuCsvPath = "", const std::string &p_scenePath = "");
     void drawUI();
     void handleEvent();
     void animate(float p_dt);
     void run();
+    void runHeadless(uint32 p_frameCount); // fixed time step, no window nor UI
+    // Deterministic benchmark: the camera follows p_path and the clock advances by p_timeStep per frame, without input.
+    // After the loading and p_warmupFrames frames, p_frameCount frames are measured and written to p_csvPath.
+    bool runScripted(const CameraPath &p_path, uint32 p_warmupFrames, uint32 p_frameCount, float p_timeStep, const std::string &p_csvPath);
     void cleanup();
 };
 
-int main() {
+int main(int argc, char **argv) {
     setWorkingDirectoryToProjectRoot();
     std::cout << "Working directory set to: " << std::filesystem::current_path() << std::endl;
+    const std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty() && args[0] == "--bench") { return runBenchmarks(std::vector<std::string>(args.begin() + 1, args.end())); }
+    // --headless [frames] renders offscreen then exits, the frame count defaults to 300
+    const auto headless = std::find(args.begin(), args.end(), "--headless");
+    uint32 headlessFrames = 300;
+    if (headless != args.end() && headless + 1 != args.end() && std::isdigit(static_cast<unsigned char>((headless + 1)->front()))) { headlessFrames = uint32(std::stoul(*(headless + 1))); }
+    auto argValue = [&args](const std::string &p_name, const std::string &p_default) {
+        const auto arg = std::find(args.begin(), args.end(), p_name);
+        return arg != args.end() && arg + 1 != args.end() ? *(arg + 1) : p_default;
+    };
+    // --gpu-csv <path> records the GPU profiler scopes from the first frame
+    const std::string gpuCsvPath = argValue("--gpu-csv", "");
+    // --scene <path> draws the instances of the file instead of the single dragon and coat, see SceneLoader.hpp
+    const std::string scenePath = argValue("--scene", "");
+    // --camera-path <path> runs the scripted benchmark, in the window or with --headless, see CameraPath.hpp. Options:
+    // --warmup [60] --frames [600] --timestep [0.016667] seconds --frame-csv [frame_times.csv], plus its _summary.csv
+    CameraPath cameraPath;
+    const std::string cameraPathFile = argValue("--camera-path", "");
+    if (!cameraPathFile.empty() && !cameraPath.load(cameraPathFile)) { return EXIT_FAILURE; }
     App app;
-    app.init();
+    app.init(std::find(args.begin(), args.end(), "--cold-start") != args.end(), headless != args.end(), gpuCsvPath, scenePath);
     try {
-        app.run();
+        if (!cameraPathFile.empty()) {
+            const bool written = app.runScripted(cameraPath, uint32(std::stoul(argValue("--warmup", "60"))), uint32(std::stoul(argValue("--frames", "600"))),
+                                                 std::stof(argValue("--timestep", std::to_string(1.0f / 60.0f))), argValue("--frame-csv", "frame_times.csv"));
+            if (!written) { return EXIT_FAILURE; }
+        } else if (headless != args.end()) {
+            app.runHeadless(headlessFrames);
+        } else {
+            app.run();
+        }
     } catch (...) {
         app.cleanup();
         return EXIT_FAILURE;
@@ -63,12 +130,17 @@ int main() {
     return EXIT_SUCCESS;
 }
 
-void App::init() {
-    ASSERT(glfwInit() == GLFW_TRUE, "Could not initialize GLFW!");
-    ASSERT(glfwVulkanSupported() == GLFW_TRUE, "GLFW: Vulkan not supported!");
-    glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-    m_window = glfwCreateWindow(800, 600, "Resurfacing", nullptr, nullptr);
-    m_renderer.init(m_window, false);
+void App::init(bool p_coldStart, bool p_headless, const std::string &p_gpuCsvPath, const std::string &p_scenePath) {
+    m_startTime = std::chrono::high_resolution_clock::now();
+    if (!p_headless) {
+        ASSERT(glfwInit() == GLFW_TRUE, "Could not initialize GLFW!");
+        ASSERT(glfwVulkanSupported() == GLFW_TRUE, "GLFW: Vulkan not supported!");
+        glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+        m_window = glfwCreateWindow(800, 600, "Resurfacing", nullptr, nullptr);
+    }
+    m_renderer.init(m_window, false, !p_coldStart);
+    m_profiler.init(m_renderer, m_renderer.getFrameSlotCount());
+    if (!p_gpuCsvPath.empty()) { m_profiler.startCsv(p_gpuCsvPath); }
 
 
     // allocate descriptor sets
@@ -90,15 +162,75 @@ void App::init() {
     memcpy(m_viewUBO.mappedMemory, &m_viewUBOData, sizeof(shaderInterface::ViewUBO));
     memcpy(m_globalShadingUBO.mappedMemory, &m_globalShadingUBOData, sizeof(shaderInterface::GlobalShadingUBO));
     m_camera.init(vec3(0, 3, 3), vec3(0));
-    
-    
-    dragon.init(m_renderer, "assets/demo/dragon/dragon_8k.obj", "Dragon", "assets/demo/dragon/dragon_8k.gltf", "assets/parametric_luts/scale_lut.obj", "assets/demo/dragon/dargon_8k_ao.png", "assets/demo/dragon/dragon_element_type_map_2k.png");
-    dragonCoat.init(m_renderer, "assets/demo/dragon/dragon_coat.obj", "Coat", "assets/demo/dragon/dragon_coat.gltf", "assets/demo/dragon/dragon_coat_ao.png");
-    ground.init(m_renderer, "assets/demo/ground.obj", "Ground");
 
-    m_hePipeline = m_renderer.createPipeline({"shaders/halfEdges/halfEdge.mesh","shaders/halfEdges/halfEdge.frag"}, PipelineDesc{});
-    m_parametricPipline = m_renderer.createPipeline({"shaders/parametric/parametric.task","shaders/parametric/parametric.mesh","shaders/parametric/parametric.frag"}, PipelineDesc{});
-    m_pebblePipeline = m_renderer.createPipeline({"shaders/pebble/pebble.task", "shaders/pebble/pebble.mesh", "shaders/pebble/pebble.frag"}, PipelineDesc{});
+    // the instances share the geometry and GPU buffers of their mesh, the meshes the scene does not list stay single.
+    // The scene only places copies of the fixed demo meshes, the names it can use are those of the instanced ones.
+    if (!p_scenePath.empty() && m_scene.load(p_scenePath)) {
+        for (const auto &[meshName, instances] : m_scene.instances) {
+            if (meshName != "Dragon" && meshName != "Coat") { std::cerr << "Scene: no instanced mesh named " << meshName << std::endl; }
+        }
+        std::cout << "Scene: " << m_scene.instanceCount() << " instances from " << p_scenePath << std::endl;
+    }
+    // the pipelines below are built while the meshes load
+    loadMeshesAsync();
+
+    std::vector<PipelineRequest> requests = {{{"shaders/halfEdges/halfEdge.mesh", "shaders/halfEdges/halfEdge.frag"}}, {{"shaders/pebble/pebble.task", "shaders/pebble/pebble.mesh", "shaders/pebble/pebble.frag"}}, {{"shaders/parametric/compaction.comp"}}};
+    for (uint32 elementType = 0; elementType <= GENERIC_ELEMENT_TYPE; elementType++) {
+        PipelineRequest request{{"shaders/parametric/parametric.task", "shaders/parametric/parametric.mesh", "shaders/parametric/parametric.frag"}};
+        request.desc.specializationConstants = {elementType};
+        requests.push_back(request);
+    }
+    const std::vector<Pipeline> pipelines = m_renderer.createPipelines(requests);
+    m_hePipeline = pipelines[0];
+    m_pebblePipeline = pipelines[1];
+    m_compactionPipeline = pipelines[2];
+    m_parametricPipelines.assign(pipelines.begin() + 3, pipelines.end());
+    std::cout << "Startup: " << millisecondsD(std::chrono::high_resolution_clock::now() - m_startTime).count() << " ms (" << (m_renderer.isPipelineCacheWarm() ? "warm" : "cold") << " start)" << std::endl;
+}
+
+void App::loadMeshesAsync() {
+    // load runs on a worker, the upload and the instancing are queued for the render thread which owns every Vulkan
+    // object. A mesh is drawn from the first frame after its upload.
+    auto submit = [this](std::function<void()> p_load, std::function<void(Renderer &)> p_upload, MeshData &p_mesh) {
+        m_loadJobs.push_back(ThreadPool::global().submit([this, p_load, p_upload, &p_mesh] {
+            const auto start = std::chrono::high_resolution_clock::now();
+            try {
+                p_load();
+            } catch (const std::exception &e) { // the mesh is never drawn, the others still are
+                std::cerr << "Could not load a mesh: " << e.what() << std::endl;
+                m_pendingUploads.push([&p_mesh] { p_mesh.failed = true; });
+                return;
+            }
+            const double loadMs = millisecondsD(std::chrono::high_resolution_clock::now() - start).count();
+            m_pendingUploads.push([this, p_upload, &p_mesh, loadMs] {
+                p_upload(m_renderer);
+                p_mesh.loaded = true;
+                std::cout << p_mesh.name << ": loaded in " << loadMs << " ms, drawn " << millisecondsD(std::chrono::high_resolution_clock::now() - m_startTime).count() << " ms after start" << std::endl;
+            });
+        }));
+    };
+    submit([this] { dragon.load("assets/demo/dragon/dragon_8k.obj", "Dragon", "assets/demo/dragon/dragon_8k.gltf", "assets/parametric_luts/scale_lut.obj", "assets/demo/dragon/dargon_8k_ao.png", "assets/demo/dragon/dragon_element_type_map_2k.png"); },
+           [this](Renderer &p_renderer) {
+               dragon.upload(p_renderer);
+               if (m_scene.instances.count(dragon.name)) { dragon.setInstances(p_renderer, m_scene.instances.at(dragon.name)); }
+           },
+           dragon);
+    submit([this] { dragonCoat.load("assets/demo/dragon/dragon_coat.obj", "Coat", "assets/demo/dragon/dragon_coat.gltf", "assets/demo/dragon/dragon_coat_ao.png"); },
+           [this](Renderer &p_renderer) {
+               dragonCoat.upload(p_renderer);
+               if (m_scene.instances.count(dragonCoat.name)) { dragonCoat.setInstances(p_renderer, m_scene.instances.at(dragonCoat.name)); }
+           },
+           dragonCoat);
+    submit([this] { ground.load("assets/demo/ground.obj", "Ground"); }, [this](Renderer &p_renderer) { ground.upload(p_renderer); }, ground);
+}
+
+bool App::hasLoadJobsRunning() const {
+    return std::any_of(m_loadJobs.begin(), m_loadJobs.end(), [](const std::future<void> &p_job) { return p_job.wait_for(std::chrono::seconds(0)) != std::future_status::ready; });
+}
+
+void App::uploadLoadedMeshes() {
+    if (m_pendingUploads.empty()) { return; }
+    for (std::function<void()> &upload : m_pendingUploads.popAll()) { upload(); }
 }
 
 void App::drawUI() {
@@ -118,19 +250,80 @@ void App::drawUI() {
     ImGui::SliderFloat("Time Scale", &m_timeScale, 0, 3);
     ImGui::Separator();
     m_globalShadingUBOData.displayUI();
+    ImGui::Checkbox("Specialized parametric pipelines", &m_specializedPipelines);
+    m_profiler.displayUI();
+    if (ImGui::CollapsingHeader("Staging memory")) {
+        const StagingArena::Stats &staging = m_renderer.getStagingStats();
+        ImGui::Text("Blocks: %u (%.1f MB reserved)", staging.blockAllocations, staging.reservedBytes / (1024.0 * 1024.0));
+        ImGui::Text("Uploads: %llu, block recycles: %llu", (unsigned long long)staging.suballocations, (unsigned long long)staging.blockRecycles);
+        ImGui::Text("In use: %.1f MB (peak %.1f MB)", staging.usedBytes / (1024.0 * 1024.0), staging.peakUsedBytes / (1024.0 * 1024.0));
+    }
+    if (ImGui::CollapsingHeader("Device memory")) {
+        const MemoryAllocator::Stats memory = m_renderer.getMemoryStats();
+        ImGui::Text("Resources: %u in %u blocks (%llu allocations)", memory.allocationCount, memory.liveBlocks, (unsigned long long)memory.deviceAllocations);
+        ImGui::Text("Used: %.1f / %.1f MB (peak %.1f MB)", memory.usedBytes / (1024.0 * 1024.0), memory.reservedBytes / (1024.0 * 1024.0), memory.peakReservedBytes / (1024.0 * 1024.0));
+        ImGui::Text("Free ranges: %u, fragmentation %.2f, reclaimable blocks %u", memory.freeRangeCount, memory.fragmentation(), memory.reclaimableBlocks);
+    }
     ImGui::End();
     
     ImGui::Begin("Meshes");
+    // the meshes still loading or that failed are listed by label, their name is only valid once loaded
+    const std::array<std::pair<const char *, const MeshData *>, 3> meshes = {{{"Dragon", &dragon}, {"Coat", &dragonCoat}, {"Ground", &ground}}};
+    for (const auto &[label, mesh] : meshes) {
+        if (!mesh->loaded) { ImGui::Text("%s: %s", label, mesh->failed ? "failed to load" : "loading..."); }
+    }
+    if (dragon.loaded) {
+        ImGui::Separator();
+        ImGui::Separator();
+        ImGui::PushID("Dragon");
+        dragon.displayUI();
+        ImGui::PopID();
+    }
+    if (dragonCoat.loaded) {
+        ImGui::Separator();
+        ImGui::Separator();
+        ImGui::PushID("Coat");
+        dragonCoat.displayUI();
+        ImGui::PopID();
+    }
     ImGui::Separator();
-    ImGui::Separator();
-    ImGui::PushID("Dragon");
-    dragon.displayUI();
-    ImGui::PopID();
-    ImGui::Separator();
-    ImGui::Separator();
-    ImGui::PushID("Coat");
-    dragonCoat.displayUI();
-    ImGui::PopID();
+    if (ImGui::CollapsingHeader("Loading")) {
+        ImGui::Text("First frame: %.1f ms, full scene: %.1f ms", m_firstFrameMs, m_fullSceneMs);
+        if (failedMeshCount() > 0) { ImGui::Text("%u meshes failed to load", failedMeshCount()); }
+    }
+    if (!dragon.loaded && !dragonCoat.loaded) {
+        ImGui::End();
+        return;
+    }
+    // the statistics below only cover the loaded meshes
+    std::vector<const MeshData *> loadedMeshes;
+    for (const MeshData *mesh : {static_cast<const MeshData *>(&dragon), static_cast<const MeshData *>(&dragonCoat)}) {
+        if (mesh->loaded) { loadedMeshes.push_back(mesh); }
+    }
+    if (ImGui::CollapsingHeader("Skinning CPU time")) {
+        for (const MeshData *mesh : loadedMeshes) { ImGui::Text("%s: %.3f ms, %u bones", mesh->name.c_str(), mesh->skinningCpuMs, mesh->boneMatCount); }
+    }
+    if (ImGui::CollapsingHeader("Instances")) {
+        for (const MeshData *mesh : loadedMeshes) {
+            ImGui::Text("%s: %u instances, %u poses", mesh->name.c_str(), mesh->instanceCount(), uint32(mesh->paletteOffsets.size()));
+        }
+    }
+    if (ImGui::CollapsingHeader("Occlusion culling CPU time")) {
+        const OcclusionBuffer::Stats &stats = m_occlusionBuffer.getStats();
+        ImGui::Text("%.3f ms, %ux%u buffer, raster %.3f ms", m_occlusionCpuMs, m_occlusionBuffer.getWidth(), m_occlusionBuffer.getHeight(), stats.rasterMs);
+        ImGui::Text("%u occluder triangles in %u tile bins", stats.triangles, stats.binnedTiles);
+        for (const MeshData *mesh : loadedMeshes) { ImGui::Text("%s: %u / %u elements occluded", mesh->name.c_str(), mesh->occludedElements, uint32(mesh->elementSpheres.size())); }
+    }
+    if (ImGui::CollapsingHeader("Cluster culling (CPU reference)")) {
+        mat4 projection = m_camera.getProjectionMatrix();
+        projection[1][1] *= -1;
+        const mat4 viewProjection = projection * m_camera.getViewMatrix();
+        auto displayStats = [&](const MeshData &mesh, float threshold) {
+            ClusterCullingStats stats = mesh.cullClustersCPU(viewProjection, m_camera.getPosition(), threshold);
+            ImGui::Text("%s: %u clusters, %.1f%% elements rejected (per element: %.1f%%)", mesh.name.c_str(), stats.clusterCount, stats.rejectedFraction() * 100.0f, stats.elementRejectedFraction() * 100.0f);
+        };
+        for (const MeshData *mesh : loadedMeshes) { displayStats(*mesh, mesh->resurfacingUBOData.cullingThreshold); }
+    }
     ImGui::End();
 }
 
@@ -148,9 +341,9 @@ void App::animate(float p_deltaTime) {
     }
 
     // update time
-    dragon.animate(m_currentTime, m_renderer);
-    dragonCoat.animate(m_currentTime, m_renderer);
-    ground.animate(m_currentTime, m_renderer);
+    if (dragon.loaded) { dragon.animate(m_currentTime, m_renderer); }
+    if (dragonCoat.loaded) { dragonCoat.animate(m_currentTime, m_renderer); }
+    if (ground.loaded) { ground.animate(m_currentTime, m_renderer); }
 }
 
 void App::run() {
@@ -182,6 +375,100 @@ void App::run() {
     cleanup();
 }
 
+void App::runHeadless(uint32 p_frameCount) {
+    m_swapChainExtent = m_renderer.getSwapChainExtent();
+    m_camera.resize(m_swapChainExtent.width, m_swapChainExtent.height);
+    // the frames drawn while the meshes load are not measured
+    while (hasLoadJobsRunning() || !m_pendingUploads.empty()) {
+        if (m_animation) { animate(1.0f / 60.0f); }
+        drawFrame();
+    }
+    const auto start = std::chrono::high_resolution_clock::now();
+    for (uint32 frame = 0; frame < p_frameCount; frame++) {
+        if (m_animation) { animate(1.0f / 60.0f); }
+        drawFrame();
+    }
+    m_renderer.m_logicalDevice.waitIdle();
+    const double totalMs = millisecondsD(std::chrono::high_resolution_clock::now() - start).count();
+    std::cout << "Headless: " << p_frameCount << " frames at " << m_swapChainExtent.width << "x" << m_swapChainExtent.height << " in " << totalMs << " ms (" << totalMs / std::max(p_frameCount, 1u) << " ms per frame)" << std::endl;
+    cleanup();
+}
+
+bool App::runScripted(const CameraPath &p_path, uint32 p_warmupFrames, uint32 p_frameCount, float p_timeStep, const std::string &p_csvPath) {
+    m_swapChainExtent = m_renderer.getSwapChainExtent();
+    m_camera.resize(m_swapChainExtent.width, m_swapChainExtent.height);
+    m_timeScale = 1.0f;
+    // the clock starts once every mesh is in, the warm-up replays the first measured frames
+    while (hasLoadJobsRunning() || !m_pendingUploads.empty()) { drawScriptedFrame(p_path, 0.0f); }
+    for (uint32 frame = 0; frame < p_warmupFrames; frame++) { drawScriptedFrame(p_path, float(frame % std::max(p_frameCount, 1u)) * p_timeStep); }
+
+    // the GPU results of a frame are read back when its frame slot comes around again
+    FrameRecorder recorder;
+    recorder.reset(p_frameCount);
+    const uint64 firstProfilerFrame = m_profiler.getFrameIndex() + 1;
+    auto collectGpuResults = [&] {
+        const uint64 profilerFrame = m_profiler.getResultsFrameIndex();
+        if (profilerFrame < firstProfilerFrame || profilerFrame - firstProfilerFrame >= p_frameCount) { return; }
+        FrameRecord &record = recorder[uint32(profilerFrame - firstProfilerFrame)];
+        record.gpuMs = 0.0;
+        record.triangles = m_profiler.hasStatistics() ? 0 : -1;
+        for (const GpuProfiler::ScopeResult &scope : m_profiler.getResults()) {
+            record.gpuMs += scope.gpuMs;
+            if (m_profiler.hasStatistics()) { record.triangles += int64(scope.meshPrimitives); }
+        }
+    };
+    for (uint32 frame = 0; frame < p_frameCount; frame++) {
+        FrameRecord &record = recorder[frame];
+        record.time = float(frame) * p_timeStep; // not accumulated, the same frame gets the same clock on every run
+        const auto start = std::chrono::high_resolution_clock::now();
+        drawScriptedFrame(p_path, record.time);
+        // includes the wait for a free frame slot, bounded by the GPU when it is the bottleneck
+        record.cpuMs = millisecondsD(std::chrono::high_resolution_clock::now() - start).count();
+        record.elementsDispatched = countDispatchedElements();
+        collectGpuResults();
+    }
+    for (uint32 frame = 0; frame < m_renderer.getFrameSlotCount(); frame++) {
+        drawScriptedFrame(p_path, float(p_frameCount) * p_timeStep);
+        collectGpuResults();
+    }
+    m_renderer.m_logicalDevice.waitIdle();
+
+    std::cout << "Scripted run: " << p_warmupFrames << " warm-up frames, " << p_path.duration() << " s camera path, " << m_swapChainExtent.width << "x" << m_swapChainExtent.height << std::endl;
+    recorder.printSummary();
+    const std::filesystem::path csvPath(p_csvPath);
+    const std::string summaryPath = (csvPath.parent_path() / (csvPath.stem().string() + "_summary.csv")).string();
+    const bool written = recorder.writeCsv(p_csvPath) && recorder.writeSummaryCsv(summaryPath);
+    if (written) { std::cout << "Frame times written to " << p_csvPath << " and " << summaryPath << std::endl; }
+    cleanup();
+    return written;
+}
+
+void App::drawScriptedFrame(const CameraPath &p_path, float p_time) {
+    if (m_window != nullptr) {
+        glfwPollEvents();
+        ImGui_ImplVulkan_NewFrame();
+        ImGui_ImplGlfw_NewFrame();
+        ImGui::NewFrame();
+    }
+    const CameraKey key = p_path.sample(p_time);
+    m_camera.setPosition(key.position);
+    m_camera.setLookAt(key.lookAt);
+    m_currentTime = p_time;
+    animate(0.0f); // the clock is set above, this only propagates it to the camera, the lights and the skeletons
+    if (m_window != nullptr) { drawUI(); }
+    drawFrame();
+    if (m_window != nullptr) { ImGui::EndFrame(); }
+}
+
+uint64 App::countDispatchedElements() const {
+    auto parametricElements = [](const auto &p_mesh) -> uint64 {
+        if (!p_mesh.loaded) { return 0; }
+        const uint64 occluded = p_mesh.resurfacingUBOData.occlusionCulling ? p_mesh.occludedElements : 0;
+        return uint64(p_mesh.heMesh.nbFaces + p_mesh.heMesh.nbVertices) * p_mesh.instanceCount() - occluded;
+    };
+    return parametricElements(dragon) + parametricElements(dragonCoat) + (ground.loaded ? uint64(ground.heMesh.nbFaces) : 0); // one pebble per face
+}
+
 void App::updateSceneUBOs() {
     mat4 projection = m_camera.getProjectionMatrix();
     projection[1][1] *= -1; // flip y coordinate
@@ -193,43 +480,133 @@ void App::updateSceneUBOs() {
     
     memcpy(m_viewUBO.mappedMemory, &m_viewUBOData, sizeof(shaderInterface::ViewUBO));
     memcpy(m_globalShadingUBO.mappedMemory, &m_globalShadingUBOData, sizeof(shaderInterface::GlobalShadingUBO));
-    dragon.updateUBOs();
-    dragonCoat.updateUBOs();
-    ground.updateUBOs();
+    if (dragon.loaded) { dragon.updateUBOs(); }
+    if (dragonCoat.loaded) { dragonCoat.updateUBOs(); }
+    if (ground.loaded) { ground.updateUBOs(); }
+}
+
+void App::cullOccludedElements() {
+    auto start = std::chrono::high_resolution_clock::now();
+    const uint32 height = std::max(1u, occlusionBufferWidth * m_swapChainExtent.height / std::max(m_swapChainExtent.width, 1u));
+    if (m_occlusionBuffer.getWidth() != occlusionBufferWidth || m_occlusionBuffer.getHeight() != height) { m_occlusionBuffer.resize(occlusionBufferWidth, height); }
+
+    // the dragon body is the only occluder, it hides its own back side and the coat elements behind it, not the ground
+    const mat4 viewProjection = m_viewUBOData.projection * m_viewUBOData.view;
+    dragon.updateSkinnedBounds(elementBoundingScale(dragon.resurfacingUBOData));
+    dragon.rasterizeOccluder(m_occlusionBuffer, viewProjection);
+    if (dragon.resurfacingUBOData.occlusionCulling) { dragon.cullOccludedElements(m_occlusionBuffer, viewProjection); }
+    if (dragonCoat.loaded && dragonCoat.resurfacingUBOData.occlusionCulling) {
+        dragonCoat.updateSkinnedBounds(elementBoundingScale(dragonCoat.resurfacingUBOData));
+        dragonCoat.cullOccludedElements(m_occlusionBuffer, viewProjection);
+    }
+    m_occlusionCpuMs = m_occlusionCpuMs * 0.95f + static_cast<float>(millisecondsD(std::chrono::high_resolution_clock::now() - start).count()) * 0.05f;
+}
+
+const Pipeline &App::getParametricPipeline(const shaderInterface::ResurfacingUBO &p_ubo) const {
+    // the element type texture mixes types inside a mesh, only the generic variant can read it
+    const bool specialized = m_specializedPipelines && !p_ubo.hasElementTypeTexture && uint32(p_ubo.elementType) < ELEMENT_TYPE_COUNT;
+    return m_parametricPipelines[specialized ? p_ubo.elementType : GENERIC_ELEMENT_TYPE];
 }
 
 void App::drawFrame() {
+    uploadLoadedMeshes();
     updateSceneUBOs();
+    // the meshes that are still loading are skipped, each step below only touches the loaded ones
+    const bool drawDragon = dragon.loaded, drawCoat = dragonCoat.loaded;
+    // before beginFrame, the culling overlaps the GPU work of the previous frames. The occluder is the single dragon.
+    if (drawDragon && dragon.instances.empty() && (dragon.resurfacingUBOData.occlusionCulling || (drawCoat && dragonCoat.resurfacingUBOData.occlusionCulling))) { cullOccludedElements(); }
     
     vk::CommandBuffer cmd = m_renderer.beginFrame();
+    m_profiler.beginFrame(cmd, m_renderer.getFrameSlot());
+    // the frame slot is free once beginFrame returns, no extra submit or wait for the bone palettes
+    if (drawDragon) {
+        dragon.uploadBoneMatrices(m_renderer);
+        dragon.uploadVisibilityMask(m_renderer);
+    }
+    if (drawCoat) {
+        dragonCoat.uploadBoneMatrices(m_renderer);
+        dragonCoat.uploadVisibilityMask(m_renderer);
+    }
+    // compaction pre-pass, dispatches cannot be recorded inside a rendering
+    const bool dragonCompaction = drawDragon && dragon.resurfacingUBOData.gpuCompaction;
+    const bool coatCompaction = drawCoat && dragonCoat.resurfacingUBOData.gpuCompaction;
+    if (dragonCompaction || coatCompaction) {
+        cmd.bindPipeline(vk::PipelineBindPoint::eCompute, m_compactionPipeline.pipeline);
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, m_compactionPipeline.layout, 0, 1, &m_uboDescriptorSet, 0, nullptr);
+        m_profiler.beginScope(cmd, "Compaction");
+        if (dragonCompaction) { dragon.dispatchCompaction(cmd, m_compactionPipeline.layout, m_renderer.getFrameSlot()); }
+        if (coatCompaction) { dragonCoat.dispatchCompaction(cmd, m_compactionPipeline.layout, m_renderer.getFrameSlot()); }
+        m_profiler.endScope(cmd);
+    }
     m_renderer.beginRendering(cmd, true);
     vk::Extent2D extent = m_renderer.getSwapChainExtent();
     // dragon
     cmd.setViewport(0, vk::Viewport(0.0f, 0.0f, extent.width, extent.height, 0.0f, 1.0f));
     cmd.setScissor(0, vk::Rect2D({0, 0}, extent));
-    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_parametricPipline.pipeline);
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_parametricPipline.layout, 0, 1, &m_uboDescriptorSet, 0, nullptr);
-    dragon.bindAndDispatch(cmd, m_parametricPipline.layout);
-    dragonCoat.bindAndDispatch(cmd, m_parametricPipline.layout);
-    
-    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_hePipeline.pipeline);
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_hePipeline.layout, 0, 1, &m_uboDescriptorSet, 0, nullptr);
-    dragon.bindAndDispatchBaseMesh(cmd, m_hePipeline.layout);
+    const Pipeline *boundPipeline = nullptr;
+    if (drawDragon) {
+        boundPipeline = &getParametricPipeline(dragon.resurfacingUBOData);
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, boundPipeline->pipeline);
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, boundPipeline->layout, 0, 1, &m_uboDescriptorSet, 0, nullptr);
+        m_profiler.beginScope(cmd, "Dragon");
+        dragon.bindAndDispatch(cmd, boundPipeline->layout);
+        m_profiler.endScope(cmd);
+    }
+    if (drawCoat) {
+        const Pipeline &coatPipeline = getParametricPipeline(dragonCoat.resurfacingUBOData);
+        if (&coatPipeline != boundPipeline) { cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, coatPipeline.pipeline); }
+        if (boundPipeline == nullptr) { cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, coatPipeline.layout, 0, 1, &m_uboDescriptorSet, 0, nullptr); } // same layout, the scene set stays bound
+        m_profiler.beginScope(cmd, "Coat");
+        dragonCoat.bindAndDispatch(cmd, coatPipeline.layout);
+        m_profiler.endScope(cmd);
+    }
 
-    cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pebblePipeline.pipeline);
-    cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pebblePipeline.layout, 0, 1, &m_uboDescriptorSet, 0, nullptr);
-    ground.bindAndDispatch(cmd, m_pebblePipeline.layout);
+    if (drawDragon) {
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_hePipeline.pipeline);
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_hePipeline.layout, 0, 1, &m_uboDescriptorSet, 0, nullptr);
+        m_profiler.beginScope(cmd, "Dragon base mesh");
+        dragon.bindAndDispatchBaseMesh(cmd, m_hePipeline.layout);
+        m_profiler.endScope(cmd);
+    }
+
+    if (ground.loaded) {
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, m_pebblePipeline.pipeline);
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, m_pebblePipeline.layout, 0, 1, &m_uboDescriptorSet, 0, nullptr);
+        m_profiler.beginScope(cmd, "Ground");
+        ground.bindAndDispatch(cmd, m_pebblePipeline.layout);
+        m_profiler.endScope(cmd);
+    }
     
     m_renderer.endRendering(cmd);
     
     // UI pass
-    ImGui::Render(); // finalize ImGui draw data
-    m_renderer.renderUI(cmd);
+    if (!m_renderer.isHeadless()) {
+        ImGui::Render(); // finalize ImGui draw data
+        m_renderer.renderUI(cmd);
+    }
     m_renderer.endFrame(cmd);
+
+    // submitted, not presented: the time the CPU needed to produce the frame
+    const double sinceStartMs = millisecondsD(std::chrono::high_resolution_clock::now() - m_startTime).count();
+    if (m_firstFrameMs < 0.0) {
+        m_firstFrameMs = sinceStartMs;
+        std::cout << "Time to first frame: " << m_firstFrameMs << " ms" << std::endl;
+    }
+    if (m_fullSceneMs < 0.0 && isSceneFinished()) {
+        m_fullSceneMs = sinceStartMs;
+        std::cout << "Time to full scene: " << m_fullSceneMs << " ms";
+        if (failedMeshCount() > 0) { std::cout << " (" << failedMeshCount() << " meshes failed to load)"; }
+        std::cout << std::endl;
+    }
 }
 
 void App::cleanup() {
+    for (std::future<void> &job : m_loadJobs) { job.wait(); } // the jobs write into the meshes
+    m_renderer.m_logicalDevice.waitIdle();
+    m_profiler.cleanup();
     m_renderer.cleanup();
-    glfwDestroyWindow(m_window);
-    glfwTerminate();
+    if (m_window != nullptr) {
+        glfwDestroyWindow(m_window);
+        glfwTerminate();
+    }
 }
\ No newline at end of file
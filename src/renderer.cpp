@@ -10,34 +10,58 @@ VULKAN_HPP_DEFAULT_DISPATCH_LOADER_DYNAMIC_STORAGE
 #include <imgui_impl_glfw.h>
 #include <imgui_impl_vulkan.h>
 
+#include <future>
 #include <set>
 
+#include "ThreadPool.hpp"
 #include "config.hpp"
 
-uint32 Renderer::findMemoryType(uint32 p_typeFilter, vk::MemoryPropertyFlags p_properties) const {
-    vk::PhysicalDeviceMemoryProperties memProperties;
-    m_device.getMemoryProperties(&memProperties);
-    for (uint32 i = 0; i < memProperties.memoryTypeCount; i++) { if ((p_typeFilter & (1 << i)) && (memProperties.memoryTypes[i].propertyFlags & p_properties) == p_properties) { return i; } }
-    throw std::runtime_error("Failed to find suitable memory type.");
-}
-
 Buffer Renderer::createStagingBuffer(uint32 p_size) {
     vk::BufferCreateInfo bufferCreateInfo({}, p_size, vk::BufferUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive);
     Buffer staging = createBufferInternal(bufferCreateInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
     return staging;
 }
 
-void Renderer::freeTrackedStagingBuffers() {
-    for (Buffer &buffer : m_usedStagingBuffers) {
-        m_logicalDevice.destroyBuffer(buffer.buffer);
-        m_logicalDevice.freeMemory(buffer.memory);
-    }
+Buffer Renderer::createDeviceBuffer(vk::DeviceSize p_size, vk::BufferUsageFlags p_usage) {
+    const vk::BufferCreateInfo bufferCreateInfo({}, p_size, p_usage, vk::SharingMode::eExclusive);
+    return createBufferInternal(bufferCreateInfo);
+}
+
+vk::CommandBuffer Renderer::beginUploadCommands() { return beginSingleTimeCommands(m_logicalDevice, m_transientCommandPool); }
+
+void Renderer::endUploadCommands(vk::CommandBuffer p_commandBuffer) {
+    p_commandBuffer.end();
+    const uint64 signalValue = ++m_uploadTimelineValue;
+    const vk::CommandBufferSubmitInfo cmdBufferInfo{p_commandBuffer};
+    const vk::SemaphoreSubmitInfo signalInfo{m_uploadTimelineSemaphore, signalValue, vk::PipelineStageFlagBits2::eAllCommands};
+    const std::array<vk::SubmitInfo2, 1> submitInfo{vk::SubmitInfo2{{}, 0, nullptr, 1, &cmdBufferInfo, 1, &signalInfo}};
+    VK_CHECK(m_graphicsQueue.submit2(uint32(submitInfo.size()), submitInfo.data(), nullptr));
+    m_stagingArena.retire(m_uploadTimelineSemaphore, signalValue);
+
+    const vk::SemaphoreWaitInfo waitInfo = {{}, 1, &m_uploadTimelineSemaphore, &signalValue};
+    VK_CHECK(m_logicalDevice.waitSemaphores(&waitInfo, std::numeric_limits<uint64>::max()));
+    m_logicalDevice.freeCommandBuffers(m_transientCommandPool, 1, &p_commandBuffer);
+    m_stagingArena.reclaim();
 }
 
 UniformBuffer Renderer::createUniformBuffer(uint32 p_size) {
     vk::BufferCreateInfo bufferCreateInfo({}, p_size, vk::BufferUsageFlagBits::eUniformBuffer, vk::SharingMode::eExclusive);
     UniformBuffer res = UniformBuffer(createBufferInternal(bufferCreateInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent));
-    res.mappedMemory = m_logicalDevice.mapMemory(res.memory, 0, p_size);
+    res.mappedMemory = getMappedMemory(res);
+    return res;
+}
+
+RingBuffer Renderer::createRingBuffer(uint32 p_sliceSize, vk::BufferUsageFlags p_usage) {
+    vk::DeviceSize alignment = 1;
+    if (p_usage & vk::BufferUsageFlagBits::eStorageBuffer) { alignment = std::max(alignment, m_deviceLimits.minStorageBufferOffsetAlignment); }
+    if (p_usage & vk::BufferUsageFlagBits::eUniformBuffer) { alignment = std::max(alignment, m_deviceLimits.minUniformBufferOffsetAlignment); }
+
+    RingBuffer res;
+    res.sliceSize = static_cast<uint32>((p_sliceSize + alignment - 1) / alignment * alignment);
+    res.sliceCount = m_maxFramesInFlight;
+    vk::BufferCreateInfo bufferCreateInfo({}, vk::DeviceSize(res.sliceSize) * res.sliceCount, p_usage, vk::SharingMode::eExclusive);
+    static_cast<Buffer &>(res) = createBufferInternal(bufferCreateInfo, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent);
+    res.mappedMemory = getMappedMemory(res);
     return res;
 }
 
@@ -45,37 +69,53 @@ Buffer Renderer::createBufferInternal(const vk::BufferCreateInfo &p_createInfo,
     Buffer res{};
     res.size = p_createInfo.size;
     VK_CHECK(m_logicalDevice.createBuffer(&p_createInfo, nullptr, &res.buffer));
-    vk::StructureChain<vk::MemoryRequirements2> memRequirements = m_logicalDevice.getBufferMemoryRequirements2(vk::BufferMemoryRequirementsInfo2(res.buffer));
-    vk::MemoryAllocateInfo allocInfo(memRequirements.get<vk::MemoryRequirements2>().memoryRequirements.size, findMemoryType(memRequirements.get<vk::MemoryRequirements2>().memoryRequirements.memoryTypeBits, p_memProperties));
-    VK_CHECK(m_logicalDevice.allocateMemory(&allocInfo, nullptr, &res.memory));
-    m_logicalDevice.bindBufferMemory(res.buffer, res.memory, 0);
+    const vk::MemoryRequirements memRequirements = m_logicalDevice.getBufferMemoryRequirements(res.buffer);
+    res.allocation = m_memoryAllocator.allocate(memRequirements.size, memRequirements.alignment, memRequirements.memoryTypeBits, uint32(p_memProperties), true);
+    ASSERT(res.allocation.valid(), "Failed to allocate buffer memory");
+    res.memory = m_memoryBlocks[res.allocation.block].memory;
+    res.offset = res.allocation.offset;
+    m_logicalDevice.bindBufferMemory(res.buffer, res.memory, res.offset);
     return res;
 }
 
 Texture Renderer::createTextureInternal(const vk::ImageCreateInfo &p_createInfo) {
     Texture res{{}, {}, p_createInfo.format, p_createInfo.initialLayout,uvec3(p_createInfo.extent.width, p_createInfo.extent.height, p_createInfo.extent.depth)};
     VK_CHECK(m_logicalDevice.createImage(&p_createInfo, nullptr, &res.image));
-    vk::StructureChain<vk::MemoryRequirements2> memRequirements = m_logicalDevice.getImageMemoryRequirements2(vk::ImageMemoryRequirementsInfo2(res.image));
-    vk::MemoryAllocateInfo allocInfo(memRequirements.get<vk::MemoryRequirements2>().memoryRequirements.size, findMemoryType(memRequirements.get<vk::MemoryRequirements2>().memoryRequirements.memoryTypeBits, vk::MemoryPropertyFlagBits::eDeviceLocal));
-    VK_CHECK(m_logicalDevice.allocateMemory(&allocInfo, nullptr, &res.memory));
-    m_logicalDevice.bindImageMemory(res.image, res.memory, 0);
+    const vk::MemoryRequirements memRequirements = m_logicalDevice.getImageMemoryRequirements(res.image);
+    res.allocation = m_memoryAllocator.allocate(memRequirements.size, memRequirements.alignment, memRequirements.memoryTypeBits, uint32(vk::MemoryPropertyFlags(vk::MemoryPropertyFlagBits::eDeviceLocal)), p_createInfo.tiling == vk::ImageTiling::eLinear);
+    ASSERT(res.allocation.valid(), "Failed to allocate image memory");
+    res.memory = m_memoryBlocks[res.allocation.block].memory;
+    m_logicalDevice.bindImageMemory(res.image, res.memory, res.allocation.offset);
     res.defaultView = m_logicalDevice.createImageView({{}, res.image, vk::ImageViewType::e2D, res.format, {}, {inferAspectFromFormat(res.format), 0, 1, 0, 1}});
     return res;
 }
 
-void Renderer::copyToStagingMem(Buffer &p_staging, const void *p_data, uint32 p_size) {
-    void *mappedData = m_logicalDevice.mapMemory(p_staging.memory, 0, p_size);
-    memcpy(mappedData, p_data, p_size);
-    m_logicalDevice.unmapMemory(p_staging.memory);
+void Renderer::destroyBuffer(Buffer &p_buffer) {
+    m_logicalDevice.destroyBuffer(p_buffer.buffer);
+    m_memoryAllocator.free(p_buffer.allocation);
+    p_buffer = {};
 }
 
-void Renderer::uploadDataToBufferInternal(Buffer &p_dstBuffer, vk::CommandBuffer p_commandBuffer,const void *p_data, uint32 p_size, uint32 p_offset) {
-    Buffer stagingBuffer = createStagingBuffer(p_size);
-    m_usedStagingBuffers.push_back(stagingBuffer);
-    copyToStagingMem(stagingBuffer, p_data, p_size);
-    vk::BufferCopy copyRegion(0, p_offset, p_size);
-    p_commandBuffer.copyBuffer(stagingBuffer.buffer, p_dstBuffer.buffer, copyRegion);
+void Renderer::destroyTexture(Texture &p_texture) {
+    m_logicalDevice.destroyImageView(p_texture.defaultView);
+    m_logicalDevice.destroyImage(p_texture.image);
+    m_memoryAllocator.free(p_texture.allocation);
+    p_texture = {};
+}
 
+void *Renderer::getMappedMemory(const Buffer &p_buffer) const {
+    void *blockMemory = m_memoryBlocks[p_buffer.allocation.block].mappedMemory;
+    ASSERT(blockMemory != nullptr, "Buffer is not host visible");
+    return static_cast<byte *>(blockMemory) + p_buffer.offset;
+}
+
+void Renderer::copyToStagingMem(Buffer &p_staging, const void *p_data, uint32 p_size) { memcpy(getMappedMemory(p_staging), p_data, p_size); }
+
+void Renderer::uploadDataToBufferInternal(Buffer &p_dstBuffer, vk::CommandBuffer p_commandBuffer,const void *p_data, uint32 p_size, uint32 p_offset) {
+    const StagingArena::Allocation staging = m_stagingArena.allocate(p_size);
+    memcpy(staging.mappedMemory, p_data, p_size);
+    vk::BufferCopy copyRegion(staging.offset, p_offset, p_size);
+    p_commandBuffer.copyBuffer(staging.buffer, p_dstBuffer.buffer, copyRegion);
 }
 
 void Renderer::uploadDataToBufferInternal(Buffer &p_stagingBuffer, Buffer &p_dstBuffer, vk::CommandBuffer p_commandBuffer,const void *p_data, uint32 p_size, uint32 p_offset) {
@@ -85,12 +125,11 @@ void Renderer::uploadDataToBufferInternal(Buffer &p_stagingBuffer, Buffer &p_dst
 }
 
 void Renderer::uploadDataToImageInternal(Texture &p_dstImage, vk::CommandBuffer p_commandBuffer,const void *p_data, uint32 p_size) {
-    Buffer stagingBuffer = createStagingBuffer(p_size);
-    m_usedStagingBuffers.push_back(stagingBuffer);
-    copyToStagingMem(stagingBuffer, p_data, p_size);
-    vk::BufferImageCopy2 copyRegion(0, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {0, 0, 0}, {p_dstImage.dimensions.x, p_dstImage.dimensions.y, p_dstImage.dimensions.z});
+    const StagingArena::Allocation staging = m_stagingArena.allocate(p_size);
+    memcpy(staging.mappedMemory, p_data, p_size);
+    vk::BufferImageCopy2 copyRegion(staging.offset, 0, 0, {vk::ImageAspectFlagBits::eColor, 0, 0, 1}, {0, 0, 0}, {p_dstImage.dimensions.x, p_dstImage.dimensions.y, p_dstImage.dimensions.z});
     cmdTransitionImageLayout(p_commandBuffer, p_dstImage, vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal);
-    p_commandBuffer.copyBufferToImage2({stagingBuffer.buffer, p_dstImage.image, vk::ImageLayout::eTransferDstOptimal, 1, &copyRegion});
+    p_commandBuffer.copyBufferToImage2({staging.buffer, p_dstImage.image, vk::ImageLayout::eTransferDstOptimal, 1, &copyRegion});
     cmdTransitionImageLayout(p_commandBuffer, p_dstImage, vk::ImageLayout::eTransferDstOptimal, p_dstImage.currentLayout == vk::ImageLayout::eUndefined ? vk::ImageLayout::eGeneral : p_dstImage.currentLayout);
     p_dstImage.currentLayout = p_dstImage.currentLayout == vk::ImageLayout::eUndefined ? vk::ImageLayout::eGeneral : p_dstImage.currentLayout;
 }
@@ -104,18 +143,25 @@ void Renderer::uploadDataToImageInternal(Buffer &p_stagingBuffer, Texture &p_dst
 }
 
 
-void Renderer::init(GLFWwindow *window, bool vSync) {
+void Renderer::init(GLFWwindow *window, bool vSync, bool p_loadPipelineCache, vk::Extent2D p_offscreenExtent) {
     m_window = window;
+    if (!isHeadless()) {
+        m_instanceExtensions.push_back(VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME);
+        m_deviceExtensions.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+    }
     VULKAN_HPP_DEFAULT_DISPATCHER.init();
     createInstance();
-    createSurface();
+    if (!isHeadless()) { createSurface(); }
     selectPhysicalDevice();
     createDeviceAndQueues();
     createTransientCommandPool();
-    m_windowSize = createSwapchain();
+    createMemoryAllocator();
+    m_windowSize = isHeadless() ? createOffscreenTargets(p_offscreenExtent) : createSwapchain();
     createFrameData();
+    createStagingArena();
+    createPipelineCache(p_loadPipelineCache);
     createDescriptorPool();
-    initImGui();
+    if (!isHeadless()) { initImGui(); }
     {
         vk::SamplerCreateInfo samplerCreateInfo = {{}, vk::Filter::eLinear, vk::Filter::eLinear, vk::SamplerMipmapMode::eLinear};
         VK_CHECK(m_logicalDevice.createSampler(&samplerCreateInfo, nullptr, &m_linearSampler));
@@ -129,12 +175,14 @@ void Renderer::cleanup() {
     cleanupSwapChain();
     m_logicalDevice.destroySampler(m_linearSampler);
     m_logicalDevice.destroySampler(m_nearestSampler);
-    ImGui_ImplVulkan_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (!isHeadless()) {
+        ImGui_ImplVulkan_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
 
     m_logicalDevice.destroyCommandPool(m_transientCommandPool);
-    m_instance.destroySurfaceKHR(m_surface);
+    if (!isHeadless()) { m_instance.destroySurfaceKHR(m_surface); }
     m_logicalDevice.destroyDescriptorPool(m_descriptorPool);
 
     for (auto &frame : m_frameData) {
@@ -143,6 +191,21 @@ void Renderer::cleanup() {
     }
     m_logicalDevice.destroySemaphore(m_FrameTimelineSemaphore);
 
+    const StagingArena::Stats &staging = m_stagingArena.getStats();
+    std::cout << "Staging arena: " << staging.blockAllocations << " block allocations (" << staging.reservedBytes / (1024 * 1024) << " MB), " << staging.suballocations << " uploads, peak "
+              << staging.peakUsedBytes / (1024 * 1024) << " MB in use, " << staging.blockRecycles << " block recycles" << std::endl;
+    m_stagingArena.cleanup();
+    m_logicalDevice.destroySemaphore(m_uploadTimelineSemaphore);
+
+    savePipelineCache();
+    m_logicalDevice.destroyPipelineCache(m_pipelineCache);
+
+    // the resources still alive are released with their blocks
+    const MemoryAllocator::Stats memory = m_memoryAllocator.getStats();
+    std::cout << "Device memory: " << memory.deviceAllocations << " block allocations for " << memory.allocationCount << " live resources, " << memory.liveBlocks << " blocks ("
+              << memory.reservedBytes / (1024 * 1024) << " MB, peak " << memory.peakReservedBytes / (1024 * 1024) << " MB), fragmentation " << memory.fragmentation() << std::endl;
+    m_memoryAllocator.cleanup();
+
     m_logicalDevice.waitIdle();
     if (enableValidationLayers) { m_instance.destroyDebugUtilsMessengerEXT(m_callback); }
     m_logicalDevice.destroy();
@@ -150,18 +213,20 @@ void Renderer::cleanup() {
 }
 
 void Renderer::createInstance() {
-    uint32 glfwExtensionCount = 0;
-    const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
     std::vector<vk::ExtensionProperties> availableInstanceExtentions = getAvailableInstanceExtensions();
 
     const vk::ApplicationInfo appInfo("Resurfacing", VK_MAKE_VERSION(1, 0, 0), "Resurfacing", VK_MAKE_VERSION(1, 0, 0),
                                       VK_API_VERSION_1_3);
 
-    m_instanceExtensions.insert(m_instanceExtensions.end(), glfwExtensions, glfwExtensions + glfwExtensionCount);
+    if (!isHeadless()) {
+        uint32 glfwExtensionCount = 0;
+        const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwExtensionCount);
+        m_instanceExtensions.insert(m_instanceExtensions.end(), glfwExtensions, glfwExtensions + glfwExtensionCount);
+    }
     bool debugUtilsAvailable = extensionIsAvailable(VK_EXT_DEBUG_UTILS_EXTENSION_NAME, availableInstanceExtentions);
     if (debugUtilsAvailable)
         m_instanceExtensions.push_back(VK_EXT_DEBUG_UTILS_EXTENSION_NAME);
-    if (extensionIsAvailable(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME, availableInstanceExtentions))
+    if (!isHeadless() && extensionIsAvailable(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME, availableInstanceExtentions))
         m_instanceExtensions.push_back(VK_EXT_SURFACE_MAINTENANCE_1_EXTENSION_NAME);
 
     if (enableValidationLayers) { m_instanceLayers.push_back("VK_LAYER_KHRONOS_validation"); }
@@ -188,18 +253,38 @@ void Renderer::selectPhysicalDevice() {
     std::vector<vk::PhysicalDevice> physicalDevices(deviceCount);
     VK_CHECK(m_instance.enumeratePhysicalDevices(&deviceCount, physicalDevices.data()));
 
+    vk::PhysicalDeviceMeshShaderPropertiesEXT meshShaderProperties{};
+    vk::PhysicalDeviceIDProperties idProperties{};
+    idProperties.pNext = &meshShaderProperties;
     vk::PhysicalDeviceProperties2 properties2{};
+    properties2.pNext = &idProperties;
+    bool found = false;
     for (uint32 i = 0; i < physicalDevices.size(); i++) {
-        if (isDeviceSuitable(physicalDevices[i], m_deviceExtensions)) {
+        if (isDeviceSuitable(physicalDevices[i], m_deviceExtensions, !isHeadless())) { // headless runs also target software drivers such as lavapipe
             chosenDevice = i;
+            found = true;
             break;
         }
     }
+    ASSERT(found, "failed to find a GPU with mesh shaders and subgroup ballot and arithmetic operations in task and compute shaders!");
 
     m_device = physicalDevices[chosenDevice];
     populateQueueFamilyIndices();
     m_device.getProperties2(&properties2);
     m_deviceLimits = properties2.properties.limits;
+    for (int i = 0; i < 3; i++) {
+        m_taskGridLimits.maxCount[i] = meshShaderProperties.maxTaskWorkGroupCount[i];
+        m_meshGridLimits.maxCount[i] = meshShaderProperties.maxMeshWorkGroupCount[i];
+        m_computeGridLimits.maxCount[i] = m_deviceLimits.maxComputeWorkGroupCount[i];
+    }
+    m_computeGridLimits.maxTotalCount = ~0u; // no total limit for dispatches
+    m_taskGridLimits.maxTotalCount = meshShaderProperties.maxTaskWorkGroupTotalCount;
+    m_meshGridLimits.maxTotalCount = meshShaderProperties.maxMeshWorkGroupTotalCount;
+    m_pipelineCacheKey.vendorID = properties2.properties.vendorID;
+    m_pipelineCacheKey.deviceID = properties2.properties.deviceID;
+    m_pipelineCacheKey.driverVersion = properties2.properties.driverVersion;
+    memcpy(m_pipelineCacheKey.deviceUUID, idProperties.deviceUUID.data(), sizeof(m_pipelineCacheKey.deviceUUID));
+    memcpy(m_pipelineCacheKey.pipelineCacheUUID, properties2.properties.pipelineCacheUUID.data(), sizeof(m_pipelineCacheKey.pipelineCacheUUID));
     std::cout << "Selected GPU: " << properties2.properties.deviceName << "\n";
     std::cout << "Driver: " << VK_VERSION_MAJOR(properties2.properties.driverVersion) << "." <<
         VK_VERSION_MINOR(properties2.properties.driverVersion) << "." << VK_VERSION_PATCH(
@@ -215,7 +300,9 @@ void Renderer::populateQueueFamilyIndices() {
     uint32 i = 0;
     while (!m_queueFamilyIndices.isComplete() && i < queueFamilies.size()) {
         // very simple policy of selecting the first queue that supports the required operations, not ideal but works for now
-        if (m_device.getSurfaceSupportKHR(i, m_surface)) { m_queueFamilyIndices.presentQueueIndex = i; }
+        // headless frames are never presented, the graphics queue stands in for the present one
+        const bool canPresent = isHeadless() ? bool(queueFamilies[i].queueFamilyProperties.queueFlags & vk::QueueFlagBits::eGraphics) : m_device.getSurfaceSupportKHR(i, m_surface) == VK_TRUE;
+        if (canPresent) { m_queueFamilyIndices.presentQueueIndex = i; }
         if ((queueFamilies[i].queueFamilyProperties.queueFlags & vk::QueueFlagBits::eGraphics) && (queueFamilies[i].queueFamilyProperties.timestampValidBits != 0)) { m_queueFamilyIndices.graphicsQueueIndex = i; } // ensure the queue supports timestamp queries
         if ((queueFamilies[i].queueFamilyProperties.queueFlags & vk::QueueFlagBits::eCompute) && (queueFamilies[i].queueFamilyProperties.timestampValidBits != 0)) { m_queueFamilyIndices.computeQueueIndex = i; } // ensure the queue supports timestamp queries
         if (queueFamilies[i].queueFamilyProperties.queueFlags & vk::QueueFlagBits::eTransfer) { m_queueFamilyIndices.transferQueueIndex = i; }
@@ -236,9 +323,11 @@ void Renderer::createDeviceAndQueues() {
     m_device.getFeatures2(&deviceFeaturesChain.get());
     ASSERT(deviceFeaturesChain.get<vk::PhysicalDeviceVulkan12Features>().scalarBlockLayout, "Scalar block layout required, update driver!");
     ASSERT(deviceFeaturesChain.get<vk::PhysicalDeviceVulkan13Features>().dynamicRendering, "Dynamic rendering required, update driver!");
+    ASSERT(deviceFeaturesChain.get<vk::PhysicalDeviceVulkan12Features>().drawIndirectCount, "Draw indirect count required, update driver!");
     vk::PhysicalDeviceMeshShaderFeaturesEXT &meshShaderFeatures = deviceFeaturesChain.get<vk::PhysicalDeviceMeshShaderFeaturesEXT>();
     ASSERT(meshShaderFeatures.meshShader && meshShaderFeatures.taskShader, "Mesh shader required, update driver!");
     m_supportMeshQueries = meshShaderFeatures.meshShaderQueries;
+    m_supportPipelineStatistics = deviceFeaturesChain.get<vk::PhysicalDeviceFeatures2>().features.pipelineStatisticsQuery;
     deviceFeaturesChain.get<vk::PhysicalDeviceMeshShaderFeaturesEXT>().primitiveFragmentShadingRateMeshShader = false;
 
     vk::DeviceCreateInfo deviceLogicalCreateInfo = {{}, static_cast<uint32>(queuesCreateInfo.size()), queuesCreateInfo.data(), 0, nullptr, static_cast<uint32>(m_deviceExtensions.size()), m_deviceExtensions.data()};
@@ -334,12 +423,59 @@ vk::Extent2D Renderer::recreateSwapChain() {
 }
 
 void Renderer::cleanupSwapChain() {
-    m_logicalDevice.destroySwapchainKHR(m_swapChain);
-    for (auto &frameRes : m_frameResources) {
-        m_logicalDevice.destroySemaphore(frameRes.imageAvailableSemaphore);
-        m_logicalDevice.destroySemaphore(frameRes.renderFinishedSemaphore);
+    if (isHeadless()) {
+        for (auto &image : m_nextImages) { destroyTexture(image); }
+    } else {
+        m_logicalDevice.destroySwapchainKHR(m_swapChain);
+        for (auto &frameRes : m_frameResources) {
+            m_logicalDevice.destroySemaphore(frameRes.imageAvailableSemaphore);
+            m_logicalDevice.destroySemaphore(frameRes.renderFinishedSemaphore);
+        }
+        for (auto &image : m_nextImages) { m_logicalDevice.destroyImageView(image.defaultView); }
     }
-    for (auto &image : m_nextImages) { m_logicalDevice.destroyImageView(image.defaultView); }
+    for (auto &image : m_depthImages) { destroyTexture(image); }
+}
+
+vk::Extent2D Renderer::createOffscreenTargets(vk::Extent2D p_extent) {
+    // one target per frame in flight like a triple buffered swapchain, they rest in transfer source layout so a frame can be read back
+    m_maxFramesInFlight = 3;
+    m_targetRestLayout = vk::ImageLayout::eTransferSrcOptimal;
+    const vk::ImageCreateInfo colorImageCreateInfo = {{}, vk::ImageType::e2D, vk::Format::eR8G8B8A8Unorm, {p_extent.width, p_extent.height, 1}, 1, 1, vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc, vk::SharingMode::eExclusive, 0, nullptr, vk::ImageLayout::eUndefined};
+    const vk::ImageCreateInfo depthImageCreateInfo = {{}, vk::ImageType::e2D, findDepthFormat(m_device), {p_extent.width, p_extent.height, 1}, 1, 1, vk::SampleCountFlagBits::e1, vk::ImageTiling::eOptimal, vk::ImageUsageFlagBits::eDepthStencilAttachment, vk::SharingMode::eExclusive, 0, nullptr, vk::ImageLayout::eUndefined};
+    m_nextImages.resize(m_maxFramesInFlight);
+    m_depthImages.resize(m_maxFramesInFlight);
+    for (uint32 i = 0; i < m_maxFramesInFlight; i++) {
+        m_nextImages[i] = createTextureInternal(colorImageCreateInfo);
+        m_depthImages[i] = createTextureInternal(depthImageCreateInfo);
+    }
+
+    vk::CommandBuffer cmdBuffer = beginSingleTimeCommands(m_logicalDevice, m_transientCommandPool);
+    for (uint32 i = 0; i < m_maxFramesInFlight; i++) { cmdTransitionImageLayout(cmdBuffer, m_nextImages[i], vk::ImageLayout::eUndefined, m_targetRestLayout); }
+    endSingleTimeCommands(cmdBuffer, m_logicalDevice, m_transientCommandPool, m_graphicsQueue);
+    return p_extent;
+}
+
+void Renderer::createMemoryAllocator() {
+    const vk::PhysicalDeviceMemoryProperties memProperties = m_device.getMemoryProperties();
+    std::vector<MemoryTypeInfo> types(memProperties.memoryTypeCount);
+    for (uint32 i = 0; i < memProperties.memoryTypeCount; i++) { types[i] = {uint32(memProperties.memoryTypes[i].propertyFlags), memProperties.memoryTypes[i].heapIndex}; }
+
+    auto allocateBlock = [this, types](uint32 p_block, uint32 p_memoryType, uint64 p_size) {
+        const vk::MemoryAllocateInfo allocInfo(p_size, p_memoryType);
+        MemoryBlock block;
+        if (m_logicalDevice.allocateMemory(&allocInfo, nullptr, &block.memory) != vk::Result::eSuccess) { return false; }
+        if (vk::MemoryPropertyFlags(types[p_memoryType].propertyFlags) & vk::MemoryPropertyFlagBits::eHostVisible) { block.mappedMemory = m_logicalDevice.mapMemory(block.memory, 0, VK_WHOLE_SIZE); }
+        if (m_memoryBlocks.size() <= p_block) { m_memoryBlocks.resize(p_block + 1); }
+        m_memoryBlocks[p_block] = block;
+        return true;
+    };
+    auto freeBlock = [this](uint32 p_block) {
+        MemoryBlock &block = m_memoryBlocks[p_block];
+        if (block.mappedMemory != nullptr) { m_logicalDevice.unmapMemory(block.memory); }
+        m_logicalDevice.freeMemory(block.memory);
+        block = {};
+    };
+    m_memoryAllocator.init(types, allocateBlock, freeBlock);
 }
 
 void Renderer::createFrameData() {
@@ -360,6 +496,30 @@ void Renderer::createFrameData() {
     }
 }
 
+void Renderer::createStagingArena() {
+    vk::SemaphoreTypeCreateInfo timelineCreateInfo(vk::SemaphoreType::eTimeline, m_uploadTimelineValue);
+    vk::SemaphoreCreateInfo semaphoreCreateInfo{};
+    semaphoreCreateInfo.pNext = &timelineCreateInfo;
+    VK_CHECK(m_logicalDevice.createSemaphore(&semaphoreCreateInfo, nullptr, &m_uploadTimelineSemaphore));
+
+    // image copies need the buffer offset to be a multiple of the texel size and of 4
+    constexpr vk::DeviceSize blockSize = 64 * 1024 * 1024;
+    const vk::DeviceSize alignment = std::max<vk::DeviceSize>(16, m_deviceLimits.optimalBufferCopyOffsetAlignment);
+    m_stagingArena.init(*this, blockSize, alignment);
+}
+
+void Renderer::createPipelineCache(bool p_load) {
+    const std::vector<byte> data = p_load ? PipelineCacheFile::load(pipelineCachePath, m_pipelineCacheKey) : std::vector<byte>{};
+    m_pipelineCacheWarm = !data.empty();
+    const vk::PipelineCacheCreateInfo createInfo({}, data.size(), data.data());
+    VK_CHECK(m_logicalDevice.createPipelineCache(&createInfo, nullptr, &m_pipelineCache));
+}
+
+void Renderer::savePipelineCache() {
+    const std::vector<byte> data = m_logicalDevice.getPipelineCacheData(m_pipelineCache);
+    if (!data.empty() && PipelineCacheFile::save(pipelineCachePath, m_pipelineCacheKey, data)) { std::cout << "Pipeline cache: " << data.size() / 1024 << " KB saved" << std::endl; }
+}
+
 void Renderer::createDescriptorPool() {
     const std::vector<vk::DescriptorPoolSize> poolSizes{{vk::DescriptorType::eSampler, 100}, {vk::DescriptorType::eSampledImage, 100}, {vk::DescriptorType::eUniformBuffer, 100}, {vk::DescriptorType::eStorageBuffer, 100}};
     const vk::DescriptorPoolCreateInfo poolInfo(vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind | vk::DescriptorPoolCreateFlagBits::eFreeDescriptorSet, 1000, static_cast<uint32>(poolSizes.size()), poolSizes.data());
@@ -379,7 +539,7 @@ void Renderer::initImGui() {
     initInfo.Device = m_logicalDevice;
     initInfo.QueueFamily = m_queueFamilyIndices.graphicsQueueIndex;
     initInfo.Queue = m_graphicsQueue;
-    initInfo.PipelineCache = VK_NULL_HANDLE;
+    initInfo.PipelineCache = m_pipelineCache;
     initInfo.DescriptorPool = m_descriptorPool;
     initInfo.Allocator = nullptr;
     initInfo.MinImageCount = 2;
@@ -405,34 +565,64 @@ Pipeline Renderer::createPipeline(const std::vector<std::string> &p_shaderPaths,
         shaderStages[i] = {{}, stage, shaderModules[i], "main"};
         i++;
     }
-    const vk::PushConstantRange pushConstantRange = {trueAllGraphics, 0, sizeof(shaderInterface::PushConstants)};
+    std::vector<vk::SpecializationMapEntry> specializationEntries;
+    for (uint32 id = 0; id < p_pipelineDesc.specializationConstants.size(); id++) { specializationEntries.emplace_back(id, id * sizeof(uint32), sizeof(uint32)); }
+    const vk::SpecializationInfo specializationInfo(specializationEntries.size(), specializationEntries.data(), p_pipelineDesc.specializationConstants.size() * sizeof(uint32), p_pipelineDesc.specializationConstants.data());
+    if (!specializationEntries.empty()) { for (auto &shaderStage : shaderStages) { shaderStage.pSpecializationInfo = &specializationInfo; } }
+    const bool isCompute = shaderStages.size() == 1 && shaderStages[0].stage == vk::ShaderStageFlagBits::eCompute;
+    const vk::PushConstantRange pushConstantRange = {isCompute ? vk::ShaderStageFlags(vk::ShaderStageFlagBits::eCompute) : trueAllGraphics, 0, sizeof(shaderInterface::PushConstants)};
     const std::vector<vk::DescriptorSetLayout> descriptorSetLayouts = {shaderInterface::getDescriptorSetLayoutInfo(shaderInterface::SceneSet, m_logicalDevice), shaderInterface::getDescriptorSetLayoutInfo(shaderInterface::HESet, m_logicalDevice), shaderInterface::getDescriptorSetLayoutInfo(shaderInterface::PerObjectSet, m_logicalDevice)};
     const vk::PipelineLayoutCreateInfo pipelineLayoutInfo({}, descriptorSetLayouts.size(), descriptorSetLayouts.data(), 1, &pushConstantRange);
     VK_CHECK(m_logicalDevice.createPipelineLayout(&pipelineLayoutInfo, nullptr, &pipeline.layout));
 
+    if (isCompute) {
+        const vk::ComputePipelineCreateInfo computeCreateInfo({}, shaderStages[0], pipeline.layout);
+        VK_CHECK(m_logicalDevice.createComputePipelines(m_pipelineCache, 1, &computeCreateInfo, nullptr, &pipeline.pipeline));
+        m_logicalDevice.destroyShaderModule(shaderModules[0]);
+        for (auto &descriptorSetLayout : descriptorSetLayouts) { m_logicalDevice.destroyDescriptorSetLayout(descriptorSetLayout); }
+        return pipeline;
+    }
+
     const std::array<vk::Format, 1> imageFormats = {{ m_nextImages[0].format}}; // same as render target
     const vk::PipelineRenderingCreateInfo pipelineRenderingCreateInfo = {{}, static_cast<uint32>(imageFormats.size()), imageFormats.data(), m_depthImages[0].format};
     const vk::PipelineDynamicStateCreateInfo dynamicStateCreateInfo = {{}, static_cast<uint32>(p_pipelineDesc.dynamicStates.size()), p_pipelineDesc.dynamicStates.data()};
     const vk::PipelineViewportStateCreateInfo viewportStateCreateInfo = {{}, 1, nullptr, 1, nullptr};
     vk::GraphicsPipelineCreateInfo pipelineCreateInfo({}, shaderStages.size(), shaderStages.data(), &p_pipelineDesc.vertexInputStateCreateInfo, &p_pipelineDesc.inputAssemblyStateCreateInfo, nullptr, &viewportStateCreateInfo, &p_pipelineDesc.rasterizationStateCreateInfo, &p_pipelineDesc.multisampleStateCreateInfo, &p_pipelineDesc.depthStencilStateCreateInfo, &p_pipelineDesc.colorBlendStateCreateInfo, &dynamicStateCreateInfo, pipeline.layout);
     pipelineCreateInfo.setPNext(&pipelineRenderingCreateInfo);
-    VK_CHECK(m_logicalDevice.createGraphicsPipelines(nullptr, 1, &pipelineCreateInfo, nullptr, &pipeline.pipeline));
+    VK_CHECK(m_logicalDevice.createGraphicsPipelines(m_pipelineCache, 1, &pipelineCreateInfo, nullptr, &pipeline.pipeline));
 
     for (auto &shaderModule : shaderModules) { m_logicalDevice.destroyShaderModule(shaderModule); }
     for (auto &descriptorSetLayout : descriptorSetLayouts) { m_logicalDevice.destroyDescriptorSetLayout(descriptorSetLayout); }
     return pipeline;
 }
 
+std::vector<Pipeline> Renderer::createPipelines(const std::vector<PipelineRequest> &p_requests) {
+    // the pipeline cache is internally synchronized, each job only creates and destroys its own objects
+    const auto start = std::chrono::high_resolution_clock::now();
+    std::vector<std::future<Pipeline>> jobs;
+    for (const PipelineRequest &request : p_requests) { jobs.push_back(ThreadPool::global().submit([this, &request] { return createPipeline(request.shaderPaths, request.desc); })); }
+    std::vector<Pipeline> pipelines;
+    for (auto &job : jobs) { pipelines.push_back(job.get()); }
+    std::cout << "Created " << pipelines.size() << " pipelines in " << millisecondsD(std::chrono::high_resolution_clock::now() - start).count() << " ms (" << (m_pipelineCacheWarm ? "warm" : "cold")
+              << " pipeline cache)" << std::endl;
+    return pipelines;
+}
+
 vk::CommandBuffer Renderer::beginFrame() {
     if (m_needRebuild) { m_windowSize = recreateSwapChain(); }
 
-    FrameData &frameData = m_frameData[m_currentFrame];
+    FrameData &frameData = m_frameData[m_frameRingCurrent]; // same slot as the one endFrame signals, m_currentFrame is reset with the swapchain
     vk::SemaphoreWaitInfo waitInfo = {{}, 1, &m_FrameTimelineSemaphore, &frameData.frameNumber};
     VK_CHECK(m_logicalDevice.waitSemaphores(&waitInfo, std::numeric_limits<uint64>::max()));
     m_logicalDevice.resetCommandPool(frameData.commandPool, {});
+    m_stagingArena.reclaim();
 
     vk::CommandBuffer cmd = frameData.commandBuffer;
     cmd.begin({vk::CommandBufferUsageFlagBits::eOneTimeSubmit}); // for now we rerecord every time
+    if (isHeadless()) {
+        m_nextImageIndex = m_frameRingCurrent; // the target of the slot is free once the slot is
+        return cmd;
+    }
     // aquiring the next image
     ASSERT(m_needRebuild == false, "Swapbuffer need to call recreateSwapChain()");
     FrameResources &frameResources = m_frameResources[m_currentFrame];
@@ -445,24 +635,24 @@ void Renderer::beginRendering(vk::CommandBuffer p_cmd, bool p_clear) {
     const std::array<vk::RenderingAttachmentInfo, 1> renderingAttachments = {{{m_nextImages[m_nextImageIndex].defaultView, vk::ImageLayout::eColorAttachmentOptimal, {}, nullptr, {}, p_clear ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore, {vk::ClearColorValue(1.f, 1.f, 1.f, 1.f)}}}};
     const vk::RenderingAttachmentInfo depthAttachment = {m_depthImages[m_nextImageIndex].defaultView, vk::ImageLayout::eDepthStencilAttachmentOptimal, {}, nullptr, {}, p_clear ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore, {vk::ClearDepthStencilValue(1.0f, 0)}};
     const vk::RenderingInfo renderingInfo = {{}, {{0, 0}, m_windowSize}, 1, {}, renderingAttachments.size(), renderingAttachments.data(),&depthAttachment};
-    cmdTransitionImageLayout(p_cmd, m_nextImages[m_nextImageIndex], vk::ImageLayout::ePresentSrcKHR, vk::ImageLayout::eColorAttachmentOptimal);
+    cmdTransitionImageLayout(p_cmd, m_nextImages[m_nextImageIndex], m_targetRestLayout, vk::ImageLayout::eColorAttachmentOptimal);
     cmdTransitionImageLayout(p_cmd, m_depthImages[m_nextImageIndex], vk::ImageLayout::eUndefined, vk::ImageLayout::eDepthStencilAttachmentOptimal, vk::ImageAspectFlagBits::eDepth);
     p_cmd.beginRendering(renderingInfo);
 }
 
 void Renderer::endRendering(vk::CommandBuffer p_cmd) {
     p_cmd.endRendering();
-    cmdTransitionImageLayout(p_cmd, m_nextImages[m_nextImageIndex],vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR);
+    cmdTransitionImageLayout(p_cmd, m_nextImages[m_nextImageIndex],vk::ImageLayout::eColorAttachmentOptimal, m_targetRestLayout);
 }
 
 void Renderer::renderUI(vk::CommandBuffer p_cmd, bool p_clear) {
     const std::array<vk::RenderingAttachmentInfo, 1> renderingAttachments = {{{m_nextImages[m_nextImageIndex].defaultView, vk::ImageLayout::eColorAttachmentOptimal, {}, nullptr, {}, p_clear ? vk::AttachmentLoadOp::eClear : vk::AttachmentLoadOp::eLoad, vk::AttachmentStoreOp::eStore,{vk::ClearColorValue(1.f, 1.f, 1.f, 1.f)}}}};
     const vk::RenderingInfo renderingInfo = {{}, {{0, 0}, m_windowSize}, 1, {}, renderingAttachments.size(), renderingAttachments.data()};
-    cmdTransitionImageLayout(p_cmd, m_nextImages[m_nextImageIndex],vk::ImageLayout::ePresentSrcKHR, vk::ImageLayout::eColorAttachmentOptimal);
+    cmdTransitionImageLayout(p_cmd, m_nextImages[m_nextImageIndex],m_targetRestLayout, vk::ImageLayout::eColorAttachmentOptimal);
     p_cmd.beginRendering(renderingInfo);
     ImGui_ImplVulkan_RenderDrawData(ImGui::GetDrawData(), p_cmd);
     p_cmd.endRendering();
-    cmdTransitionImageLayout(p_cmd, m_nextImages[m_nextImageIndex],vk::ImageLayout::eColorAttachmentOptimal, vk::ImageLayout::ePresentSrcKHR);
+    cmdTransitionImageLayout(p_cmd, m_nextImages[m_nextImageIndex],vk::ImageLayout::eColorAttachmentOptimal, m_targetRestLayout);
 }
 
 void Renderer::endFrame(vk::CommandBuffer p_cmd) {
@@ -470,20 +660,23 @@ void Renderer::endFrame(vk::CommandBuffer p_cmd) {
     // prepare submit
     std::vector<vk::SemaphoreSubmitInfo> waitSemaphoreSubmitInfos;
     std::vector<vk::SemaphoreSubmitInfo> signalSemaphoreSubmitInfos;
-    waitSemaphoreSubmitInfos.push_back({m_frameResources[m_currentFrame].imageAvailableSemaphore, 0, vk::PipelineStageFlagBits2::eColorAttachmentOutput});
-    signalSemaphoreSubmitInfos.push_back({m_frameResources[m_currentFrame].renderFinishedSemaphore, 0, vk::PipelineStageFlagBits2::eColorAttachmentOutput});
+    if (!isHeadless()) {
+        waitSemaphoreSubmitInfos.push_back({m_frameResources[m_currentFrame].imageAvailableSemaphore, 0, vk::PipelineStageFlagBits2::eColorAttachmentOutput});
+        signalSemaphoreSubmitInfos.push_back({m_frameResources[m_currentFrame].renderFinishedSemaphore, 0, vk::PipelineStageFlagBits2::eColorAttachmentOutput});
+    }
 
     FrameData &frameData = m_frameData[m_frameRingCurrent];
     const uint64 signalValue = frameData.frameNumber + m_maxFramesInFlight;
     frameData.frameNumber = signalValue;
 
     signalSemaphoreSubmitInfos.push_back({m_FrameTimelineSemaphore, signalValue, vk::PipelineStageFlagBits2::eColorAttachmentOutput});
+    m_stagingArena.retire(m_FrameTimelineSemaphore, signalValue); // uploads recorded in the frame command buffer
 
     const std::array<vk::CommandBufferSubmitInfo, 1> cmdSubmitInfo = {{{p_cmd}}};
     const std::array<vk::SubmitInfo2, 1> submitInfo = {vk::SubmitInfo2({}, waitSemaphoreSubmitInfos.size(), waitSemaphoreSubmitInfos.data(), cmdSubmitInfo.size(), cmdSubmitInfo.data(), signalSemaphoreSubmitInfos.size(), signalSemaphoreSubmitInfos.data())};
 
     m_graphicsQueue.submit2(submitInfo, nullptr);
-    presentFrame();
+    if (!isHeadless()) { presentFrame(); }
 
     m_frameRingCurrent = (m_frameRingCurrent + 1) % m_maxFramesInFlight;
 }
@@ -3,8 +3,11 @@
 #define VULKAN_HPP_DISPATCH_LOADER_DYNAMIC 1
 #include <vulkan/vulkan.hpp>
 
+#include "StagingArena.hpp"
+#include "TaskGrid.hpp"
 #include "defines.hpp"
 #include "imgui.h"
+#include "loaders/PipelineCacheFile.hpp"
 #include "vkHelper.hpp"
 
 #include <stb_image.h>
@@ -28,9 +31,16 @@ public:
     vk::Sampler m_nearestSampler{};
 
 public:
-    void init(GLFWwindow *window, bool vSync);
+    // p_loadPipelineCache = false starts from an empty pipeline cache (cold start), the cache is saved on cleanup either way
+    // A null window renders headless into offscreen images of p_offscreenExtent: no surface, swapchain, present or UI
+    void init(GLFWwindow *window, bool vSync, bool p_loadPipelineCache = true, vk::Extent2D p_offscreenExtent = {1280, 720});
+    bool isHeadless() const { return m_window == nullptr; }
     void cleanup();
+    // A single .comp shader makes a compute pipeline, p_pipelineDesc only provides its specialization constants then
     Pipeline createPipeline(const std::vector<std::string> &p_shaderPaths, const PipelineDesc &p_pipelineDesc);
+    // Compiles the pipelines in parallel on the thread pool, in request order
+    std::vector<Pipeline> createPipelines(const std::vector<PipelineRequest> &p_requests);
+    bool isPipelineCacheWarm() const { return m_pipelineCacheWarm; }
     vk::Extent2D getSwapChainExtent() const { return m_windowSize; }
     vk::CommandBuffer beginFrame();
     void beginRendering(vk::CommandBuffer p_cmd, bool p_clear = false);
@@ -39,8 +49,25 @@ public:
     void endFrame(vk::CommandBuffer p_cmd);
 
     UniformBuffer createUniformBuffer(uint32 p_size);
+    RingBuffer createRingBuffer(uint32 p_sliceSize, vk::BufferUsageFlags p_usage);
+    uint32 getFrameSlot() const { return m_frameRingCurrent; } // slice of the per frame ring buffers free for the frame being recorded
+    uint32 getFrameSlotCount() const { return m_maxFramesInFlight; }
+    float getTimestampPeriod() const { return m_deviceLimits.timestampPeriod; } // nanoseconds per tick
+    bool supportsMeshQueries() const { return m_supportMeshQueries && m_supportPipelineStatistics; }
+    const TaskGridLimits &getTaskGridLimits() const { return m_taskGridLimits; } // draws with a task shader
+    const TaskGridLimits &getMeshGridLimits() const { return m_meshGridLimits; } // draws without
+    const TaskGridLimits &getComputeGridLimits() const { return m_computeGridLimits; }
     Buffer createStagingBuffer(uint32 p_size);
-    void freeTrackedStagingBuffers();
+    Buffer createDeviceBuffer(vk::DeviceSize p_size, vk::BufferUsageFlags p_usage); // device local, filled by the GPU
+    void destroyBuffer(Buffer &p_buffer);
+    void destroyTexture(Texture &p_texture);
+    void *getMappedMemory(const Buffer &p_buffer) const; // host visible blocks stay mapped for their whole life
+    MemoryAllocator::Stats getMemoryStats() const { return m_memoryAllocator.getStats(); }
+    const StagingArena::Stats &getStagingStats() const { return m_stagingArena.getStats(); }
+
+    // Load time uploads: the submit blocks until the copies are done, then their staging memory is recycled
+    vk::CommandBuffer beginUploadCommands();
+    void endUploadCommands(vk::CommandBuffer p_commandBuffer);
 
     template <typename T>
     Buffer createAndUploadBuffer(vk::CommandBuffer p_commandBuffer, const std::vector<T> &p_data, vk::BufferUsageFlags p_usage) {
@@ -70,23 +97,28 @@ public:
 
 
 private:
-    // Instance extension
-    std::vector<const char *> m_instanceExtensions = {VK_KHR_GET_SURFACE_CAPABILITIES_2_EXTENSION_NAME};
+    // Instance extension, the surface ones are added when there is a window
+    std::vector<const char *> m_instanceExtensions = {};
     std::vector<const char *> m_instanceLayers = {}; // Add extra layers here
 
-    // Device extension
-    std::vector<const char *> m_deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME, VK_EXT_MESH_SHADER_EXTENSION_NAME};
+    // Device extension, the swapchain is added when there is a window
+    std::vector<const char *> m_deviceExtensions = {VK_EXT_MESH_SHADER_EXTENSION_NAME};
 
     GLFWwindow *m_window{};
 
 
     QueueFamilyIndices m_queueFamilyIndices{};
     vk::PhysicalDeviceLimits m_deviceLimits;
+    TaskGridLimits m_taskGridLimits;
+    TaskGridLimits m_meshGridLimits;
+    TaskGridLimits m_computeGridLimits;
     bool m_supportMeshQueries;
+    bool m_supportPipelineStatistics;
     
     vk::Extent2D m_windowSize{};
     std::vector<Texture> m_nextImages{};
     std::vector<Texture> m_depthImages{};
+    vk::ImageLayout m_targetRestLayout = vk::ImageLayout::ePresentSrcKHR; // layout of the color targets between frames
     std::vector<FrameResources> m_frameResources{};
     uint32_t m_currentFrame = 0;
     uint32_t m_nextImageIndex = 0;
@@ -101,7 +133,20 @@ private:
     bool m_vsync{false};
     uint32 m_frameIndex{0};
 
-    std::vector<Buffer> m_usedStagingBuffers{}; // gather for later cleanup
+    struct MemoryBlock {
+        vk::DeviceMemory memory;
+        void *mappedMemory = nullptr;
+    };
+    MemoryAllocator m_memoryAllocator{};
+    std::vector<MemoryBlock> m_memoryBlocks{}; // indexed by allocator block id
+
+    StagingArena m_stagingArena{};
+    vk::Semaphore m_uploadTimelineSemaphore{}; // signaled by endUploadCommands submits
+    uint64 m_uploadTimelineValue{0};
+
+    vk::PipelineCache m_pipelineCache{};
+    PipelineCacheFile::DeviceKey m_pipelineCacheKey{};
+    bool m_pipelineCacheWarm{false}; // the cache was loaded from disk
 
 private:
     void createInstance();
@@ -110,17 +155,19 @@ private:
     void populateQueueFamilyIndices();
     void createDeviceAndQueues();
     void createTransientCommandPool();
+    void createMemoryAllocator();
     vk::Extent2D createSwapchain();
     vk::Extent2D recreateSwapChain();
+    vk::Extent2D createOffscreenTargets(vk::Extent2D p_extent);
     void cleanupSwapChain();
     void createFrameData();
+    void createStagingArena();
+    void createPipelineCache(bool p_load);
+    void savePipelineCache();
     void createDescriptorPool();
     void initImGui();
     void presentFrame();
 
-
-    uint32 findMemoryType(uint32 p_typeFilter, vk::MemoryPropertyFlags p_properties) const;
-
     Buffer createBufferInternal(const vk::BufferCreateInfo &p_createInfo, const vk::MemoryPropertyFlags p_memProperties = vk::MemoryPropertyFlagBits::eDeviceLocal);
     Texture createTextureInternal(const vk::ImageCreateInfo &p_createInfo);
     
@@ -1,5 +1,6 @@
 ﻿#pragma once
 #include "defines.hpp"
+#include "MemoryAllocator.hpp"
 
 
 #include <vulkan/vk_enum_string_helper.h>
@@ -28,6 +29,7 @@ struct Texture {
     vk::ImageLayout currentLayout = vk::ImageLayout::eUndefined;
     uvec3 dimensions = {1, 1, 1};
     vk::ImageView defaultView;
+    MemoryAllocation allocation; // range of memory in its block
 
 };
 
@@ -39,8 +41,10 @@ struct SampledTexture : public Texture {
 
 struct Buffer {
     vk::Buffer buffer;
-    vk::DeviceMemory memory;
-    vk::DeviceSize size = 0; // size in bytes
+    vk::DeviceMemory memory;  // shared with the other buffers of the block
+    vk::DeviceSize offset = 0; // offset of the buffer in memory
+    vk::DeviceSize size = 0;   // size in bytes
+    MemoryAllocation allocation;
 };
 
 struct UniformBuffer : public Buffer {
@@ -49,6 +53,17 @@ struct UniformBuffer : public Buffer {
     UniformBuffer(Buffer b) : Buffer(b) {} // should check if the buffer is a UBO
 };
 
+// Host visible buffer with one slice per frame in flight, persistently mapped and bound once. The shaders find the
+// slice of the frame from an index pushed with the draws.
+struct RingBuffer : public Buffer {
+    void *mappedMemory = nullptr;
+    uint32 sliceSize = 0; // aligned on the storage buffer offset alignment of the device
+    uint32 sliceCount = 0;
+
+    uint32 sliceOffset(uint32 p_slice) const { return p_slice * sliceSize; }
+    void *slice(uint32 p_slice) const { return static_cast<byte *>(mappedMemory) + sliceOffset(p_slice); }
+};
+
 struct QueueFamilyIndices {
     uint32 presentQueueIndex = ~0U;
     uint32 graphicsQueueIndex = ~0U;
@@ -78,6 +93,25 @@ struct PipelineDesc {
     vk::PipelineColorBlendAttachmentState colorBlendAttachmentState{VK_FALSE, vk::BlendFactor::eZero, vk::BlendFactor::eZero, vk::BlendOp::eAdd, vk::BlendFactor::eZero, vk::BlendFactor::eZero, vk::BlendOp::eAdd, vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG | vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA};
     vk::PipelineColorBlendStateCreateInfo colorBlendStateCreateInfo{{}, VK_FALSE, vk::LogicOp::eCopy, 1, &colorBlendAttachmentState, {0.0f, 0.0f, 0.0f, 0.0f}};
     std::array<vk::DynamicState, 2> dynamicStates = {vk::DynamicState::eViewport, vk::DynamicState::eScissor};
+    std::vector<uint32> specializationConstants; // value of constant_id i, shared by every stage
+
+    PipelineDesc() = default;
+    // colorBlendStateCreateInfo points into the desc, a copy must point to its own attachment: the requests are copied
+    // to the worker threads that create the pipelines, after which the original may be gone
+    PipelineDesc(const PipelineDesc &p_other) { *this = p_other; }
+    PipelineDesc &operator=(const PipelineDesc &p_other) {
+        multisampleStateCreateInfo = p_other.multisampleStateCreateInfo;
+        rasterizationStateCreateInfo = p_other.rasterizationStateCreateInfo;
+        vertexInputStateCreateInfo = p_other.vertexInputStateCreateInfo;
+        inputAssemblyStateCreateInfo = p_other.inputAssemblyStateCreateInfo;
+        depthStencilStateCreateInfo = p_other.depthStencilStateCreateInfo;
+        colorBlendAttachmentState = p_other.colorBlendAttachmentState;
+        colorBlendStateCreateInfo = p_other.colorBlendStateCreateInfo;
+        colorBlendStateCreateInfo.pAttachments = &colorBlendAttachmentState;
+        dynamicStates = p_other.dynamicStates;
+        specializationConstants = p_other.specializationConstants;
+        return *this;
+    }
 };
 
 struct Pipeline {
@@ -85,7 +119,13 @@ struct Pipeline {
     vk::Pipeline pipeline;
 };
 
+struct PipelineRequest {
+    std::vector<std::string> shaderPaths;
+    PipelineDesc desc{};
+};
+
 constexpr vk::ShaderStageFlags trueAllGraphics = vk::ShaderStageFlagBits::eAllGraphics | vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+constexpr vk::ShaderStageFlags trueAllStages = trueAllGraphics | vk::ShaderStageFlagBits::eCompute;
 
 // Functions
 
@@ -99,6 +139,7 @@ static std::pair<vk::PipelineStageFlags2, vk::AccessFlags2> makePipelineStageAcc
     case vk::ImageLayout::eDepthStencilAttachmentOptimal: return std::make_pair(PipelineStageBits::eEarlyFragmentTests | PipelineStageBits::eLateFragmentTests, AccessBits::eDepthStencilAttachmentRead | AccessBits::eDepthStencilAttachmentWrite);
     case vk::ImageLayout::eShaderReadOnlyOptimal: return std::make_pair(PipelineStageBits::eFragmentShader | PipelineStageBits::eComputeShader | PipelineStageBits::ePreRasterizationShaders, AccessBits::eShaderRead);
     case vk::ImageLayout::eTransferDstOptimal: return std::make_pair(PipelineStageBits::eTransfer, AccessBits::eTransferWrite);
+    case vk::ImageLayout::eTransferSrcOptimal: return std::make_pair(PipelineStageBits::eTransfer, AccessBits::eTransferRead);
     case vk::ImageLayout::eGeneral: return std::make_pair(PipelineStageBits::eComputeShader | PipelineStageBits::eTransfer,
                                                           AccessBits::eMemoryRead | AccessBits::eMemoryWrite | AccessBits::eTransferWrite);
     case vk::ImageLayout::ePresentSrcKHR: return std::make_pair(PipelineStageBits::eColorAttachmentOutput, AccessBits::eNone);
@@ -153,6 +194,12 @@ static void cmdTransitionImageLayout(vk::CommandBuffer p_cmd, Texture& p_texture
     p_cmd.pipelineBarrier2({{}, {}, {}, {}, {}, 1, &barrier});
 }
 
+// Dependency on the whole buffer
+static void cmdBufferBarrier(vk::CommandBuffer p_cmd, const Buffer &p_buffer, vk::PipelineStageFlags2 p_srcStage, vk::AccessFlags2 p_srcAccess, vk::PipelineStageFlags2 p_dstStage, vk::AccessFlags2 p_dstAccess) {
+    const vk::BufferMemoryBarrier2 barrier{p_srcStage, p_srcAccess, p_dstStage, p_dstAccess, VK_QUEUE_FAMILY_IGNORED, VK_QUEUE_FAMILY_IGNORED, p_buffer.buffer, 0, VK_WHOLE_SIZE};
+    p_cmd.pipelineBarrier2({{}, {}, {}, 1, &barrier, {}, {}});
+}
+
 static vk::AccessFlags2 inferAccessMaskFromStage(vk::PipelineStageFlags2 stage, bool src) {
     vk::AccessFlags2 access{};
 
@@ -243,12 +290,12 @@ static void setupDebugMessenger(vk::Instance p_instance, vk::DebugUtilsMessenger
 }
 
 
-static bool isDeviceSuitable(vk::PhysicalDevice p_device, const std::vector<const char *> &p_requiredDeviceExtentions) {
+static bool isDeviceSuitable(vk::PhysicalDevice p_device, const std::vector<const char *> &p_requiredDeviceExtentions, bool p_requireDiscrete = true) {
     vk::PhysicalDeviceProperties2 prop = p_device.getProperties2();
     std::string deviceName = prop.properties.deviceName;
 
     // check for discrete GPU
-    if (prop.properties.deviceType != vk::PhysicalDeviceType::eDiscreteGpu) {
+    if (p_requireDiscrete && prop.properties.deviceType != vk::PhysicalDeviceType::eDiscreteGpu) {
         std::cout << "Device " << deviceName << " is not a discrete GPU." << '\n';
         return false;
     }
@@ -263,6 +310,22 @@ static bool isDeviceSuitable(vk::PhysicalDevice p_device, const std::vector<cons
         }
     }
 
+    // parametric.task and compaction.comp count and append their elements with subgroup ballots and arithmetic
+    vk::PhysicalDeviceSubgroupProperties subgroup{};
+    vk::PhysicalDeviceProperties2 subgroupProperties{};
+    subgroupProperties.pNext = &subgroup;
+    p_device.getProperties2(&subgroupProperties);
+    const vk::ShaderStageFlags subgroupStages = vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eCompute;
+    const vk::SubgroupFeatureFlags subgroupOperations = vk::SubgroupFeatureFlagBits::eBasic | vk::SubgroupFeatureFlagBits::eBallot | vk::SubgroupFeatureFlagBits::eArithmetic;
+    if ((subgroup.supportedStages & subgroupStages) != subgroupStages) {
+        std::cout << "Device " << deviceName << " does not support subgroup operations in task and compute shaders." << '\n';
+        return false;
+    }
+    if ((subgroup.supportedOperations & subgroupOperations) != subgroupOperations) {
+        std::cout << "Device " << deviceName << " does not support the basic, ballot and arithmetic subgroup operations." << '\n';
+        return false;
+    }
+
     std::cout << "Device " << deviceName << " is suitable." << '\n';
     return true;
 }